@@ -0,0 +1,244 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "util_bench.h"
+#include "util_debug.h"
+
+static const char *s_lap_name[BENCH_LAP_NUM] =
+{
+    "preprocess",
+    "invoke",
+    "decode",
+    "nms",
+    "total",
+};
+
+static int    s_lap_enable = 0;
+static double s_lap_t0[BENCH_LAP_NUM];
+static double s_lap_ms[BENCH_LAP_NUM];
+
+
+static double
+get_time_ms ()
+{
+    struct timespec tv;
+    clock_gettime (CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec * 1000.0 + tv.tv_nsec / 1000000.0);
+}
+
+
+/* -------------------------------------------------- *
+ *  stage time of the current frame
+ * -------------------------------------------------- */
+void
+bench_lap_enable (int enable)
+{
+    s_lap_enable = enable;
+    bench_lap_reset ();
+}
+
+void
+bench_lap_start (int lap)
+{
+    if (!s_lap_enable)
+        return;
+
+    s_lap_t0[lap] = get_time_ms ();
+}
+
+void
+bench_lap_stop (int lap)
+{
+    if (!s_lap_enable)
+        return;
+
+    s_lap_ms[lap] += get_time_ms () - s_lap_t0[lap];
+}
+
+void
+bench_lap_add (int lap, double ms)
+{
+    if (!s_lap_enable)
+        return;
+
+    s_lap_ms[lap] += ms;
+}
+
+double
+bench_lap_get (int lap)
+{
+    return s_lap_ms[lap];
+}
+
+void
+bench_lap_reset ()
+{
+    memset (s_lap_ms, 0, sizeof (s_lap_ms));
+}
+
+
+/* -------------------------------------------------- *
+ *  samples
+ * -------------------------------------------------- */
+int
+bench_init (bench_t *bench, int max_samples)
+{
+    memset (bench, 0, sizeof (*bench));
+
+    for (int i = 0; i < BENCH_LAP_NUM; i ++)
+    {
+        bench->samples[i] = (double *)calloc (max_samples, sizeof (double));
+        if (bench->samples[i] == NULL)
+        {
+            DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+            bench_destroy (bench);
+            return -1;
+        }
+    }
+    bench->max_samples = max_samples;
+
+    return 0;
+}
+
+void
+bench_destroy (bench_t *bench)
+{
+    for (int i = 0; i < BENCH_LAP_NUM; i ++)
+        free (bench->samples[i]);
+
+    memset (bench, 0, sizeof (*bench));
+}
+
+/*
+ *  the decode time is not measured directly: it is whatever is left
+ *  of the total after preprocess, invoke and nms.
+ */
+int
+bench_commit_frame (bench_t *bench)
+{
+    if (bench->num_samples >= bench->max_samples)
+        return -1;
+
+    double decode_ms = s_lap_ms[BENCH_LAP_TOTAL]
+                     - s_lap_ms[BENCH_LAP_PREPROCESS]
+                     - s_lap_ms[BENCH_LAP_INVOKE]
+                     - s_lap_ms[BENCH_LAP_NMS];
+    s_lap_ms[BENCH_LAP_DECODE] = (decode_ms > 0) ? decode_ms : 0;
+
+    for (int i = 0; i < BENCH_LAP_NUM; i ++)
+        bench->samples[i][bench->num_samples] = s_lap_ms[i];
+
+    bench->num_samples ++;
+    bench_lap_reset ();
+
+    return 0;
+}
+
+
+static int
+compare_double (const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return (da > db) - (da < db);
+}
+
+/* nearest-rank percentile (0 - 100) */
+double
+bench_get_percentile (bench_t *bench, int lap, double percentile)
+{
+    int num = bench->num_samples;
+    if (num <= 0)
+        return 0;
+
+    double *sorted = (double *)malloc (num * sizeof (double));
+    if (sorted == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return 0;
+    }
+
+    memcpy (sorted, bench->samples[lap], num * sizeof (double));
+    qsort (sorted, num, sizeof (double), compare_double);
+
+    int rank = (int)(percentile / 100.0 * num + 0.999999);
+    if (rank < 1)   rank = 1;
+    if (rank > num) rank = num;
+
+    double val = sorted[rank - 1];
+    free (sorted);
+
+    return val;
+}
+
+double
+bench_get_mean (bench_t *bench, int lap)
+{
+    double sum = 0;
+
+    if (bench->num_samples <= 0)
+        return 0;
+
+    for (int i = 0; i < bench->num_samples; i ++)
+        sum += bench->samples[lap][i];
+
+    return sum / bench->num_samples;
+}
+
+/* peak resident set size of this process [KB] */
+long
+bench_get_peak_rss_kb ()
+{
+    struct rusage usage;
+
+    if (getrusage (RUSAGE_SELF, &usage) != 0)
+        return -1;
+
+    return usage.ru_maxrss;
+}
+
+
+/* -------------------------------------------------- *
+ *  report
+ * -------------------------------------------------- */
+const char *
+bench_get_lap_name (int lap)
+{
+    if (lap < 0 || lap >= BENCH_LAP_NUM)
+        return "";
+
+    return s_lap_name[lap];
+}
+
+/*
+ *  "stages": {
+ *    "preprocess": {"mean": 1.234, "p50": 1.200, "p90": ..., "p99": ..., "max": ...},
+ *    ...
+ *  }
+ */
+int
+bench_write_stages_json (bench_t *bench, FILE *fp, const char *indent)
+{
+    fprintf (fp, "%s\"stages\": {\n", indent);
+
+    for (int i = 0; i < BENCH_LAP_NUM; i ++)
+    {
+        fprintf (fp, "%s  \"%s\": {", indent, s_lap_name[i]);
+        fprintf (fp, "\"mean\": %.3f, ", bench_get_mean (bench, i));
+        fprintf (fp, "\"p50\": %.3f, ",  bench_get_percentile (bench, i,  50.0));
+        fprintf (fp, "\"p90\": %.3f, ",  bench_get_percentile (bench, i,  90.0));
+        fprintf (fp, "\"p99\": %.3f, ",  bench_get_percentile (bench, i,  99.0));
+        fprintf (fp, "\"max\": %.3f}",   bench_get_percentile (bench, i, 100.0));
+        fprintf (fp, "%s\n", (i < BENCH_LAP_NUM - 1) ? "," : "");
+    }
+
+    fprintf (fp, "%s}", indent);
+    return 0;
+}
@@ -0,0 +1,58 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_BENCH_H_
+#define _UTIL_BENCH_H_
+
+#include <stdio.h>
+
+/* stages of one frame */
+#define BENCH_LAP_PREPROCESS    0   /* resize/crop/normalize into the input tensor */
+#define BENCH_LAP_INVOKE        1   /* Interpreter::Invoke()                       */
+#define BENCH_LAP_DECODE        2   /* everything else in the frame                */
+#define BENCH_LAP_NMS           3   /* non max suppression                         */
+#define BENCH_LAP_TOTAL         4
+#define BENCH_LAP_NUM           5
+
+/*
+ *  per-frame samples of every stage.
+ *
+ *  the stage times of the current frame are accumulated by bench_lap_start()
+ *  and bench_lap_stop(), which can be called from anywhere in the process
+ *  (they do nothing until bench_lap_enable() is called). bench_commit_frame()
+ *  stores them as one sample and clears them for the next frame.
+ */
+typedef struct _bench_t
+{
+    int     max_samples;
+    int     num_samples;
+    double  *samples[BENCH_LAP_NUM];
+} bench_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void   bench_lap_enable (int enable);
+void   bench_lap_start (int lap);
+void   bench_lap_stop (int lap);
+void   bench_lap_add (int lap, double ms);
+double bench_lap_get (int lap);
+void   bench_lap_reset ();
+
+int    bench_init (bench_t *bench, int max_samples);
+void   bench_destroy (bench_t *bench);
+int    bench_commit_frame (bench_t *bench);
+double bench_get_percentile (bench_t *bench, int lap, double percentile);
+double bench_get_mean (bench_t *bench, int lap);
+long   bench_get_peak_rss_kb ();
+
+const char *bench_get_lap_name (int lap);
+int    bench_write_stages_json (bench_t *bench, FILE *fp, const char *indent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_BENCH_H_ */
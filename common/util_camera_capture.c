@@ -5,41 +5,80 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <time.h>
 #include "util_v4l2.h"
 #include "util_debug.h"
 #include "util_texture.h"
+#include "util_egl.h"
 #include "util_camera_capture.h"
 
+/*
+ *  triple buffer between the capture thread (producer) and the render thread (consumer).
+ *
+ *    s_back_idx : slot being filled by the capture thread  (owned by the producer)
+ *    s_mid_idx  : latest complete frame                    (exchanged atomically)
+ *    s_front_idx: slot being read by the render thread     (owned by the consumer)
+ *
+ *  SLOT_FRESH is set in s_mid_idx while the consumer has not taken the slot yet.
+ */
+#define NUM_CAPTURE_SLOTS   3
+#define SLOT_FRESH          0x100
+#define SLOT_IDX_MASK       0x0FF
+
+typedef struct _capture_slot_t
+{
+    void            *buf;
+    capture_frame_t *v4l_frame;     /* non NULL while a V4L2 buffer is held (zero copy) */
+    EGLSyncKHR      gpu_fence;      /* GPU reads of the V4L2 buffer through EGLImage */
+    uint64_t        seq;
+    double          timestamp_ms;
+} capture_slot_t;
+
+static capture_slot_t s_slots[NUM_CAPTURE_SLOTS];
+static int          s_back_idx  = 0;
+static int          s_mid_idx   = 1;
+static int          s_front_idx = 2;
+static uint64_t     s_last_seq  = 0;
+static uint64_t     s_num_taken = 0;
+static uint64_t     s_num_dropped = 0;
+static uint64_t     s_num_repeated = 0;
+static int          s_zero_copy = 0;
+
 static pthread_t    s_capture_thread;
-static void         *s_capture_buf = NULL;
 static capture_dev_t *s_cap_dev;
 static int          s_capture_w, s_capture_h;
 static int          s_capcrop_w, s_capcrop_h;
 static int          s_capcropped = 0;
 static unsigned int s_capture_fmt;
 static int          s_force_convert_to_rgba = 0;
+static int          s_dmabuf_import = 0;
+
+/*
+ *  file backed fake capture device (CAPTURE_FAKE_FILE=xxx.yuyv CAPTURE_FAKE_SIZE=640x480).
+ *  delivers raw YUYV frames at 30fps through the same frame exchange as V4L2.
+ */
+#define NUM_FAKE_FRAMES     6
+static FILE            *s_fake_fp = NULL;
+static capture_frame_t s_fake_frames[NUM_FAKE_FRAMES];
+static int             s_fake_busy[NUM_FAKE_FRAMES];
 
 #define _max(A, B)    ((A) > (B) ? (A) : (B))
 #define _min(A, B)    ((A) < (B) ? (A) : (B))
 
 
 static int
-convert_to_rgba8888 (void *buf, int ofstx, int ofsty, int cap_w, int cap_h, unsigned int fmt)
+convert_to_rgba8888 (void *dst, void *buf, int ofstx, int ofsty, int cap_w, int cap_h, unsigned int fmt)
 {
     int x, y;
 
-    if (s_capture_buf == NULL)
-    {
-        s_capture_buf = (unsigned char *)malloc (cap_w * cap_h * 4);
-    }
-
     if (fmt == v4l2_fourcc ('Y', 'U', 'Y', 'V') ||
         fmt == v4l2_fourcc ('U', 'Y', 'V', 'Y'))
     {
         unsigned char *src8 = buf;
         unsigned char *srcline = buf;
-        unsigned char *dst8 = s_capture_buf;
+        unsigned char *dst8 = dst;
         int y0_idx = 0, cb_idx = 1, y1_idx = 2, cr_idx = 3;
 
         if (fmt == v4l2_fourcc ('U', 'Y', 'V', 'Y'))
@@ -105,18 +144,13 @@ convert_to_rgba8888 (void *buf, int ofstx, int ofsty, int cap_w, int cap_h, unsi
 }
 
 static int
-copy_yuyv_image_cropped (void *buf, int ofstx, int ofsty, int cap_w, int cap_h, unsigned int fmt)
+copy_yuyv_image_cropped (void *dst, void *buf, int ofstx, int ofsty, int cap_w, int cap_h, unsigned int fmt)
 {
-    if (s_capture_buf == NULL)
-    {
-        s_capture_buf = (unsigned char *)malloc (cap_w * cap_h * 2);
-    }
-
     if (fmt == v4l2_fourcc ('Y', 'U', 'Y', 'V') ||
         fmt == v4l2_fourcc ('U', 'Y', 'V', 'Y'))
     {
         unsigned char *src8 = buf;
-        unsigned char *dst8 = s_capture_buf;
+        unsigned char *dst8 = dst;
         for (int ydst = 0; ydst < cap_h; ydst ++)
         {
             int ysrc = ydst + ofsty;
@@ -137,57 +171,188 @@ copy_yuyv_image_cropped (void *buf, int ofstx, int ofsty, int cap_w, int cap_h,
     return 0;
 }
 
+static double
+get_monotonic_time_ms ()
+{
+    struct timespec tv;
+    clock_gettime (CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec * 1000.0 + tv.tv_nsec / 1000000.0);
+}
+
+
+/* -------------------------------------------------- *
+ *  fake capture device
+ * -------------------------------------------------- */
 static int
-copy_yuyv_image (void *buf, int cap_w, int cap_h, unsigned int fmt)
+open_fake_capture_device (const char *fname, const char *size_str)
 {
-    if (s_capture_buf == NULL)
+    int w = 640, h = 480;
+
+    if (size_str && sscanf (size_str, "%dx%d", &w, &h) != 2)
     {
-        s_capture_buf = (unsigned char *)malloc (cap_w * cap_h * 2);
+        DBG_LOGE ("ERR: %s(%d): invalid CAPTURE_FAKE_SIZE (%s)\n", __FILE__, __LINE__, size_str);
+        return -1;
     }
 
-    if (fmt == v4l2_fourcc ('Y', 'U', 'Y', 'V') ||
-        fmt == v4l2_fourcc ('U', 'Y', 'V', 'Y'))
+    s_fake_fp = fopen (fname, "rb");
+    if (s_fake_fp == NULL)
     {
-        memcpy (s_capture_buf, buf, cap_w * cap_h * 2);
+        DBG_LOGE ("ERR: %s(%d): can't open %s\n", __FILE__, __LINE__, fname);
+        return -1;
     }
-    else
+
+    for (int i = 0; i < NUM_FAKE_FRAMES; i ++)
     {
-        fprintf (stderr, "ERR: %s(%d): pixformat(%.4s) is not supported.\n",
-            __FILE__, __LINE__, (char *)&fmt);
-        return -1;
+        s_fake_frames[i].vaddr         = malloc (w * h * 2);
+        s_fake_frames[i].prime_fd      = -1;
+        s_fake_frames[i].v4l_buf.index = i;
+        if (s_fake_frames[i].vaddr == NULL)
+        {
+            DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+            return -1;
+        }
     }
+
+    s_capture_w   = w;
+    s_capture_h   = h;
+    s_capture_fmt = v4l2_fourcc ('Y', 'U', 'Y', 'V');
+
+    fprintf (stderr, "-------------------------------\n");
+    fprintf (stderr, " capture_devie  : %s (fake)\n", fname);
+    fprintf (stderr, " WH(%d, %d), 4CC(YUYV)\n", w, h);
+    fprintf (stderr, "-------------------------------\n");
     return 0;
 }
 
+static capture_frame_t *
+acquire_fake_capture_frame ()
+{
+    static double s_next_ms = 0;
+    int size = s_capture_w * s_capture_h * 2;
+    int i;
+
+    for (i = 0; i < NUM_FAKE_FRAMES; i ++)
+    {
+        if (s_fake_busy[i] == 0)
+            break;
+    }
+    if (i == NUM_FAKE_FRAMES)
+        return NULL;
+
+    /* pace to 30fps */
+    double now_ms = get_monotonic_time_ms ();
+    if (now_ms < s_next_ms)
+        usleep ((s_next_ms - now_ms) * 1000);
+    s_next_ms = _max (now_ms, s_next_ms) + 1000.0 / 30;
+
+    capture_frame_t *frame = &s_fake_frames[i];
+    if (fread (frame->vaddr, 1, size, s_fake_fp) != size)
+    {
+        /* loop the file */
+        rewind (s_fake_fp);
+        if (fread (frame->vaddr, 1, size, s_fake_fp) != size)
+            return NULL;
+    }
+
+    s_fake_busy[i] = 1;
+    return frame;
+}
+
+static capture_frame_t *
+acquire_capture_frame ()
+{
+    if (s_fake_fp)
+        return acquire_fake_capture_frame ();
+
+    return v4l2_acquire_capture_frame (s_cap_dev);
+}
+
+static void
+release_capture_frame (capture_frame_t *frame)
+{
+    if (s_fake_fp)
+    {
+        s_fake_busy[frame->v4l_buf.index] = 0;
+        return;
+    }
+
+    v4l2_release_capture_frame (s_cap_dev, frame);
+}
+
+
+/* -------------------------------------------------- *
+ *  capture thread
+ * -------------------------------------------------- */
+
+/* hand the back slot over to the consumer and take the old middle one. */
+static void
+publish_capture_slot ()
+{
+    int prev = __atomic_exchange_n (&s_mid_idx, s_back_idx | SLOT_FRESH, __ATOMIC_ACQ_REL);
+    s_back_idx = prev & SLOT_IDX_MASK;
+
+    /* the consumer skipped this frame. give the V4L2 buffer back to the driver. */
+    capture_slot_t *slot = &s_slots[s_back_idx];
+    if (slot->v4l_frame)
+    {
+        /* the GPU may still sample the buffer. the driver must not overwrite it yet. */
+        if (slot->gpu_fence != EGL_NO_SYNC_KHR)
+        {
+            egl_wait_fence (slot->gpu_fence);
+            slot->gpu_fence = EGL_NO_SYNC_KHR;
+        }
+
+        release_capture_frame (slot->v4l_frame);
+        slot->v4l_frame = NULL;
+        slot->buf       = NULL;
+    }
+}
+
 static void *
 capture_thread_main ()
 {
-    v4l2_start_capture (s_cap_dev);
+    uint64_t seq = 0;
+
+    if (s_fake_fp == NULL)
+        v4l2_start_capture (s_cap_dev);
 
     while (1)
     {
         int ofstx = (s_capture_w - s_capcrop_w) * 0.5f;
         int ofsty = (s_capture_h - s_capcrop_h) * 0.5f;
 
-        capture_frame_t *frame = v4l2_acquire_capture_frame (s_cap_dev);
+        capture_frame_t *frame = acquire_capture_frame ();
+        if (frame == NULL)
+        {
+            usleep (1000);
+            continue;
+        }
 
-        if (s_force_convert_to_rgba)
+        capture_slot_t *slot = &s_slots[s_back_idx];
+        slot->timestamp_ms = get_monotonic_time_ms ();
+        slot->seq          = ++ seq;
+
+        if (s_zero_copy)
         {
-            convert_to_rgba8888 (frame->vaddr, ofstx, ofsty, s_capcrop_w, s_capcrop_h, s_capture_fmt);
+            /* hold the V4L2 buffer until the consumer is done with it. */
+            slot->buf       = frame->vaddr;
+            slot->v4l_frame = frame;
         }
         else
         {
-            if (s_capcropped)
-                copy_yuyv_image_cropped (frame->vaddr, ofstx, ofsty, s_capcrop_w, s_capcrop_h, s_capture_fmt);
+            if (s_force_convert_to_rgba)
+                convert_to_rgba8888 (slot->buf, frame->vaddr, ofstx, ofsty, s_capcrop_w, s_capcrop_h, s_capture_fmt);
             else
-                copy_yuyv_image (frame->vaddr, s_capcrop_w, s_capcrop_h, s_capture_fmt);
+                copy_yuyv_image_cropped (slot->buf, frame->vaddr, ofstx, ofsty, s_capcrop_w, s_capcrop_h, s_capture_fmt);
+
+            release_capture_frame (frame);
         }
-        v4l2_release_capture_frame (s_cap_dev, frame);
+
+        publish_capture_slot ();
     }
     return 0;
 }
 
-
 int
 init_capture (uint32_t flags)
 {
@@ -196,22 +361,35 @@ init_capture (uint32_t flags)
     int cap_w, cap_h;
     unsigned int cap_fmt;
 
-    cap_dev = v4l2_open_capture_device (cap_devid);
-    if (cap_dev == NULL)
+    char *env_fake = getenv ("CAPTURE_FAKE_FILE");
+    if (env_fake)
     {
-        fprintf (stderr, "capture device not found.\n");
-        return -1;
+        if (open_fake_capture_device (env_fake, getenv ("CAPTURE_FAKE_SIZE")) < 0)
+            return -1;
+
+        cap_w   = s_capture_w;
+        cap_h   = s_capture_h;
+        cap_fmt = s_capture_fmt;
     }
+    else
+    {
+        cap_dev = v4l2_open_capture_device (cap_devid);
+        if (cap_dev == NULL)
+        {
+            fprintf (stderr, "capture device not found.\n");
+            return -1;
+        }
 
-    v4l2_get_capture_wh (cap_dev, &cap_w, &cap_h);
-    v4l2_get_capture_pixelformat (cap_dev, &cap_fmt);
+        v4l2_get_capture_wh (cap_dev, &cap_w, &cap_h);
+        v4l2_get_capture_pixelformat (cap_dev, &cap_fmt);
 
-    v4l2_show_current_capture_settings (cap_dev);
+        v4l2_show_current_capture_settings (cap_dev);
 
-    s_cap_dev     = cap_dev;
-    s_capture_fmt = cap_fmt;
-    s_capture_w = cap_w;
-    s_capture_h = cap_h;
+        s_cap_dev     = cap_dev;
+        s_capture_fmt = cap_fmt;
+        s_capture_w = cap_w;
+        s_capture_h = cap_h;
+    }
 
     if (flags & CAPTURE_SQUARED_CROP)
     {
@@ -231,7 +409,47 @@ init_capture (uint32_t flags)
     {
         s_force_convert_to_rgba = 1;
     }
-    
+
+    /*
+     *  an uncropped YUYV frame can be uploaded straight from the V4L2 buffer.
+     *  otherwise, each slot owns a buffer for the cropped/converted image.
+     */
+    if (!s_force_convert_to_rgba && !s_capcropped)
+    {
+        s_zero_copy = 1;
+
+        /* let the GPU sample the V4L2 buffer directly through EGLImage. */
+        char *env_dmabuf = getenv ("CAPTURE_DMABUF");
+        if (env_dmabuf)
+        {
+            if (atoi (env_dmabuf))
+                flags |=  CAPTURE_DMABUF_IMPORT;
+            else
+                flags &= ~CAPTURE_DMABUF_IMPORT;
+        }
+
+        if ((flags & CAPTURE_DMABUF_IMPORT) && s_fake_fp == NULL)
+        {
+            if (v4l2_export_dmabuf (s_cap_dev) == 0)
+                s_dmabuf_import = 1;
+            else
+                fprintf (stderr, "dmabuf export failed. fallback to texture upload.\n");
+        }
+    }
+    else
+    {
+        int bpp = s_force_convert_to_rgba ? 4 : 2;
+        for (int i = 0; i < NUM_CAPTURE_SLOTS; i ++)
+        {
+            s_slots[i].buf = malloc (s_capcrop_w * s_capcrop_h * bpp);
+            if (s_slots[i].buf == NULL)
+            {
+                DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+                return -1;
+            }
+        }
+    }
+
     return 0;
 }
 
@@ -251,6 +469,10 @@ get_capture_pixformat (uint32_t *pixformat)
     {
         *pixformat = pixfmt_fourcc('R', 'G', 'B', 'A');
     }
+    else if (s_dmabuf_import)
+    {
+        *pixformat = pixfmt_fourcc('E', 'X', 'T', 'X');
+    }
     else
     {
         if (s_capture_fmt == v4l2_fourcc ('Y', 'U', 'Y', 'V'))
@@ -267,10 +489,120 @@ get_capture_pixformat (uint32_t *pixformat)
     return 0;
 }
 
+/*
+ *  layout of the dmabuf to be imported as EGLImage.
+ *  V4L2 and DRM share the fourcc codes of YUYV, UYVY and NV12.
+ */
+int
+get_capture_dmabuf_attr (uint32_t *fourcc, int *num_planes, int *pitches, int *offsets)
+{
+    int bpl;
+
+    if (!s_dmabuf_import)
+        return -1;
+
+    v4l2_get_capture_bytesperline (s_cap_dev, &bpl);
+
+    *fourcc     = s_capture_fmt;
+    *num_planes = 1;
+    pitches[0]  = bpl;
+    offsets[0]  = 0;
+
+    if (s_capture_fmt == v4l2_fourcc ('N', 'V', '1', '2'))
+    {
+        *num_planes = 2;
+        pitches[1]  = bpl;
+        offsets[1]  = bpl * s_capture_h;
+    }
+    return 0;
+}
+
+/* the GPU failed to import the dmabuf. upload the V4L2 buffer with glTexSubImage2D instead. */
+int
+disable_capture_dmabuf ()
+{
+    s_dmabuf_import = 0;
+    return 0;
+}
+
+/*
+ *  take the newest complete frame. must be called from a single consumer thread.
+ *  the buffer stays valid until the next call.
+ */
+int
+get_capture_frame (capture_frame_info_t *info)
+{
+    memset (info, 0, sizeof (*info));
+
+    if (__atomic_load_n (&s_mid_idx, __ATOMIC_ACQUIRE) & SLOT_FRESH)
+    {
+        int prev = __atomic_exchange_n (&s_mid_idx, s_front_idx, __ATOMIC_ACQ_REL);
+        s_front_idx = prev & SLOT_IDX_MASK;
+    }
+
+    capture_slot_t *slot = &s_slots[s_front_idx];
+    if (slot->seq == 0)
+        return 0;               /* no frame captured yet */
+
+    info->buf          = slot->buf;
+    info->buf_index    = slot->v4l_frame ? (int)slot->v4l_frame->v4l_buf.index : -1;
+    info->dmabuf_fd    = (slot->v4l_frame && s_dmabuf_import) ? slot->v4l_frame->prime_fd : -1;
+    info->seq          = slot->seq;
+    info->timestamp_ms = slot->timestamp_ms;
+    info->is_new       = (slot->seq != s_last_seq);
+    if (info->is_new && s_last_seq > 0)
+        info->num_dropped = (int)(slot->seq - s_last_seq - 1);
+
+    if (info->is_new)
+        s_num_taken ++;
+    else
+        s_num_repeated ++;
+    s_num_dropped += info->num_dropped;
+
+    s_last_seq = slot->seq;
+    return 0;
+}
+
+/*
+ *  fence the GPU reads of the frame returned by the last get_capture_frame().
+ *  the capture thread waits for it before re-queueing the V4L2 buffer.
+ *  the fence of the newer draws supersedes the previous one of the same frame.
+ */
+int
+set_capture_frame_fence (void *fence)
+{
+    capture_slot_t *slot = &s_slots[s_front_idx];
+
+    if (slot->v4l_frame == NULL)
+    {
+        egl_destroy_fence (fence);
+        return -1;
+    }
+
+    if (slot->gpu_fence != EGL_NO_SYNC_KHR)
+        egl_destroy_fence (slot->gpu_fence);
+
+    slot->gpu_fence = fence;
+    return 0;
+}
+
+/* frames taken / overwritten before being taken / returned more than once */
+int
+get_capture_stats (uint64_t *num_taken, uint64_t *num_dropped, uint64_t *num_repeated)
+{
+    *num_taken    = s_num_taken;
+    *num_dropped  = s_num_dropped;
+    *num_repeated = s_num_repeated;
+    return 0;
+}
+
 int
 get_capture_buffer (void ** buf)
 {
-    *buf = s_capture_buf;
+    capture_frame_info_t info;
+
+    get_capture_frame (&info);
+    *buf = info.buf;
     return 0;
 }
 
@@ -9,10 +9,27 @@
 
 #define CAPTURE_SQUARED_CROP        (1 << 0)
 #define CAPTURE_PIXFORMAT_RGBA      (1 << 1)
+#define CAPTURE_DMABUF_IMPORT       (1 << 2)    /* sample V4L2 buffers via EGLImage (no upload) */
+
+typedef struct _capture_frame_info_t
+{
+    void        *buf;           /* NULL until the first frame is captured */
+    int         buf_index;      /* V4L2 buffer index (-1: copied to a private buffer) */
+    int         dmabuf_fd;      /* -1 unless CAPTURE_DMABUF_IMPORT is active */
+    uint64_t    seq;            /* 1, 2, 3, ... */
+    double      timestamp_ms;   /* CLOCK_MONOTONIC when the frame was dequeued */
+    int         is_new;         /* 0 if the same frame as the previous call   */
+    int         num_dropped;    /* frames overwritten since the previous call */
+} capture_frame_info_t;
 
 int init_capture (uint32_t flags);
 int get_capture_dimension (int *width, int *height);
 int get_capture_pixformat (uint32_t *pixformat);
+int get_capture_frame (capture_frame_info_t *info);
+int get_capture_dmabuf_attr (uint32_t *fourcc, int *num_planes, int *pitches, int *offsets);
+int disable_capture_dmabuf ();
+int set_capture_frame_fence (void *fence);
+int get_capture_stats (uint64_t *num_taken, uint64_t *num_dropped, uint64_t *num_repeated);
 int get_capture_buffer (void ** buf);
 
 int start_capture ();
@@ -3,6 +3,9 @@
  * Copyright (c) 2019 terryky1220@gmail.com
  * ------------------------------------------------ */
 #include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include <GLES2/gl2.h>
 #include "util_shader.h"
 #include "util_debugstr.h"
@@ -13,31 +16,33 @@
 static const char s_strDbgStrVS[] =
     "attribute vec4 a_Vertex;                               \n"
     "attribute vec2 a_UV;                                   \n"
-    "uniform   vec4 u_Translate;                            \n"
+    "attribute vec4 a_ColorFG;                              \n"
+    "attribute vec4 a_ColorBG;                              \n"
     "uniform   vec4 u_PrjMul, u_PrjAdd;                     \n"
     "varying   vec2 v_UV;                                   \n"
+    "varying   vec4 v_ColorFG;                              \n"
+    "varying   vec4 v_ColorBG;                              \n"
     "                                                       \n"
     "void main()                                            \n"
     "{                                                      \n"
-    "   vec4 pos;                                           \n"
-    "   pos         = a_Vertex + u_Translate;               \n"
-    "   pos         = pos * u_PrjMul;                       \n"
-    "   gl_Position = pos + u_PrjAdd;                       \n"
+    "   gl_Position = a_Vertex * u_PrjMul + u_PrjAdd;       \n"
     "   v_UV        = a_UV;                                 \n"
+    "   v_ColorFG   = a_ColorFG;                            \n"
+    "   v_ColorBG   = a_ColorBG;                            \n"
     "}                                                      \n";
 
 static const char s_strDbgStrFS[] =
     "precision mediump float;                               \n"
     "                                                       \n"
     "varying vec2       v_UV;                               \n"
+    "varying vec4       v_ColorFG;                          \n"
+    "varying vec4       v_ColorBG;                          \n"
     "uniform sampler2D  u_Sampler0;                         \n"
-    "uniform vec4       u_ColorFG;                          \n"
-    "uniform vec4       u_ColorBG;                          \n"
     "                                                       \n"
     "void main()                                            \n"
     "{                                                      \n"
     "   vec4 texcol = texture2D (u_Sampler0, v_UV);         \n"
-    "   gl_FragColor = mix (u_ColorBG, u_ColorFG, texcol.r);\n"
+    "   gl_FragColor = mix (v_ColorBG, v_ColorFG, texcol.r);\n"
     "}                                                      \n";
 
 
@@ -47,14 +52,25 @@ static const char s_strDbgStrFS[] =
 #define DBGSTR_IMAGE_WIDTH  (DEBSTR_FONT_WIDTH*DEBSTR_FONT_NUM)
 #define DBGSTR_IMAGE_HEIGHT (DEBSTR_FONT_HEIGHT)
 
+#define DBGSTR_BATCH_MAX_CHAR   2048    /* flushed when full */
+
 static unsigned int     s_font12x22[];
 static unsigned int     s_fontTexID;
 static int              s_wndW, s_wndH;
 static GLuint           s_progShader;
-static int              locVtx, locUv, locTranslate, locSampler0;
+static int              locVtx, locUv, locSampler0;
 static int              locPrjMul, locPrjAdd;
 static int              locColFG, locColBG;
 
+/*
+ *  glyphs of all the strings are accumulated between begin_dbgstr_batch()
+ *  and end_dbgstr_batch(), and drawn with one glDrawArrays.
+ */
+static GLuint           s_batchVBO;
+static int              s_batchEnabled;
+static int              s_batchNumVtx;
+static dbgstr_vtx_t     s_batchVtx[DBGSTR_BATCH_MAX_CHAR * 6];
+
 static int
 load_debug_font_texture (void)
 {
@@ -81,22 +97,20 @@ setup_shader()
 {
     s_progShader = build_shader (s_strDbgStrVS, s_strDbgStrFS);
 
-    locVtx = glGetAttribLocation (s_progShader, "a_Vertex");
-    locUv  = glGetAttribLocation (s_progShader, "a_UV"    );
+    locVtx   = glGetAttribLocation (s_progShader, "a_Vertex" );
+    locUv    = glGetAttribLocation (s_progShader, "a_UV"     );
+    locColFG = glGetAttribLocation (s_progShader, "a_ColorFG");
+    locColBG = glGetAttribLocation (s_progShader, "a_ColorBG");
 
     locSampler0  = glGetUniformLocation (s_progShader, "u_Sampler0" );
-    locTranslate = glGetUniformLocation (s_progShader, "u_Translate");
     locPrjMul    = glGetUniformLocation (s_progShader, "u_PrjMul");
     locPrjAdd    = glGetUniformLocation (s_progShader, "u_PrjAdd");
-    locColFG     = glGetUniformLocation (s_progShader, "u_ColorFG" );
-    locColBG     = glGetUniformLocation (s_progShader, "u_ColorBG" );
 
     return 0;
 }
 
 
 
-
 void
 init_dbgstr (int win_w, int win_h)
 {
@@ -105,85 +119,201 @@ init_dbgstr (int win_w, int win_h)
 
     load_debug_font_texture ();
     setup_shader();
+
+    glGenBuffers (1, &s_batchVBO);
 }
 
 
-int
-draw_dbgstr_ex (char *str, int x, int y, float scale, float *col_fg, float *col_bg)
+/* -------------------------------------------------- *
+ *  glyph quads
+ * -------------------------------------------------- */
+static void
+pack_color (float *color, unsigned char *col)
+{
+    for (int i = 0; i < 4; i ++)
+    {
+        float c = color[i] < 0.0f ? 0.0f : (color[i] > 1.0f ? 1.0f : color[i]);
+        col[i] = (unsigned char)(c * 255.0f + 0.5f);
+    }
+}
+
+static int
+count_glyphs (char *str)
+{
+    int num = 0;
+    for (int i = 0; str[i]; i ++)
+    {
+        if (str[i] != '\n')
+            num ++;
+    }
+    return num;
+}
+
+/* 6 vertices (2 triangles) per character. returns the number of vertices. */
+static int
+build_glyphs (dbgstr_vtx_t *vtx, char *str, int x, int y, float scale, float *col_fg, float *col_bg)
 {
-    int   i, row, column;
-    float u0, u1;
-    float vertices[8], texcoord[8];
+    unsigned char fg[4], bg[4];
     float fW = DEBSTR_FONT_WIDTH  * scale;
     float fH = DEBSTR_FONT_HEIGHT * scale;
-    float fx = (float)x;
-    float fy = (float)y;
+    int   row = 0, column = 0, num_vtx = 0;
 
-    vertices[ 2 * 0 + 0 ] = fx;      vertices[ 2 * 0 + 1 ] = fy;
-    vertices[ 2 * 1 + 0 ] = fx;      vertices[ 2 * 1 + 1 ] = fy + fH;
-    vertices[ 2 * 2 + 0 ] = fx + fW; vertices[ 2 * 2 + 1 ] = fy;
-    vertices[ 2 * 3 + 0 ] = fx + fW; vertices[ 2 * 3 + 1 ] = fy + fH;
+    pack_color (col_fg, fg);
+    pack_color (col_bg, bg);
 
-    glUseProgram (s_progShader);
+    for (int i = 0; str[i]; i ++)
+    {
+        int c = str[i];
 
-    glBindBuffer (GL_ARRAY_BUFFER, 0);
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+        if (c == '\n')
+        {
+            row ++;
+            column = 0;
+            continue;
+        }
+
+        float x0 = x + column * fW;
+        float y0 = y + row    * fH;
+        float u0 = (c - 0x20) * (1.0f / DEBSTR_FONT_NUM);
+        float u1 = u0 + (1.0f / DEBSTR_FONT_NUM);
+        float quad[4][4] = {
+            {x0,      y0,      u0, 0.0f},
+            {x0,      y0 + fH, u0, 1.0f},
+            {x0 + fW, y0,      u1, 0.0f},
+            {x0 + fW, y0 + fH, u1, 1.0f}};
+        static const int idx[6] = {0, 1, 2, 2, 1, 3};
+
+        for (int j = 0; j < 6; j ++)
+        {
+            dbgstr_vtx_t *v = &vtx[num_vtx ++];
+            v->x = quad[idx[j]][0];
+            v->y = quad[idx[j]][1];
+            v->u = quad[idx[j]][2];
+            v->v = quad[idx[j]][3];
+            memcpy (v->fg, fg, 4);
+            memcpy (v->bg, bg, 4);
+        }
+        column ++;
+    }
+
+    return num_vtx;
+}
+
+/* draw (num_vtx) vertices in the VBO which is bound */
+static void
+draw_glyph_vbo (int num_vtx)
+{
+    glUseProgram (s_progShader);
 
     glEnableVertexAttribArray (locVtx);
     glEnableVertexAttribArray (locUv );
-    glVertexAttribPointer (locVtx, 2, GL_FLOAT, GL_FALSE, 0, vertices);
-    glVertexAttribPointer (locUv,  2, GL_FLOAT, GL_FALSE, 0, texcoord);
+    glEnableVertexAttribArray (locColFG);
+    glEnableVertexAttribArray (locColBG);
+    glVertexAttribPointer (locVtx,   2, GL_FLOAT,         GL_FALSE, sizeof (dbgstr_vtx_t), (void *)offsetof (dbgstr_vtx_t, x ));
+    glVertexAttribPointer (locUv,    2, GL_FLOAT,         GL_FALSE, sizeof (dbgstr_vtx_t), (void *)offsetof (dbgstr_vtx_t, u ));
+    glVertexAttribPointer (locColFG, 4, GL_UNSIGNED_BYTE, GL_TRUE,  sizeof (dbgstr_vtx_t), (void *)offsetof (dbgstr_vtx_t, fg));
+    glVertexAttribPointer (locColBG, 4, GL_UNSIGNED_BYTE, GL_TRUE,  sizeof (dbgstr_vtx_t), (void *)offsetof (dbgstr_vtx_t, bg));
 
     glUniform1i (locSampler0, 0);
     glUniform4f (locPrjMul, 2.0f / s_wndW, -2.0f / s_wndH, 0.0f, 0.0f);
     glUniform4f (locPrjAdd, -1.0f, 1.0f, 1.0f, 1.0f);
-    glUniform4fv(locColFG, 1, col_fg);
-    glUniform4fv(locColBG, 1, col_bg);
 
     glDisable (GL_DEPTH_TEST);
     glDisable (GL_CULL_FACE );
     glActiveTexture (GL_TEXTURE0);
     glBindTexture   (GL_TEXTURE_2D, s_fontTexID);
-    GLASSERT();
 
     glEnable (GL_BLEND);
     glBlendFuncSeparate (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, 
     	       GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
-    row = column = 0;
-    for (i = 0; ; i ++)
-    {
-        int c = str[i];
+    glDrawArrays (GL_TRIANGLES, 0, num_vtx);
 
-        if ( c == 0 )
-            break;
+    glDisable (GL_BLEND);
+    glDisableVertexAttribArray (locVtx);
+    glDisableVertexAttribArray (locUv );
+    glDisableVertexAttribArray (locColFG);
+    glDisableVertexAttribArray (locColBG);
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+    GLASSERT();
+}
 
-        if (c == '\n')
-        {
-            row ++;
-            column = 0;
-            continue;
-        }
+/* stream (num_vtx) vertices to the batch VBO and draw them */
+static void
+draw_glyph_stream (dbgstr_vtx_t *vtx, int num_vtx)
+{
+    if (num_vtx <= 0)
+        return;
 
-        u0 = (c - 0x20) * (1.0f / DEBSTR_FONT_NUM);
-        u1 = u0 + (1.0f / DEBSTR_FONT_NUM);
+    glBindBuffer (GL_ARRAY_BUFFER, s_batchVBO);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
 
-        texcoord[ 2 * 0 + 0 ] = texcoord[ 2 * 1 + 0 ] = u0;
-        texcoord[ 2 * 2 + 0 ] = texcoord[ 2 * 3 + 0 ] = u1;
-        texcoord[ 2 * 0 + 1 ] = texcoord[ 2 * 2 + 1 ] = 0.0;
-        texcoord[ 2 * 1 + 1 ] = texcoord[ 2 * 3 + 1 ] = 1.0;
+    /* orphan the previous storage, not to wait for the draw which reads it. */
+    glBufferData (GL_ARRAY_BUFFER, sizeof (s_batchVtx), NULL, GL_STREAM_DRAW);
+    glBufferSubData (GL_ARRAY_BUFFER, 0, num_vtx * sizeof (dbgstr_vtx_t), vtx);
 
-        glUniform4f (locTranslate, column * fW, row * fH, 0.0f, 0.0f );
+    draw_glyph_vbo (num_vtx);
+}
 
-        glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+static dbgstr_vtx_t *
+batch_alloc (int num_vtx)
+{
+    if (s_batchNumVtx + num_vtx > DBGSTR_BATCH_MAX_CHAR * 6)
+        flush_dbgstr_batch ();
 
-        column ++;
+    dbgstr_vtx_t *vtx = &s_batchVtx[s_batchNumVtx];
+    s_batchNumVtx += num_vtx;
+    return vtx;
+}
+
+
+/* -------------------------------------------------- *
+ *  batch
+ * -------------------------------------------------- */
+int
+begin_dbgstr_batch ()
+{
+    s_batchEnabled = 1;
+    return 0;
+}
+
+int
+flush_dbgstr_batch ()
+{
+    draw_glyph_stream (s_batchVtx, s_batchNumVtx);
+    s_batchNumVtx = 0;
+    return 0;
+}
+
+int
+end_dbgstr_batch ()
+{
+    flush_dbgstr_batch ();
+    s_batchEnabled = 0;
+    return 0;
+}
+
+
+int
+draw_dbgstr_ex (char *str, int x, int y, float scale, float *col_fg, float *col_bg)
+{
+    int num_vtx = count_glyphs (str) * 6;
+
+    if (num_vtx > DBGSTR_BATCH_MAX_CHAR * 6)
+    {
+        fprintf (stderr, "ERR: %s(%d): too long string (%d chars)\n", __FILE__, __LINE__, num_vtx / 6);
+        return -1;
     }
 
-    glDisable (GL_BLEND);
-    glDisableVertexAttribArray (locVtx);
-    glDisableVertexAttribArray (locUv );
-    GLASSERT();
+    if (s_batchEnabled)
+    {
+        build_glyphs (batch_alloc (num_vtx), str, x, y, scale, col_fg, col_bg);
+        return 0;
+    }
+
+    /* one draw call for the whole string. (the arena is empty out of a batch) */
+    build_glyphs (s_batchVtx, str, x, y, scale, col_fg, col_bg);
+    draw_glyph_stream (s_batchVtx, num_vtx);
 
     return 0;
 }
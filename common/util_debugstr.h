@@ -5,6 +5,14 @@
 #ifndef _UTIL_DEBUGSTR_H_
 #define _UTIL_DEBUGSTR_H_
 
+typedef struct _dbgstr_vtx_t
+{
+    float           x, y;
+    float           u, v;
+    unsigned char   fg[4];
+    unsigned char   bg[4];
+} dbgstr_vtx_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -13,6 +21,15 @@ void init_dbgstr (int win_w, int win_h);
 int  draw_dbgstr    (char *str, int x, int y);
 int  draw_dbgstr_ex (char *str, int x, int y, float scale, float *col_fg, float *col_bg);
 
+/*
+ *  between begin_dbgstr_batch() and end_dbgstr_batch(), the strings are
+ *  accumulated and drawn with one draw call at the end, over everything
+ *  drawn in between. end the batch before changing the viewport.
+ */
+int  begin_dbgstr_batch ();
+int  flush_dbgstr_batch ();
+int  end_dbgstr_batch ();
+
 #ifdef __cplusplus
 }
 #endif
@@ -1101,3 +1101,136 @@ egl_create_eglimage (int width, int height)
     return EGL_NO_IMAGE_KHR;
 #endif
 }
+
+/*
+ *  import a dmabuf (e.g. a V4L2 capture buffer) as EGLImage.
+ *  fourcc is a DRM fourcc (YUYV, UYVY, NV12, ...).
+ *  requires EGL_EXT_image_dma_buf_import.
+ */
+EGLImageKHR
+egl_create_eglimage_dmabuf (int width, int height, uint32_t fourcc,
+                            int num_planes, int *fds, int *pitches, int *offsets)
+{
+    static PFNEGLCREATEIMAGEKHRPROC s_eglCreateImageKHR = NULL;
+    EGLImageKHR egl_img;
+    EGLint      attrs[32];
+    int         n = 0;
+
+    if (s_eglCreateImageKHR == NULL)
+    {
+        s_eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC)eglGetProcAddress ("eglCreateImageKHR");
+        if (s_eglCreateImageKHR == NULL)
+        {
+            fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+            return EGL_NO_IMAGE_KHR;
+        }
+    }
+
+    attrs[n ++] = EGL_WIDTH;                        attrs[n ++] = width;
+    attrs[n ++] = EGL_HEIGHT;                       attrs[n ++] = height;
+    attrs[n ++] = EGL_LINUX_DRM_FOURCC_EXT;         attrs[n ++] = fourcc;
+
+    attrs[n ++] = EGL_DMA_BUF_PLANE0_FD_EXT;        attrs[n ++] = fds[0];
+    attrs[n ++] = EGL_DMA_BUF_PLANE0_PITCH_EXT;     attrs[n ++] = pitches[0];
+    attrs[n ++] = EGL_DMA_BUF_PLANE0_OFFSET_EXT;    attrs[n ++] = offsets[0];
+    if (num_planes > 1)
+    {
+        attrs[n ++] = EGL_DMA_BUF_PLANE1_FD_EXT;    attrs[n ++] = fds[1];
+        attrs[n ++] = EGL_DMA_BUF_PLANE1_PITCH_EXT; attrs[n ++] = pitches[1];
+        attrs[n ++] = EGL_DMA_BUF_PLANE1_OFFSET_EXT;attrs[n ++] = offsets[1];
+    }
+
+    /* BT.601 limited range, same as the YUYV shader of util_render2d */
+    attrs[n ++] = EGL_YUV_COLOR_SPACE_HINT_EXT;     attrs[n ++] = EGL_ITU_REC601_EXT;
+    attrs[n ++] = EGL_SAMPLE_RANGE_HINT_EXT;        attrs[n ++] = EGL_YUV_NARROW_RANGE_EXT;
+    attrs[n ++] = EGL_NONE;
+
+    egl_img = s_eglCreateImageKHR (s_dpy, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attrs);
+    if (egl_img == EGL_NO_IMAGE_KHR)
+    {
+        EGLASSERT();
+        fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+        return EGL_NO_IMAGE_KHR;
+    }
+
+    return egl_img;
+}
+
+int
+egl_destroy_eglimage (EGLImageKHR egl_img)
+{
+    static PFNEGLDESTROYIMAGEKHRPROC s_eglDestroyImageKHR = NULL;
+
+    if (s_eglDestroyImageKHR == NULL)
+        s_eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC)eglGetProcAddress ("eglDestroyImageKHR");
+
+    if (s_eglDestroyImageKHR == NULL || egl_img == EGL_NO_IMAGE_KHR)
+        return -1;
+
+    s_eglDestroyImageKHR (s_dpy, egl_img);
+    return 0;
+}
+
+
+/*
+ *  fence of the GL commands issued so far. requires EGL_KHR_fence_sync.
+ *
+ *  the commands are flushed here, so that the fence can be waited on
+ *  any thread (eglClientWaitSyncKHR without EGL_SYNC_FLUSH_COMMANDS_BIT).
+ */
+static PFNEGLCREATESYNCKHRPROC     s_eglCreateSyncKHR;
+static PFNEGLDESTROYSYNCKHRPROC    s_eglDestroySyncKHR;
+static PFNEGLCLIENTWAITSYNCKHRPROC s_eglClientWaitSyncKHR;
+
+EGLSyncKHR
+egl_create_fence ()
+{
+    EGLSyncKHR sync;
+
+    if (s_eglCreateSyncKHR == NULL)
+    {
+        s_eglCreateSyncKHR     = (PFNEGLCREATESYNCKHRPROC)    eglGetProcAddress ("eglCreateSyncKHR");
+        s_eglDestroySyncKHR    = (PFNEGLDESTROYSYNCKHRPROC)   eglGetProcAddress ("eglDestroySyncKHR");
+        s_eglClientWaitSyncKHR = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress ("eglClientWaitSyncKHR");
+    }
+
+    if (!s_eglCreateSyncKHR || !s_eglDestroySyncKHR || !s_eglClientWaitSyncKHR)
+        return EGL_NO_SYNC_KHR;
+
+    sync = s_eglCreateSyncKHR (s_dpy, EGL_SYNC_FENCE_KHR, NULL);
+    if (sync == EGL_NO_SYNC_KHR)
+        return EGL_NO_SYNC_KHR;
+
+    glFlush ();
+    return sync;
+}
+
+/* wait until the fence signals, and destroy it. */
+int
+egl_wait_fence (EGLSyncKHR sync)
+{
+    EGLint ret;
+
+    if (sync == EGL_NO_SYNC_KHR)
+        return -1;
+
+    ret = s_eglClientWaitSyncKHR (s_dpy, sync, 0, EGL_FOREVER_KHR);
+    s_eglDestroySyncKHR (s_dpy, sync);
+
+    if (ret == EGL_FALSE)
+    {
+        fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+    return 0;
+}
+
+int
+egl_destroy_fence (EGLSyncKHR sync)
+{
+    if (sync == EGL_NO_SYNC_KHR)
+        return -1;
+
+    s_eglDestroySyncKHR (s_dpy, sync);
+    return 0;
+}
@@ -24,6 +24,13 @@ int egl_swap ();
 int egl_set_swap_interval (int interval);
 
 EGLImageKHR egl_create_eglimage (int width, int height);
+EGLImageKHR egl_create_eglimage_dmabuf (int width, int height, uint32_t fourcc,
+                                        int num_planes, int *fds, int *pitches, int *offsets);
+int         egl_destroy_eglimage (EGLImageKHR egl_img);
+
+EGLSyncKHR  egl_create_fence ();
+int         egl_wait_fence (EGLSyncKHR sync);
+int         egl_destroy_fence (EGLSyncKHR sync);
 
 int egl_get_current_surface_dimension (int *width, int *height);
 
@@ -0,0 +1,264 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "util_heatmap.h"
+#include "util_debug.h"
+
+#if defined (__SSE2__)
+#define HEATMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define HEATMAP_NEON
+#include <arm_neon.h>
+#endif
+
+#define MAXF(a, b)  ((a) > (b) ? (a) : (b))
+
+
+int
+heatmap_init_filter (heatmap_filter_t *filter, int w, int h, int radius)
+{
+    int win = 2 * radius + 1;
+    int max_len = MAXF (w, h);
+
+    /* the padded line is rounded up to the blocks of (win) pixels */
+    int line_len = ((max_len + 2 * radius + win - 1) / win) * win;
+    size_t size = 0;
+
+    size += sizeof (float) * w * h * 3;         /* plane, max, tmp */
+    size += sizeof (float) * line_len * 3;      /* line, fwd, bwd  */
+
+    char *buf = (char *)malloc (size);
+    if (buf == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    filter->w      = w;
+    filter->h      = h;
+    filter->radius = radius;
+
+    filter->plane = (float *)buf;   buf += sizeof (float) * w * h;
+    filter->max   = (float *)buf;   buf += sizeof (float) * w * h;
+    filter->tmp   = (float *)buf;   buf += sizeof (float) * w * h;
+    filter->line  = (float *)buf;   buf += sizeof (float) * line_len;
+    filter->fwd   = (float *)buf;   buf += sizeof (float) * line_len;
+    filter->bwd   = (float *)buf;
+
+    return 0;
+}
+
+void
+heatmap_destroy_filter (heatmap_filter_t *filter)
+{
+    free (filter->plane);   /* head of the buffer */
+    memset (filter, 0, sizeof (*filter));
+}
+
+void
+heatmap_load_channel (heatmap_filter_t *filter, const float *heatmap, int num_ch, int ch)
+{
+    int num = filter->w * filter->h;
+    const float *src = heatmap + ch;
+
+    if (num_ch == 1)
+    {
+        memcpy (filter->plane, heatmap, sizeof (float) * num);
+        return;
+    }
+
+    for (int i = 0; i < num; i ++)
+        filter->plane[i] = src[i * num_ch];
+}
+
+
+/* -------------------------------------------------- *
+ *  van Herk/Gil-Werman max filter
+ *
+ *   the padded line is split into the blocks of (win) pixels.
+ *   fwd[] is the running max from the head of each block, and bwd[] is
+ *   the one from the tail. a window starting at (i) covers the tail of
+ *   one block and the head of the next, so its max is
+ *   max (bwd[i], fwd[i + win - 1]).
+ * -------------------------------------------------- */
+static void
+max_filter_line (heatmap_filter_t *filter, const float *src, int src_step,
+                 float *dst, int dst_step, int len)
+{
+    int radius = filter->radius;
+    int win    = 2 * radius + 1;
+    int line_len = ((len + 2 * radius + win - 1) / win) * win;
+    float *line = filter->line;
+    float *fwd  = filter->fwd;
+    float *bwd  = filter->bwd;
+
+    /* pad with -FLT_MAX: same as clipping the window at the border */
+    for (int i = 0; i < line_len; i ++)
+        line[i] = -FLT_MAX;
+    for (int i = 0; i < len; i ++)
+        line[i + radius] = src[i * src_step];
+
+    for (int blk = 0; blk < line_len; blk += win)
+    {
+        fwd[blk] = line[blk];
+        for (int i = blk + 1; i < blk + win; i ++)
+            fwd[i] = MAXF (fwd[i - 1], line[i]);
+
+        bwd[blk + win - 1] = line[blk + win - 1];
+        for (int i = blk + win - 2; i >= blk; i --)
+            bwd[i] = MAXF (bwd[i + 1], line[i]);
+    }
+
+    for (int i = 0; i < len; i ++)
+        dst[i * dst_step] = MAXF (bwd[i], fwd[i + win - 1]);
+}
+
+void
+heatmap_max_filter (heatmap_filter_t *filter)
+{
+    int w = filter->w;
+    int h = filter->h;
+
+    /* horizontal */
+    for (int y = 0; y < h; y ++)
+        max_filter_line (filter, &filter->plane[y * w], 1, &filter->tmp[y * w], 1, w);
+
+    /* vertical */
+    for (int x = 0; x < w; x ++)
+        max_filter_line (filter, &filter->tmp[x], w, &filter->max[x], w, h);
+}
+
+
+/* -------------------------------------------------- *
+ *  peaks
+ *   most of the pixels are below the threshold, so test 4 pixels at a
+ *   time and look at the lanes only when one of them passes.
+ * -------------------------------------------------- */
+static inline int
+add_peak (heatmap_filter_t *filter, int idx, heatmap_peak_t *peaks, int num_peaks, int max_peaks)
+{
+    if (num_peaks >= max_peaks)
+        return num_peaks;
+
+    peaks[num_peaks].x     = idx % filter->w;
+    peaks[num_peaks].y     = idx / filter->w;
+    peaks[num_peaks].score = filter->plane[idx];
+    return num_peaks + 1;
+}
+
+int
+heatmap_find_peaks (heatmap_filter_t *filter, float thresh, heatmap_peak_t *peaks, int max_peaks)
+{
+    const float *plane = filter->plane;
+    const float *max   = filter->max;
+    int num = filter->w * filter->h;
+    int num_peaks = 0;
+    int i = 0;
+
+#if defined (HEATMAP_SSE2)
+    __m128 vthresh = _mm_set1_ps (thresh);
+    for (; i + 4 <= num; i += 4)
+    {
+        __m128 v = _mm_loadu_ps (&plane[i]);
+        __m128 m = _mm_and_ps (_mm_cmpge_ps (v, vthresh), _mm_cmpge_ps (v, _mm_loadu_ps (&max[i])));
+        int mask = _mm_movemask_ps (m);
+        if (mask == 0)
+            continue;
+
+        for (int j = 0; j < 4; j ++)
+        {
+            if (mask & (1 << j))
+                num_peaks = add_peak (filter, i + j, peaks, num_peaks, max_peaks);
+        }
+    }
+#elif defined (HEATMAP_NEON)
+    float32x4_t vthresh = vdupq_n_f32 (thresh);
+    for (; i + 4 <= num; i += 4)
+    {
+        float32x4_t v = vld1q_f32 (&plane[i]);
+        uint32x4_t  m = vandq_u32 (vcgeq_f32 (v, vthresh), vcgeq_f32 (v, vld1q_f32 (&max[i])));
+        uint32x2_t  m2 = vorr_u32 (vget_low_u32 (m), vget_high_u32 (m));
+        if ((vget_lane_u32 (m2, 0) | vget_lane_u32 (m2, 1)) == 0)
+            continue;
+
+        for (int j = 0; j < 4; j ++)
+        {
+            if (plane[i + j] >= thresh && plane[i + j] >= max[i + j])
+                num_peaks = add_peak (filter, i + j, peaks, num_peaks, max_peaks);
+        }
+    }
+#endif
+
+    for (; i < num; i ++)
+    {
+        if (plane[i] >= thresh && plane[i] >= max[i])
+            num_peaks = add_peak (filter, i, peaks, num_peaks, max_peaks);
+    }
+
+    return num_peaks;
+}
+
+void
+heatmap_find_max (heatmap_filter_t *filter, heatmap_peak_t *peak)
+{
+    const float *plane = filter->plane;
+    int num = filter->w * filter->h;
+    int max_idx = 0;
+
+    for (int i = 1; i < num; i ++)
+    {
+        if (plane[i] > plane[max_idx])
+            max_idx = i;
+    }
+
+    peak->x     = max_idx % filter->w;
+    peak->y     = max_idx / filter->w;
+    peak->score = plane[max_idx];
+}
+
+
+/* -------------------------------------------------- *
+ *  sub-pixel refinement
+ * -------------------------------------------------- */
+static float
+parabola_offset (float l, float c, float r)
+{
+    float denom = l - 2.0f * c + r;
+
+    /* not a peak on this axis (flat or convex) */
+    if (denom >= 0.0f)
+        return 0.0f;
+
+    float ofst = 0.5f * (l - r) / denom;
+    if (ofst < -0.5f) ofst = -0.5f;
+    if (ofst >  0.5f) ofst =  0.5f;
+    return ofst;
+}
+
+void
+heatmap_refine_peak (heatmap_filter_t *filter, const heatmap_peak_t *peak, float *x, float *y)
+{
+    const float *plane = filter->plane;
+    int w  = filter->w;
+    int h  = filter->h;
+    int px = peak->x;
+    int py = peak->y;
+    float c = plane[py * w + px];
+
+    *x = (float)px;
+    *y = (float)py;
+
+    if (px > 0 && px < w - 1)
+        *x += parabola_offset (plane[py * w + px - 1], c, plane[py * w + px + 1]);
+
+    if (py > 0 && py < h - 1)
+        *y += parabola_offset (plane[(py - 1) * w + px], c, plane[(py + 1) * w + px]);
+}
@@ -0,0 +1,69 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_HEATMAP_H_
+#define _UTIL_HEATMAP_H_
+
+/*
+ *  peak extraction of the heatmap models (objectron, posenet, pose3d).
+ *
+ *  one channel of the heatmap is loaded into a packed plane, max filtered
+ *  with the separable van Herk/Gil-Werman filter (3 compares per pixel per
+ *  axis, whatever the radius is), and the pixels which pass the threshold
+ *  and equal the local max are taken as the peaks.
+ */
+typedef struct _heatmap_peak_t
+{
+    int     x, y;           /* grid position */
+    float   score;
+} heatmap_peak_t;
+
+typedef struct _heatmap_filter_t
+{
+    int     w, h;
+    int     radius;         /* window = (2 * radius + 1)^2                */
+
+    float   *plane;         /* [h][w] the channel to process              */
+    float   *max;           /* [h][w] max of the window around each pixel */
+
+    /* scratch */
+    float   *tmp;           /* [h][w] max of the rows                     */
+    float   *line;          /* padded line                                */
+    float   *fwd, *bwd;     /* block-wise prefix/suffix max of the line   */
+} heatmap_filter_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int     heatmap_init_filter    (heatmap_filter_t *filter, int w, int h, int radius);
+void    heatmap_destroy_filter (heatmap_filter_t *filter);
+
+/* copy the channel (ch) of the interleaved [h][w][num_ch] heatmap into filter->plane */
+void    heatmap_load_channel (heatmap_filter_t *filter, const float *heatmap, int num_ch, int ch);
+
+/* filter->plane --> filter->max */
+void    heatmap_max_filter (heatmap_filter_t *filter);
+
+/*
+ *  write the pixels of (plane >= thresh) && (plane >= max) to peaks[] in the
+ *  raster order, and return the count (at most max_peaks).
+ *  heatmap_max_filter() must be called before.
+ */
+int     heatmap_find_peaks (heatmap_filter_t *filter, float thresh, heatmap_peak_t *peaks, int max_peaks);
+
+/* the first pixel of the highest score in filter->plane */
+void    heatmap_find_max (heatmap_filter_t *filter, heatmap_peak_t *peak);
+
+/*
+ *  sub-pixel position of the peak, from the parabola through the peak and
+ *  its neighbors on each axis. the offset is clamped to +-0.5.
+ */
+void    heatmap_refine_peak (heatmap_filter_t *filter, const heatmap_peak_t *peak, float *x, float *y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_HEATMAP_H_ */
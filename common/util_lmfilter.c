@@ -0,0 +1,593 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "util_lmfilter.h"
+#include "util_debug.h"
+
+#if defined (__SSE2__)
+#define LMFILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define LMFILTER_NEON
+#include <arm_neon.h>
+#endif
+
+#define DT_MIN  (1.0f / 10000.0f)   /* [sec] */
+
+
+void
+lmfilter_default_param (lmfilter_param_t *param, int type)
+{
+    /* tuned for the values normalized by the image (or ROI) size */
+    param->type          = type;
+    param->min_cutoff    = 1.0f;
+    param->beta          = 30.0f;
+    param->d_cutoff      = 1.0f;
+    param->process_noise = 1.0f;
+    param->measure_noise = 1e-5f;
+    param->reset_ms      = 500.0f;
+}
+
+
+int
+lmfilter_init (lmfilter_t *filter, int num)
+{
+    memset (filter, 0, sizeof (*filter));
+
+    /* one allocation for all the state arrays */
+    float *buf = (float *)calloc (num * 5, sizeof (float));
+    if (buf == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    filter->num = num;
+    filter->x   = buf + num * 0;
+    filter->dx  = buf + num * 1;
+    filter->p00 = buf + num * 2;
+    filter->p01 = buf + num * 3;
+    filter->p11 = buf + num * 4;
+
+    return 0;
+}
+
+void
+lmfilter_destroy (lmfilter_t *filter)
+{
+    free (filter->x);
+    memset (filter, 0, sizeof (*filter));
+}
+
+void
+lmfilter_reset (lmfilter_t *filter)
+{
+    filter->valid = 0;
+}
+
+static void
+start_track (lmfilter_t *filter, const lmfilter_param_t *param, const float *val, double time_ms)
+{
+    int num = filter->num;
+
+    memcpy (filter->x, val, num * sizeof (float));
+    for (int i = 0; i < num; i ++)
+    {
+        filter->dx [i] = 0.0f;
+        filter->p00[i] = param->measure_noise;
+        filter->p01[i] = 0.0f;
+        filter->p11[i] = param->process_noise;  /* velocity unknown: 1 sec of the acceleration */
+    }
+
+    filter->valid   = 1;
+    filter->time_ms = time_ms;
+}
+
+
+/* -------------------------------------------------- *
+ *  One-Euro
+ *
+ *   dx  = lowpass ((val - x) / dt,  d_cutoff)
+ *   x   = lowpass (val, min_cutoff + beta * |dx|)
+ *
+ *   the smoothing factor of the cutoff (fc) is  r / (1 + r),  r = 2 * PI * fc * dt
+ * -------------------------------------------------- */
+static inline float
+one_euro_scalar (float *x, float *dx, float val, float rate, float ad,
+                 float w_min, float w_beta)
+{
+    float d  = (val - *x) * rate;
+    float dh = *dx + ad * (d - *dx);
+    float r  = w_min + w_beta * fabsf (dh);
+    float a  = r / (1.0f + r);
+
+    *dx = dh;
+    *x  = *x + a * (val - *x);
+    return *x;
+}
+
+static void
+apply_one_euro (lmfilter_t *filter, const lmfilter_param_t *param, float *val, float dt)
+{
+    float *x  = filter->x;
+    float *dx = filter->dx;
+    float rd  = 2.0f * (float)M_PI * param->d_cutoff * dt;
+    float ad  = rd / (1.0f + rd);
+    float rate   = 1.0f / dt;
+    float w_min  = 2.0f * (float)M_PI * param->min_cutoff * dt;
+    float w_beta = 2.0f * (float)M_PI * param->beta * dt;
+    int   num = filter->num;
+    int   i = 0;
+
+#if defined (LMFILTER_SSE2)
+    __m128 vrate  = _mm_set1_ps (rate);
+    __m128 vad    = _mm_set1_ps (ad);
+    __m128 vwmin  = _mm_set1_ps (w_min);
+    __m128 vwbeta = _mm_set1_ps (w_beta);
+    __m128 vone   = _mm_set1_ps (1.0f);
+    __m128 vabs   = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+
+    for (; i + 4 <= num; i += 4)
+    {
+        __m128 vx  = _mm_loadu_ps (&x[i]);
+        __m128 vdx = _mm_loadu_ps (&dx[i]);
+        __m128 vv  = _mm_loadu_ps (&val[i]);
+        __m128 vdiff = _mm_sub_ps (vv, vx);
+
+        __m128 vd  = _mm_mul_ps (vdiff, vrate);
+        __m128 vdh = _mm_add_ps (vdx, _mm_mul_ps (vad, _mm_sub_ps (vd, vdx)));
+        __m128 vr  = _mm_add_ps (vwmin, _mm_mul_ps (vwbeta, _mm_and_ps (vdh, vabs)));
+        __m128 va  = _mm_div_ps (vr, _mm_add_ps (vone, vr));
+
+        vx = _mm_add_ps (vx, _mm_mul_ps (va, vdiff));
+        _mm_storeu_ps (&dx[i],  vdh);
+        _mm_storeu_ps (&x[i],   vx);
+        _mm_storeu_ps (&val[i], vx);
+    }
+#elif defined (LMFILTER_NEON)
+    float32x4_t vrate  = vdupq_n_f32 (rate);
+    float32x4_t vad    = vdupq_n_f32 (ad);
+    float32x4_t vwmin  = vdupq_n_f32 (w_min);
+    float32x4_t vwbeta = vdupq_n_f32 (w_beta);
+    float32x4_t vone   = vdupq_n_f32 (1.0f);
+
+    for (; i + 4 <= num; i += 4)
+    {
+        float32x4_t vx  = vld1q_f32 (&x[i]);
+        float32x4_t vdx = vld1q_f32 (&dx[i]);
+        float32x4_t vv  = vld1q_f32 (&val[i]);
+        float32x4_t vdiff = vsubq_f32 (vv, vx);
+
+        float32x4_t vd  = vmulq_f32 (vdiff, vrate);
+        float32x4_t vdh = vmlaq_f32 (vdx, vad, vsubq_f32 (vd, vdx));
+        float32x4_t vr  = vmlaq_f32 (vwmin, vwbeta, vabsq_f32 (vdh));
+
+        /* 1 / (1 + r): reciprocal estimate + 2 Newton-Raphson steps */
+        float32x4_t vden = vaddq_f32 (vone, vr);
+        float32x4_t vinv = vrecpeq_f32 (vden);
+        vinv = vmulq_f32 (vrecpsq_f32 (vden, vinv), vinv);
+        vinv = vmulq_f32 (vrecpsq_f32 (vden, vinv), vinv);
+        float32x4_t va  = vmulq_f32 (vr, vinv);
+
+        vx = vmlaq_f32 (vx, va, vdiff);
+        vst1q_f32 (&dx[i],  vdh);
+        vst1q_f32 (&x[i],   vx);
+        vst1q_f32 (&val[i], vx);
+    }
+#endif
+
+    for (; i < num; i ++)
+        val[i] = one_euro_scalar (&x[i], &dx[i], val[i], rate, ad, w_min, w_beta);
+}
+
+
+/* -------------------------------------------------- *
+ *  Kalman (constant velocity, white noise acceleration)
+ *
+ *   predict:  x  += v * dt
+ *             P   = F P F' + Q
+ *   update :  K   = P H' / (H P H' + R),  H = [1 0]
+ *             x  += K (val - x)
+ *             P   = (I - K H) P
+ * -------------------------------------------------- */
+static inline float
+kalman_scalar (float *x, float *v, float *p00, float *p01, float *p11, float val,
+               float dt, float q00, float q01, float q11, float r)
+{
+    /* predict */
+    float px   = *x + *v * dt;
+    float p11p = *p11 + q11;
+    float p01p = *p01 + dt * *p11 + q01;
+    float p00p = *p00 + dt * (*p01 + p01p) + q00;
+
+    /* update */
+    float inv_s = 1.0f / (p00p + r);
+    float k0 = p00p * inv_s;
+    float k1 = p01p * inv_s;
+    float y  = val - px;
+
+    *x   = px + k0 * y;
+    *v   = *v + k1 * y;
+    *p00 = p00p - k0 * p00p;
+    *p01 = p01p - k0 * p01p;
+    *p11 = p11p - k1 * p01p;
+    return *x;
+}
+
+static void
+apply_kalman (lmfilter_t *filter, const lmfilter_param_t *param, float *val, float dt)
+{
+    float *x   = filter->x;
+    float *v   = filter->dx;
+    float *p00 = filter->p00;
+    float *p01 = filter->p01;
+    float *p11 = filter->p11;
+    float q   = param->process_noise;
+    float q00 = q * dt * dt * dt * dt * 0.25f;
+    float q01 = q * dt * dt * dt * 0.5f;
+    float q11 = q * dt * dt;
+    float r   = param->measure_noise;
+    int   num = filter->num;
+    int   i = 0;
+
+    /*
+     *  P01 of the prediction is  p01 + dt * p11 + q01, and
+     *  P00 is  p00 + dt * (2 * p01 + dt * p11) + q00 = p00 + dt * (p01 + P01) + (q00 - dt * q01).
+     *  (the scalar code uses the same form to get the same result)
+     */
+    q00 -= dt * q01;
+
+#if defined (LMFILTER_SSE2)
+    __m128 vdt  = _mm_set1_ps (dt);
+    __m128 vq00 = _mm_set1_ps (q00);
+    __m128 vq01 = _mm_set1_ps (q01);
+    __m128 vq11 = _mm_set1_ps (q11);
+    __m128 vr   = _mm_set1_ps (r);
+    __m128 vone = _mm_set1_ps (1.0f);
+
+    for (; i + 4 <= num; i += 4)
+    {
+        __m128 vx   = _mm_loadu_ps (&x[i]);
+        __m128 vv   = _mm_loadu_ps (&v[i]);
+        __m128 v00  = _mm_loadu_ps (&p00[i]);
+        __m128 v01  = _mm_loadu_ps (&p01[i]);
+        __m128 v11  = _mm_loadu_ps (&p11[i]);
+
+        __m128 px   = _mm_add_ps (vx, _mm_mul_ps (vv, vdt));
+        __m128 p11p = _mm_add_ps (v11, vq11);
+        __m128 p01p = _mm_add_ps (_mm_add_ps (v01, _mm_mul_ps (vdt, v11)), vq01);
+        __m128 p00p = _mm_add_ps (_mm_add_ps (v00, _mm_mul_ps (vdt, _mm_add_ps (v01, p01p))), vq00);
+
+        __m128 inv_s = _mm_div_ps (vone, _mm_add_ps (p00p, vr));
+        __m128 k0 = _mm_mul_ps (p00p, inv_s);
+        __m128 k1 = _mm_mul_ps (p01p, inv_s);
+        __m128 y  = _mm_sub_ps (_mm_loadu_ps (&val[i]), px);
+
+        vx = _mm_add_ps (px, _mm_mul_ps (k0, y));
+        _mm_storeu_ps (&x[i],   vx);
+        _mm_storeu_ps (&val[i], vx);
+        _mm_storeu_ps (&v[i],   _mm_add_ps (vv, _mm_mul_ps (k1, y)));
+        _mm_storeu_ps (&p00[i], _mm_sub_ps (p00p, _mm_mul_ps (k0, p00p)));
+        _mm_storeu_ps (&p01[i], _mm_sub_ps (p01p, _mm_mul_ps (k0, p01p)));
+        _mm_storeu_ps (&p11[i], _mm_sub_ps (p11p, _mm_mul_ps (k1, p01p)));
+    }
+#elif defined (LMFILTER_NEON)
+    float32x4_t vdt  = vdupq_n_f32 (dt);
+    float32x4_t vq00 = vdupq_n_f32 (q00);
+    float32x4_t vq01 = vdupq_n_f32 (q01);
+    float32x4_t vq11 = vdupq_n_f32 (q11);
+    float32x4_t vr   = vdupq_n_f32 (r);
+
+    for (; i + 4 <= num; i += 4)
+    {
+        float32x4_t vx   = vld1q_f32 (&x[i]);
+        float32x4_t vv   = vld1q_f32 (&v[i]);
+        float32x4_t v00  = vld1q_f32 (&p00[i]);
+        float32x4_t v01  = vld1q_f32 (&p01[i]);
+        float32x4_t v11  = vld1q_f32 (&p11[i]);
+
+        float32x4_t px   = vmlaq_f32 (vx, vv, vdt);
+        float32x4_t p11p = vaddq_f32 (v11, vq11);
+        float32x4_t p01p = vaddq_f32 (vmlaq_f32 (v01, vdt, v11), vq01);
+        float32x4_t p00p = vaddq_f32 (vmlaq_f32 (v00, vdt, vaddq_f32 (v01, p01p)), vq00);
+
+        /* 1 / S: reciprocal estimate + 2 Newton-Raphson steps */
+        float32x4_t vs    = vaddq_f32 (p00p, vr);
+        float32x4_t inv_s = vrecpeq_f32 (vs);
+        inv_s = vmulq_f32 (vrecpsq_f32 (vs, inv_s), inv_s);
+        inv_s = vmulq_f32 (vrecpsq_f32 (vs, inv_s), inv_s);
+
+        float32x4_t k0 = vmulq_f32 (p00p, inv_s);
+        float32x4_t k1 = vmulq_f32 (p01p, inv_s);
+        float32x4_t y  = vsubq_f32 (vld1q_f32 (&val[i]), px);
+
+        vx = vmlaq_f32 (px, k0, y);
+        vst1q_f32 (&x[i],   vx);
+        vst1q_f32 (&val[i], vx);
+        vst1q_f32 (&v[i],   vmlaq_f32 (vv, k1, y));
+        vst1q_f32 (&p00[i], vmlsq_f32 (p00p, k0, p00p));
+        vst1q_f32 (&p01[i], vmlsq_f32 (p01p, k0, p01p));
+        vst1q_f32 (&p11[i], vmlsq_f32 (p11p, k1, p01p));
+    }
+#endif
+
+    for (; i < num; i ++)
+    {
+        val[i] = kalman_scalar (&x[i], &v[i], &p00[i], &p01[i], &p11[i], val[i],
+                                dt, q00, q01, q11, r);
+    }
+}
+
+
+void
+lmfilter_apply (lmfilter_t *filter, const lmfilter_param_t *param, float *val, double time_ms)
+{
+    if (param->type == LMFILTER_NONE)
+        return;
+
+    if (!filter->valid || time_ms - filter->time_ms > param->reset_ms)
+    {
+        start_track (filter, param, val, time_ms);
+        return;
+    }
+
+    float dt = (float)((time_ms - filter->time_ms) / 1000.0);
+    if (dt < DT_MIN)
+        dt = DT_MIN;
+    filter->time_ms = time_ms;
+
+    switch (param->type)
+    {
+    case LMFILTER_ONE_EURO:
+        apply_one_euro (filter, param, val, dt);
+        break;
+    case LMFILTER_KALMAN:
+        apply_kalman (filter, param, val, dt);
+        break;
+    default:
+        break;
+    }
+}
+
+
+int
+lmfilter_predict (lmfilter_t *filter, const lmfilter_param_t *param, float *val, double time_ms)
+{
+    if (param->type == LMFILTER_NONE || !filter->valid)
+        return -1;
+
+    /* hold the values if the track is too old to extrapolate */
+    double elapsed = time_ms - filter->time_ms;
+    if (elapsed > param->reset_ms)
+        elapsed = 0;
+
+    float dt = (float)(elapsed / 1000.0);
+    for (int i = 0; i < filter->num; i ++)
+        val[i] = filter->x[i] + filter->dx[i] * dt;
+
+    return 0;
+}
+
+
+/* -------------------------------------------------- *
+ *  tracks
+ * -------------------------------------------------- */
+int
+lmfilter_init_bank (lmfilter_bank_t *bank, const lmfilter_param_t *param, int num_tracks, int num)
+{
+    memset (bank, 0, sizeof (*bank));
+
+    if (num_tracks > LMFILTER_MAX_TRACK)
+        num_tracks = LMFILTER_MAX_TRACK;
+
+    bank->param      = *param;
+    bank->num_tracks = num_tracks;
+
+    for (int i = 0; i < num_tracks; i ++)
+    {
+        if (lmfilter_init (&bank->filter[i], num) < 0)
+        {
+            DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+            lmfilter_destroy_bank (bank);
+            return -1;
+        }
+        bank->track_id[i] = -1;
+    }
+
+    return 0;
+}
+
+void
+lmfilter_destroy_bank (lmfilter_bank_t *bank)
+{
+    for (int i = 0; i < bank->num_tracks; i ++)
+        lmfilter_destroy (&bank->filter[i]);
+
+    memset (bank, 0, sizeof (*bank));
+}
+
+void
+lmfilter_bank_apply (lmfilter_bank_t *bank, int track_id, float *val, double time_ms)
+{
+    int slot = -1;
+
+    if (bank->num_tracks <= 0)
+        return;
+
+    for (int i = 0; i < bank->num_tracks; i ++)
+    {
+        if (bank->track_id[i] == track_id)
+        {
+            slot = i;
+            break;
+        }
+    }
+
+    /* take over the unused track, or the oldest one */
+    if (slot < 0)
+    {
+        slot = 0;
+        for (int i = 0; i < bank->num_tracks; i ++)
+        {
+            lmfilter_t *f = &bank->filter[i];
+            if (!f->valid)
+            {
+                slot = i;
+                break;
+            }
+            if (f->time_ms < bank->filter[slot].time_ms)
+                slot = i;
+        }
+
+        bank->track_id[slot] = track_id;
+        lmfilter_reset (&bank->filter[slot]);
+    }
+
+    lmfilter_apply (&bank->filter[slot], &bank->param, val, time_ms);
+}
+
+int
+lmfilter_bank_predict (lmfilter_bank_t *bank, int track_id, float *val, double time_ms)
+{
+    for (int i = 0; i < bank->num_tracks; i ++)
+    {
+        if (bank->track_id[i] == track_id)
+            return lmfilter_predict (&bank->filter[i], &bank->param, val, time_ms);
+    }
+
+    return -1;
+}
+
+
+/* -------------------------------------------------- *
+ *  ROI <--> image coordinates
+ * -------------------------------------------------- */
+void
+lmfilter_roi_to_image (const lmfilter_roi_t *roi, float *xyz, int num)
+{
+    float c = cosf (roi->rotation);
+    float s = sinf (roi->rotation);
+
+    for (int i = 0; i < num; i ++, xyz += 3)
+    {
+        float x = (xyz[0] - 0.5f) * roi->w;
+        float y = (xyz[1] - 0.5f) * roi->h;
+
+        xyz[0] = roi->cx + c * x - s * y;
+        xyz[1] = roi->cy + s * x + c * y;
+        xyz[2] = xyz[2] * roi->w;
+    }
+}
+
+void
+lmfilter_image_to_roi (const lmfilter_roi_t *roi, float *xyz, int num)
+{
+    float c = cosf (roi->rotation);
+    float s = sinf (roi->rotation);
+
+    if (roi->w == 0.0f || roi->h == 0.0f)
+        return;
+
+    for (int i = 0; i < num; i ++, xyz += 3)
+    {
+        float x = xyz[0] - roi->cx;
+        float y = xyz[1] - roi->cy;
+
+        xyz[0] = ( c * x + s * y) / roi->w + 0.5f;
+        xyz[1] = (-s * x + c * y) / roi->h + 0.5f;
+        xyz[2] = xyz[2] / roi->w;
+    }
+}
+
+
+/* -------------------------------------------------- *
+ *  track ids of the detections
+ * -------------------------------------------------- */
+void
+lmfilter_init_tracker (lmfilter_tracker_t *tracker)
+{
+    memset (tracker, 0, sizeof (*tracker));
+}
+
+static float
+calc_box_iou (const float *a, const float *b)
+{
+    float ix0 = fmaxf (a[0] - 0.5f * a[2], b[0] - 0.5f * b[2]);
+    float iy0 = fmaxf (a[1] - 0.5f * a[3], b[1] - 0.5f * b[3]);
+    float ix1 = fminf (a[0] + 0.5f * a[2], b[0] + 0.5f * b[2]);
+    float iy1 = fminf (a[1] + 0.5f * a[3], b[1] + 0.5f * b[3]);
+    float iw  = fmaxf (ix1 - ix0, 0.0f);
+    float ih  = fmaxf (iy1 - iy0, 0.0f);
+
+    float intersection = iw * ih;
+    float area_union   = a[2] * a[3] + b[2] * b[3] - intersection;
+    if (area_union <= 0.0f)
+        return 0.0f;
+
+    return intersection / area_union;
+}
+
+void
+lmfilter_assign_tracks (lmfilter_tracker_t *tracker, float (*box)[4], int num, float iou_min,
+                        int *track_id)
+{
+    int prev_used[LMFILTER_MAX_TRACK] = {0};
+
+    for (int i = 0; i < num; i ++)
+        track_id[i] = -1;
+
+    /* greedy matching: the pair with the largest IoU first */
+    for (;;)
+    {
+        float best_iou = iou_min;
+        int   best_cur = -1;
+        int   best_prev = -1;
+
+        for (int i = 0; i < num; i ++)
+        {
+            if (track_id[i] >= 0)
+                continue;
+
+            for (int j = 0; j < tracker->num; j ++)
+            {
+                if (prev_used[j])
+                    continue;
+
+                float iou = calc_box_iou (box[i], tracker->box[j]);
+                if (iou >= best_iou)
+                {
+                    best_iou  = iou;
+                    best_cur  = i;
+                    best_prev = j;
+                }
+            }
+        }
+
+        if (best_cur < 0)
+            break;
+
+        track_id[best_cur]  = tracker->track_id[best_prev];
+        prev_used[best_prev] = 1;
+    }
+
+    /* the subjects which have just appeared */
+    for (int i = 0; i < num; i ++)
+    {
+        if (track_id[i] < 0)
+            track_id[i] = tracker->next_id ++;
+    }
+
+    tracker->num = (num < LMFILTER_MAX_TRACK) ? num : LMFILTER_MAX_TRACK;
+    for (int i = 0; i < tracker->num; i ++)
+    {
+        tracker->track_id[i] = track_id[i];
+        memcpy (tracker->box[i], box[i], sizeof (tracker->box[i]));
+    }
+}
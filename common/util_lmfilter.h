@@ -0,0 +1,138 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_LMFILTER_H_
+#define _UTIL_LMFILTER_H_
+
+/*
+ *  temporal smoothing of the landmarks (facemesh, handpose, blazepose, ...).
+ *
+ *  the landmarks of a track are given as one contiguous float array, and
+ *  every value is filtered independently, 4 values at a time (SSE2/NEON).
+ *  the filter state is kept in the separate arrays (SoA), so a landmark
+ *  array of fvec3 can be passed as it is.
+ *
+ *   - One-Euro : low pass filter whose cutoff rises with the speed.
+ *                (Casiez et al, "1 Euro Filter", CHI 2012)
+ *   - Kalman   : constant velocity model per value.
+ *
+ *  the time is given in [ms], so the frames may be skipped or come at
+ *  irregular intervals.
+ */
+#define LMFILTER_NONE       0
+#define LMFILTER_ONE_EURO   1
+#define LMFILTER_KALMAN     2
+
+#define LMFILTER_MAX_TRACK  8
+
+typedef struct _lmfilter_param_t
+{
+    int     type;
+
+    /* One-Euro */
+    float   min_cutoff;     /* [Hz] cutoff at rest                            */
+    float   beta;           /* cutoff gain of the speed  [Hz / (value/sec)]   */
+    float   d_cutoff;       /* [Hz] cutoff of the speed                       */
+
+    /* Kalman */
+    float   process_noise;  /* variance of the acceleration [(value/sec^2)^2] */
+    float   measure_noise;  /* variance of the measurement  [value^2]         */
+
+    /* the track restarts if no value comes in this time */
+    float   reset_ms;
+} lmfilter_param_t;
+
+typedef struct _lmfilter_t
+{
+    int     num;            /* number of the values          */
+    int     valid;          /* 0 until the first value comes */
+    double  time_ms;        /* time of the last value        */
+
+    float   *x;             /* [num] filtered value                */
+    float   *dx;            /* [num] filtered speed / velocity     */
+    float   *p00;           /* [num] covariance (Kalman only)      */
+    float   *p01;           /* [num]                               */
+    float   *p11;           /* [num]                               */
+} lmfilter_t;
+
+typedef struct _lmfilter_bank_t
+{
+    lmfilter_param_t param;
+    int         num_tracks;
+    int         track_id[LMFILTER_MAX_TRACK];
+    lmfilter_t  filter  [LMFILTER_MAX_TRACK];
+} lmfilter_bank_t;
+
+/* rotated ROI the landmarks of a model are normalized in */
+typedef struct _lmfilter_roi_t
+{
+    float   cx, cy;         /* center   (normalized image coordinates) */
+    float   w,  h;          /* size     (normalized image coordinates) */
+    float   rotation;       /* [rad] */
+} lmfilter_roi_t;
+
+typedef struct _lmfilter_tracker_t
+{
+    int     num;                            /* number of the boxes of the last frame */
+    int     next_id;
+    int     track_id[LMFILTER_MAX_TRACK];
+    float   box     [LMFILTER_MAX_TRACK][4];/* (cx, cy, w, h) */
+} lmfilter_tracker_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void    lmfilter_default_param (lmfilter_param_t *param, int type);
+
+int     lmfilter_init    (lmfilter_t *filter, int num);
+void    lmfilter_destroy (lmfilter_t *filter);
+void    lmfilter_reset   (lmfilter_t *filter);
+
+/* filter (val[num]) in place */
+void    lmfilter_apply (lmfilter_t *filter, const lmfilter_param_t *param, float *val, double time_ms);
+
+/*
+ *  extrapolate the filtered values to (time_ms) with their speed, for the
+ *  frames without the inference. the filter state is not changed.
+ *  returns -1 (val is not touched) if the filter has no value yet.
+ */
+int     lmfilter_predict (lmfilter_t *filter, const lmfilter_param_t *param, float *val, double time_ms);
+
+
+/*
+ *  the filters of (num_tracks) tracks keyed by the track id.
+ *  a new track id takes over the track which was not updated for the longest time.
+ */
+int     lmfilter_init_bank    (lmfilter_bank_t *bank, const lmfilter_param_t *param, int num_tracks, int num);
+void    lmfilter_destroy_bank (lmfilter_bank_t *bank);
+
+void    lmfilter_bank_apply   (lmfilter_bank_t *bank, int track_id, float *val, double time_ms);
+int     lmfilter_bank_predict (lmfilter_bank_t *bank, int track_id, float *val, double time_ms);
+
+/*
+ *  the landmarks (xyz[num] of (x, y, z)) from/to the image coordinates:
+ *      image = center + rotate ((p - 0.5) * size),   z * w
+ *  filter the landmarks in the image coordinates, not in the ROI. the ROI
+ *  jumps (detection <--> tracking), and the landmarks in the ROI jump the
+ *  other way, so only the composed point is continuous.
+ */
+void    lmfilter_roi_to_image (const lmfilter_roi_t *roi, float *xyz, int num);
+void    lmfilter_image_to_roi (const lmfilter_roi_t *roi, float *xyz, int num);
+
+/*
+ *  the detections are sorted by the score, so their index changes from frame
+ *  to frame. box[i] (cx, cy, w, h) takes over the track id of the box of the
+ *  last frame which overlaps it most (IoU >= iou_min), or gets a new id.
+ *  a new id never matches a track in the bank, so its filter starts over.
+ */
+void    lmfilter_init_tracker  (lmfilter_tracker_t *tracker);
+void    lmfilter_assign_tracks (lmfilter_tracker_t *tracker, float (*box)[4], int num, float iou_min,
+                                int *track_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_LMFILTER_H_ */
@@ -0,0 +1,387 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "util_nms.h"
+#include "util_debug.h"
+
+#if defined (__SSE2__)
+#define NMS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define NMS_NEON
+#include <arm_neon.h>
+#endif
+
+
+/* -------------------------------------------------- *
+ *  boxes / anchors
+ * -------------------------------------------------- */
+int
+nms_init_boxes (nms_boxes_t *boxes, int max_num, int num_keys)
+{
+    int num_blend = 4 + num_keys * 2;
+    size_t size = 0;
+
+    size += sizeof (float) * max_num * 5;               /* score, x0, y0, x1, y1 */
+    size += sizeof (float) * max_num * num_keys * 2;    /* keys                  */
+    size += sizeof (int)   * max_num;                   /* index                 */
+    size += sizeof (nms_rank_t) * max_num;              /* rank                  */
+    size += sizeof (float) * max_num;                   /* area                  */
+    size += sizeof (float) * num_blend;                 /* blend                 */
+    size += sizeof (unsigned char) * max_num;           /* done                  */
+
+    char *buf = (char *)malloc (size);
+    if (buf == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    boxes->max_num  = max_num;
+    boxes->num_keys = num_keys;
+    boxes->num      = 0;
+
+    boxes->rank  = (nms_rank_t *)buf;  buf += sizeof (nms_rank_t) * max_num;
+    boxes->score = (float *)buf;       buf += sizeof (float) * max_num;
+    boxes->x0    = (float *)buf;       buf += sizeof (float) * max_num;
+    boxes->y0    = (float *)buf;       buf += sizeof (float) * max_num;
+    boxes->x1    = (float *)buf;       buf += sizeof (float) * max_num;
+    boxes->y1    = (float *)buf;       buf += sizeof (float) * max_num;
+    boxes->keys  = (float *)buf;       buf += sizeof (float) * max_num * num_keys * 2;
+    boxes->index = (int   *)buf;       buf += sizeof (int)   * max_num;
+    boxes->area  = (float *)buf;       buf += sizeof (float) * max_num;
+    boxes->blend = (float *)buf;       buf += sizeof (float) * num_blend;
+    boxes->done  = (unsigned char *)buf;
+
+    return 0;
+}
+
+void
+nms_destroy_boxes (nms_boxes_t *boxes)
+{
+    free (boxes->rank);     /* head of the buffer */
+    memset (boxes, 0, sizeof (*boxes));
+}
+
+float *
+nms_get_keys (nms_boxes_t *boxes, int box_idx)
+{
+    return &boxes->keys[box_idx * boxes->num_keys * 2];
+}
+
+int
+nms_init_anchors (nms_anchors_t *anchors, int num)
+{
+    anchors->cx = (float *)malloc (sizeof (float) * num * 2);
+    if (anchors->cx == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+    anchors->cy  = anchors->cx + num;
+    anchors->num = num;
+
+    return 0;
+}
+
+void
+nms_destroy_anchors (nms_anchors_t *anchors)
+{
+    free (anchors->cx);
+    memset (anchors, 0, sizeof (*anchors));
+}
+
+
+/* -------------------------------------------------- *
+ *  score thresholding
+ *   most of the anchors are below the threshold, so test 4 scores at a
+ *   time and look at the lanes only when one of them passes.
+ * -------------------------------------------------- */
+#define CMP_GE  0
+#define CMP_GT  1
+
+static inline int
+pass_score (float v, float thresh, int cmp)
+{
+    return (cmp == CMP_GE) ? (v >= thresh) : (v > thresh);
+}
+
+static int
+filter_scores (const float *scores, int num, float thresh, int cmp, int *idx, int max_idx)
+{
+    int num_sel = 0;
+    int i = 0;
+
+#if defined (NMS_SSE2)
+    __m128 vthresh = _mm_set1_ps (thresh);
+    for (; i + 4 <= num; i += 4)
+    {
+        __m128 v = _mm_loadu_ps (&scores[i]);
+        __m128 m = (cmp == CMP_GE) ? _mm_cmpge_ps (v, vthresh) : _mm_cmpgt_ps (v, vthresh);
+        int mask = _mm_movemask_ps (m);
+        if (mask == 0)
+            continue;
+
+        for (int j = 0; j < 4; j ++)
+        {
+            if ((mask & (1 << j)) && num_sel < max_idx)
+                idx[num_sel ++] = i + j;
+        }
+    }
+#elif defined (NMS_NEON)
+    float32x4_t vthresh = vdupq_n_f32 (thresh);
+    for (; i + 4 <= num; i += 4)
+    {
+        float32x4_t v = vld1q_f32 (&scores[i]);
+        uint32x4_t  m = (cmp == CMP_GE) ? vcgeq_f32 (v, vthresh) : vcgtq_f32 (v, vthresh);
+        uint32x2_t  m2 = vorr_u32 (vget_low_u32 (m), vget_high_u32 (m));
+        if ((vget_lane_u32 (m2, 0) | vget_lane_u32 (m2, 1)) == 0)
+            continue;
+
+        for (int j = 0; j < 4; j ++)
+        {
+            if (pass_score (scores[i + j], thresh, cmp) && num_sel < max_idx)
+                idx[num_sel ++] = i + j;
+        }
+    }
+#endif
+
+    for (; i < num; i ++)
+    {
+        if (pass_score (scores[i], thresh, cmp) && num_sel < max_idx)
+            idx[num_sel ++] = i;
+    }
+
+    return num_sel;
+}
+
+int
+nms_filter_scores (const float *scores, int num, float thresh, int *idx, int max_idx)
+{
+    return filter_scores (scores, num, thresh, CMP_GE, idx, max_idx);
+}
+
+int
+nms_filter_logits (const float *logits, int num, float thresh, int *idx, int max_idx)
+{
+    /* sigmoid (x) > t  <=>  x > log (t / (1 - t)) */
+    if (thresh <= 0.0f)
+        thresh = -INFINITY;
+    else if (thresh >= 1.0f)
+        return 0;
+    else
+        thresh = logf (thresh / (1.0f - thresh));
+
+    return filter_scores (logits, num, thresh, CMP_GT, idx, max_idx);
+}
+
+
+/* -------------------------------------------------- *
+ *  anchor decode
+ * -------------------------------------------------- */
+int
+nms_decode_anchors (nms_boxes_t *boxes, const nms_anchors_t *anchors,
+                    const float *logits, const float *regressors, int stride,
+                    float img_w, float img_h, float score_thresh)
+{
+    int num_keys = boxes->num_keys;
+    float sx = 1.0f / img_w;
+    float sy = 1.0f / img_h;
+
+    /* the sigmoid is evaluated only for the anchors above the threshold */
+    int num = nms_filter_logits (logits, anchors->num, score_thresh, boxes->index, boxes->max_num);
+
+    for (int i = 0; i < num; i ++)
+    {
+        int   a  = boxes->index[i];
+        float ax = anchors->cx[a];
+        float ay = anchors->cy[a];
+        const float *p = &regressors[a * stride];
+
+        float cx = (p[0] + ax) * sx;
+        float cy = (p[1] + ay) * sy;
+        float w  = p[2] * sx;
+        float h  = p[3] * sy;
+
+        boxes->score[i] = 1.0f / (1.0f + expf (-logits[a]));
+        boxes->x0[i] = cx - w * 0.5f;
+        boxes->y0[i] = cy - h * 0.5f;
+        boxes->x1[i] = cx + w * 0.5f;
+        boxes->y1[i] = cy + h * 0.5f;
+
+        float *keys = nms_get_keys (boxes, i);
+        for (int j = 0; j < num_keys; j ++)
+        {
+            keys[2 * j + 0] = (p[4 + 2 * j + 0] + ax) * sx;
+            keys[2 * j + 1] = (p[4 + 2 * j + 1] + ay) * sy;
+        }
+    }
+
+    boxes->num = num;
+    return num;
+}
+
+
+/* -------------------------------------------------- *
+ *  Apply NonMaxSuppression:
+ *      https://github.com/tensorflow/tfjs/blob/master/tfjs-core/src/ops/image_ops.ts
+ *      mediapipe/calculators/util/non_max_suppression_calculator.cc
+ * -------------------------------------------------- */
+static int
+compare_rank (const void *a, const void *b)
+{
+    const nms_rank_t *r0 = (const nms_rank_t *)a;
+    const nms_rank_t *r1 = (const nms_rank_t *)b;
+
+    if (r0->score > r1->score) return -1;
+    if (r0->score < r1->score) return  1;
+
+    /* keep the decode order for the same scores (as std::list::sort does) */
+    return r0->box_idx - r1->box_idx;
+}
+
+static void
+sort_boxes (nms_boxes_t *boxes)
+{
+    for (int i = 0; i < boxes->num; i ++)
+    {
+        float w = boxes->x1[i] - boxes->x0[i];
+        float h = boxes->y1[i] - boxes->y0[i];
+
+        boxes->rank[i].score   = boxes->score[i];
+        boxes->rank[i].box_idx = i;
+        boxes->area[i] = fabsf (w) * fabsf (h);
+        boxes->done[i] = 0;
+    }
+
+    qsort (boxes->rank, boxes->num, sizeof (nms_rank_t), compare_rank);
+}
+
+static float
+calc_intersection_over_union (nms_boxes_t *boxes, int i0, int i1)
+{
+    float area0 = boxes->area[i0];
+    float area1 = boxes->area[i1];
+    if (area0 <= 0 || area1 <= 0)
+        return 0.0f;
+
+    float xmin0 = fminf (boxes->x0[i0], boxes->x1[i0]);
+    float ymin0 = fminf (boxes->y0[i0], boxes->y1[i0]);
+    float xmax0 = fmaxf (boxes->x0[i0], boxes->x1[i0]);
+    float ymax0 = fmaxf (boxes->y0[i0], boxes->y1[i0]);
+    float xmin1 = fminf (boxes->x0[i1], boxes->x1[i1]);
+    float ymin1 = fminf (boxes->y0[i1], boxes->y1[i1]);
+    float xmax1 = fmaxf (boxes->x0[i1], boxes->x1[i1]);
+    float ymax1 = fmaxf (boxes->y0[i1], boxes->y1[i1]);
+
+    float intersect_w = fminf (xmax0, xmax1) - fmaxf (xmin0, xmin1);
+    float intersect_h = fminf (ymax0, ymax1) - fmaxf (ymin0, ymin1);
+    if (intersect_w <= 0 || intersect_h <= 0)
+        return 0.0f;
+
+    float intersect_area = intersect_w * intersect_h;
+    return intersect_area / (area0 + area1 - intersect_area);
+}
+
+int
+nms_hard (nms_boxes_t *boxes, float iou_thresh, int *sel, int max_sel)
+{
+    int num_sel = 0;
+
+    sort_boxes (boxes);
+
+    for (int i = 0; i < boxes->num && num_sel < max_sel; i ++)
+    {
+        int candidate = boxes->rank[i].box_idx;
+        int ignore_candidate = 0;
+
+        for (int j = num_sel - 1; j >= 0; j --)
+        {
+            float iou = calc_intersection_over_union (boxes, candidate, sel[j]);
+            if (iou >= iou_thresh)
+            {
+                ignore_candidate = 1;
+                break;
+            }
+        }
+
+        if (!ignore_candidate)
+            sel[num_sel ++] = candidate;
+    }
+
+    return num_sel;
+}
+
+static void
+blend_box (nms_boxes_t *boxes, int box_idx, float weight)
+{
+    float *blend = boxes->blend;
+    float *keys  = nms_get_keys (boxes, box_idx);
+
+    blend[0] += boxes->x0[box_idx] * weight;
+    blend[1] += boxes->y0[box_idx] * weight;
+    blend[2] += boxes->x1[box_idx] * weight;
+    blend[3] += boxes->y1[box_idx] * weight;
+    for (int k = 0; k < boxes->num_keys * 2; k ++)
+        blend[4 + k] += keys[k] * weight;
+}
+
+int
+nms_weighted (nms_boxes_t *boxes, float iou_thresh, int *sel, int max_sel)
+{
+    int num_blend = 4 + boxes->num_keys * 2;
+    float *blend  = boxes->blend;
+    int num_sel = 0;
+
+    sort_boxes (boxes);
+
+    for (int i = 0; i < boxes->num && num_sel < max_sel; i ++)
+    {
+        int top = boxes->rank[i].box_idx;
+        if (boxes->done[top])
+            continue;
+
+        /* the IoU is taken against the original (not blended) top box */
+        float total_score = boxes->score[top];
+        memset (blend, 0, sizeof (float) * num_blend);
+        blend_box (boxes, top, total_score);
+        boxes->done[top] = 1;
+
+        for (int j = i + 1; j < boxes->num; j ++)
+        {
+            int candidate = boxes->rank[j].box_idx;
+            if (boxes->done[candidate])
+                continue;
+
+            float iou = calc_intersection_over_union (boxes, top, candidate);
+            if (iou > iou_thresh)
+            {
+                total_score += boxes->score[candidate];
+                blend_box (boxes, candidate, boxes->score[candidate]);
+                boxes->done[candidate] = 1;
+            }
+        }
+
+        sel[num_sel ++] = top;
+        if (total_score <= 0)
+            continue;
+
+        /* the score of the top box is kept */
+        float *keys = nms_get_keys (boxes, top);
+        boxes->x0[top] = blend[0] / total_score;
+        boxes->y0[top] = blend[1] / total_score;
+        boxes->x1[top] = blend[2] / total_score;
+        boxes->y1[top] = blend[3] / total_score;
+        for (int k = 0; k < boxes->num_keys * 2; k ++)
+            keys[k] = blend[4 + k] / total_score;
+    }
+
+    return num_sel;
+}
@@ -0,0 +1,94 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_NMS_H_
+#define _UTIL_NMS_H_
+
+/*
+ *  detection post-process shared by the SSD/anchor based apps.
+ *
+ *  the candidate boxes are kept as SoA, so that the score thresholding and
+ *  the IoU loop run over flat arrays instead of std::list<xxx_t>.
+ *  the apps fill the boxes (or let nms_decode_anchors() do it), run
+ *  nms_hard() or nms_weighted(), and pack their own result structs from
+ *  the selected box indices.
+ */
+typedef struct _nms_rank_t
+{
+    float   score;
+    int     box_idx;
+} nms_rank_t;
+
+typedef struct _nms_boxes_t
+{
+    int     max_num;        /* capacity                              */
+    int     num_keys;       /* keypoints per box                     */
+    int     num;            /* number of valid boxes                 */
+
+    float   *score;
+    float   *x0, *y0;       /* topleft  (normalized)                 */
+    float   *x1, *y1;       /* btmright (normalized)                 */
+    float   *keys;          /* [max_num][num_keys][2]  (normalized)  */
+    int     *index;         /* anchor (or grid cell) of each box     */
+
+    /* scratch for the NMS */
+    nms_rank_t *rank;
+    float   *area;
+    float   *blend;         /* [4 + num_keys * 2] */
+    unsigned char *done;
+} nms_boxes_t;
+
+/* anchor centers in the pixel coordinates of the model input */
+typedef struct _nms_anchors_t
+{
+    int     num;
+    float   *cx;
+    float   *cy;
+} nms_anchors_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int     nms_init_boxes    (nms_boxes_t *boxes, int max_num, int num_keys);
+void    nms_destroy_boxes (nms_boxes_t *boxes);
+
+int     nms_init_anchors    (nms_anchors_t *anchors, int num);
+void    nms_destroy_anchors (nms_anchors_t *anchors);
+
+float  *nms_get_keys (nms_boxes_t *boxes, int box_idx);
+
+/*
+ *  write the indices of the scores above the threshold to idx[] and return the count.
+ *    nms_filter_scores(): score >= thresh                (the scores are probabilities)
+ *    nms_filter_logits(): sigmoid (logit) > thresh      (compared in the logit domain)
+ */
+int     nms_filter_scores (const float *scores, int num, float thresh, int *idx, int max_idx);
+int     nms_filter_logits (const float *logits, int num, float thresh, int *idx, int max_idx);
+
+/*
+ *  MediaPipe style center-size decode (BlazeFace, BlazePalm, BlazePose).
+ *    regressors[anchor * stride + 0..3] : cx, cy, w, h    (pixels, relative to the anchor)
+ *    regressors[anchor * stride + 4.. ] : keypoints x, y (pixels, relative to the anchor)
+ *  the boxes and keys are normalized by (img_w, img_h).
+ */
+int     nms_decode_anchors (nms_boxes_t *boxes, const nms_anchors_t *anchors,
+                            const float *logits, const float *regressors, int stride,
+                            float img_w, float img_h, float score_thresh);
+
+/*
+ *  write the selected box indices (in the descending score order) to sel[],
+ *  and return the count (at most max_sel).
+ *    nms_hard()    : drop the boxes overlapping a higher score box (IoU >= iou_thresh).
+ *    nms_weighted(): blend the overlapping boxes and keys into the highest score box,
+ *                    weighted by the scores. (the blended box is written in place)
+ */
+int     nms_hard     (nms_boxes_t *boxes, float iou_thresh, int *sel, int max_sel);
+int     nms_weighted (nms_boxes_t *boxes, float iou_thresh, int *sel, int max_sel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_NMS_H_ */
@@ -0,0 +1,288 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "util_pipeline.h"
+#include "util_debug.h"
+
+#define STAGE_AVERAGE_WEIGHT    0.1     /* weight of the latest stage time */
+
+
+static double
+get_time_ms ()
+{
+    struct timespec tv;
+    clock_gettime (CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec * 1000.0 + tv.tv_nsec / 1000000.0);
+}
+
+
+/* -------------------------------------------------- *
+ *  bounded queue
+ * -------------------------------------------------- */
+static void
+queue_init (pipeline_queue_t *q)
+{
+    memset (q, 0, sizeof (*q));
+    pthread_mutex_init (&q->mutex, NULL);
+    pthread_cond_init  (&q->cond,  NULL);
+}
+
+static void
+queue_destroy (pipeline_queue_t *q)
+{
+    pthread_mutex_destroy (&q->mutex);
+    pthread_cond_destroy  (&q->cond);
+}
+
+static int
+queue_push (pipeline_queue_t *q, void *item)
+{
+    pthread_mutex_lock (&q->mutex);
+
+    /* never blocks: every queue can hold all the frame contexts. */
+    if (q->count >= PIPELINE_MAX_FRAMES)
+    {
+        pthread_mutex_unlock (&q->mutex);
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    q->items[(q->head + q->count) % PIPELINE_MAX_FRAMES] = item;
+    q->count ++;
+
+    pthread_cond_signal (&q->cond);
+    pthread_mutex_unlock (&q->mutex);
+    return 0;
+}
+
+/* returns NULL if the queue is empty (non-blocking) or closed */
+static void *
+queue_pop (pipeline_queue_t *q, int block)
+{
+    void *item = NULL;
+
+    pthread_mutex_lock (&q->mutex);
+
+    while (block && q->count == 0 && !q->closed)
+        pthread_cond_wait (&q->cond, &q->mutex);
+
+    if (q->count > 0)
+    {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % PIPELINE_MAX_FRAMES;
+        q->count --;
+    }
+
+    pthread_mutex_unlock (&q->mutex);
+    return item;
+}
+
+static void
+queue_close (pipeline_queue_t *q)
+{
+    pthread_mutex_lock (&q->mutex);
+    q->closed = 1;
+    pthread_cond_broadcast (&q->cond);
+    pthread_mutex_unlock (&q->mutex);
+}
+
+
+/* -------------------------------------------------- *
+ *  frame contexts
+ * -------------------------------------------------- */
+void *
+pipeline_get_frame (pipeline_t *pl, int idx)
+{
+    if (idx < 0 || idx >= pl->num_frames)
+        return NULL;
+
+    return pl->frame_pool + idx * pl->frame_size;
+}
+
+static int
+get_frame_index (pipeline_t *pl, void *frame)
+{
+    return ((unsigned char *)frame - pl->frame_pool) / pl->frame_size;
+}
+
+int
+pipeline_frame_failed (pipeline_t *pl, void *frame)
+{
+    return pl->frame_failed[get_frame_index (pl, frame)];
+}
+
+
+/* -------------------------------------------------- *
+ *  stage worker
+ * -------------------------------------------------- */
+static void *
+stage_thread_main (void *arg)
+{
+    pipeline_stage_t *stage = (pipeline_stage_t *)arg;
+    pipeline_t       *pl    = stage->pl;
+    pipeline_queue_t *inq   = &pl->queues[stage->idx];
+    pipeline_queue_t *outq  = &pl->queues[stage->idx + 1];
+
+    while (1)
+    {
+        void *frame = queue_pop (inq, 1);
+        if (frame == NULL)
+            break;                  /* closed */
+
+        int fidx = get_frame_index (pl, frame);
+
+        double t0 = get_time_ms ();
+        if (stage->func (frame, stage->usr) != 0)
+            pl->frame_failed[fidx] = 1;
+        double t1 = get_time_ms ();
+
+        /* stage times are read by pipeline_get_stage_time() under the same lock */
+        pthread_mutex_lock (&inq->mutex);
+        stage->last_ms = t1 - t0;
+        if (stage->avg_ms == 0)
+            stage->avg_ms = stage->last_ms;
+        else
+            stage->avg_ms += (stage->last_ms - stage->avg_ms) * STAGE_AVERAGE_WEIGHT;
+        pthread_mutex_unlock (&inq->mutex);
+
+        queue_push (outq, frame);
+    }
+
+    return NULL;
+}
+
+
+/* -------------------------------------------------- *
+ *  API
+ * -------------------------------------------------- */
+int
+pipeline_init (pipeline_t *pl, int num_frames, int frame_size)
+{
+    memset (pl, 0, sizeof (*pl));
+
+    if (num_frames <= 0 || num_frames > PIPELINE_MAX_FRAMES)
+    {
+        DBG_LOGE ("ERR: %s(%d): num_frames must be 1..%d\n", __FILE__, __LINE__, PIPELINE_MAX_FRAMES);
+        return -1;
+    }
+
+    pl->num_frames   = num_frames;
+    pl->frame_size   = frame_size;
+    pl->frame_pool   = (unsigned char *)calloc (num_frames, frame_size);
+    pl->frame_failed = (int *)calloc (num_frames, sizeof (int));
+    if (pl->frame_pool == NULL || pl->frame_failed == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    for (int i = 0; i <= PIPELINE_MAX_STAGES; i ++)
+        queue_init (&pl->queues[i]);
+
+    queue_init (&pl->free_queue);
+    for (int i = 0; i < num_frames; i ++)
+        queue_push (&pl->free_queue, pipeline_get_frame (pl, i));
+
+    return 0;
+}
+
+int
+pipeline_add_stage (pipeline_t *pl, const char *name, pipeline_func_t func, void *usr)
+{
+    if (pl->num_stages >= PIPELINE_MAX_STAGES)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    pipeline_stage_t *stage = &pl->stages[pl->num_stages];
+    snprintf (stage->name, sizeof (stage->name), "%s", name);
+    stage->func = func;
+    stage->usr  = usr;
+    stage->pl   = pl;
+    stage->idx  = pl->num_stages;
+
+    pl->num_stages ++;
+    return 0;
+}
+
+int
+pipeline_start (pipeline_t *pl)
+{
+    for (int i = 0; i < pl->num_stages; i ++)
+    {
+        pipeline_stage_t *stage = &pl->stages[i];
+        if (pthread_create (&stage->thread, NULL, stage_thread_main, stage) != 0)
+        {
+            DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* let the stages drain the queued frames, then join them. */
+int
+pipeline_stop (pipeline_t *pl)
+{
+    for (int i = 0; i < pl->num_stages; i ++)
+    {
+        queue_close (&pl->queues[i]);
+        pthread_join (pl->stages[i].thread, NULL);
+    }
+
+    for (int i = 0; i <= PIPELINE_MAX_STAGES; i ++)
+        queue_destroy (&pl->queues[i]);
+    queue_destroy (&pl->free_queue);
+
+    free (pl->frame_pool);
+    free (pl->frame_failed);
+    memset (pl, 0, sizeof (*pl));
+    return 0;
+}
+
+void *
+pipeline_acquire_frame (pipeline_t *pl, int block)
+{
+    void *frame = queue_pop (&pl->free_queue, block);
+    if (frame)
+        pl->frame_failed[get_frame_index (pl, frame)] = 0;
+
+    return frame;
+}
+
+int
+pipeline_submit_frame (pipeline_t *pl, void *frame)
+{
+    return queue_push (&pl->queues[0], frame);
+}
+
+void *
+pipeline_poll_frame (pipeline_t *pl, int block)
+{
+    return queue_pop (&pl->queues[pl->num_stages], block);
+}
+
+int
+pipeline_release_frame (pipeline_t *pl, void *frame)
+{
+    return queue_push (&pl->free_queue, frame);
+}
+
+int
+pipeline_get_stage_time (pipeline_t *pl, int stage_idx, double *last_ms, double *avg_ms)
+{
+    if (stage_idx < 0 || stage_idx >= pl->num_stages)
+        return -1;
+
+    pthread_mutex_lock (&pl->queues[stage_idx].mutex);
+    *last_ms = pl->stages[stage_idx].last_ms;
+    *avg_ms  = pl->stages[stage_idx].avg_ms;
+    pthread_mutex_unlock (&pl->queues[stage_idx].mutex);
+    return 0;
+}
@@ -0,0 +1,90 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_PIPELINE_H_
+#define _UTIL_PIPELINE_H_
+
+#include <pthread.h>
+
+#define PIPELINE_MAX_STAGES     4
+#define PIPELINE_MAX_FRAMES     8
+
+/*
+ *  bounded FIFO of frame contexts.
+ */
+typedef struct _pipeline_queue_t
+{
+    void            *items[PIPELINE_MAX_FRAMES];
+    int             head;
+    int             count;
+    int             closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+} pipeline_queue_t;
+
+/*
+ *  a stage runs func() for each frame context on its own worker thread.
+ *  return value other than 0 marks the frame as failed, but it still flows
+ *  down to the next stages (they can check pipeline_frame_failed()).
+ */
+typedef int (*pipeline_func_t) (void *frame, void *usr);
+
+typedef struct _pipeline_stage_t
+{
+    char            name[32];
+    pipeline_func_t func;
+    void            *usr;
+    pthread_t       thread;
+    struct _pipeline_t *pl;
+    int             idx;
+
+    double          last_ms;        /* time of the latest func() */
+    double          avg_ms;         /* moving average of func()  */
+} pipeline_stage_t;
+
+/*
+ *  frame contexts cycle through the queues:
+ *
+ *    free --(acquire/submit)--> q[0] --stage0--> q[1] --stage1--> ... q[N] --(poll/release)--> free
+ */
+typedef struct _pipeline_t
+{
+    int              num_stages;
+    pipeline_stage_t stages[PIPELINE_MAX_STAGES];
+    pipeline_queue_t queues[PIPELINE_MAX_STAGES + 1];
+    pipeline_queue_t free_queue;
+
+    int              num_frames;
+    int              frame_size;
+    unsigned char    *frame_pool;
+    int              *frame_failed;
+} pipeline_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int   pipeline_init (pipeline_t *pl, int num_frames, int frame_size);
+int   pipeline_add_stage (pipeline_t *pl, const char *name, pipeline_func_t func, void *usr);
+int   pipeline_start (pipeline_t *pl);
+int   pipeline_stop (pipeline_t *pl);
+
+void *pipeline_get_frame (pipeline_t *pl, int idx);
+
+/* producer side: take a free context, fill it and push it into the first stage */
+void *pipeline_acquire_frame (pipeline_t *pl, int block);
+int   pipeline_submit_frame (pipeline_t *pl, void *frame);
+
+/* consumer side: take a context which went through all stages, and return it */
+void *pipeline_poll_frame (pipeline_t *pl, int block);
+int   pipeline_release_frame (pipeline_t *pl, void *frame);
+
+int   pipeline_frame_failed (pipeline_t *pl, void *frame);
+int   pipeline_get_stage_time (pipeline_t *pl, int stage_idx, double *last_ms, double *avg_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_PIPELINE_H_ */
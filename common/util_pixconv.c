@@ -0,0 +1,444 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "util_pixconv.h"
+#include "util_debug.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+#define PIXCONV_X86
+#include <immintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define PIXCONV_NEON
+#include <arm_neon.h>
+#endif
+
+
+/*
+ *  out[c] = pixel[c] * scale[c] + bias[c]
+ *      scale = 1 / std,  bias = -mean / std
+ */
+typedef void (*rgba8_to_fp32_func_t) (const uint8_t *src, int num_pix, float *dst,
+                                      const float *scale, const float *bias, int dst_ch);
+typedef void (*rgba8_to_rgb8_func_t) (const uint8_t *src, int num_pix, uint8_t *dst);
+
+static rgba8_to_fp32_func_t s_rgba8_to_fp32;
+static rgba8_to_rgb8_func_t s_rgba8_to_rgb8;
+static const char          *s_simd_str;
+static pthread_once_t       s_select_once = PTHREAD_ONCE_INIT;
+
+
+/* -------------------------------------------------- *
+ *  C reference
+ * -------------------------------------------------- */
+static void
+rgba8_to_fp32_c (const uint8_t *src, int num_pix, float *dst,
+                 const float *scale, const float *bias, int dst_ch)
+{
+    for (int i = 0; i < num_pix; i ++)
+    {
+        dst[0] = src[0] * scale[0] + bias[0];
+        dst[1] = src[1] * scale[1] + bias[1];
+        dst[2] = src[2] * scale[2] + bias[2];
+        if (dst_ch == 4)
+            dst[3] = 0.0f;
+        src += 4;
+        dst += dst_ch;
+    }
+}
+
+static void
+rgba8_to_rgb8_c (const uint8_t *src, int num_pix, uint8_t *dst)
+{
+    for (int i = 0; i < num_pix; i ++)
+    {
+        *dst ++ = *src ++;
+        *dst ++ = *src ++;
+        *dst ++ = *src ++;
+        src ++;                 /* skip alpha */
+    }
+}
+
+
+/* -------------------------------------------------- *
+ *  x86 (SSE2 / SSSE3 / AVX2)
+ * -------------------------------------------------- */
+#if defined (PIXCONV_X86)
+/*
+ *  Each pixel is stored as 4 floats. For 3ch output, the 4th float spills into
+ *  the next pixel and is overwritten by the next store, so the very last pixel
+ *  is always left to the C loop.
+ */
+__attribute__((target("sse2"))) static void
+rgba8_to_fp32_sse2 (const uint8_t *src, int num_pix, float *dst,
+                    const float *scale, const float *bias, int dst_ch)
+{
+    __m128  vscale = _mm_setr_ps (scale[0], scale[1], scale[2], 0.0f);
+    __m128  vbias  = _mm_setr_ps (bias[0],  bias[1],  bias[2],  0.0f);
+    __m128i zero   = _mm_setzero_si128 ();
+    int limit = (dst_ch == 4) ? num_pix : num_pix - 1;
+    int i = 0;
+
+    for (; i + 4 <= limit; i += 4)
+    {
+        __m128i v8   = _mm_loadu_si128 ((const __m128i *)(src + 4 * i));
+        __m128i v16l = _mm_unpacklo_epi8 (v8, zero);
+        __m128i v16h = _mm_unpackhi_epi8 (v8, zero);
+        __m128  p0   = _mm_cvtepi32_ps (_mm_unpacklo_epi16 (v16l, zero));
+        __m128  p1   = _mm_cvtepi32_ps (_mm_unpackhi_epi16 (v16l, zero));
+        __m128  p2   = _mm_cvtepi32_ps (_mm_unpacklo_epi16 (v16h, zero));
+        __m128  p3   = _mm_cvtepi32_ps (_mm_unpackhi_epi16 (v16h, zero));
+        float   *d   = dst + dst_ch * i;
+
+        _mm_storeu_ps (d             , _mm_add_ps (_mm_mul_ps (p0, vscale), vbias));
+        _mm_storeu_ps (d + dst_ch    , _mm_add_ps (_mm_mul_ps (p1, vscale), vbias));
+        _mm_storeu_ps (d + dst_ch * 2, _mm_add_ps (_mm_mul_ps (p2, vscale), vbias));
+        _mm_storeu_ps (d + dst_ch * 3, _mm_add_ps (_mm_mul_ps (p3, vscale), vbias));
+    }
+
+    rgba8_to_fp32_c (src + 4 * i, num_pix - i, dst + dst_ch * i, scale, bias, dst_ch);
+}
+
+__attribute__((target("avx2,fma"))) static void
+rgba8_to_fp32_avx2 (const uint8_t *src, int num_pix, float *dst,
+                    const float *scale, const float *bias, int dst_ch)
+{
+    __m256 vscale = _mm256_setr_ps (scale[0], scale[1], scale[2], 0.0f,
+                                    scale[0], scale[1], scale[2], 0.0f);
+    __m256 vbias  = _mm256_setr_ps (bias[0],  bias[1],  bias[2],  0.0f,
+                                    bias[0],  bias[1],  bias[2],  0.0f);
+    int limit = (dst_ch == 4) ? num_pix : num_pix - 1;
+    int i = 0;
+
+    for (; i + 8 <= limit; i += 8)
+    {
+        const uint8_t *s = src + 4 * i;
+        float         *d = dst + dst_ch * i;
+
+        for (int j = 0; j < 4; j ++)
+        {
+            /* 2 pixels */
+            __m128i v8 = _mm_loadl_epi64 ((const __m128i *)(s + 8 * j));
+            __m256  p  = _mm256_cvtepi32_ps (_mm256_cvtepu8_epi32 (v8));
+            p = _mm256_fmadd_ps (p, vscale, vbias);
+
+            _mm_storeu_ps (d + dst_ch * (2 * j + 0), _mm256_castps256_ps128 (p));
+            _mm_storeu_ps (d + dst_ch * (2 * j + 1), _mm256_extractf128_ps (p, 1));
+        }
+    }
+
+    rgba8_to_fp32_c (src + 4 * i, num_pix - i, dst + dst_ch * i, scale, bias, dst_ch);
+}
+
+/* 16 bytes are stored for 12 valid bytes, so the last 2 pixels are left to the C loop. */
+__attribute__((target("ssse3"))) static void
+rgba8_to_rgb8_ssse3 (const uint8_t *src, int num_pix, uint8_t *dst)
+{
+    __m128i shuf = _mm_setr_epi8 (0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    int i = 0;
+
+    for (; i + 4 + 2 <= num_pix; i += 4)
+    {
+        __m128i v8 = _mm_loadu_si128 ((const __m128i *)(src + 4 * i));
+        _mm_storeu_si128 ((__m128i *)(dst + 3 * i), _mm_shuffle_epi8 (v8, shuf));
+    }
+
+    rgba8_to_rgb8_c (src + 4 * i, num_pix - i, dst + 3 * i);
+}
+#endif /* PIXCONV_X86 */
+
+
+/* -------------------------------------------------- *
+ *  ARM (NEON)
+ * -------------------------------------------------- */
+#if defined (PIXCONV_NEON)
+static void
+rgba8_to_fp32_neon (const uint8_t *src, int num_pix, float *dst,
+                    const float *scale, const float *bias, int dst_ch)
+{
+    int i = 0;
+
+    for (; i + 16 <= num_pix; i += 16)
+    {
+        /* de-interleave 16 pixels into R, G, B, A planes */
+        uint8x16x4_t v = vld4q_u8 (src + 4 * i);
+        float32x4_t  f[3][4];
+
+        for (int c = 0; c < 3; c ++)
+        {
+            uint16x8_t  lo     = vmovl_u8 (vget_low_u8  (v.val[c]));
+            uint16x8_t  hi     = vmovl_u8 (vget_high_u8 (v.val[c]));
+            float32x4_t vscale = vdupq_n_f32 (scale[c]);
+            float32x4_t vbias  = vdupq_n_f32 (bias[c]);
+
+            f[c][0] = vmlaq_f32 (vbias, vcvtq_f32_u32 (vmovl_u16 (vget_low_u16  (lo))), vscale);
+            f[c][1] = vmlaq_f32 (vbias, vcvtq_f32_u32 (vmovl_u16 (vget_high_u16 (lo))), vscale);
+            f[c][2] = vmlaq_f32 (vbias, vcvtq_f32_u32 (vmovl_u16 (vget_low_u16  (hi))), vscale);
+            f[c][3] = vmlaq_f32 (vbias, vcvtq_f32_u32 (vmovl_u16 (vget_high_u16 (hi))), vscale);
+        }
+
+        for (int q = 0; q < 4; q ++)
+        {
+            float *d = dst + dst_ch * (i + 4 * q);
+            if (dst_ch == 4)
+            {
+                float32x4x4_t o = {{ f[0][q], f[1][q], f[2][q], vdupq_n_f32 (0.0f) }};
+                vst4q_f32 (d, o);
+            }
+            else
+            {
+                float32x4x3_t o = {{ f[0][q], f[1][q], f[2][q] }};
+                vst3q_f32 (d, o);
+            }
+        }
+    }
+
+    rgba8_to_fp32_c (src + 4 * i, num_pix - i, dst + dst_ch * i, scale, bias, dst_ch);
+}
+
+static void
+rgba8_to_rgb8_neon (const uint8_t *src, int num_pix, uint8_t *dst)
+{
+    int i = 0;
+
+    for (; i + 16 <= num_pix; i += 16)
+    {
+        uint8x16x4_t v = vld4q_u8 (src + 4 * i);
+        uint8x16x3_t o = {{ v.val[0], v.val[1], v.val[2] }};
+        vst3q_u8 (dst + 3 * i, o);
+    }
+
+    rgba8_to_rgb8_c (src + 4 * i, num_pix - i, dst + 3 * i);
+}
+#endif /* PIXCONV_NEON */
+
+
+/* -------------------------------------------------- *
+ *  runtime CPU dispatch
+ *
+ *   selected once by pthread_once(), the pipeline workers may
+ *   convert their first frames at the same time.
+ * -------------------------------------------------- */
+static void
+pixconv_select_simd (void)
+{
+    int enable_simd = 1;
+
+    s_rgba8_to_fp32 = rgba8_to_fp32_c;
+    s_rgba8_to_rgb8 = rgba8_to_rgb8_c;
+    s_simd_str      = "C";
+
+    char *env_simd = getenv ("FORCE_PIXCONV_SIMD");
+    if (env_simd && strcmp (env_simd, "none") == 0)
+    {
+        DBG_LOGI ("@@@@@@ FORCE_PIXCONV_SIMD=%s\n", env_simd);
+        enable_simd = 0;
+    }
+
+    if (!enable_simd)
+        return;
+
+#if defined (PIXCONV_X86)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("sse2"))
+    {
+        s_rgba8_to_fp32 = rgba8_to_fp32_sse2;
+        s_simd_str      = "SSE2";
+    }
+    if (__builtin_cpu_supports ("ssse3"))
+    {
+        s_rgba8_to_rgb8 = rgba8_to_rgb8_ssse3;
+    }
+    if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+    {
+        s_rgba8_to_fp32 = rgba8_to_fp32_avx2;
+        s_simd_str      = "AVX2";
+    }
+#endif
+
+#if defined (PIXCONV_NEON)
+    s_rgba8_to_fp32 = rgba8_to_fp32_neon;
+    s_rgba8_to_rgb8 = rgba8_to_rgb8_neon;
+    s_simd_str      = "NEON";
+#endif
+}
+
+const char *
+pixconv_get_simd_str (void)
+{
+    pthread_once (&s_select_once, pixconv_select_simd);
+
+    return s_simd_str;
+}
+
+
+/* -------------------------------------------------- *
+ *  generic path (any source format, type and layout)
+ * -------------------------------------------------- */
+static inline int
+clamp_u8 (float v)
+{
+    return (v < 0.0f) ? 0 : (v > 255.0f) ? 255 : (int)v;
+}
+
+static void
+fetch_rgb (int src_fmt, const uint8_t *src, int i, float *rgb)
+{
+    switch (src_fmt)
+    {
+    case PIXCONV_SRC_RGB8:
+        rgb[0] = src[3 * i + 0];
+        rgb[1] = src[3 * i + 1];
+        rgb[2] = src[3 * i + 2];
+        break;
+
+    case PIXCONV_SRC_YUYV:
+    {
+        /* same conversion as the YUYV shader of util_render2d.c */
+        const uint8_t *p = &src[4 * (i >> 1)];
+        float y = p[(i & 1) ? 2 : 0];
+        float u = p[1] - 128.0f;
+        float v = p[3] - 128.0f;
+        rgb[0] = clamp_u8 (y + 1.402f   * v);
+        rgb[1] = clamp_u8 (y - 0.34413f * u - 0.71414f * v);
+        rgb[2] = clamp_u8 (y + 1.772f   * u);
+        break;
+    }
+
+    case PIXCONV_SRC_RGBA8:
+    default:
+        rgb[0] = src[4 * i + 0];
+        rgb[1] = src[4 * i + 1];
+        rgb[2] = src[4 * i + 2];
+        break;
+    }
+}
+
+static void
+convert_pixels_generic (pixconv_param_t *prm, const uint8_t *src, int num_pix, void *dst,
+                        const float *scale, const float *bias)
+{
+    float    qscale = (prm->quant_scale != 0.0f) ? 1.0f / prm->quant_scale : 1.0f;
+    float    qzerop = prm->quant_zerop;
+    int      qmin   = (prm->dst_type == PIXCONV_DST_INT8) ? -128 : 0;
+    int      qmax   = (prm->dst_type == PIXCONV_DST_INT8) ?  127 : 255;
+    float    *dst_f32 = (float   *)dst;
+    uint8_t  *dst_u8  = (uint8_t *)dst;
+    int8_t   *dst_s8  = (int8_t  *)dst;
+    int      dst_ch   = prm->dst_ch;
+
+    for (int i = 0; i < num_pix; i ++)
+    {
+        float rgb[3];
+        fetch_rgb (prm->src_fmt, src, i, rgb);
+
+        for (int c = 0; c < dst_ch; c ++)
+        {
+            int   idx = (prm->dst_layout == PIXCONV_LAYOUT_NCHW) ? c * num_pix + i
+                                                                 : i * dst_ch  + c;
+            float val = (c < 3) ? rgb[c] * scale[c] + bias[c] : 0.0f;
+
+            if (prm->dst_type == PIXCONV_DST_FP32)
+            {
+                dst_f32[idx] = val;
+                continue;
+            }
+
+            int q = (int)lrintf (val * qscale + qzerop);
+            q = (q < qmin) ? qmin : (q > qmax) ? qmax : q;
+
+            if (prm->dst_type == PIXCONV_DST_INT8)
+                dst_s8[idx] = q;
+            else
+                dst_u8[idx] = q;
+        }
+    }
+}
+
+
+/* -------------------------------------------------- *
+ *  API
+ * -------------------------------------------------- */
+void
+pixconv_init_param (pixconv_param_t *prm, int src_fmt, int dst_type, float mean, float std)
+{
+    memset (prm, 0, sizeof (*prm));
+
+    prm->src_fmt    = src_fmt;
+    prm->dst_type   = dst_type;
+    prm->dst_layout = PIXCONV_LAYOUT_NHWC;
+    prm->dst_ch     = 3;
+    for (int c = 0; c < 3; c ++)
+    {
+        prm->mean[c] = mean;
+        prm->std [c] = std;
+    }
+}
+
+int
+convert_pixels (pixconv_param_t *prm, const void *src, int w, int h, void *dst)
+{
+    int   num_pix = w * h;
+    float scale[3], bias[3];
+
+    pthread_once (&s_select_once, pixconv_select_simd);
+
+    for (int c = 0; c < 3; c ++)
+    {
+        scale[c] = 1.0f / prm->std[c];
+        bias [c] = -prm->mean[c] / prm->std[c];
+    }
+
+    if (prm->src_fmt == PIXCONV_SRC_RGBA8 && prm->dst_layout == PIXCONV_LAYOUT_NHWC)
+    {
+        if (prm->dst_type == PIXCONV_DST_FP32)
+        {
+            s_rgba8_to_fp32 ((const uint8_t *)src, num_pix, (float *)dst, scale, bias, prm->dst_ch);
+            return 0;
+        }
+
+        int is_raw = (prm->mean[0] == 0.0f && prm->mean[1] == 0.0f && prm->mean[2] == 0.0f &&
+                      prm->std [0] == 1.0f && prm->std [1] == 1.0f && prm->std [2] == 1.0f &&
+                      (prm->quant_scale == 0.0f || prm->quant_scale == 1.0f) &&
+                      prm->quant_zerop == 0);
+        if (prm->dst_type == PIXCONV_DST_UINT8 && prm->dst_ch == 3 && is_raw)
+        {
+            s_rgba8_to_rgb8 ((const uint8_t *)src, num_pix, (uint8_t *)dst);
+            return 0;
+        }
+    }
+
+    convert_pixels_generic (prm, (const uint8_t *)src, num_pix, dst, scale, bias);
+    return 0;
+}
+
+void
+pixconv_rgba8_to_fp32 (const uint8_t *src, int num_pix, float *dst, float mean, float std)
+{
+    float scale[3], bias[3];
+
+    pthread_once (&s_select_once, pixconv_select_simd);
+
+    for (int c = 0; c < 3; c ++)
+    {
+        scale[c] = 1.0f / std;
+        bias [c] = -mean / std;
+    }
+
+    s_rgba8_to_fp32 (src, num_pix, dst, scale, bias, 3);
+}
+
+void
+pixconv_rgba8_to_rgb8 (const uint8_t *src, int num_pix, uint8_t *dst)
+{
+    pthread_once (&s_select_once, pixconv_select_simd);
+
+    s_rgba8_to_rgb8 (src, num_pix, dst);
+}
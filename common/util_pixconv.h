@@ -0,0 +1,53 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_PIXCONV_H_
+#define _UTIL_PIXCONV_H_
+
+#include <stdint.h>
+
+/* source pixel format */
+#define PIXCONV_SRC_RGBA8       0
+#define PIXCONV_SRC_RGB8        1
+#define PIXCONV_SRC_YUYV        2   /* Y0 U Y1 V */
+
+/* destination tensor type */
+#define PIXCONV_DST_FP32        0   /* (pixel - mean) / std                        */
+#define PIXCONV_DST_UINT8       1   /* quantize ((pixel - mean) / std) with scale/zerop */
+#define PIXCONV_DST_INT8        2   /* quantize ((pixel - mean) / std) with scale/zerop */
+
+/* destination tensor layout */
+#define PIXCONV_LAYOUT_NHWC     0
+#define PIXCONV_LAYOUT_NCHW     1
+
+typedef struct _pixconv_param_t
+{
+    int     src_fmt;
+    int     dst_type;
+    int     dst_layout;
+    int     dst_ch;         /* 3 or 4 (4th channel is filled with zero) */
+    float   mean[3];
+    float   std[3];
+    float   quant_scale;    /* tflite_tensor_t.quant_scale (0: raw pixel) */
+    int     quant_zerop;    /* tflite_tensor_t.quant_zerop */
+} pixconv_param_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void pixconv_init_param (pixconv_param_t *prm, int src_fmt, int dst_type, float mean, float std);
+int  convert_pixels (pixconv_param_t *prm, const void *src, int w, int h, void *dst);
+
+/* shortcuts for the RGBA8 image read from the framebuffer */
+void pixconv_rgba8_to_fp32 (const uint8_t *src, int num_pix, float *dst, float mean, float std);
+void pixconv_rgba8_to_rgb8 (const uint8_t *src, int num_pix, uint8_t *dst);
+
+const char *pixconv_get_simd_str (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_PIXCONV_H_ */
@@ -0,0 +1,501 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined (USE_GLES_31)
+#include <GLES3/gl31.h>
+#elif defined (USE_GLES_30)
+#include <GLES3/gl3.h>
+#else
+#include <GLES2/gl2.h>
+#endif
+#include "assertgl.h"
+#include "util_shader.h"
+#include "util_render2d.h"
+#include "util_preprocess.h"
+#include "util_pixconv.h"
+#include "util_debug.h"
+
+#define UNUSED(x) (void)(x)
+
+
+#if defined (USE_GLES_31)
+/*
+ *  Compute Shader to convert the resized RGBA8 image to a normalized FP32 tensor.
+ *  The ROI is drawn upside down, so row 0 of the FBO is already the top row
+ *  of the tensor.
+ */
+static char s_strCS[] =
+    "#version 310 es                                    \n"
+    "                                                   \n"
+    "layout(local_size_x = 16, local_size_y = 16) in;   \n"
+    "layout(location = 0) uniform sampler2D u_sampler;  \n"
+    "layout(location = 1) uniform ivec2 u_imgsize;      \n"
+    "uniform float u_mean;                              \n"
+    "uniform float u_std;                               \n"
+    "                                                   \n"
+    "layout(std430) buffer;                             \n"
+    "layout(binding = 1) buffer Output {                \n"
+    "    float elements[];                              \n"
+    "} output_data;                                     \n"
+    "                                                   \n"
+    "void main() {                                      \n"
+    "    int img_w = u_imgsize.x;                       \n"
+    "    int img_h = u_imgsize.y;                       \n"
+    "    ivec2 gid = ivec2(gl_GlobalInvocationID.xy);   \n"
+    "    if (gid.x >= img_w || gid.y >= img_h)          \n"
+    "        return;                                    \n"
+    "                                                   \n"
+    "    vec3 pixel = texelFetch(u_sampler, gid, 0).xyz;\n"
+    "    pixel = (pixel * 255.0 - u_mean) / u_std;      \n"
+    "                                                   \n"
+    "    int idx = 3 * (gid.y * img_w + gid.x);         \n"
+    "    output_data.elements[idx + 0] = pixel.x;       \n"
+    "    output_data.elements[idx + 1] = pixel.y;       \n"
+    "    output_data.elements[idx + 2] = pixel.z;       \n"
+    "}                                                  \n";
+#endif
+
+
+/* -------------------------------------------------- *
+ *  convert RGBA8 ==> input tensor
+ * -------------------------------------------------- */
+static void
+convert_rgba8_to_tensor (preproc_t *pp, unsigned char *src, void *dst)
+{
+    int num_pix = pp->w * pp->h;
+
+    if (pp->dst_type == PREPROC_TYPE_RGBA8)
+    {
+        memcpy (dst, src, num_pix * 4);
+        return;
+    }
+
+    if (pp->dst_type == PREPROC_TYPE_UINT8)
+    {
+        pixconv_rgba8_to_rgb8 (src, num_pix, (unsigned char *)dst);
+        return;
+    }
+
+    /* convert UI8 [0, 255] ==> FP32 */
+    pixconv_rgba8_to_fp32 (src, num_pix, (float *)dst, pp->mean, pp->std);
+}
+
+
+/* -------------------------------------------------- *
+ *  initialize
+ * -------------------------------------------------- */
+int
+init_preprocess (preproc_t *pp, int backend, int w, int h, int dst_type, float mean, float std)
+{
+    memset (pp, 0, sizeof (*pp));
+
+#if !defined (USE_GLES_30) && !defined (USE_GLES_31)
+    if (backend == PREPROC_BACKEND_PBO)
+    {
+        DBG_LOGW ("PBO readback needs GLES3 (USE_GLES_30). fallback to glReadPixels.\n");
+        backend = PREPROC_BACKEND_READPIXELS;
+    }
+#endif
+#if !defined (USE_GLES_31)
+    if (backend == PREPROC_BACKEND_SSBO)
+    {
+        DBG_LOGW ("SSBO tensor needs GLES3.1 (USE_GLES_31). fallback to glReadPixels.\n");
+        backend = PREPROC_BACKEND_READPIXELS;
+    }
+#endif
+    if (backend == PREPROC_BACKEND_SSBO && dst_type != PREPROC_TYPE_FP32)
+    {
+        DBG_LOGW ("SSBO tensor supports FP32 only. fallback to glReadPixels.\n");
+        backend = PREPROC_BACKEND_READPIXELS;
+    }
+
+    pp->backend  = backend;
+    pp->w        = w;
+    pp->h        = h;
+    pp->dst_type = dst_type;
+    pp->mean     = mean;
+    pp->std      = std;
+
+    pp->buf_ui8 = (unsigned char *)malloc (w * h * 4);
+    if (pp->buf_ui8 == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    if (backend == PREPROC_BACKEND_CPU)
+        return 0;
+
+    create_render_target (&pp->rtarget, w, h, RTARGET_COLOR);
+
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+    if (backend == PREPROC_BACKEND_PBO)
+    {
+        glGenBuffers (2, pp->pbo_id);
+        for (int i = 0; i < 2; i ++)
+        {
+            glBindBuffer (GL_PIXEL_PACK_BUFFER, pp->pbo_id[i]);
+            glBufferData (GL_PIXEL_PACK_BUFFER, w * h * 4, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+    }
+#endif
+
+#if defined (USE_GLES_31)
+    if (backend == PREPROC_BACKEND_SSBO)
+    {
+        GLuint ssbo;
+        glGenBuffers (1, &ssbo);
+        glBindBuffer (GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferData (GL_SHADER_STORAGE_BUFFER, w * h * 3 * sizeof(float), NULL, GL_STREAM_COPY);
+        glBindBuffer (GL_SHADER_STORAGE_BUFFER, 0);
+        pp->ssbo_id = ssbo;
+
+        pp->prog_cs     = build_compute_shader (s_strCS);
+        pp->loc_cs_mean = glGetUniformLocation (pp->prog_cs, "u_mean");
+        pp->loc_cs_std  = glGetUniformLocation (pp->prog_cs, "u_std");
+    }
+#endif
+
+    GLASSERT();
+    return 0;
+}
+
+void
+destroy_preprocess (preproc_t *pp)
+{
+    if (pp->buf_ui8)
+        free (pp->buf_ui8);
+
+    if (pp->backend != PREPROC_BACKEND_CPU)
+        destroy_render_target (&pp->rtarget);
+
+    if (pp->pbo_id[0])
+        glDeleteBuffers (2, pp->pbo_id);
+    if (pp->ssbo_id)
+        glDeleteBuffers (1, &pp->ssbo_id);
+    if (pp->prog_cs)
+        glDeleteProgram (pp->prog_cs);
+
+    memset (pp, 0, sizeof (*pp));
+}
+
+uint32_t
+preprocess_get_ssbo (preproc_t *pp)
+{
+    return pp->ssbo_id;
+}
+
+void
+preprocess_reset (preproc_t *pp)
+{
+    pp->pbo_num = 0;
+}
+
+void
+preprocess_get_tensor_roi (preproc_t *pp, float *roi)
+{
+    memcpy (roi, pp->roi, sizeof (pp->roi));
+}
+
+int
+preprocess_set_tag (preproc_t *pp, const void *tag, int size)
+{
+    if (size < 0 || size > PREPROC_MAX_TAG)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    memcpy (pp->tag, tag, size);
+    pp->tag_size = size;
+    return 0;
+}
+
+int
+preprocess_get_tensor_tag (preproc_t *pp, void *tag, int size)
+{
+    if (size != pp->tag_size)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    memcpy (tag, pp->tag, size);
+    return 0;
+}
+
+
+/* -------------------------------------------------- *
+ *  GPU path: crop/rotate/resize the ROI into FBO
+ * -------------------------------------------------- */
+static void
+roi_to_texcoord (float *roi, float *texcoord)
+{
+    /*
+     *  the ROI is drawn upside down, so that glReadPixels() returns
+     *  the top row of the ROI first.
+     *
+     *    0--------1        v(0,0) = 3,  v(0,1) = 0
+     *    |  ROI   |        v(1,0) = 2,  v(1,1) = 1
+     *    3--------2
+     */
+    texcoord[0] = roi[6];   texcoord[1] = roi[7];
+    texcoord[2] = roi[0];   texcoord[3] = roi[1];
+    texcoord[4] = roi[4];   texcoord[5] = roi[5];
+    texcoord[6] = roi[2];   texcoord[7] = roi[3];
+}
+
+int
+preprocess_texture (preproc_t *pp, texture_2d_t *srctex, float *roi)
+{
+    float roi_full[] = { 0.0f, 0.0f,
+                         1.0f, 0.0f,
+                         1.0f, 1.0f,
+                         0.0f, 1.0f };
+    float texcoord[8];
+    GLint  viewport[4];
+    GLint  fbo_save;
+    int w = pp->w;
+    int h = pp->h;
+
+    if (pp->backend == PREPROC_BACKEND_CPU)
+    {
+        DBG_LOGE ("ERR: %s(%d): CPU backend can't read textures\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    if (roi == NULL)
+        roi = roi_full;
+    memcpy (pp->roi, roi, sizeof (pp->roi));
+    roi_to_texcoord (roi, texcoord);
+
+    glGetIntegerv (GL_FRAMEBUFFER_BINDING, &fbo_save);
+    glGetIntegerv (GL_VIEWPORT, viewport);
+
+    set_render_target (&pp->rtarget);
+    set_2d_projection_matrix (w, h);
+    draw_2d_texture_ex_texcoord (srctex, 0, 0, w, h, texcoord);
+
+    switch (pp->backend)
+    {
+    case PREPROC_BACKEND_READPIXELS:
+        glPixelStorei (GL_PACK_ALIGNMENT, 4);
+        glReadPixels (0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pp->buf_ui8);
+        break;
+
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+    case PREPROC_BACKEND_PBO:
+        /*
+         *  returns immediately. the copy completes during the next frame,
+         *  and preprocess_get_tensor() maps the PBO filled on the previous one.
+         */
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, pp->pbo_id[pp->pbo_idx]);
+        glPixelStorei (GL_PACK_ALIGNMENT, 4);
+        glReadPixels (0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+
+        memcpy (pp->pbo_roi[pp->pbo_idx], roi, sizeof (pp->roi));
+        memcpy (pp->pbo_tag[pp->pbo_idx], pp->tag, pp->tag_size);
+        pp->pbo_idx ^= 1;
+        if (pp->pbo_num < 2)
+            pp->pbo_num ++;
+        break;
+#endif
+
+#if defined (USE_GLES_31)
+    case PREPROC_BACKEND_SSBO:
+    {
+        int ssbo_range = w * h * 3 * sizeof(float);
+
+        glUseProgram (pp->prog_cs);
+        glActiveTexture (GL_TEXTURE0);
+        glBindTexture (GL_TEXTURE_2D, pp->rtarget.texc_id);
+        glUniform1i (0, 0);
+        glUniform2i (1, w, h);
+        glUniform1f (pp->loc_cs_mean, pp->mean);
+        glUniform1f (pp->loc_cs_std,  pp->std);
+        glBindBufferRange (GL_SHADER_STORAGE_BUFFER, 1, pp->ssbo_id, 0, ssbo_range);
+
+        int group_size = 16;
+        int num_group_x = (w + group_size - 1) / group_size;
+        int num_group_y = (h + group_size - 1) / group_size;
+        glDispatchCompute (num_group_x, num_group_y, 1);
+
+        /* for the compute shaders of the GL delegate which read the SSBO */
+        glMemoryBarrier (GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glBindBuffer (GL_SHADER_STORAGE_BUFFER, 0);
+        glBindTexture (GL_TEXTURE_2D, 0);
+        break;
+    }
+#endif
+
+    default:
+        break;
+    }
+
+    /* restore the framebuffer of the application */
+    glBindFramebuffer (GL_FRAMEBUFFER, fbo_save);
+    glViewport (viewport[0], viewport[1], viewport[2], viewport[3]);
+    set_2d_projection_matrix (viewport[2], viewport[3]);
+
+    GLASSERT();
+    return 0;
+}
+
+
+/* -------------------------------------------------- *
+ *  CPU path: bilinear resampling of the ROI
+ * -------------------------------------------------- */
+static void
+sample_bilinear (unsigned char *src, int src_w, int src_h, float u, float v, unsigned char *dst)
+{
+    float fx = u * src_w - 0.5f;
+    float fy = v * src_h - 0.5f;
+    int   x0 = (int)floorf (fx);
+    int   y0 = (int)floorf (fy);
+    float ax = fx - x0;
+    float ay = fy - y0;
+    int   x1 = x0 + 1;
+    int   y1 = y0 + 1;
+
+    /* GL_CLAMP_TO_EDGE */
+    x0 = (x0 < 0) ? 0 : (x0 >= src_w) ? src_w - 1 : x0;
+    x1 = (x1 < 0) ? 0 : (x1 >= src_w) ? src_w - 1 : x1;
+    y0 = (y0 < 0) ? 0 : (y0 >= src_h) ? src_h - 1 : y0;
+    y1 = (y1 < 0) ? 0 : (y1 >= src_h) ? src_h - 1 : y1;
+
+    unsigned char *p00 = &src[(y0 * src_w + x0) * 4];
+    unsigned char *p01 = &src[(y0 * src_w + x1) * 4];
+    unsigned char *p10 = &src[(y1 * src_w + x0) * 4];
+    unsigned char *p11 = &src[(y1 * src_w + x1) * 4];
+
+    for (int c = 0; c < 4; c ++)
+    {
+        float top = p00[c] + (p01[c] - p00[c]) * ax;
+        float btm = p10[c] + (p11[c] - p10[c]) * ax;
+        dst[c] = (unsigned char)(top + (btm - top) * ay + 0.5f);
+    }
+}
+
+int
+preprocess_buffer (preproc_t *pp, unsigned char *rgba, int src_w, int src_h, float *roi)
+{
+    float roi_full[] = { 0.0f, 0.0f,
+                         1.0f, 0.0f,
+                         1.0f, 1.0f,
+                         0.0f, 1.0f };
+    unsigned char *dst = pp->buf_ui8;
+    int w = pp->w;
+    int h = pp->h;
+
+    if (roi == NULL)
+        roi = roi_full;
+    memcpy (pp->roi, roi, sizeof (pp->roi));
+
+    for (int y = 0; y < h; y ++)
+    {
+        float v = (y + 0.5f) / (float)h;
+
+        /* left and right edges of the ROI at this row */
+        float lx = roi[0] + (roi[6] - roi[0]) * v;
+        float ly = roi[1] + (roi[7] - roi[1]) * v;
+        float rx = roi[2] + (roi[4] - roi[2]) * v;
+        float ry = roi[3] + (roi[5] - roi[3]) * v;
+
+        for (int x = 0; x < w; x ++)
+        {
+            float u = (x + 0.5f) / (float)w;
+            float tx = lx + (rx - lx) * u;
+            float ty = ly + (ry - ly) * u;
+
+            sample_bilinear (rgba, src_w, src_h, tx, ty, dst);
+            dst += 4;
+        }
+    }
+
+    return 0;
+}
+
+
+/* -------------------------------------------------- *
+ *  write the input tensor
+ * -------------------------------------------------- */
+int
+preprocess_get_tensor (preproc_t *pp, void *dst)
+{
+    switch (pp->backend)
+    {
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+    case PREPROC_BACKEND_PBO:
+    {
+        if (pp->pbo_num == 0)
+        {
+            DBG_LOGE ("ERR: %s(%d): no image has been read back\n", __FILE__, __LINE__);
+            return -1;
+        }
+
+        /*
+         *  map the PBO filled on the previous frame, which the GPU has finished.
+         *  only the first frame after a reset waits for the current readback.
+         */
+        int idx = (pp->pbo_num == 2) ? pp->pbo_idx : pp->pbo_idx ^ 1;
+        memcpy (pp->roi, pp->pbo_roi[idx], sizeof (pp->roi));
+        memcpy (pp->tag, pp->pbo_tag[idx], pp->tag_size);
+
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, pp->pbo_id[idx]);
+        void *p = glMapBufferRange (GL_PIXEL_PACK_BUFFER, 0, pp->w * pp->h * 4, GL_MAP_READ_BIT);
+        if (p == NULL)
+        {
+            DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+            glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+            return -1;
+        }
+        convert_rgba8_to_tensor (pp, (unsigned char *)p, dst);
+        glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+        GLASSERT();
+        break;
+    }
+#endif
+
+#if defined (USE_GLES_31)
+    case PREPROC_BACKEND_SSBO:
+    {
+        /* the SSBO is bound to the GPU delegate: nothing to do. */
+        if (dst == NULL)
+            break;
+
+        /* make the compute shader writes visible to glMapBufferRange() */
+        glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        int bytes = pp->w * pp->h * 3 * sizeof(float);
+        glBindBuffer (GL_SHADER_STORAGE_BUFFER, pp->ssbo_id);
+        void *p = glMapBufferRange (GL_SHADER_STORAGE_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+        if (p == NULL)
+        {
+            DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+            glBindBuffer (GL_SHADER_STORAGE_BUFFER, 0);
+            return -1;
+        }
+        memcpy (dst, p, bytes);
+        glUnmapBuffer (GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer (GL_SHADER_STORAGE_BUFFER, 0);
+        GLASSERT();
+        break;
+    }
+#endif
+
+    default:
+        convert_rgba8_to_tensor (pp, pp->buf_ui8, dst);
+        break;
+    }
+
+    return 0;
+}
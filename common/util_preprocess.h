@@ -0,0 +1,102 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_PREPROCESS_H_
+#define _UTIL_PREPROCESS_H_
+
+#include <stdint.h>
+#include "util_texture.h"
+#include "util_render_target.h"
+
+/*
+ *  how the resized image is brought to the input tensor.
+ */
+#define PREPROC_BACKEND_READPIXELS  0   /* draw to FBO + glReadPixels          (GLES2)   */
+#define PREPROC_BACKEND_PBO         1   /* draw to FBO + async readback to PBO (GLES3)   *
+                                         *   the tensor lags one frame behind the texture */
+#define PREPROC_BACKEND_SSBO        2   /* draw to FBO + compute shader to SSBO(GLES3.1) */
+#define PREPROC_BACKEND_CPU         3   /* software resampling without GL (headless)     */
+
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+#define PREPROC_BACKEND_DEFAULT     PREPROC_BACKEND_PBO
+#else
+#define PREPROC_BACKEND_DEFAULT     PREPROC_BACKEND_READPIXELS
+#endif
+
+/* input tensor type */
+#define PREPROC_TYPE_FP32           0   /* (pixel - mean) / std */
+#define PREPROC_TYPE_UINT8          1   /* pixel as is          */
+#define PREPROC_TYPE_RGBA8          2   /* pixel as is, with alpha (source of preprocess_buffer) */
+
+#define PREPROC_MAX_TAG             512 /* bytes of the user data kept with the ROI */
+
+typedef struct _preproc_t
+{
+    int             backend;
+    int             w, h;           /* input tensor size (RGB) */
+    int             dst_type;
+    float           mean;
+    float           std;
+
+    unsigned char   *buf_ui8;       /* RGBA8 staging buffer */
+    render_target_t rtarget;
+
+    uint32_t        pbo_id[2];      /* PBO backend: double buffered readback */
+    int             pbo_idx;        /* PBO written by the next preprocess_texture() */
+    int             pbo_num;        /* PBOs filled since the last reset (0..2) */
+    float           pbo_roi[2][8];  /* ROI drawn into each PBO */
+    float           roi[8];         /* ROI of the last tensor returned */
+    unsigned char   pbo_tag[2][PREPROC_MAX_TAG];
+    unsigned char   tag[PREPROC_MAX_TAG];
+    int             tag_size;
+
+    uint32_t        ssbo_id;
+    int             prog_cs;
+    int             loc_cs_mean;
+    int             loc_cs_std;
+} preproc_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  init_preprocess (preproc_t *pp, int backend, int w, int h, int dst_type, float mean, float std);
+void destroy_preprocess (preproc_t *pp);
+
+/*
+ *  roi: quad to be cropped, in normalized texture coordinates.
+ *      roi[0..1]: top-left,     roi[2..3]: top-right,
+ *      roi[4..5]: bottom-right, roi[6..7]: bottom-left.
+ *      NULL for the whole texture.
+ */
+int  preprocess_texture (preproc_t *pp, texture_2d_t *srctex, float *roi);
+int  preprocess_buffer  (preproc_t *pp, unsigned char *rgba, int src_w, int src_h, float *roi);
+int  preprocess_get_tensor (preproc_t *pp, void *dst);
+
+/*
+ *  the PBO backend returns the image read back at the previous
+ *  preprocess_texture(), so that mapping the PBO doesn't wait for the GPU.
+ *  preprocess_get_tensor_roi() gives the ROI the returned tensor was cropped
+ *  with. call preprocess_reset() when a frame was skipped, then the next
+ *  tensor is the current one (and stalls once).
+ */
+void preprocess_get_tensor_roi (preproc_t *pp, float *roi);
+void preprocess_reset (preproc_t *pp);
+
+/*
+ *  user data which travels with the ROI through the PBO backend,
+ *  e.g. the whole detection the ROI was derived from.
+ *  preprocess_set_tag() before preprocess_texture()/preprocess_buffer(),
+ *  preprocess_get_tensor_tag() after preprocess_get_tensor().
+ */
+int  preprocess_set_tag (preproc_t *pp, const void *tag, int size);
+int  preprocess_get_tensor_tag (preproc_t *pp, void *tag, int size);
+
+uint32_t preprocess_get_ssbo (preproc_t *pp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_PREPROCESS_H_ */
@@ -3,6 +3,7 @@
  * Copyright (c) 2019 terryky1220@gmail.com
  * ------------------------------------------------ */
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
 #include <GLES2/gl2.h>
@@ -252,6 +253,68 @@ void main (void)                                      \n\
     gl_FragColor *= u_Color;                          \n\
 }                                                     \n";
 
+/* ------------------------------------------------------ *
+ *  shader for Class Map (segmentation)
+ *      u_sampler : class id of each pixel (GL_LUMINANCE, NEAREST)
+ *      u_sampler2: color of each class    (256x1 RGBA,   NEAREST)
+ *
+ *  the 4 texels around are looked up in the palette and blended,
+ *  which is GL_LINEAR of the colored image.
+ * ------------------------------------------------------ */
+static char fs_classmap[] = "                         \n\
+#ifdef GL_FRAGMENT_PRECISION_HIGH                     \n\
+precision highp float;                                \n\
+#else                                                 \n\
+precision mediump float;                              \n\
+#endif                                                \n\
+varying     vec2      v_TexCoord;                     \n\
+uniform     sampler2D u_sampler;                      \n\
+uniform     sampler2D u_sampler2;                     \n\
+uniform     vec4      u_Color;                        \n\
+uniform     vec2      u_TexDim;                       \n\
+                                                      \n\
+vec4 class_color (vec2 pix)                           \n\
+{                                                     \n\
+    float id = texture2D (u_sampler, (pix + 0.5) / u_TexDim).r;         \n\
+    return texture2D (u_sampler2, vec2 ((id * 255.0 + 0.5) / 256.0, 0.5)); \n\
+}                                                     \n\
+                                                      \n\
+void main (void)                                      \n\
+{                                                     \n\
+    vec2 pos = v_TexCoord * u_TexDim - 0.5;           \n\
+    vec2 p0  = floor (pos);                           \n\
+    vec2 f   = pos - p0;                              \n\
+    vec4 c00 = class_color (p0);                      \n\
+    vec4 c10 = class_color (p0 + vec2 (1.0, 0.0));    \n\
+    vec4 c01 = class_color (p0 + vec2 (0.0, 1.0));    \n\
+    vec4 c11 = class_color (p0 + vec2 (1.0, 1.0));    \n\
+    gl_FragColor = mix (mix (c00, c10, f.x), mix (c01, c11, f.x), f.y); \n\
+    gl_FragColor *= u_Color;                          \n\
+}                                                     \n";
+
+/* ------------------------------------------------------ *
+ *  shader for the batched primitives (per-vertex color)
+ * ------------------------------------------------------ */
+static char vs_fill_vc[] = "                          \n\
+attribute    vec4    a_Vertex;                        \n\
+attribute    vec4    a_Color;                         \n\
+varying      vec4    v_Color;                         \n\
+uniform      mat4    u_PMVMatrix;                     \n\
+void main (void)                                      \n\
+{                                                     \n\
+    gl_Position = u_PMVMatrix * a_Vertex;             \n\
+    v_Color     = a_Color;                            \n\
+}                                                     ";
+
+static char fs_fill_vc[] = "                          \n\
+precision mediump float;                              \n\
+varying      vec4    v_Color;                         \n\
+                                                      \n\
+void main (void)                                      \n\
+{                                                     \n\
+    gl_FragColor = v_Color;                           \n\
+}                                                     ";
+
 enum shader_type {
     SHADER_TYPE_FILL    = 0,    // 0
     SHADER_TYPE_TEX,            // 1
@@ -259,6 +322,8 @@ enum shader_type {
     SHADER_TYPE_CMAP_JET,       // 3
     SHADER_TYPE_TEX_YUYV,       // 4
     SHADER_TYPE_TEX_UYVY,       // 5
+    SHADER_TYPE_CLASSMAP,       // 6
+    SHADER_TYPE_FILL_VC,        // 7
 
     SHADER_TYPE_MAX
 };
@@ -272,12 +337,15 @@ static char *s_shader[SHADER_NUM * 2] =
     vs_tex,    fs_cmap_jet,
     vs_tex_yuyv, fs_tex_yuyv,
     vs_tex_uyvy, fs_tex_uyvy,
+    vs_tex,    fs_classmap,
+    vs_fill_vc, fs_fill_vc,
 };
 
 static shader_obj_t s_sobj[SHADER_NUM];
 static int s_loc_mtx[SHADER_NUM];
 static int s_loc_color[SHADER_NUM];
 static int s_loc_texdim[SHADER_NUM];
+static int s_loc_tex2[SHADER_NUM];
 
 static float varray[] =
 {   0.0, 0.0,
@@ -285,6 +353,29 @@ static float varray[] =
     1.0, 0.0,
     1.0, 1.0 };
 
+/*
+ *  batch of the fill primitives (rect, line, circle).
+ *  between begin_2d_batch() and end_2d_batch(), they are expanded into
+ *  triangles with per-vertex color, and drawn with one glDrawArrays.
+ */
+#define BATCH_MAX_VTX   8192
+
+typedef struct _batch_vtx_t
+{
+    float           x, y;
+    unsigned char   col[4];
+} batch_vtx_t;
+
+typedef struct _batch_t
+{
+    int          enabled;
+    int          num_vtx;
+    GLuint       vbo;
+    batch_vtx_t  vtx[BATCH_MAX_VTX];
+} batch_t;
+
+static batch_t s_batch;
+
 static float s_matprj[16];
 int
 set_2d_projection_matrix (int w, int h)
@@ -299,6 +390,9 @@ set_2d_projection_matrix (int w, int h)
     mat_proj[0] =  2.0f / (float)w;
     mat_proj[5] = -2.0f / (float)h;
 
+    /* the pending primitives are in the current projection */
+    flush_2d_batch ();
+
     memcpy (s_matprj, mat_proj, 16*sizeof(float));
 
     GLASSERT ();
@@ -323,17 +417,166 @@ init_2d_renderer (int w, int h)
         s_loc_mtx[i]    = glGetUniformLocation(s_sobj[i].program, "u_PMVMatrix");
         s_loc_color[i]  = glGetUniformLocation(s_sobj[i].program, "u_Color");
         s_loc_texdim[i] = glGetUniformLocation(s_sobj[i].program, "u_TexDim");
+        s_loc_tex2[i]   = glGetUniformLocation(s_sobj[i].program, "u_sampler2");
     }
 
+    glGenBuffers (1, &s_batch.vbo);
+
     set_2d_projection_matrix (w, h);
 
     return 0;
 }
 
+
+/* -------------------------------------------------- *
+ *  batch
+ * -------------------------------------------------- */
+int
+begin_2d_batch ()
+{
+    s_batch.enabled = 1;
+    return 0;
+}
+
+int
+flush_2d_batch ()
+{
+    int ttype = SHADER_TYPE_FILL_VC;
+    shader_obj_t *sobj = &s_sobj[ttype];
+
+    if (s_batch.num_vtx == 0)
+        return 0;
+
+    glBindBuffer (GL_ARRAY_BUFFER, s_batch.vbo);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    /* orphan the previous storage, not to wait for the draw which reads it. */
+    glBufferData (GL_ARRAY_BUFFER, sizeof (s_batch.vtx), NULL, GL_STREAM_DRAW);
+    glBufferSubData (GL_ARRAY_BUFFER, 0, s_batch.num_vtx * sizeof (batch_vtx_t), s_batch.vtx);
+
+    glUseProgram (sobj->program);
+    glUniformMatrix4fv (s_loc_mtx[ttype], 1, GL_FALSE, s_matprj);
+
+    glEnable (GL_BLEND);
+    glBlendFuncSeparate (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+               GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    glEnableVertexAttribArray (sobj->loc_vtx);
+    glVertexAttribPointer (sobj->loc_vtx, 2, GL_FLOAT, GL_FALSE, sizeof (batch_vtx_t),
+                           (void *)offsetof (batch_vtx_t, x));
+    glEnableVertexAttribArray (sobj->loc_clr);
+    glVertexAttribPointer (sobj->loc_clr, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof (batch_vtx_t),
+                           (void *)offsetof (batch_vtx_t, col));
+
+    glDrawArrays (GL_TRIANGLES, 0, s_batch.num_vtx);
+
+    glDisableVertexAttribArray (sobj->loc_vtx);
+    glDisableVertexAttribArray (sobj->loc_clr);
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+    glDisable (GL_BLEND);
+
+    s_batch.num_vtx = 0;
+
+    GLASSERT ();
+    return 0;
+}
+
+int
+end_2d_batch ()
+{
+    flush_2d_batch ();
+    s_batch.enabled = 0;
+    return 0;
+}
+
+static batch_vtx_t *
+batch_alloc (int num)
+{
+    if (s_batch.num_vtx + num > BATCH_MAX_VTX)
+        flush_2d_batch ();
+
+    batch_vtx_t *vtx = &s_batch.vtx[s_batch.num_vtx];
+    s_batch.num_vtx += num;
+    return vtx;
+}
+
+static void
+batch_set_vtx (batch_vtx_t *vtx, float x, float y, unsigned char *col)
+{
+    vtx->x = x;
+    vtx->y = y;
+    memcpy (vtx->col, col, 4);
+}
+
+static void
+batch_color (float *color, unsigned char *col)
+{
+    for (int i = 0; i < 4; i ++)
+    {
+        float c = color[i] < 0.0f ? 0.0f : (color[i] > 1.0f ? 1.0f : color[i]);
+        col[i] = (unsigned char)(c * 255.0f + 0.5f);
+    }
+}
+
+/* quad of the 4 corners in TRIANGLE_STRIP order */
+static void
+batch_add_quad (float *x, float *y, unsigned char *col)
+{
+    batch_vtx_t *vtx = batch_alloc (6);
+
+    batch_set_vtx (&vtx[0], x[0], y[0], col);
+    batch_set_vtx (&vtx[1], x[1], y[1], col);
+    batch_set_vtx (&vtx[2], x[2], y[2], col);
+    batch_set_vtx (&vtx[3], x[2], y[2], col);
+    batch_set_vtx (&vtx[4], x[1], y[1], col);
+    batch_set_vtx (&vtx[5], x[3], y[3], col);
+}
+
+/* line as a quad of (line_width). (cap) extends both ends by half the width. */
+static void
+batch_add_line (float x0, float y0, float x1, float y1, unsigned char *col,
+                float line_width, int cap)
+{
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float len = sqrtf (dx * dx + dy * dy);
+    float x[4], y[4];
+
+    if (len == 0)
+        return;
+
+    float hw = 0.5f * line_width;
+    float tx = dx / len * hw;       /* along the line  */
+    float ty = dy / len * hw;
+    float nx = -ty;                 /* normal          */
+    float ny =  tx;
+
+    if (!cap)
+        tx = ty = 0;
+
+    x[0] = x0 - tx + nx;  y[0] = y0 - ty + ny;
+    x[1] = x0 - tx - nx;  y[1] = y0 - ty - ny;
+    x[2] = x1 + tx + nx;  y[2] = y1 + ty + ny;
+    x[3] = x1 + tx - nx;  y[3] = y1 + ty - ny;
+    batch_add_quad (x, y, col);
+}
+
+/* outline of the 4 corners (x[0],y[0])-(x[1],y[1])-(x[2],y[2])-(x[3],y[3]) */
+static void
+batch_add_rect_outline (float *x, float *y, unsigned char *col, float line_width)
+{
+    for (int i = 0; i < 4; i ++)
+    {
+        int j = (i + 1) % 4;
+        batch_add_line (x[i], y[i], x[j], y[j], col, line_width, 1);
+    }
+}
+
 typedef struct _texparam
 {
     int          textype;
     int          texid;
+    int          texid2;            /* u_sampler2 */
     int          x, y, w, h;
     int          texw, texh;
     int          upsidedown;
@@ -384,6 +627,9 @@ draw_2d_texture_in (texparam_t *tparam)
         1.0, 1.0 };
     float *uv = tarray;
 
+    /* keep the drawing order with the batched primitives */
+    flush_2d_batch ();
+
     glBindBuffer (GL_ARRAY_BUFFER, 0);
     glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
 
@@ -403,6 +649,13 @@ draw_2d_texture_in (texparam_t *tparam)
     case SHADER_TYPE_EXTEX:
         glBindTexture (GL_TEXTURE_EXTERNAL_OES, texid);
         break;
+    case SHADER_TYPE_CLASSMAP:
+        glActiveTexture (GL_TEXTURE1);
+        glBindTexture (GL_TEXTURE_2D, tparam->texid2);
+        glUniform1i (s_loc_tex2[ttype], 1);
+        glActiveTexture (GL_TEXTURE0);
+        glBindTexture (GL_TEXTURE_2D, texid);
+        break;
     default:
         break;
     }
@@ -567,6 +820,8 @@ draw_2d_texture_ex_texcoord (texture_2d_t *tex, int x, int y, int w, int h, floa
         tparam.textype = SHADER_TYPE_TEX_YUYV;
     else if (tex->format == pixfmt_fourcc('U', 'Y', 'V', 'Y'))
         tparam.textype = SHADER_TYPE_TEX_UYVY;
+    else if (tex->format == pixfmt_fourcc('E', 'X', 'T', 'X'))
+        tparam.textype = SHADER_TYPE_EXTEX;
 
     draw_2d_texture_in (&tparam);
 
@@ -600,6 +855,8 @@ draw_2d_texture_ex_texcoord_rot (texture_2d_t *tex, int x, int y, int w, int h,
         tparam.textype = SHADER_TYPE_TEX_YUYV;
     else if (tex->format == pixfmt_fourcc('U', 'Y', 'V', 'Y'))
         tparam.textype = SHADER_TYPE_TEX_UYVY;
+    else if (tex->format == pixfmt_fourcc('E', 'X', 'T', 'X'))
+        tparam.textype = SHADER_TYPE_EXTEX;
 
     draw_2d_texture_in (&tparam);
 
@@ -678,10 +935,73 @@ draw_2d_colormap (int texid, int x, int y, int w, int h, float alpha, int upside
     return 0;
 }
 
+/* class map of segmap_t (util_segmap.h), colored with the palette texture */
+int
+draw_2d_classmap (texture_2d_t *classtex, int palette_texid, int x, int y, int w, int h,
+                  float alpha, int upsidedown)
+{
+    texparam_t tparam = {0};
+    tparam.x       = x;
+    tparam.y       = y;
+    tparam.w       = w;
+    tparam.h       = h;
+    tparam.texid   = classtex->texid;
+    tparam.texid2  = palette_texid;
+    tparam.textype = SHADER_TYPE_CLASSMAP;
+    tparam.texw    = classtex->width;
+    tparam.texh    = classtex->height;
+    tparam.color[0]= 1.0f;
+    tparam.color[1]= 1.0f;
+    tparam.color[2]= 1.0f;
+    tparam.color[3]= alpha;
+    tparam.upsidedown = upsidedown;
+    draw_2d_texture_in (&tparam);
+
+    return 0;
+}
+
+int
+draw_2d_classmap_rot (texture_2d_t *classtex, int palette_texid, int x, int y, int w, int h,
+                      float alpha, float px, float py, float deg)
+{
+    texparam_t tparam = {0};
+    tparam.x       = x;
+    tparam.y       = y;
+    tparam.w       = w;
+    tparam.h       = h;
+    tparam.texid   = classtex->texid;
+    tparam.texid2  = palette_texid;
+    tparam.textype = SHADER_TYPE_CLASSMAP;
+    tparam.texw    = classtex->width;
+    tparam.texh    = classtex->height;
+    tparam.rot     = deg;
+    tparam.px      = px * w;    /* relative pivot position (0 <= px <= 1) */
+    tparam.py      = py * h;    /* relative pivot position (0 <= py <= 1) */
+    tparam.color[0]= 1.0f;
+    tparam.color[1]= 1.0f;
+    tparam.color[2]= 1.0f;
+    tparam.color[3]= alpha;
+    tparam.upsidedown = 0;
+    draw_2d_texture_in (&tparam);
+
+    return 0;
+}
+
 
 int
 draw_2d_fillrect (int x, int y, int w, int h, float *color)
 {
+    if (s_batch.enabled)
+    {
+        float vx[4] = {x, x,     x + w, x + w};
+        float vy[4] = {y, y + h, y,     y + h};
+        unsigned char col[4];
+
+        batch_color (color, col);
+        batch_add_quad (vx, vy, col);
+        return 0;
+    }
+
     texparam_t tparam = {0};
     tparam.x       = x;
     tparam.y       = y;
@@ -705,6 +1025,17 @@ draw_2d_rect (int x, int y, int w, int h, float *color, float line_width)
     shader_obj_t *sobj = &s_sobj[ttype];
     float matrix[16];
 
+    if (s_batch.enabled)
+    {
+        float vx[4] = {x, x + w, x + w, x    };
+        float vy[4] = {y, y,     y + h, y + h};
+        unsigned char col[4];
+
+        batch_color (color, col);
+        batch_add_rect_outline (vx, vy, col, line_width);
+        return 0;
+    }
+
     glBindBuffer (GL_ARRAY_BUFFER, 0);
     glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
 
@@ -751,6 +1082,27 @@ draw_2d_rect_rot (int x, int y, int w, int h, float *color, float line_width,
     shader_obj_t *sobj = &s_sobj[ttype];
     float matrix[16];
 
+    if (s_batch.enabled)
+    {
+        float vx[4] = {x, x + w, x + w, x    };
+        float vy[4] = {y, y,     y + h, y + h};
+        float c = cosf (DEG_TO_RAD (rot_degree));
+        float s = sinf (DEG_TO_RAD (rot_degree));
+        unsigned char col[4];
+
+        for (int i = 0; i < 4; i ++)
+        {
+            float dx = vx[i] - px;
+            float dy = vy[i] - py;
+            vx[i] = c * dx - s * dy + px;
+            vy[i] = s * dx + c * dy + py;
+        }
+
+        batch_color (color, col);
+        batch_add_rect_outline (vx, vy, col, line_width);
+        return 0;
+    }
+
     glBindBuffer (GL_ARRAY_BUFFER, 0);
     glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
 
@@ -800,6 +1152,15 @@ draw_2d_rect_rot (int x, int y, int w, int h, float *color, float line_width,
 int
 draw_2d_line (int x0, int y0, int x1, int y1, float *color, float line_width)
 {
+    if (s_batch.enabled)
+    {
+        unsigned char col[4];
+
+        batch_color (color, col);
+        batch_add_line (x0, y0, x1, y1, col, line_width, 0);
+        return 0;
+    }
+
     if (line_width == 1.0f)
     {
         int ttype = 0;
@@ -866,6 +1227,22 @@ draw_2d_fillcircle (int x, int y, int radius, float *color)
     float matrix[16];
     float vtx[(CIRCLE_DIVNUM+2) * 2];
 
+    if (s_batch.enabled)
+    {
+        unsigned char col[4];
+        float delta = 2 * M_PI / (float)CIRCLE_DIVNUM;
+
+        batch_color (color, col);
+        for (int i = 0; i < CIRCLE_DIVNUM; i ++)
+        {
+            batch_vtx_t *tri = batch_alloc (3);
+            batch_set_vtx (&tri[0], x, y, col);
+            batch_set_vtx (&tri[1], radius * cosf (delta * i)     + x, radius * sinf (delta * i)     + y, col);
+            batch_set_vtx (&tri[2], radius * cosf (delta * (i+1)) + x, radius * sinf (delta * (i+1)) + y, col);
+        }
+        return 0;
+    }
+
     glBindBuffer (GL_ARRAY_BUFFER, 0);
     glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
 
@@ -912,6 +1289,21 @@ draw_2d_circle (int x, int y, int radius, float *color, float line_width)
     float matrix[16];
     float vtx[(CIRCLE_DIVNUM+2) * 2];
 
+    if (s_batch.enabled)
+    {
+        unsigned char col[4];
+        float delta = 2 * M_PI / (float)CIRCLE_DIVNUM;
+
+        batch_color (color, col);
+        for (int i = 0; i < CIRCLE_DIVNUM; i ++)
+        {
+            batch_add_line (radius * cosf (delta * i)     + x, radius * sinf (delta * i)     + y,
+                            radius * cosf (delta * (i+1)) + x, radius * sinf (delta * (i+1)) + y,
+                            col, line_width, 1);
+        }
+        return 0;
+    }
+
     glBindBuffer (GL_ARRAY_BUFFER, 0);
     glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
 
@@ -28,6 +28,10 @@ int draw_2d_texture_blendfunc (int texid, int x, int y, int w, int h,
 int draw_2d_texture_modulate (int texid, int x, int y, int w, int h,
                            int upsidedown, float *color, unsigned int *blendfunc);
 int draw_2d_colormap (int texid, int x, int y, int w, int h, float alpha, int upsidedown);
+int draw_2d_classmap (texture_2d_t *classtex, int palette_texid, int x, int y, int w, int h,
+                      float alpha, int upsidedown);
+int draw_2d_classmap_rot (texture_2d_t *classtex, int palette_texid, int x, int y, int w, int h,
+                          float alpha, float px, float py, float deg);
 
 int draw_2d_rect (int x, int y, int w, int h, float *color, float line_width);
 int draw_2d_rect_rot (int x, int y, int w, int h, float *color, float line_width,
@@ -36,6 +40,16 @@ int draw_2d_line (int x0, int y0, int x1, int y1, float *color, float line_width
 int draw_2d_fillcircle (int x, int y, int radius, float *color);
 int draw_2d_circle (int x, int y, int radius, float *color, float line_width);
 
+/*
+ *  between begin_2d_batch() and end_2d_batch(), draw_2d_fillrect/rect/rect_rot/
+ *  line/fillcircle/circle are accumulated and drawn with one draw call.
+ *  the texture draws flush them first, so the drawing order is kept.
+ *  call flush_2d_batch() before drawing with the other renderers (e.g. draw_dbgstr).
+ */
+int begin_2d_batch ();
+int flush_2d_batch ();
+int end_2d_batch ();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,140 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "util_sched.h"
+#include "util_pmeter.h"
+
+#define AVERAGE_WEIGHT      0.1     /* weight of the latest time     */
+#define INTERVAL_HYSTERESIS 0.2     /* to stop the interval flapping */
+
+
+static void
+update_average (double *avg, double val)
+{
+    if (*avg == 0)
+        *avg = val;
+    else
+        *avg += (val - *avg) * AVERAGE_WEIGHT;
+}
+
+void
+sched_init (sched_t *sched, float target_fps, int max_interval)
+{
+    memset (sched, 0, sizeof (*sched));
+
+    sched->target_ms    = (target_fps > 0) ? 1000.0 / target_fps : 0;
+    sched->max_interval = (max_interval > 1) ? max_interval : 1;
+    sched->interval     = 1;
+}
+
+/*
+ *  the smallest interval of  render_ms + infer_ms / interval <= target_ms.
+ *  it goes down only when the smaller one fits with a margin.
+ */
+static void
+update_interval (sched_t *sched)
+{
+    double budget = sched->target_ms - sched->render_ms;
+    double ratio;
+    int    interval;
+
+    if (sched->infer_ms <= 0)
+        return;
+
+    if (budget <= 0)
+    {
+        sched->interval = sched->max_interval;
+        return;
+    }
+
+    ratio    = sched->infer_ms / budget;
+    interval = (int)ceil (ratio);
+
+    if (interval < sched->interval && ratio > sched->interval - 1 - INTERVAL_HYSTERESIS)
+        interval = sched->interval;
+
+    if (interval < 1)
+        interval = 1;
+    if (interval > sched->max_interval)
+        interval = sched->max_interval;
+
+    sched->interval = interval;
+}
+
+int
+sched_begin_frame (sched_t *sched)
+{
+    double now = pmeter_get_time_ms ();
+
+    /* close the previous frame */
+    if (sched->frame_begin_ms > 0)
+    {
+        double frame_ms = now - sched->frame_begin_ms;
+
+        update_average (&sched->render_ms, frame_ms - sched->frame_infer_ms);
+        if (sched->run)
+            update_average (&sched->infer_ms, sched->frame_infer_ms);
+    }
+    sched->frame_begin_ms = now;
+    sched->frame_infer_ms = 0;
+
+    if (sched->target_ms <= 0)
+    {
+        sched->run = 1;
+        return 1;
+    }
+
+    update_interval (sched);
+
+    if (sched->countdown > sched->interval - 1)
+        sched->countdown = sched->interval - 1;
+
+    sched->run = (sched->countdown <= 0);
+    if (sched->run)
+        sched->countdown = sched->interval - 1;
+    else
+        sched->countdown --;
+
+    return sched->run;
+}
+
+void
+sched_stage_begin (sched_t *sched, int stage)
+{
+    if (stage < 0 || stage >= SCHED_MAX_STAGES)
+        return;
+
+    sched->stages[stage].begin_ms = pmeter_get_time_ms ();
+}
+
+void
+sched_stage_end (sched_t *sched, int stage)
+{
+    if (stage < 0 || stage >= SCHED_MAX_STAGES)
+        return;
+
+    sched_stage_t *s = &sched->stages[stage];
+    s->last_ms = pmeter_get_time_ms () - s->begin_ms;
+    update_average (&s->avg_ms, s->last_ms);
+
+    sched->frame_infer_ms += s->last_ms;
+}
+
+double
+sched_get_stage_ms (sched_t *sched, int stage)
+{
+    if (stage < 0 || stage >= SCHED_MAX_STAGES)
+        return 0;
+
+    return sched->stages[stage].avg_ms;
+}
+
+int
+sched_get_interval (sched_t *sched)
+{
+    return sched->interval;
+}
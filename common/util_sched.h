@@ -0,0 +1,72 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_SCHED_H_
+#define _UTIL_SCHED_H_
+
+#define SCHED_MAX_STAGES    4
+
+/*
+ *  adaptive inference rate.
+ *
+ *  the inference runs once in (interval) rendered frames. the interval is
+ *  chosen from the measured times so that the average frame time
+ *
+ *      render_ms + infer_ms / interval
+ *
+ *  fits in the frame budget of the target FPS. the frames in between reuse
+ *  (or extrapolate) the last results.
+ *
+ *    for (;;) {
+ *        if (sched_begin_frame (&sched)) {
+ *            sched_stage_begin (&sched, 0);  invoke stage0;  sched_stage_end (&sched, 0);
+ *            sched_stage_begin (&sched, 1);  invoke stage1;  sched_stage_end (&sched, 1);
+ *        }
+ *        render; swap;
+ *    }
+ */
+typedef struct _sched_stage_t
+{
+    double  begin_ms;
+    double  last_ms;            /* time of the latest run  */
+    double  avg_ms;             /* moving average          */
+} sched_stage_t;
+
+typedef struct _sched_t
+{
+    double  target_ms;          /* frame budget (0: inference on every frame) */
+    int     max_interval;
+
+    int     interval;           /* the inference runs once in (interval) frames */
+    int     countdown;          /* frames until the next inference              */
+    int     run;                /* the inference runs in the current frame      */
+
+    double  frame_begin_ms;
+    double  frame_infer_ms;     /* inference time in the current frame          */
+    double  render_ms;          /* moving average of the frame time w/o inference */
+    double  infer_ms;           /* moving average of the inference time         */
+
+    sched_stage_t stages[SCHED_MAX_STAGES];
+} sched_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void    sched_init (sched_t *sched, float target_fps, int max_interval);
+
+/* returns 1 if the inference runs in this frame */
+int     sched_begin_frame (sched_t *sched);
+
+void    sched_stage_begin (sched_t *sched, int stage);
+void    sched_stage_end   (sched_t *sched, int stage);
+
+double  sched_get_stage_ms (sched_t *sched, int stage);
+int     sched_get_interval (sched_t *sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_SCHED_H_ */
@@ -0,0 +1,547 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GLES2/gl2.h>
+#if defined (USE_GLES_31)
+#include <GLES3/gl31.h>
+#elif defined (USE_GLES_30)
+#include <GLES3/gl3.h>
+#endif
+#include "util_segmap.h"
+#include "util_shader.h"
+#include "util_debug.h"
+
+#if defined (__SSE2__)
+#define SEGMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define SEGMAP_NEON
+#include <arm_neon.h>
+#endif
+
+
+/* -------------------------------------------------- *
+ *  argmax
+ *
+ *   the classes of a pixel are contiguous, so 4 pixels are processed
+ *   side by side: one lane per pixel, one class per step. the select
+ *   replaces the data dependent branch of the scalar loop.
+ *   the first class of the highest confidence wins, same as the scalar.
+ * -------------------------------------------------- */
+void
+segmap_argmax (const float *confidence, int num_pix, int num_ch, int num_class,
+               unsigned char *class_map)
+{
+    int i = 0;
+
+#if defined (SEGMAP_SSE2)
+    for (; i + 4 <= num_pix; i += 4)
+    {
+        const float *p0 = &confidence[(i + 0) * num_ch];
+        const float *p1 = &confidence[(i + 1) * num_ch];
+        const float *p2 = &confidence[(i + 2) * num_ch];
+        const float *p3 = &confidence[(i + 3) * num_ch];
+
+        __m128  vmax = _mm_setr_ps (p0[0], p1[0], p2[0], p3[0]);
+        __m128i vidx = _mm_setzero_si128 ();
+
+        for (int c = 1; c < num_class; c ++)
+        {
+            __m128  v  = _mm_setr_ps (p0[c], p1[c], p2[c], p3[c]);
+            __m128  gt = _mm_cmpgt_ps (v, vmax);
+            __m128i gti= _mm_castps_si128 (gt);
+
+            vmax = _mm_or_ps (_mm_and_ps (gt, v), _mm_andnot_ps (gt, vmax));
+            vidx = _mm_or_si128 (_mm_and_si128 (gti, _mm_set1_epi32 (c)), _mm_andnot_si128 (gti, vidx));
+        }
+
+        int idx[4];
+        _mm_storeu_si128 ((__m128i *)idx, vidx);
+        class_map[i + 0] = idx[0];
+        class_map[i + 1] = idx[1];
+        class_map[i + 2] = idx[2];
+        class_map[i + 3] = idx[3];
+    }
+#elif defined (SEGMAP_NEON)
+    for (; i + 4 <= num_pix; i += 4)
+    {
+        const float *p0 = &confidence[(i + 0) * num_ch];
+        const float *p1 = &confidence[(i + 1) * num_ch];
+        const float *p2 = &confidence[(i + 2) * num_ch];
+        const float *p3 = &confidence[(i + 3) * num_ch];
+        float v4[4] = {p0[0], p1[0], p2[0], p3[0]};
+
+        float32x4_t vmax = vld1q_f32 (v4);
+        uint32x4_t  vidx = vdupq_n_u32 (0);
+
+        for (int c = 1; c < num_class; c ++)
+        {
+            v4[0] = p0[c];
+            v4[1] = p1[c];
+            v4[2] = p2[c];
+            v4[3] = p3[c];
+
+            float32x4_t v  = vld1q_f32 (v4);
+            uint32x4_t  gt = vcgtq_f32 (v, vmax);
+
+            vmax = vbslq_f32 (gt, v, vmax);
+            vidx = vbslq_u32 (gt, vdupq_n_u32 (c), vidx);
+        }
+
+        unsigned int idx[4];
+        vst1q_u32 (idx, vidx);
+        class_map[i + 0] = idx[0];
+        class_map[i + 1] = idx[1];
+        class_map[i + 2] = idx[2];
+        class_map[i + 3] = idx[3];
+    }
+#endif
+
+    for (; i < num_pix; i ++)
+    {
+        const float *p = &confidence[i * num_ch];
+        int max_id = 0;
+
+        for (int c = 1; c < num_class; c ++)
+        {
+            if (p[c] > p[max_id])
+                max_id = c;
+        }
+        class_map[i] = max_id;
+    }
+}
+
+void
+segmap_colorize (const unsigned char *class_map, int num_pix,
+                 const unsigned int *palette, unsigned int *rgba)
+{
+    for (int i = 0; i < num_pix; i ++)
+        rgba[i] = palette[class_map[i]];
+}
+
+
+/* -------------------------------------------------- *
+ *  GPU
+ * -------------------------------------------------- */
+static GLuint
+create_nearest_texture (GLenum fmt, int w, int h, void *imgbuf)
+{
+    GLuint texid;
+
+    glGenTextures (1, &texid);
+    glBindTexture (GL_TEXTURE_2D, texid);
+
+    /* the class ids must not be interpolated */
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D (GL_TEXTURE_2D, 0, fmt, w, h, 0, fmt, GL_UNSIGNED_BYTE, imgbuf);
+
+    return texid;
+}
+
+int
+segmap_init (segmap_t *segmap, int w, int h)
+{
+    memset (segmap, 0, sizeof (*segmap));
+
+    segmap->class_map = (unsigned char *)calloc (w * h, 1);
+    if (segmap->class_map == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    segmap->w = w;
+    segmap->h = h;
+
+    segmap->classtex.texid  = create_nearest_texture (GL_LUMINANCE, w, h, segmap->class_map);
+    segmap->classtex.width  = w;
+    segmap->classtex.height = h;
+    segmap->classtex.format = pixfmt_fourcc ('L', '0', '0', '8');
+
+    segmap->palette_texid = create_nearest_texture (GL_RGBA, SEGMAP_MAX_CLASS, 1, NULL);
+
+    return 0;
+}
+
+void
+segmap_destroy (segmap_t *segmap)
+{
+    GLuint texid[4] = {segmap->classtex.texid, segmap->palette_texid,
+                       segmap->conf_texid,     segmap->colortex.texid};
+
+    glDeleteTextures (4, texid);
+    glDeleteFramebuffers (1, &segmap->fbo_id);
+    if (segmap->prog)
+        glDeleteProgram (segmap->prog);
+    free (segmap->class_map);
+    memset (segmap, 0, sizeof (*segmap));
+}
+
+/* the classes after (num_class) are transparent */
+void
+segmap_set_palette (segmap_t *segmap, const unsigned int *palette, int num_class)
+{
+    unsigned int colors[SEGMAP_MAX_CLASS] = {0};
+
+    if (num_class > SEGMAP_MAX_CLASS)
+        num_class = SEGMAP_MAX_CLASS;
+    memcpy (colors, palette, num_class * sizeof (unsigned int));
+
+    glBindTexture (GL_TEXTURE_2D, segmap->palette_texid);
+    glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, SEGMAP_MAX_CLASS, 1, GL_RGBA, GL_UNSIGNED_BYTE, colors);
+}
+
+void
+segmap_upload (segmap_t *segmap)
+{
+    glBindTexture (GL_TEXTURE_2D, segmap->classtex.texid);
+    glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, segmap->w, segmap->h,
+                     GL_LUMINANCE, GL_UNSIGNED_BYTE, segmap->class_map);
+}
+
+void
+segmap_update (segmap_t *segmap, const float *confidence, int num_ch, int num_class)
+{
+    segmap_argmax (confidence, segmap->w * segmap->h, num_ch, num_class, segmap->class_map);
+    segmap_upload (segmap);
+}
+
+
+/* -------------------------------------------------- *
+ *  argmax on GPU
+ *
+ *   the confidence tensor [h][w][num_ch] is uploaded without repacking,
+ *   SEGMAP_CONF_TEXW floats per texture row. one fragment of colortex is
+ *   one pixel of the class map: it walks the classes of its pixel and
+ *   writes the palette color of the most confident one.
+ *
+ *   GLES3: R32F texture, texelFetch() with integer indices.
+ *   GLES2: no float texture, so the float bits are uploaded as RGBA8 and
+ *          decoded in the shader (IEEE754, little endian). needs highp.
+ * -------------------------------------------------- */
+#define SEGMAP_CONF_TEXW    2048
+
+#define SEGMAP_CONF_RGBA8   1
+#define SEGMAP_CONF_R32F    2
+
+static char s_argmax_vs[] = "                             \n\
+                                                          \n\
+attribute vec4 a_Vertex;                                  \n\
+void main(void)                                           \n\
+{                                                         \n\
+    gl_Position = a_Vertex;                               \n\
+}                                                         \n";
+
+static char s_argmax_fs[] = "                             \n\
+                                                          \n\
+precision highp float;                                    \n\
+uniform sampler2D u_sampler;                              \n\
+uniform sampler2D u_sampler2;                             \n\
+uniform float     u_SegW;                                 \n\
+uniform float     u_NumCh;                                \n\
+uniform float     u_NumClass;                             \n\
+uniform float     u_ConfH;                                \n\
+                                                          \n\
+float                                                     \n\
+fetch_conf (float idx)                                    \n\
+{                                                         \n\
+    float row = floor (idx / 2048.0);                     \n\
+    float col = idx - row * 2048.0;                       \n\
+    vec2  uv  = vec2 ((col + 0.5) / 2048.0, (row + 0.5) / u_ConfH); \n\
+    vec4  b   = floor (texture2D (u_sampler, uv) * 255.0 + 0.5); \n\
+                                                          \n\
+    float expo = mod (b.a, 128.0) * 2.0 + floor (b.b / 128.0); \n\
+    float mant = mod (b.b, 128.0) * 65536.0 + b.g * 256.0 + b.r; \n\
+    if (expo == 0.0)                                      \n\
+        return 0.0;                                       \n\
+                                                          \n\
+    float val = exp2 (expo - 127.0) * (1.0 + mant / 8388608.0); \n\
+    return (b.a >= 128.0) ? -val : val;                   \n\
+}                                                         \n\
+                                                          \n\
+void main(void)                                           \n\
+{                                                         \n\
+    vec2  pos  = floor (gl_FragCoord.xy);                 \n\
+    float idx  = (pos.y * u_SegW + pos.x) * u_NumCh;      \n\
+    float vmax = fetch_conf (idx);                        \n\
+    float id   = 0.0;                                     \n\
+                                                          \n\
+    for (int c = 1; c < 256; c ++)                        \n\
+    {                                                     \n\
+        float fc = float (c);                             \n\
+        if (fc >= u_NumClass)                             \n\
+            break;                                        \n\
+                                                          \n\
+        float v = fetch_conf (idx + fc);                  \n\
+        if (v > vmax)                                     \n\
+        {                                                 \n\
+            vmax = v;                                     \n\
+            id   = fc;                                    \n\
+        }                                                 \n\
+    }                                                     \n\
+    gl_FragColor = texture2D (u_sampler2, vec2 ((id + 0.5) / 256.0, 0.5)); \n\
+}                                                         \n";
+
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+static char s_argmax_vs_es3[] = "#version 300 es          \n\
+                                                          \n\
+in vec4 a_Vertex;                                         \n\
+void main(void)                                           \n\
+{                                                         \n\
+    gl_Position = a_Vertex;                               \n\
+}                                                         \n";
+
+static char s_argmax_fs_es3[] = "#version 300 es          \n\
+                                                          \n\
+precision highp float;                                    \n\
+precision highp int;                                      \n\
+uniform highp sampler2D u_sampler;                        \n\
+uniform lowp  sampler2D u_sampler2;                       \n\
+uniform int   u_SegW;                                     \n\
+uniform int   u_NumCh;                                    \n\
+uniform int   u_NumClass;                                 \n\
+out vec4 o_FragColor;                                     \n\
+                                                          \n\
+float                                                     \n\
+fetch_conf (int idx)                                      \n\
+{                                                         \n\
+    return texelFetch (u_sampler, ivec2 (idx & 2047, idx >> 11), 0).r; \n\
+}                                                         \n\
+                                                          \n\
+void main(void)                                           \n\
+{                                                         \n\
+    ivec2 pos  = ivec2 (gl_FragCoord.xy);                 \n\
+    int   idx  = (pos.y * u_SegW + pos.x) * u_NumCh;      \n\
+    float vmax = fetch_conf (idx);                        \n\
+    int   id   = 0;                                       \n\
+                                                          \n\
+    for (int c = 1; c < u_NumClass; c ++)                 \n\
+    {                                                     \n\
+        float v = fetch_conf (idx + c);                   \n\
+        if (v > vmax)                                     \n\
+        {                                                 \n\
+            vmax = v;                                     \n\
+            id   = c;                                     \n\
+        }                                                 \n\
+    }                                                     \n\
+    o_FragColor = texelFetch (u_sampler2, ivec2 (id, 0), 0); \n\
+}                                                         \n";
+
+static int
+get_gles_major_version ()
+{
+    const char *ver = (const char *)glGetString (GL_VERSION);
+    int major = 0, minor = 0;
+
+    /* "OpenGL ES N.M ..." */
+    if (ver == NULL || sscanf (ver, "OpenGL ES %d.%d", &major, &minor) < 1)
+        return 2;
+
+    return major;
+}
+#endif
+
+int
+segmap_init_gpu (segmap_t *segmap, int num_ch)
+{
+    int num_conf = segmap->w * segmap->h * num_ch;
+    int conf_texh = (num_conf + SEGMAP_CONF_TEXW - 1) / SEGMAP_CONF_TEXW;
+    GLint max_texsize;
+    GLenum ifmt, fmt, type;
+    int conf_fmt = SEGMAP_CONF_RGBA8;
+    char *vs = s_argmax_vs;
+    char *fs = s_argmax_fs;
+
+    /* the caller falls back to the CPU argmax */
+    glGetIntegerv (GL_MAX_TEXTURE_SIZE, &max_texsize);
+    if (SEGMAP_CONF_TEXW > max_texsize || conf_texh > max_texsize)
+        return -1;
+
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+    if (get_gles_major_version () >= 3)
+    {
+        conf_fmt = SEGMAP_CONF_R32F;
+        vs = s_argmax_vs_es3;
+        fs = s_argmax_fs_es3;
+    }
+#endif
+
+    if (conf_fmt == SEGMAP_CONF_RGBA8)
+    {
+        /* the decoded mantissa (24bit) and the tensor index need highp */
+        GLint range[2], precision = 0;
+        glGetShaderPrecisionFormat (GL_FRAGMENT_SHADER, GL_HIGH_FLOAT, range, &precision);
+        if (precision < 23 || num_conf >= (1 << 24))
+            return -1;
+    }
+
+    int prog = build_shader (vs, fs);
+    if (prog == 0)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    /* confidence tensor */
+    ifmt = GL_RGBA;
+    fmt  = GL_RGBA;
+    type = GL_UNSIGNED_BYTE;
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+    if (conf_fmt == SEGMAP_CONF_R32F)
+    {
+        ifmt = GL_R32F;
+        fmt  = GL_RED;
+        type = GL_FLOAT;
+    }
+#endif
+
+    GLuint texid;
+    glGenTextures (1, &texid);
+    glBindTexture (GL_TEXTURE_2D, texid);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D (GL_TEXTURE_2D, 0, ifmt, SEGMAP_CONF_TEXW, conf_texh, 0, fmt, type, NULL);
+
+    segmap->conf_texid = texid;
+    segmap->conf_texh  = conf_texh;
+
+    /* palette color of the argmax. LINEAR to blend the class colors */
+    glGenTextures (1, &texid);
+    glBindTexture (GL_TEXTURE_2D, texid);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, segmap->w, segmap->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    segmap->colortex.texid  = texid;
+    segmap->colortex.width  = segmap->w;
+    segmap->colortex.height = segmap->h;
+    segmap->colortex.format = pixfmt_fourcc ('R', 'G', 'B', 'A');
+
+    GLint fbo_prev;
+    glGetIntegerv (GL_FRAMEBUFFER_BINDING, &fbo_prev);
+    glGenFramebuffers (1, &segmap->fbo_id);
+    glBindFramebuffer (GL_FRAMEBUFFER, segmap->fbo_id);
+    glFramebufferTexture2D (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texid, 0);
+    GLenum status = glCheckFramebufferStatus (GL_FRAMEBUFFER);
+    glBindFramebuffer (GL_FRAMEBUFFER, fbo_prev);
+
+    segmap->prog            = prog;
+    segmap->num_ch          = num_ch;
+    segmap->conf_fmt        = conf_fmt;
+    segmap->loc_vtx         = glGetAttribLocation  (prog, "a_Vertex");
+    segmap->loc_tex_conf    = glGetUniformLocation (prog, "u_sampler");
+    segmap->loc_tex_palette = glGetUniformLocation (prog, "u_sampler2");
+    segmap->loc_seg_w       = glGetUniformLocation (prog, "u_SegW");
+    segmap->loc_num_ch      = glGetUniformLocation (prog, "u_NumCh");
+    segmap->loc_num_class   = glGetUniformLocation (prog, "u_NumClass");
+    segmap->loc_conf_texh   = glGetUniformLocation (prog, "u_ConfH");
+
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        segmap->conf_fmt = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+upload_confidence (segmap_t *segmap, const float *confidence)
+{
+    int num_conf = segmap->w * segmap->h * segmap->num_ch;
+    int rows = num_conf / SEGMAP_CONF_TEXW;
+    int rem  = num_conf % SEGMAP_CONF_TEXW;
+    GLenum fmt  = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+    if (segmap->conf_fmt == SEGMAP_CONF_R32F)
+    {
+        fmt  = GL_RED;
+        type = GL_FLOAT;
+    }
+#endif
+
+    glBindTexture (GL_TEXTURE_2D, segmap->conf_texid);
+    glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+
+    if (rows > 0)
+        glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, SEGMAP_CONF_TEXW, rows, fmt, type, confidence);
+
+    if (rem > 0)
+        glTexSubImage2D (GL_TEXTURE_2D, 0, 0, rows, rem, 1, fmt, type,
+                         &confidence[rows * SEGMAP_CONF_TEXW]);
+}
+
+void
+segmap_update_gpu (segmap_t *segmap, const float *confidence, int num_class)
+{
+    float vtx[] = {-1.0f,  1.0f,
+                   -1.0f, -1.0f,
+                    1.0f,  1.0f,
+                    1.0f, -1.0f};
+    GLint fbo_prev, viewport[4];
+
+    if (num_class > SEGMAP_MAX_CLASS)
+        num_class = SEGMAP_MAX_CLASS;
+
+    upload_confidence (segmap, confidence);
+
+    glGetIntegerv (GL_FRAMEBUFFER_BINDING, &fbo_prev);
+    glGetIntegerv (GL_VIEWPORT, viewport);
+
+    glBindFramebuffer (GL_FRAMEBUFFER, segmap->fbo_id);
+    glViewport (0, 0, segmap->w, segmap->h);
+
+    glUseProgram (segmap->prog);
+
+    glActiveTexture (GL_TEXTURE1);
+    glBindTexture (GL_TEXTURE_2D, segmap->palette_texid);
+    glActiveTexture (GL_TEXTURE0);
+    glBindTexture (GL_TEXTURE_2D, segmap->conf_texid);
+    glUniform1i (segmap->loc_tex_conf,    0);
+    glUniform1i (segmap->loc_tex_palette, 1);
+
+    if (segmap->conf_fmt == SEGMAP_CONF_R32F)
+    {
+        glUniform1i (segmap->loc_seg_w,     segmap->w);
+        glUniform1i (segmap->loc_num_ch,    segmap->num_ch);
+        glUniform1i (segmap->loc_num_class, num_class);
+    }
+    else
+    {
+        glUniform1f (segmap->loc_seg_w,     segmap->w);
+        glUniform1f (segmap->loc_num_ch,    segmap->num_ch);
+        glUniform1f (segmap->loc_num_class, num_class);
+        glUniform1f (segmap->loc_conf_texh, segmap->conf_texh);
+    }
+
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+    glEnableVertexAttribArray (segmap->loc_vtx);
+    glVertexAttribPointer (segmap->loc_vtx, 2, GL_FLOAT, GL_FALSE, 0, vtx);
+
+    glDisable (GL_BLEND);
+    glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+
+    glDisableVertexAttribArray (segmap->loc_vtx);
+    glBindFramebuffer (GL_FRAMEBUFFER, fbo_prev);
+    glViewport (viewport[0], viewport[1], viewport[2], viewport[3]);
+}
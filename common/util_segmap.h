@@ -0,0 +1,83 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_SEGMAP_H_
+#define _UTIL_SEGMAP_H_
+
+#include "util_texture.h"
+
+/*
+ *  class map of the segmentation models.
+ *
+ *  segmap_update_gpu():
+ *    the confidence tensor is uploaded as it is, and the argmax and the
+ *    palette lookup are done in the fragment shader, into segmap->colortex
+ *    (RGBA, GL_LINEAR). the blend of the class colors is the bilinear
+ *    filter when colortex is drawn.
+ *
+ *  segmap_update():
+ *    the fallback when segmap_init_gpu() fails, and for headless use.
+ *    the most confident class of each pixel is found on CPU (4 pixels at a
+ *    time with SSE2/NEON), and only the 1 byte class map is uploaded.
+ *    the palette lookup and the bilinear blend of the class colors are done
+ *    in the fragment shader (draw_2d_classmap()).
+ *
+ *  the colors are packed as (a << 24) | (b << 16) | (g << 8) | r.
+ */
+#define SEGMAP_MAX_CLASS    256
+
+typedef struct _segmap_t
+{
+    int             w, h;
+    unsigned char   *class_map;         /* [h][w] */
+    texture_2d_t    classtex;           /* class_map on GPU (GL_LUMINANCE) */
+    uint32_t        palette_texid;      /* [SEGMAP_MAX_CLASS] x 1 (RGBA)   */
+
+    /* segmap_init_gpu() */
+    int             num_ch;
+    int             conf_fmt;           /* 0: no GPU argmax                */
+    uint32_t        conf_texid;         /* confidence tensor as it is      */
+    int             conf_texh;          /* SEGMAP_CONF_TEXW x conf_texh    */
+    uint32_t        fbo_id;
+    texture_2d_t    colortex;           /* palette color of the argmax     */
+    int             prog;
+    int             loc_vtx;
+    int             loc_tex_conf;
+    int             loc_tex_palette;
+    int             loc_seg_w;
+    int             loc_num_ch;
+    int             loc_num_class;
+    int             loc_conf_texh;
+} segmap_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* CPU only, for headless use too */
+void segmap_argmax (const float *confidence, int num_pix, int num_ch, int num_class,
+                    unsigned char *class_map);
+void segmap_colorize (const unsigned char *class_map, int num_pix,
+                      const unsigned int *palette, unsigned int *rgba);
+
+/* GPU */
+int  segmap_init (segmap_t *segmap, int w, int h);
+void segmap_destroy (segmap_t *segmap);
+void segmap_set_palette (segmap_t *segmap, const unsigned int *palette, int num_class);
+
+/* segmap_argmax() into segmap->class_map, and upload it */
+void segmap_update (segmap_t *segmap, const float *confidence, int num_ch, int num_class);
+
+/* upload segmap->class_map filled by the caller */
+void segmap_upload (segmap_t *segmap);
+
+/* argmax on GPU. returns -1 if not supported, then use segmap_update() */
+int  segmap_init_gpu (segmap_t *segmap, int num_ch);
+void segmap_update_gpu (segmap_t *segmap, const float *confidence, int num_class);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_SEGMAP_H_ */
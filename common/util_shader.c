@@ -5,11 +5,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 #if defined (USE_GLES_31)
 #include <GLES3/gl31.h>
 #include <GLES3/gl3ext.h>
+#elif defined (USE_GLES_30)
+#include <GLES3/gl3.h>
 #endif
 #include "util_shader.h"
 #include "util_debug.h"
@@ -162,41 +168,299 @@ link_shaders (GLuint vertShader, GLuint fragShader)
   return program;
 }
 
-int
-build_shader (const char *strVS, const char *strFS)
+
+/* ----------------------------------------------------------- *
+ *   program binary cache
+ *
+ *   the linked programs are saved to $SHADER_CACHE_DIR
+ *   (default: $HOME/.cache/tflite_gles_app/shader), keyed by the
+ *   hash of the sources and the driver strings. when the driver
+ *   rejects a cached binary (updated etc.), the program is built
+ *   from the sources and the cache is overwritten.
+ *   SHADER_CACHE_DIR="" disables the cache.
+ *   only the programs built here are cached. the shaders of ImGui
+ *   and of the TFLite GL/GPU delegate are built by themselves, and
+ *   are compiled every run.
+ * ----------------------------------------------------------- */
+#if !defined (USE_GLX)
+#define SHADER_CACHE_MAGIC  0x31424753      /* "SGB1" */
+
+typedef struct _shader_cache_header_t
 {
-    GLuint vs, fs, prog;
-    
-    vs = compile_shader_text (GL_VERTEX_SHADER, strVS);
-    fs = compile_shader_text (GL_FRAGMENT_SHADER, strFS);
-    prog = link_shaders (vs, fs);
+  uint32_t magic;
+  uint32_t format;                          /* binaryFormat of the driver */
+  uint32_t length;
+  uint32_t reserved;
+  uint64_t key;
+} shader_cache_header_t;
+
+static int      s_cache_state;              /* 0: not yet, 1: enabled, -1: disabled */
+static char     s_cache_dir[256];
+static uint64_t s_cache_driver_hash;
+static PFNGLGETPROGRAMBINARYOESPROC s_glGetProgramBinary;
+static PFNGLPROGRAMBINARYOESPROC    s_glProgramBinary;
+
+/* FNV-1a. the terminating '\0' is hashed too, to separate the strings */
+static uint64_t
+hash_string (uint64_t hash, const char *str)
+{
+  if (str == NULL)
+    str = "";
 
-    return prog;
+  do
+    {
+      hash ^= (unsigned char)*str;
+      hash *= 0x100000001b3ULL;
+    } while (*str ++);
+
+  return hash;
 }
 
-int
-generate_shader (shader_obj_t *sobj, char *str_vs, char *str_fs)
+static int
+make_cache_dir (char *path)
+{
+  /* mkdir -p */
+  for (char *p = path + 1; *p; p ++)
+    {
+      if (*p != '/')
+        continue;
+
+      *p = '\0';
+      mkdir (path, 0755);
+      *p = '/';
+    }
+
+  if (mkdir (path, 0755) < 0 && errno != EEXIST)
+    return -1;
+
+  return 0;
+}
+
+static int
+init_shader_cache ()
+{
+  if (s_cache_state != 0)
+    return s_cache_state;
+
+  s_cache_state = -1;
+
+  const char *env_dir = getenv ("SHADER_CACHE_DIR");
+  const char *env_home = getenv ("HOME");
+  if (env_dir)
+    snprintf (s_cache_dir, sizeof (s_cache_dir), "%s", env_dir);
+  else if (env_home)
+    snprintf (s_cache_dir, sizeof (s_cache_dir), "%s/.cache/tflite_gles_app/shader", env_home);
+
+  if (s_cache_dir[0] == '\0')
+    return s_cache_state;
+
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+  s_glGetProgramBinary = glGetProgramBinary;
+  s_glProgramBinary    = glProgramBinary;
+#else
+  const char *ext = (const char *)glGetString (GL_EXTENSIONS);
+  if (ext && strstr (ext, "GL_OES_get_program_binary"))
+    {
+      s_glGetProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress ("glGetProgramBinaryOES");
+      s_glProgramBinary    = (PFNGLPROGRAMBINARYOESPROC)   eglGetProcAddress ("glProgramBinaryOES");
+    }
+#endif
+  if (s_glGetProgramBinary == NULL || s_glProgramBinary == NULL)
+    return s_cache_state;
+
+  /* some drivers expose the API without any binary format */
+  GLint num_formats = 0;
+  glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS_OES, &num_formats);
+  if (num_formats <= 0)
+    return s_cache_state;
+
+  if (make_cache_dir (s_cache_dir) < 0)
+    {
+      DBG_LOGW ("can't create the shader cache dir: %s\n", s_cache_dir);
+      return s_cache_state;
+    }
+
+  /* a binary is valid only for the driver which created it */
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = hash_string (hash, (const char *)glGetString (GL_VENDOR));
+  hash = hash_string (hash, (const char *)glGetString (GL_RENDERER));
+  hash = hash_string (hash, (const char *)glGetString (GL_VERSION));
+  s_cache_driver_hash = hash;
+
+  s_cache_state = 1;
+  return s_cache_state;
+}
+
+static void
+get_cache_path (char *path, int size, uint64_t key)
+{
+  snprintf (path, size, "%s/%016llx.bin", s_cache_dir, (unsigned long long)key);
+}
+
+static GLuint
+load_program_binary (uint64_t key)
+{
+  shader_cache_header_t hdr;
+  char   path[320];
+  void   *binary = NULL;
+  GLuint program = 0;
+
+  get_cache_path (path, sizeof (path), key);
+
+  FILE *fp = fopen (path, "rb");
+  if (fp == NULL)
+    return 0;
+
+  if (fread (&hdr, sizeof (hdr), 1, fp) != 1 ||
+      hdr.magic != SHADER_CACHE_MAGIC || hdr.key != key || hdr.length == 0)
+    goto exit;
+
+  binary = malloc (hdr.length);
+  if (binary == NULL || fread (binary, 1, hdr.length, fp) != hdr.length)
+    goto exit;
+
+  program = glCreateProgram ();
+  s_glProgramBinary (program, hdr.format, binary, hdr.length);
+
+  GLint stat = 0;
+  glGetProgramiv (program, GL_LINK_STATUS, &stat);
+  if (!stat)
+    {
+      /* rejected by the driver. clear the error and build from the sources */
+      glGetError ();
+      glDeleteProgram (program);
+      program = 0;
+    }
+
+exit:
+  free (binary);
+  fclose (fp);
+  return program;
+}
+
+static int
+save_program_binary (GLuint program, uint64_t key)
+{
+  shader_cache_header_t hdr = {0};
+  char    path[320], path_tmp[330];
+  GLint   length = 0;
+  GLsizei len    = 0;
+  GLenum  format = 0;
+
+  glGetProgramiv (program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+  if (length <= 0)
+    return -1;
+
+  void *binary = malloc (length);
+  if (binary == NULL)
+    return -1;
+
+  s_glGetProgramBinary (program, length, &len, &format, binary);
+  if (len <= 0)
+    {
+      free (binary);
+      return -1;
+    }
+
+  hdr.magic  = SHADER_CACHE_MAGIC;
+  hdr.format = format;
+  hdr.length = len;
+  hdr.key    = key;
+
+  /* write to a temporary file and rename it, not to leave a broken cache */
+  get_cache_path (path, sizeof (path), key);
+  snprintf (path_tmp, sizeof (path_tmp), "%s.%d", path, (int)getpid ());
+
+  int ret = -1;
+  FILE *fp = fopen (path_tmp, "wb");
+  if (fp)
+    {
+      if (fwrite (&hdr, sizeof (hdr), 1, fp) == 1 &&
+          fwrite (binary, 1, len, fp) == (size_t)len)
+        ret = 0;
+
+      fclose (fp);
+
+      if (ret == 0)
+        ret = rename (path_tmp, path);
+      if (ret < 0)
+        remove (path_tmp);
+    }
+
+  free (binary);
+  return ret;
+}
+#endif /* !defined (USE_GLX) */
+
+/*
+ *  compile and link, or load the program from the binary cache.
+ *  returns 0 on failure.
+ */
+static GLuint
+build_program_cached (const char *str_vs, const char *str_fs)
 {
   GLuint fs, vs, program;
 
+#if !defined (USE_GLX)
+  uint64_t key = 0;
+  int use_cache = (init_shader_cache () > 0);
+  if (use_cache)
+    {
+      key = hash_string (s_cache_driver_hash, str_vs);
+      key = hash_string (key, str_fs);
+
+      program = load_program_binary (key);
+      if (program)
+        return program;
+    }
+#endif
+
   vs = compile_shader_text (GL_VERTEX_SHADER,   str_vs);
   fs = compile_shader_text (GL_FRAGMENT_SHADER, str_fs);
   if (vs == 0 || fs == 0)
     {
       DBG_LOGE ("Failed to compile shader.\n");
-      return -1;
+      return 0;
     }
 
   program = link_shaders (vs, fs);
   if (program == 0)
     {
       DBG_LOGE ("Failed to link shaders.\n");
-      return -1;
+      return 0;
     }
 
   glDeleteShader (vs);
   glDeleteShader (fs);
 
+#if !defined (USE_GLX)
+  if (use_cache && save_program_binary (program, key) < 0)
+    DBG_LOGW ("can't save the shader cache.\n");
+#endif
+
+  return program;
+}
+
+
+int
+build_shader (const char *strVS, const char *strFS)
+{
+    GLuint prog;
+
+    prog = build_program_cached (strVS, strFS);
+
+    return prog;
+}
+
+int
+generate_shader (shader_obj_t *sobj, char *str_vs, char *str_fs)
+{
+  GLuint program;
+
+  program = build_program_cached (str_vs, str_fs);
+  if (program == 0)
+    return -1;
+
   sobj->program = program;
   sobj->loc_vtx = glGetAttribLocation (program, "a_Vertex"  );
   sobj->loc_nrm = glGetAttribLocation (program, "a_Normal"  );
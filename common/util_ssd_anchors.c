@@ -0,0 +1,186 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+
+// Copyright 2019 The MediaPipe Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "util_ssd_anchors.h"
+#include "util_debug.h"
+
+#define MAX_ANCHOR_TABLES   8
+
+typedef struct _anchor_table_t
+{
+    ssd_anchor_options_t options;
+    nms_anchors_t        anchors;
+} anchor_table_t;
+
+static anchor_table_t   s_tables[MAX_ANCHOR_TABLES];
+static int              s_num_tables;
+static pthread_mutex_t  s_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+void
+ssd_anchors_default_options (ssd_anchor_options_t *options)
+{
+    /* clear the padding too, the struct is compared with memcmp() */
+    memset (options, 0, sizeof (*options));
+
+    options->anchor_offset_x = 0.5f;
+    options->anchor_offset_y = 0.5f;
+    options->interpolated_scale_aspect_ratio = 1.0f;
+}
+
+
+/* -------------------------------------------------- *
+ *  based on:
+ *   mediapipe/calculators/tflite/ssd_anchors_calculator.cc
+ * -------------------------------------------------- */
+static int
+get_num_anchors_per_cell (const ssd_anchor_options_t *options, int first_layer, int last_layer)
+{
+    int num = 0;
+
+    for (int layer = first_layer; layer < last_layer; layer ++)
+    {
+        if (layer == 0 && options->reduce_boxes_in_lowest_layer)
+        {
+            num += 3;   /* predefined anchors for the first layer */
+        }
+        else
+        {
+            num += options->num_aspect_ratios;
+            if (options->interpolated_scale_aspect_ratio > 0.0f)
+                num += 1;
+        }
+    }
+    return num;
+}
+
+static void
+get_feature_map_size (const ssd_anchor_options_t *options, int layer, int *w, int *h)
+{
+    if (options->feature_map_width[layer] > 0)
+    {
+        *w = options->feature_map_width [layer];
+        *h = options->feature_map_height[layer];
+    }
+    else
+    {
+        int stride = options->strides[layer];
+        *w = (int)ceilf (1.0f * options->input_size_width  / stride);
+        *h = (int)ceilf (1.0f * options->input_size_height / stride);
+    }
+}
+
+/*
+ *  walk the layers in the order of GenerateAnchors(), merging the layers of
+ *  the same stride. the anchors of one cell share the center, so only the
+ *  centers are emitted (fixed_anchor_size).
+ */
+static int
+generate_anchors (const ssd_anchor_options_t *options, nms_anchors_t *anchors)
+{
+    int num_anchors = 0;
+    int layer_id = 0;
+
+    while (layer_id < options->num_layers)
+    {
+        int last_same_stride_layer = layer_id;
+        while (last_same_stride_layer < options->num_layers &&
+               options->strides[last_same_stride_layer] == options->strides[layer_id])
+        {
+            last_same_stride_layer ++;
+        }
+
+        int num_per_cell = get_num_anchors_per_cell (options, layer_id, last_same_stride_layer);
+        int fmap_w, fmap_h;
+        get_feature_map_size (options, layer_id, &fmap_w, &fmap_h);
+
+        for (int y = 0; y < fmap_h; y ++)
+        {
+            float y_center = (y + options->anchor_offset_y) / fmap_h;
+            for (int x = 0; x < fmap_w; x ++)
+            {
+                float x_center = (x + options->anchor_offset_x) / fmap_w;
+                for (int n = 0; n < num_per_cell; n ++)
+                {
+                    if (anchors)
+                    {
+                        anchors->cx[num_anchors] = x_center * options->input_size_width;
+                        anchors->cy[num_anchors] = y_center * options->input_size_height;
+                    }
+                    num_anchors ++;
+                }
+            }
+        }
+        layer_id = last_same_stride_layer;
+    }
+
+    return num_anchors;
+}
+
+
+const nms_anchors_t *
+ssd_anchors_get (const ssd_anchor_options_t *options)
+{
+    const nms_anchors_t *ret = NULL;
+
+    if (!options->fixed_anchor_size)
+    {
+        /* the decoders in this tree take the anchor centers only */
+        DBG_LOGE ("ERR: %s(%d): fixed_anchor_size is required\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    pthread_mutex_lock (&s_tables_mutex);
+
+    for (int i = 0; i < s_num_tables; i ++)
+    {
+        if (memcmp (&s_tables[i].options, options, sizeof (*options)) == 0)
+        {
+            ret = &s_tables[i].anchors;
+            goto exit;
+        }
+    }
+
+    if (s_num_tables >= MAX_ANCHOR_TABLES)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        goto exit;
+    }
+
+    anchor_table_t *table = &s_tables[s_num_tables];
+    int num_anchors = generate_anchors (options, NULL);
+
+    if (nms_init_anchors (&table->anchors, num_anchors) < 0)
+        goto exit;
+
+    generate_anchors (options, &table->anchors);
+    memcpy (&table->options, options, sizeof (*options));
+    s_num_tables ++;
+
+    ret = &table->anchors;
+
+exit:
+    pthread_mutex_unlock (&s_tables_mutex);
+    return ret;
+}
@@ -0,0 +1,58 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_SSD_ANCHORS_H_
+#define _UTIL_SSD_ANCHORS_H_
+
+#include "util_nms.h"
+
+#define SSD_ANCHORS_MAX_LAYERS  8
+
+/*
+ *  SsdAnchorsCalculatorOptions
+ *      mediapipe/calculators/tflite/ssd_anchors_calculator.proto
+ *
+ *  the whole struct is the key of the anchor table cache,
+ *  so always start from ssd_anchors_default_options().
+ */
+typedef struct _ssd_anchor_options_t
+{
+    int     input_size_width;                       /* [required] */
+    int     input_size_height;                      /* [required] */
+    float   min_scale;                              /* [required] */
+    float   max_scale;                              /* [required] */
+    float   anchor_offset_x;                        /* default = 0.5 */
+    float   anchor_offset_y;                        /* default = 0.5 */
+
+    int     num_layers;                             /* [required] */
+    int     feature_map_width [SSD_ANCHORS_MAX_LAYERS];  /* 0: computed from the strides */
+    int     feature_map_height[SSD_ANCHORS_MAX_LAYERS];
+    int     strides[SSD_ANCHORS_MAX_LAYERS];
+
+    int     num_aspect_ratios;
+    float   aspect_ratios[SSD_ANCHORS_MAX_LAYERS];
+
+    int     reduce_boxes_in_lowest_layer;           /* default = false */
+    float   interpolated_scale_aspect_ratio;        /* default = 1.0   */
+    int     fixed_anchor_size;                      /* default = false */
+} ssd_anchor_options_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ssd_anchors_default_options (ssd_anchor_options_t *options);
+
+/*
+ *  returns the anchor table (the anchor centers in the input pixels).
+ *  the tables are generated once per process and shared between the
+ *  detectors with the same options. don't free it.
+ */
+const nms_anchors_t *ssd_anchors_get (const ssd_anchor_options_t *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_SSD_ANCHORS_H_ */
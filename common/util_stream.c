@@ -0,0 +1,664 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "util_stream.h"
+#include "util_v4l2.h"
+#include "util_pixconv.h"
+#include "util_debug.h"
+#if defined (USE_INPUT_VIDEO_DECODE)
+#include "util_video_decode.h"
+#endif
+
+#define STREAM_AVERAGE_WEIGHT   0.1     /* weight of the latest time */
+#define FILE_FRAME_INTERVAL_US  33333   /* 30fps */
+#define V4L2_WAIT_TIMEOUT_MS    100     /* to see the stop request */
+
+
+static double
+get_time_ms ()
+{
+    struct timespec tv;
+    clock_gettime (CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec * 1000.0 + tv.tv_nsec / 1000000.0);
+}
+
+static void
+update_average (double *avg, double val)
+{
+    if (*avg == 0)
+        *avg = val;
+    else
+        *avg += (val - *avg) * STREAM_AVERAGE_WEIGHT;
+}
+
+
+/* -------------------------------------------------- *
+ *  frame exchange (source --> worker)
+ * -------------------------------------------------- */
+static void
+publish_frame (stream_t *st, double timestamp_ms)
+{
+    stream_server_t *srv = st->srv;
+
+    pthread_mutex_lock (&srv->mutex);
+
+    unsigned char *tmp = st->mid;
+    st->mid  = st->back;
+    st->back = tmp;
+
+    if (st->pending)
+        st->stats.num_skipped ++;
+
+    st->pending = 1;
+    st->mid_seq ++;
+    st->mid_timestamp_ms = timestamp_ms;
+    st->stats.num_captured ++;
+
+    pthread_cond_broadcast (&srv->cond_job);
+    pthread_mutex_unlock (&srv->mutex);
+}
+
+static int
+is_running (stream_server_t *srv)
+{
+    pthread_mutex_lock (&srv->mutex);
+    int running = srv->running;
+    pthread_mutex_unlock (&srv->mutex);
+
+    return running;
+}
+
+
+/* -------------------------------------------------- *
+ *  sources
+ * -------------------------------------------------- */
+static void *
+v4l2_source_main (void *arg)
+{
+    stream_t *st = (stream_t *)arg;
+    capture_dev_t *cap_dev = (capture_dev_t *)st->cap_dev;
+    pixconv_param_t prm;
+    int bpl;
+
+    /* YUYV --> RGBA8 (raw pixel, the 4th channel is zero) */
+    pixconv_init_param (&prm, st->src_fmt, PIXCONV_DST_UINT8, 0.0f, 1.0f);
+    prm.dst_ch = 4;
+
+    v4l2_get_capture_bytesperline (cap_dev, &bpl);
+    v4l2_start_capture (cap_dev);
+
+    while (is_running (st->srv))
+    {
+        /* not to block in the acquire after stream_server_stop() */
+        int ret = v4l2_wait_capture_frame (cap_dev, V4L2_WAIT_TIMEOUT_MS);
+        if (ret < 0)
+            break;
+        if (ret == 0)
+            continue;
+
+        capture_frame_t *frame = v4l2_acquire_capture_frame (cap_dev);
+        if (frame == NULL)
+            break;
+
+        double timestamp_ms = get_time_ms ();
+        unsigned char *src = (unsigned char *)frame->vaddr;
+        for (int y = 0; y < st->h; y ++)
+            convert_pixels (&prm, src + y * bpl, st->w, 1, st->back + y * st->w * 4);
+
+        v4l2_release_capture_frame (cap_dev, frame);
+        publish_frame (st, timestamp_ms);
+    }
+
+    return NULL;
+}
+
+static void *
+file_source_main (void *arg)
+{
+    stream_t *st = (stream_t *)arg;
+    int    bpp = (st->src_fmt == PIXCONV_SRC_YUYV) ? 2 : 4;
+    size_t frame_size = (size_t)st->w * st->h * bpp;
+    unsigned char *raw = NULL;
+    pixconv_param_t prm;
+
+    if (st->src_fmt != PIXCONV_SRC_RGBA8)
+    {
+        raw = (unsigned char *)malloc (frame_size);
+        if (raw == NULL)
+        {
+            DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+            return NULL;
+        }
+        pixconv_init_param (&prm, st->src_fmt, PIXCONV_DST_UINT8, 0.0f, 1.0f);
+        prm.dst_ch = 4;
+    }
+
+    while (is_running (st->srv))
+    {
+        unsigned char *dst = raw ? raw : st->back;
+
+        if (fread (dst, 1, frame_size, st->fp) != frame_size)
+        {
+            /* loop the file */
+            rewind (st->fp);
+            if (fread (dst, 1, frame_size, st->fp) != frame_size)
+            {
+                DBG_LOGE ("ERR: %s(%d): %s is too short\n", __FILE__, __LINE__, st->name);
+                break;
+            }
+        }
+
+        if (raw)
+            convert_pixels (&prm, raw, st->w, st->h, st->back);
+
+        publish_frame (st, get_time_ms ());
+        usleep (FILE_FRAME_INTERVAL_US);
+    }
+
+    free (raw);
+    return NULL;
+}
+
+#if defined (USE_INPUT_VIDEO_DECODE)
+static void *
+video_source_main (void *arg)
+{
+    stream_t *st = (stream_t *)arg;
+    void *buf = NULL;
+
+    start_video_decode ();
+
+    /* the decoder updates its buffer at the video frame rate, and has no notification */
+    while (is_running (st->srv))
+    {
+        get_video_buffer (&buf);
+        if (buf)
+        {
+            memcpy (st->back, buf, (size_t)st->w * st->h * 4);
+            publish_frame (st, get_time_ms ());
+        }
+        usleep (FILE_FRAME_INTERVAL_US);
+    }
+
+    return NULL;
+}
+#endif
+
+static stream_t *
+alloc_stream (stream_server_t *srv, int src_type, const char *name, int w, int h)
+{
+    if (srv->num_streams >= STREAM_MAX_STREAMS)
+    {
+        DBG_LOGE ("ERR: %s(%d): too many streams\n", __FILE__, __LINE__);
+        return NULL;
+    }
+
+    stream_t *st = &srv->streams[srv->num_streams];
+    size_t frame_size = (size_t)w * h * 4;
+
+    memset (st, 0, sizeof (*st));
+    st->srv      = srv;
+    st->id       = srv->num_streams;
+    st->src_type = src_type;
+    st->w        = w;
+    st->h        = h;
+    snprintf (st->name, sizeof (st->name), "%s", name);
+
+    st->back     = (unsigned char *)calloc (1, frame_size);
+    st->mid      = (unsigned char *)calloc (1, frame_size);
+    st->inflight = (unsigned char *)calloc (1, frame_size);
+    st->results  = (unsigned char *)calloc (STREAM_RESULT_QUEUE, srv->result_size);
+    if (!st->back || !st->mid || !st->inflight || !st->results)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        free (st->back);
+        free (st->mid);
+        free (st->inflight);
+        free (st->results);
+        return NULL;
+    }
+
+    srv->num_streams ++;
+    return st;
+}
+
+int
+stream_server_add_v4l2 (stream_server_t *srv, int devid)
+{
+    capture_dev_t *cap_dev = v4l2_open_capture_device (devid);
+    unsigned int pixfmt;
+    int w, h;
+
+    if (cap_dev == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d): can't open /dev/video%d\n", __FILE__, __LINE__, devid);
+        return -1;
+    }
+
+    v4l2_get_capture_wh (cap_dev, &w, &h);
+    v4l2_get_capture_pixelformat (cap_dev, &pixfmt);
+    if (pixfmt != v4l2_fourcc ('Y', 'U', 'Y', 'V'))
+    {
+        DBG_LOGE ("ERR: %s(%d): %s: pixformat not supported\n", __FILE__, __LINE__, cap_dev->dev_name);
+        v4l2_close_capture_device (cap_dev);
+        return -1;
+    }
+
+    stream_t *st = alloc_stream (srv, STREAM_SRC_V4L2, cap_dev->dev_name, w, h);
+    if (st == NULL)
+    {
+        v4l2_close_capture_device (cap_dev);
+        return -1;
+    }
+
+    st->cap_dev = cap_dev;
+    st->src_fmt = PIXCONV_SRC_YUYV;
+
+    return st->id;
+}
+
+int
+stream_server_add_file (stream_server_t *srv, const char *fname, int w, int h, int src_fmt)
+{
+    if (src_fmt != PIXCONV_SRC_YUYV && src_fmt != PIXCONV_SRC_RGBA8)
+    {
+        DBG_LOGE ("ERR: %s(%d): pixformat not supported\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    FILE *fp = fopen (fname, "rb");
+    if (fp == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d): can't open %s\n", __FILE__, __LINE__, fname);
+        return -1;
+    }
+
+    stream_t *st = alloc_stream (srv, STREAM_SRC_FILE, fname, w, h);
+    if (st == NULL)
+    {
+        fclose (fp);
+        return -1;
+    }
+
+    st->fp      = fp;
+    st->src_fmt = src_fmt;
+
+    return st->id;
+}
+
+int
+stream_server_add_video (stream_server_t *srv, const char *fname)
+{
+#if defined (USE_INPUT_VIDEO_DECODE)
+    int w, h;
+
+    /* util_video_decode has a single decoder */
+    for (int i = 0; i < srv->num_streams; i ++)
+    {
+        if (srv->streams[i].src_type == STREAM_SRC_VIDEO)
+        {
+            DBG_LOGE ("ERR: %s(%d): only one video stream is supported\n", __FILE__, __LINE__);
+            return -1;
+        }
+    }
+
+    if (init_video_decode () != 0 || open_video_file (fname) != 0)
+    {
+        DBG_LOGE ("ERR: %s(%d): can't open %s\n", __FILE__, __LINE__, fname);
+        return -1;
+    }
+    get_video_dimension (&w, &h);
+
+    stream_t *st = alloc_stream (srv, STREAM_SRC_VIDEO, fname, w, h);
+    if (st == NULL)
+        return -1;
+
+    st->src_fmt = PIXCONV_SRC_RGBA8;
+
+    return st->id;
+#else
+    DBG_LOGE ("ERR: %s(%d): built without USE_INPUT_VIDEO_DECODE (%s)\n", __FILE__, __LINE__, fname);
+    return -1;
+#endif
+}
+
+
+/* -------------------------------------------------- *
+ *  dispatch
+ * -------------------------------------------------- */
+static int
+is_ready (stream_t *st)
+{
+    return st->pending && !st->busy;
+}
+
+/* must be called with the server lock */
+static stream_t *
+pick_stream (stream_server_t *srv)
+{
+    int num = srv->num_streams;
+    stream_t *best = NULL;
+
+    if (srv->dispatch == STREAM_DISPATCH_ROUND_ROBIN)
+    {
+        for (int i = 0; i < num; i ++)
+        {
+            int idx = (srv->rr_next + i) % num;
+            if (is_ready (&srv->streams[idx]))
+            {
+                srv->rr_next = (idx + 1) % num;
+                return &srv->streams[idx];
+            }
+        }
+        return NULL;
+    }
+
+    /* STREAM_DISPATCH_LATENCY: the result expected last comes first */
+    double now = get_time_ms ();
+    double best_due = 0;
+    for (int i = 0; i < num; i ++)
+    {
+        stream_t *st = &srv->streams[i];
+        if (!is_ready (st))
+            continue;
+
+        double due = (now - st->mid_timestamp_ms) + st->stats.avg_infer_ms;
+        if (best == NULL || due > best_due)
+        {
+            best     = st;
+            best_due = due;
+        }
+    }
+    return best;
+}
+
+/* must be called with the server lock */
+static void
+push_result (stream_t *st, stream_result_info_t *info, const void *result)
+{
+    size_t result_size = st->srv->result_size;
+
+    if (st->res_count == STREAM_RESULT_QUEUE)
+    {
+        /* the consumer is late. drop the oldest. */
+        st->res_head = (st->res_head + 1) % STREAM_RESULT_QUEUE;
+        st->res_count --;
+        st->stats.num_dropped ++;
+    }
+
+    int idx = (st->res_head + st->res_count) % STREAM_RESULT_QUEUE;
+    st->infos[idx] = *info;
+    memcpy (st->results + idx * result_size, result, result_size);
+    st->res_count ++;
+}
+
+static void *
+worker_main (void *arg)
+{
+    stream_worker_t *wk = (stream_worker_t *)arg;
+    stream_server_t *srv = wk->srv;
+    void *result;
+
+    if (srv->worker_init)
+    {
+        wk->init_ret = srv->worker_init (wk->id, srv->usr, &wk->wctx);
+        if (wk->init_ret != 0)
+            DBG_LOGE ("ERR: %s(%d): worker %d init failed\n", __FILE__, __LINE__, wk->id);
+    }
+
+    result = calloc (1, srv->result_size);
+    if (result == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        wk->init_ret = -1;
+    }
+
+    /* report to stream_server_start() */
+    pthread_mutex_lock (&srv->mutex);
+    srv->num_init_done ++;
+    if (wk->init_ret != 0)
+        srv->init_failed = 1;
+    pthread_cond_broadcast (&srv->cond_init);
+
+    if (wk->init_ret != 0)
+    {
+        pthread_mutex_unlock (&srv->mutex);
+        free (result);
+        return NULL;
+    }
+
+    while (srv->running)
+    {
+        stream_t *st = pick_stream (srv);
+        if (st == NULL)
+        {
+            pthread_cond_wait (&srv->cond_job, &srv->mutex);
+            continue;
+        }
+
+        /* take the latest frame */
+        unsigned char *tmp = st->inflight;
+        st->inflight = st->mid;
+        st->mid      = tmp;
+        st->pending  = 0;
+        st->busy     = 1;
+
+        stream_frame_t frame;
+        frame.stream_id    = st->id;
+        frame.seq          = st->mid_seq;
+        frame.timestamp_ms = st->mid_timestamp_ms;
+        frame.w            = st->w;
+        frame.h            = st->h;
+        frame.rgba         = st->inflight;
+        pthread_mutex_unlock (&srv->mutex);
+
+        double t0 = get_time_ms ();
+        int ret = srv->infer (wk->wctx, &frame, result);
+        double t1 = get_time_ms ();
+
+        stream_result_info_t info;
+        info.stream_id    = st->id;
+        info.worker_id    = wk->id;
+        info.ret          = ret;
+        info.seq          = frame.seq;
+        info.timestamp_ms = frame.timestamp_ms;
+        info.done_ms      = t1;
+
+        pthread_mutex_lock (&srv->mutex);
+        push_result (st, &info, result);
+        st->busy = 0;
+        st->stats.num_inferred ++;
+        update_average (&st->stats.avg_infer_ms,   t1 - t0);
+        update_average (&st->stats.avg_latency_ms, t1 - frame.timestamp_ms);
+
+        pthread_cond_broadcast (&srv->cond_result);
+        pthread_cond_broadcast (&srv->cond_job);    /* the stream may have a frame already */
+    }
+    pthread_mutex_unlock (&srv->mutex);
+
+    free (result);
+    return NULL;
+}
+
+
+/* -------------------------------------------------- *
+ *  API
+ * -------------------------------------------------- */
+int
+stream_server_init (stream_server_t *srv, int num_workers, int dispatch, size_t result_size,
+                    stream_worker_init_t worker_init, stream_infer_t infer, void *usr)
+{
+    memset (srv, 0, sizeof (*srv));
+
+    if (num_workers < 1 || num_workers > STREAM_MAX_WORKERS || infer == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    srv->num_workers = num_workers;
+    srv->dispatch    = dispatch;
+    srv->result_size = (result_size > 0) ? result_size : 1;
+    srv->worker_init = worker_init;
+    srv->infer       = infer;
+    srv->usr         = usr;
+
+    pthread_mutex_init (&srv->mutex, NULL);
+    pthread_cond_init  (&srv->cond_job, NULL);
+    pthread_cond_init  (&srv->cond_result, NULL);
+    pthread_cond_init  (&srv->cond_init, NULL);
+
+    return 0;
+}
+
+int
+stream_server_start (stream_server_t *srv)
+{
+    if (srv->num_streams <= 0)
+    {
+        DBG_LOGE ("ERR: %s(%d): no stream\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    srv->running       = 1;
+    srv->num_init_done = 0;
+    srv->init_failed   = 0;
+
+    for (int i = 0; i < srv->num_workers; i ++)
+    {
+        stream_worker_t *wk = &srv->workers[i];
+        wk->srv = srv;
+        wk->id  = i;
+        pthread_create (&wk->thread, NULL, worker_main, wk);
+    }
+
+    /* the sources start after all the workers have their interpreters */
+    pthread_mutex_lock (&srv->mutex);
+    while (srv->num_init_done < srv->num_workers)
+        pthread_cond_wait (&srv->cond_init, &srv->mutex);
+
+    if (srv->init_failed)
+    {
+        srv->running = 0;
+        pthread_cond_broadcast (&srv->cond_job);
+        pthread_mutex_unlock (&srv->mutex);
+
+        for (int i = 0; i < srv->num_workers; i ++)
+            pthread_join (srv->workers[i].thread, NULL);
+
+        DBG_LOGE ("ERR: %s(%d): worker_init failed\n", __FILE__, __LINE__);
+        return -1;
+    }
+    pthread_mutex_unlock (&srv->mutex);
+
+    for (int i = 0; i < srv->num_streams; i ++)
+    {
+        stream_t *st = &srv->streams[i];
+        void *(*source_main) (void *) = file_source_main;
+
+        if (st->src_type == STREAM_SRC_V4L2)
+            source_main = v4l2_source_main;
+#if defined (USE_INPUT_VIDEO_DECODE)
+        if (st->src_type == STREAM_SRC_VIDEO)
+            source_main = video_source_main;
+#endif
+        pthread_create (&st->thread, NULL, source_main, st);
+    }
+    srv->started = 1;
+
+    return 0;
+}
+
+int
+stream_server_stop (stream_server_t *srv)
+{
+    pthread_mutex_lock (&srv->mutex);
+    srv->running = 0;
+    pthread_cond_broadcast (&srv->cond_job);
+    pthread_cond_broadcast (&srv->cond_result);
+    pthread_mutex_unlock (&srv->mutex);
+
+    if (srv->started)
+    {
+        /* the V4L2 sources wake up from the wait within V4L2_WAIT_TIMEOUT_MS */
+        for (int i = 0; i < srv->num_streams; i ++)
+            pthread_join (srv->streams[i].thread, NULL);
+
+        for (int i = 0; i < srv->num_workers; i ++)
+            pthread_join (srv->workers[i].thread, NULL);
+        srv->started = 0;
+    }
+
+    for (int i = 0; i < srv->num_streams; i ++)
+    {
+        stream_t *st = &srv->streams[i];
+
+        if (st->fp)
+            fclose (st->fp);
+        if (st->cap_dev)
+            v4l2_close_capture_device ((capture_dev_t *)st->cap_dev);
+        free (st->back);
+        free (st->mid);
+        free (st->inflight);
+        free (st->results);
+    }
+    srv->num_streams = 0;
+
+    pthread_mutex_destroy (&srv->mutex);
+    pthread_cond_destroy  (&srv->cond_job);
+    pthread_cond_destroy  (&srv->cond_result);
+    pthread_cond_destroy  (&srv->cond_init);
+
+    return 0;
+}
+
+int
+stream_server_poll_result (stream_server_t *srv, int stream_id, stream_result_info_t *info,
+                           void *result, int block)
+{
+    if (stream_id < 0 || stream_id >= srv->num_streams)
+        return -1;
+
+    stream_t *st = &srv->streams[stream_id];
+
+    pthread_mutex_lock (&srv->mutex);
+    while (block && srv->running && st->res_count == 0)
+        pthread_cond_wait (&srv->cond_result, &srv->mutex);
+
+    if (st->res_count == 0)
+    {
+        pthread_mutex_unlock (&srv->mutex);
+        return -1;
+    }
+
+    int idx = st->res_head;
+    if (info)
+        *info = st->infos[idx];
+    if (result)
+        memcpy (result, st->results + idx * srv->result_size, srv->result_size);
+
+    st->res_head = (st->res_head + 1) % STREAM_RESULT_QUEUE;
+    st->res_count --;
+    pthread_mutex_unlock (&srv->mutex);
+
+    return 0;
+}
+
+int
+stream_server_get_stats (stream_server_t *srv, int stream_id, stream_stats_t *stats)
+{
+    if (stream_id < 0 || stream_id >= srv->num_streams)
+        return -1;
+
+    pthread_mutex_lock (&srv->mutex);
+    *stats = srv->streams[stream_id].stats;
+    pthread_mutex_unlock (&srv->mutex);
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _UTIL_STREAM_H_
+#define _UTIL_STREAM_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ *  multi-stream inference server.
+ *
+ *  several capture/video sources feed a pool of workers. every worker owns
+ *  its interpreters (created by worker_init() on the worker thread), and
+ *  runs infer() for the frames of any stream:
+ *
+ *    source[0] --+                 +-- worker[0] --+--> results of stream[0]
+ *    source[1] --+--> dispatch --> +-- worker[1] --+--> results of stream[1]
+ *    source[2] --+                                 +--> results of stream[2]
+ *
+ *  - each stream keeps only its latest frame. a frame which is overwritten
+ *    before a worker takes it is counted as skipped.
+ *  - a stream has at most one frame in flight, so its results come in order.
+ *  - the results are queued per stream. the oldest one is dropped if the
+ *    consumer does not poll them in time.
+ */
+#define STREAM_MAX_STREAMS          8
+#define STREAM_MAX_WORKERS          8
+#define STREAM_RESULT_QUEUE         4
+
+/* source type */
+#define STREAM_SRC_V4L2             0   /* /dev/videoN via util_v4l2                 */
+#define STREAM_SRC_FILE             1   /* raw YUYV or RGBA frames, looped at 30fps  */
+#define STREAM_SRC_VIDEO            2   /* util_video_decode (one per process)       */
+
+/* which stream a free worker serves next */
+#define STREAM_DISPATCH_ROUND_ROBIN 0   /* the streams in turn                          */
+#define STREAM_DISPATCH_LATENCY     1   /* the one whose result is the most overdue:
+                                           age of its frame + its average infer time */
+
+typedef struct _stream_frame_t
+{
+    int             stream_id;
+    uint64_t        seq;            /* 1, 2, 3, ... per stream            */
+    double          timestamp_ms;   /* CLOCK_MONOTONIC when captured      */
+    int             w, h;
+    unsigned char   *rgba;
+} stream_frame_t;
+
+typedef struct _stream_result_info_t
+{
+    int             stream_id;
+    int             worker_id;
+    int             ret;            /* return value of infer()            */
+    uint64_t        seq;            /* of the frame                       */
+    double          timestamp_ms;   /* of the frame                       */
+    double          done_ms;        /* when infer() returned              */
+} stream_result_info_t;
+
+typedef struct _stream_stats_t
+{
+    uint64_t        num_captured;
+    uint64_t        num_inferred;
+    uint64_t        num_skipped;    /* frames overwritten before inference */
+    uint64_t        num_dropped;    /* results overwritten before polled   */
+    double          avg_infer_ms;
+    double          avg_latency_ms; /* capture --> result                  */
+} stream_stats_t;
+
+/* called on the worker thread */
+typedef int  (*stream_worker_init_t) (int worker_id, void *usr, void **wctx);
+typedef int  (*stream_infer_t) (void *wctx, const stream_frame_t *frame, void *result);
+
+struct _stream_server_t;
+
+typedef struct _stream_t
+{
+    struct _stream_server_t *srv;
+    int             id;
+    int             src_type;
+    char            name[256];
+
+    /* source */
+    void            *cap_dev;       /* capture_dev_t (STREAM_SRC_V4L2) */
+    FILE            *fp;            /* STREAM_SRC_FILE                 */
+    int             src_fmt;        /* PIXCONV_SRC_xxx                 */
+    int             w, h;
+    pthread_t       thread;
+
+    /*
+     *  triple buffer:  back (source) --> mid (latest) --> inflight (worker)
+     *  mid and inflight are swapped under the server lock.
+     */
+    unsigned char   *back, *mid, *inflight;
+    uint64_t        mid_seq;
+    double          mid_timestamp_ms;
+    int             pending;        /* mid holds a frame not taken yet */
+    int             busy;           /* a worker runs infer() for this stream */
+
+    /* results */
+    unsigned char   *results;       /* [STREAM_RESULT_QUEUE][result_size] */
+    stream_result_info_t infos[STREAM_RESULT_QUEUE];
+    int             res_head;
+    int             res_count;
+
+    stream_stats_t  stats;
+} stream_t;
+
+typedef struct _stream_worker_t
+{
+    struct _stream_server_t *srv;
+    int             id;
+    pthread_t       thread;
+    void            *wctx;
+    int             init_ret;
+} stream_worker_t;
+
+typedef struct _stream_server_t
+{
+    int             num_streams;
+    stream_t        streams[STREAM_MAX_STREAMS];
+
+    int             num_workers;
+    stream_worker_t workers[STREAM_MAX_WORKERS];
+
+    int             dispatch;
+    int             rr_next;
+    size_t          result_size;
+    stream_worker_init_t worker_init;
+    stream_infer_t  infer;
+    void            *usr;
+
+    int             running;
+    int             started;        /* the threads are created            */
+    int             num_init_done;  /* workers which returned worker_init */
+    int             init_failed;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond_job;       /* a frame came, or a stream got free */
+    pthread_cond_t  cond_result;    /* a result came                      */
+    pthread_cond_t  cond_init;      /* a worker finished worker_init      */
+} stream_server_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  stream_server_init (stream_server_t *srv, int num_workers, int dispatch, size_t result_size,
+                         stream_worker_init_t worker_init, stream_infer_t infer, void *usr);
+
+/* returns the stream id, or -1 */
+int  stream_server_add_v4l2  (stream_server_t *srv, int devid);
+int  stream_server_add_file  (stream_server_t *srv, const char *fname, int w, int h, int src_fmt);
+int  stream_server_add_video (stream_server_t *srv, const char *fname);
+
+/* returns -1 if worker_init() fails on any worker. call stream_server_stop() to clean up */
+int  stream_server_start (stream_server_t *srv);
+int  stream_server_stop  (stream_server_t *srv);
+
+/* take the oldest result of the stream. returns -1 if there is none (block: wait for it) */
+int  stream_server_poll_result (stream_server_t *srv, int stream_id, stream_result_info_t *info,
+                                void *result, int block);
+
+int  stream_server_get_stats (stream_server_t *srv, int stream_id, stream_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UTIL_STREAM_H_ */
@@ -13,6 +13,11 @@
 
 #if defined (USE_INPUT_CAMERA_CAPTURE)
 #include "util_camera_capture.h"
+#if !defined (USE_GLX)
+#include <GLES2/gl2ext.h>
+#include "util_egl.h"
+#define CAPTURE_DMABUF_TEXTURE
+#endif
 #endif
 
 #if defined (USE_INPUT_VIDEO_DECODE)
@@ -202,16 +207,111 @@ load_png_cube_texture (char *name[], int *lpTexID)
 
 
 #if defined (USE_INPUT_CAMERA_CAPTURE)
+#if defined (CAPTURE_DMABUF_TEXTURE)
+/*
+ *  one external texture per V4L2 buffer, created on the first use
+ *  and bound to the EGLImage of its dmabuf.
+ */
+#define MAX_CAPTURE_DMABUF  16
+
+static GLuint s_dmabuf_texid[MAX_CAPTURE_DMABUF];
+
+static int
+update_capture_texture_dmabuf (texture_2d_t *captex, capture_frame_info_t *frame)
+{
+    static PFNGLEGLIMAGETARGETTEXTURE2DOESPROC s_glEGLImageTargetTexture2DOES = NULL;
+    int idx = frame->buf_index;
+
+    if (frame->dmabuf_fd < 0 || idx < 0 || idx >= MAX_CAPTURE_DMABUF)
+        return -1;
+
+    if (s_dmabuf_texid[idx] == 0)
+    {
+        uint32_t fourcc;
+        int      num_planes, fds[2], pitches[2], offsets[2];
+
+        if (s_glEGLImageTargetTexture2DOES == NULL)
+        {
+            s_glEGLImageTargetTexture2DOES = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)
+                                    eglGetProcAddress ("glEGLImageTargetTexture2DOES");
+            if (s_glEGLImageTargetTexture2DOES == NULL)
+                return -1;
+        }
+
+        if (get_capture_dmabuf_attr (&fourcc, &num_planes, pitches, offsets) < 0)
+            return -1;
+
+        fds[0] = fds[1] = frame->dmabuf_fd;
+        EGLImageKHR img = egl_create_eglimage_dmabuf (captex->width, captex->height, fourcc,
+                                                      num_planes, fds, pitches, offsets);
+        if (img == EGL_NO_IMAGE_KHR)
+            return -1;
+
+        GLuint texid;
+        glGenTextures (1, &texid);
+        glBindTexture (GL_TEXTURE_EXTERNAL_OES, texid);
+        glTexParameteri (GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri (GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri (GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri (GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        s_glEGLImageTargetTexture2DOES (GL_TEXTURE_EXTERNAL_OES, img);
+        GLASSERT();
+
+        /* the texture keeps a reference to the image. */
+        egl_destroy_eglimage (img);
+
+        s_dmabuf_texid[idx] = texid;
+    }
+
+    captex->texid = s_dmabuf_texid[idx];
+    return 0;
+}
+
+/*
+ *  the draws issued since the last update sampled the current V4L2 buffer.
+ *  it is re-queued to the driver when get_capture_frame() moves on to a new
+ *  frame, so fence them before that. the capture thread waits for the fence.
+ */
+static void
+fence_capture_texture_dmabuf ()
+{
+    EGLSyncKHR fence = egl_create_fence ();
+    if (fence == EGL_NO_SYNC_KHR)
+    {
+        /* EGL_KHR_fence_sync is not supported */
+        glFinish ();
+        return;
+    }
+
+    set_capture_frame_fence (fence);
+}
+#endif
+
 int
 create_capture_texture (texture_2d_t *captex)
 {
     int      cap_w, cap_h;
     uint32_t cap_fmt;
 
+#if !defined (CAPTURE_DMABUF_TEXTURE)
+    disable_capture_dmabuf ();
+#endif
+
     get_capture_dimension (&cap_w, &cap_h);
     get_capture_pixformat (&cap_fmt);
 
-    create_2d_texture_ex (captex, NULL, cap_w, cap_h, cap_fmt);
+    if (cap_fmt == pixfmt_fourcc('E', 'X', 'T', 'X'))
+    {
+        /* texid is switched to the texture of the latest V4L2 buffer every frame. */
+        captex->texid  = 0;
+        captex->width  = cap_w;
+        captex->height = cap_h;
+        captex->format = cap_fmt;
+    }
+    else
+    {
+        create_2d_texture_ex (captex, NULL, cap_w, cap_h, cap_fmt);
+    }
     start_capture ();
 
     return 0;
@@ -222,13 +322,41 @@ update_capture_texture (texture_2d_t *captex)
 {
     int      cap_w, cap_h;
     uint32_t cap_fmt;
-    void     *cap_buf;
+    capture_frame_info_t cap_frame;
 
     get_capture_dimension (&cap_w, &cap_h);
+
+#if defined (CAPTURE_DMABUF_TEXTURE)
+    if (captex->format == pixfmt_fourcc('E', 'X', 'T', 'X') && captex->texid)
+        fence_capture_texture_dmabuf ();
+#endif
+
+    get_capture_frame (&cap_frame);
+
+#if defined (CAPTURE_DMABUF_TEXTURE)
+    if (captex->format == pixfmt_fourcc('E', 'X', 'T', 'X'))
+    {
+        if (cap_frame.buf == NULL || !cap_frame.is_new)
+            return;
+
+        if (update_capture_texture_dmabuf (captex, &cap_frame) == 0)
+            return;
+
+        /* EGLImage import is not supported. fallback to texture upload. */
+        fprintf (stderr, "ERR: %s(%d): dmabuf import failed. fallback to texture upload.\n",
+            __FILE__, __LINE__);
+        disable_capture_dmabuf ();
+        get_capture_pixformat (&cap_fmt);
+        create_2d_texture_ex (captex, NULL, cap_w, cap_h, cap_fmt);
+    }
+#endif
+
     get_capture_pixformat (&cap_fmt);
-    get_capture_buffer (&cap_buf);
-    if (cap_buf)
+
+    /* skip the upload if the camera has not delivered a new frame yet. */
+    if (cap_frame.buf && cap_frame.is_new)
     {
+        void *cap_buf = cap_frame.buf;
         int texw = cap_w;
         int texh = cap_h;
         int texfmt = GL_RGBA;
@@ -4,7 +4,15 @@
  * ------------------------------------------------ */
 #include "util_tflite.h"
 #include "util_debug.h"
+#include "tensorflow/lite/external_cpu_backend_context.h"
+#include "tensorflow/lite/kernels/cpu_backend_context.h"
 #include <thread>
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
 
 using namespace tflite;
 
@@ -137,226 +145,600 @@ tflite_print_tensor_info (std::unique_ptr<Interpreter> &interpreter)
 }
 
 
-static int
-modify_graph_with_delegate (tflite_interpreter_t *p, tflite_createopt_t *opt)
+/* -------------------------------------------------- *
+ *  Delegate
+ * -------------------------------------------------- */
+static const char *
+tflite_get_delegate_str (int delegate_type)
 {
-    TfLiteDelegate *delegate = NULL;
+    switch (delegate_type)
+    {
+    case TFLITE_DELEGATE_NONE:      return "none";
+    case TFLITE_DELEGATE_DEFAULT:   return "default";
+    case TFLITE_DELEGATE_XNNPACK:   return "xnnpack";
+    case TFLITE_DELEGATE_GL:        return "gl";
+    case TFLITE_DELEGATE_GPUV2:     return "gpuv2";
+    case TFLITE_DELEGATE_NNAPI:     return "nnapi";
+    case TFLITE_DELEGATE_HEXAGON:   return "hexagon";
+    default:                        return "????";
+    }
+}
 
+/* the delegate selected by TFLITE_DELEGATE in Makefile.env */
+static int
+tflite_get_default_delegate ()
+{
 #if defined (USE_GL_DELEGATE)
-    const TfLiteGpuDelegateOptions options = {
-        .metadata = NULL,
-        .compile_options = {
-            .precision_loss_allowed = 1,  // FP16
-            .preferred_gl_object_type = TFLITE_GL_OBJECT_TYPE_FASTEST,
-            .dynamic_batch_enabled = 0,   // Not fully functional yet
-        },
-    };
-    delegate = TfLiteGpuDelegateCreate(&options);
+    return TFLITE_DELEGATE_GL;
+#elif defined (USE_GPU_DELEGATEV2)
+    return TFLITE_DELEGATE_GPUV2;
+#elif defined (USE_NNAPI_DELEGATE)
+    return TFLITE_DELEGATE_NNAPI;
+#elif defined (USE_HEXAGON_DELEGATE)
+    return TFLITE_DELEGATE_HEXAGON;
+#elif defined (USE_XNNPACK_DELEGATE)
+    return TFLITE_DELEGATE_XNNPACK;
+#else
+    return TFLITE_DELEGATE_NONE;
+#endif
+}
 
-#if defined (USE_INPUT_SSBO)
-    if (opt && opt->gpubuffer)
+/*
+ *  FORCE_TFLITE_DELEGATE="gpuv2,xnnpack" overrides the fallback order
+ *  of every interpreter in the process.
+ */
+static int
+tflite_parse_delegate_env (tflite_createopt_t *opt)
+{
+    char *env_delegate = getenv ("FORCE_TFLITE_DELEGATE");
+    if (env_delegate == NULL)
+        return 0;
+
+    std::string str (env_delegate);
+    size_t pos = 0;
+
+    opt->num_delegates = 0;
+    while (pos <= str.size() && opt->num_delegates < TFLITE_MAX_DELEGATES)
     {
-        int ssbo_id = opt->gpubuffer;
-        int tensor_index = p->interpreter->inputs()[0];
+        size_t end = str.find (',', pos);
+        if (end == std::string::npos)
+            end = str.size();
 
-        TfLiteIntArray *dim = interpreter->tensor(tensor_index)->dims;
-        if (TfLiteGpuDelegateBindBufferToTensor(delegate, ssbo_id, tensor_index) != kTfLiteOk)
+        std::string name = str.substr (pos, end - pos);
+        int type;
+        for (type = TFLITE_DELEGATE_NONE; type < TFLITE_DELEGATE_NUM; type ++)
         {
-            DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-            return -1;
+            if (name == tflite_get_delegate_str (type))
+            {
+                opt->delegates[opt->num_delegates ++] = type;
+                break;
+            }
         }
-    }
-#endif
-#endif
 
-#if defined (USE_GPU_DELEGATEV2)
-    const TfLiteGpuDelegateOptionsV2 options = {
-        .is_precision_loss_allowed = 1, // FP16
-        .inference_preference = TFLITE_GPU_INFERENCE_PREFERENCE_FAST_SINGLE_ANSWER,
-        .inference_priority1 = TFLITE_GPU_INFERENCE_PRIORITY_MIN_LATENCY,
-        .inference_priority2 = TFLITE_GPU_INFERENCE_PRIORITY_AUTO,
-        .inference_priority3 = TFLITE_GPU_INFERENCE_PRIORITY_AUTO,
-    };
-    delegate = TfLiteGpuDelegateV2Create(&options);
-#endif
+        if (type == TFLITE_DELEGATE_NUM)
+        {
+            std::string names;
+            for (type = TFLITE_DELEGATE_NONE; type < TFLITE_DELEGATE_NUM; type ++)
+            {
+                names += (type > TFLITE_DELEGATE_NONE) ? "," : "";
+                names += tflite_get_delegate_str (type);
+            }
+            DBG_LOGE ("ERR: %s(%d): unknown delegate \"%s\" in FORCE_TFLITE_DELEGATE (%s)\n",
+                      __FILE__, __LINE__, name.c_str(), names.c_str());
+        }
+        pos = end + 1;
+    }
 
-#if defined (USE_NNAPI_DELEGATE)
-    delegate = tflite::NnApiDelegate ();
-#endif
+    DBG_LOGI ("@@@@@@ FORCE_TFLITE_DELEGATE=%s\n", env_delegate);
+    return 0;
+}
 
+static int
+tflite_get_num_threads (tflite_createopt_t *opt)
+{
+    int num_threads = std::thread::hardware_concurrency();
 
-#if defined (USE_HEXAGON_DELEGATE)
-    // Assuming shared libraries are under "/data/local/tmp/"
-    // If files are packaged with native lib in android App then it
-    // will typically be equivalent to the path provided by
-    // "getContext().getApplicationInfo().nativeLibraryDir"
-
-    //const char library_directory_path[] = "/data/local/tmp/";
-    //TfLiteHexagonInitWithPath(library_directory_path);  // Needed once at startup.
-
-    TfLiteHexagonInit();  // Needed once at startup.
-    TfLiteHexagonDelegateOptions params = {0};
-
-    // 'delegate_ptr' Need to outlive the interpreter. For example,
-    // If use case will need to resize input or anything that can trigger
-    // re-applying delegates then 'delegate_ptr' need to outlive the interpreter.
-    auto* delegate_ptr = TfLiteHexagonDelegateCreate(&params);
-    tflite::Interpreter::TfLiteDelegatePtr delegatep(delegate_ptr,
-        [](TfLiteDelegate* delegatep) {
-            TfLiteHexagonDelegateDelete(delegatep);
-        });
-
-    delegate = delegatep.get();
-#endif
+    if (opt->num_threads > 0)
+        num_threads = opt->num_threads;
 
-#if defined (USE_XNNPACK_DELEGATE)
-    int num_threads = std::thread::hardware_concurrency();
     char *env_tflite_num_threads = getenv ("FORCE_TFLITE_NUM_THREADS");
     if (env_tflite_num_threads)
     {
         num_threads = atoi (env_tflite_num_threads);
-        DBG_LOGI ("@@@@@@ FORCE_TFLITE_NUM_THREADS(XNNPACK)=%d\n", num_threads);
+        DBG_LOGI ("@@@@@@ FORCE_TFLITE_NUM_THREADS=%d\n", num_threads);
     }
 
-    // IMPORTANT: initialize options with TfLiteXNNPackDelegateOptionsDefault() for
-    // API-compatibility with future extensions of the TfLiteXNNPackDelegateOptions
-    // structure.
-    TfLiteXNNPackDelegateOptions xnnpack_options = TfLiteXNNPackDelegateOptionsDefault();
-    xnnpack_options.num_threads = num_threads;
+    return num_threads;
+}
 
-    delegate = TfLiteXNNPackDelegateCreate (&xnnpack_options);
-    if (!delegate)
+
+/* -------------------------------------------------- *
+ *  CPU thread budget shared by all interpreters
+ * -------------------------------------------------- */
+#define BUDGET_REBALANCE_INTERVAL   30      /* rebalance every N invokes */
+#define BUDGET_AVERAGE_WEIGHT       0.1     /* weight of the latest invoke time */
+
+typedef struct tflite_budget_stage_t
+{
+    tflite_interpreter_t    *p;
+    double                  avg_ms;         /* moving average of Invoke() time */
+    int                     num_threads;    /* threads assigned by the budget */
+} tflite_budget_stage_t;
+
+typedef struct tflite_budget_t
+{
+    int                                 enabled;
+    int                                 mode;           /* TFLITE_BUDGET_SERIAL/CONCURRENT */
+    int                                 num_threads;    /* total threads for the process */
+    int                                 invoke_count;
+    std::vector<tflite_budget_stage_t>  stages;
+    std::unique_ptr<ExternalCpuBackendContext> cpu_context;
+    std::mutex                          mutex;
+} tflite_budget_t;
+
+static tflite_budget_t s_budget;
+
+/*
+ *  TFLITE_BUDGET_SERIAL:
+ *      the stages run one after another on the same thread. every stage may
+ *      use the whole budget, and they share one CPU backend context so that
+ *      only one worker pool exists in the process.
+ *
+ *  TFLITE_BUDGET_CONCURRENT:
+ *      the stages run in parallel. the budget is split between them in
+ *      proportion to their measured Invoke() time (at least one each).
+ *
+ *  Threads owned by a delegate (XNNPACK) are fixed when the delegate is created,
+ *  so they get the initial share only.
+ */
+int
+tflite_init_thread_budget (int num_threads, int mode)
+{
+    std::lock_guard<std::mutex> lock (s_budget.mutex);
+
+    if (num_threads <= 0)
+        num_threads = std::thread::hardware_concurrency();
+
+    char *env_tflite_num_threads = getenv ("FORCE_TFLITE_NUM_THREADS");
+    if (env_tflite_num_threads)
     {
-        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        num_threads = atoi (env_tflite_num_threads);
+        DBG_LOGI ("@@@@@@ FORCE_TFLITE_NUM_THREADS(BUDGET)=%d\n", num_threads);
     }
-#endif
 
-    if (!delegate)
-        return 0;
+    s_budget.enabled     = 1;
+    s_budget.mode        = mode;
+    s_budget.num_threads = std::max (num_threads, 1);
 
-    if (p->interpreter->ModifyGraphWithDelegate(delegate) != kTfLiteOk)
+    if (mode == TFLITE_BUDGET_SERIAL && !s_budget.cpu_context)
     {
-        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        return -1;
+        s_budget.cpu_context.reset (new ExternalCpuBackendContext());
+        s_budget.cpu_context->set_internal_backend_context (
+            std::unique_ptr<TfLiteInternalBackendContext>(new CpuBackendContext()));
     }
 
+    DBG_LOG ("@@@@@@ TFLITE_THREAD_BUDGET=%d (%s)\n", s_budget.num_threads,
+             (mode == TFLITE_BUDGET_SERIAL) ? "serial" : "concurrent");
     return 0;
 }
 
+/* TFLITE_BUDGET_SERIAL/CONCURRENT, or -1 if the budget is not set up yet */
+int
+tflite_get_thread_budget_mode ()
+{
+    std::lock_guard<std::mutex> lock (s_budget.mutex);
 
+    return s_budget.enabled ? s_budget.mode : -1;
+}
+
+/*
+ *  call before creating the interpreters when the stages are invoked on
+ *  separate pipeline threads. each interpreter gets its own CPU worker pool.
+ *  (C entry point for the applications: see tflite_facemesh.h and others)
+ */
 int
-tflite_create_interpreter_from_file (tflite_interpreter_t *p, const char *model_path)
+enable_tflite_concurrent_invoke ()
 {
-    p->model = FlatBufferModel::BuildFromFile (model_path);
-    if (!p->model)
+    return tflite_init_thread_budget (0, TFLITE_BUDGET_CONCURRENT);
+}
+
+/* must be called with s_budget.mutex locked */
+static void
+thread_budget_rebalance ()
+{
+    int num_stages  = s_budget.stages.size();
+    int num_threads = s_budget.num_threads;
+
+    if (num_stages == 0)
+        return;
+
+    if (s_budget.mode == TFLITE_BUDGET_SERIAL)
     {
-        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        return -1;
+        for (auto &stage : s_budget.stages)
+            stage.num_threads = num_threads;
+        return;
     }
 
-    InterpreterBuilder(*(p->model), p->resolver)(&(p->interpreter));
-    if (!p->interpreter)
+    /* every stage gets one thread, the rest is distributed by the stage cost. */
+    double total_ms = 0;
+    for (auto &stage : s_budget.stages)
+        total_ms += stage.avg_ms;
+
+    int remain = std::max (num_threads - num_stages, 0);
+    int assigned = 0;
+    std::vector<double> frac (num_stages);
+
+    for (int i = 0; i < num_stages; i ++)
     {
-        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        return -1;
+        tflite_budget_stage_t &stage = s_budget.stages[i];
+        double share = (total_ms > 0) ? remain * stage.avg_ms / total_ms
+                                      : (double)remain / num_stages;
+        stage.num_threads = 1 + (int)share;
+        frac[i]   = share - (int)share;
+        assigned += (int)share;
     }
 
-    int num_threads = std::thread::hardware_concurrency();
-    char *env_tflite_num_threads = getenv ("FORCE_TFLITE_NUM_THREADS");
-    if (env_tflite_num_threads)
+    /* largest remainder goes first */
+    for (; assigned < remain; assigned ++)
     {
-        num_threads = atoi (env_tflite_num_threads);
-        DBG_LOGI ("@@@@@@ FORCE_TFLITE_NUM_THREADS=%d\n", num_threads);
+        int max_i = std::max_element (frac.begin(), frac.end()) - frac.begin();
+        s_budget.stages[max_i].num_threads ++;
+        frac[max_i] = -1.0;
     }
-    DBG_LOG ("@@@@@@ TFLITE_NUM_THREADS=%d\n", num_threads);
-    p->interpreter->SetNumThreads(num_threads);
+}
+
+static int
+thread_budget_join (tflite_interpreter_t *p)
+{
+    std::lock_guard<std::mutex> lock (s_budget.mutex);
+
+    if (s_budget.cpu_context)
+        p->interpreter->SetExternalContext (kTfLiteCpuBackendContext, s_budget.cpu_context.get());
+
+    tflite_budget_stage_t stage;
+    stage.p           = p;
+    stage.avg_ms      = 0;
+    stage.num_threads = 1;
+    s_budget.stages.push_back (stage);
+    p->budget_slot = s_budget.stages.size();
+
+    thread_budget_rebalance ();
+
+    return s_budget.stages[p->budget_slot - 1].num_threads;
+}
+
+
+/* total time the calling thread has spent in tflite_invoke() */
+static thread_local double s_invoke_ms_total = 0;
+
+double
+tflite_get_invoke_time_ms ()
+{
+    return s_invoke_ms_total;
+}
+
+/*
+ *  Invoke() with the thread count assigned by the budget.
+ *  SetNumThreads() is applied here, on the thread which owns the interpreter.
+ */
+int
+tflite_invoke (tflite_interpreter_t *p)
+{
+    tflite_budget_stage_t *stage = NULL;
 
-    if (modify_graph_with_delegate (p, NULL) < 0)
+    if (p->budget_slot > 0)
     {
-        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        //return -1;
+        std::lock_guard<std::mutex> lock (s_budget.mutex);
+        stage = &s_budget.stages[p->budget_slot - 1];
+
+        if (stage->num_threads != p->num_threads)
+        {
+            p->interpreter->SetNumThreads (stage->num_threads);
+            p->num_threads = stage->num_threads;
+        }
     }
 
-    if (p->interpreter->AllocateTensors() != kTfLiteOk)
+    auto t0 = std::chrono::steady_clock::now();
+
+    if (p->interpreter->Invoke() != kTfLiteOk)
     {
         DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
     }
 
-#if 1 /* for debug */
-    DBG_LOG ("\n");
-    DBG_LOG ("##### LOAD TFLITE FILE: \"%s\"\n", model_path);
-    tflite_print_tensor_info (p->interpreter);
-#endif
+    auto t1 = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    s_invoke_ms_total += ms;
+
+    if (p->budget_slot > 0)
+    {
+        std::lock_guard<std::mutex> lock (s_budget.mutex);
+        stage = &s_budget.stages[p->budget_slot - 1];
+        if (stage->avg_ms == 0)
+            stage->avg_ms = ms;
+        else
+            stage->avg_ms += (ms - stage->avg_ms) * BUDGET_AVERAGE_WEIGHT;
+
+        if ((++ s_budget.invoke_count % BUDGET_REBALANCE_INTERVAL) == 0)
+            thread_budget_rebalance ();
+    }
 
     return 0;
 }
 
-int
-tflite_create_interpreter_ex_from_file (tflite_interpreter_t *p, const char *model_path, tflite_createopt_t *opt)
+
+#if defined (USE_XNNPACK_DELEGATE) && defined (USE_XNNPACK_WEIGHTS_CACHE)
+/*
+ *  XNNPACK packs the weights of every interpreter it owns. When the same model
+ *  is loaded more than once (multiple streams, A/B testing), the packed weights
+ *  are shared through a weights cache keyed by the model source.
+ */
+static std::map<std::string, TfLiteXNNPackDelegateWeightsCache *> s_xnnpack_weights_cache;
+
+static TfLiteXNNPackDelegateWeightsCache *
+get_xnnpack_weights_cache (const char *model_key)
 {
-    p->model = FlatBufferModel::BuildFromFile (model_path);
-    if (!p->model)
+    auto itr = s_xnnpack_weights_cache.find (model_key);
+    if (itr != s_xnnpack_weights_cache.end())
+        return itr->second;
+
+    TfLiteXNNPackDelegateWeightsCache *cache = TfLiteXNNPackDelegateWeightsCacheCreate ();
+    if (cache == NULL)
     {
         DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        return -1;
+        return NULL;
     }
 
-    InterpreterBuilder(*(p->model), p->resolver)(&(p->interpreter));
-    if (!p->interpreter)
+    s_xnnpack_weights_cache[model_key] = cache;
+    return cache;
+}
+#endif
+
+
+static TfLiteDelegate *
+create_delegate (tflite_interpreter_t *p, int delegate_type, tflite_createopt_t *opt, const char *model_key)
+{
+    TfLiteDelegate *delegate = NULL;
+
+    switch (delegate_type)
     {
-        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        return -1;
+#if defined (USE_GL_DELEGATE)
+    case TFLITE_DELEGATE_GL:
+    {
+        TfLiteGpuDelegateOptions options = {
+            .metadata = NULL,
+            .compile_options = {
+                .precision_loss_allowed = opt->allow_fp16,  // FP16
+                .preferred_gl_object_type = TFLITE_GL_OBJECT_TYPE_FASTEST,
+                .dynamic_batch_enabled = 0,   // Not fully functional yet
+            },
+        };
+        delegate = TfLiteGpuDelegateCreate(&options);
+
+#if defined (USE_INPUT_SSBO)
+        if (delegate && opt->gpubuffer)
+        {
+            int ssbo_id = opt->gpubuffer;
+            int tensor_index = p->interpreter->inputs()[0];
+
+            if (TfLiteGpuDelegateBindBufferToTensor(delegate, ssbo_id, tensor_index) != kTfLiteOk)
+            {
+                DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+                TfLiteGpuDelegateDelete (delegate);
+                return NULL;
+            }
+        }
+#endif
+        break;
     }
+#endif
 
-    int num_threads = std::thread::hardware_concurrency();
-    char *env_tflite_num_threads = getenv ("FORCE_TFLITE_NUM_THREADS");
-    if (env_tflite_num_threads)
-    {
-        num_threads = atoi (env_tflite_num_threads);
-        DBG_LOGI ("@@@@@@ FORCE_TFLITE_NUM_THREADS=%d\n", num_threads);
+#if defined (USE_GPU_DELEGATEV2)
+    case TFLITE_DELEGATE_GPUV2:
+    {
+        TfLiteGpuDelegateOptionsV2 options = TfLiteGpuDelegateOptionsV2Default();
+        options.is_precision_loss_allowed = opt->allow_fp16; // FP16
+        options.inference_preference = TFLITE_GPU_INFERENCE_PREFERENCE_FAST_SINGLE_ANSWER;
+        options.inference_priority1  = TFLITE_GPU_INFERENCE_PRIORITY_MIN_LATENCY;
+        options.inference_priority2  = TFLITE_GPU_INFERENCE_PRIORITY_AUTO;
+        options.inference_priority3  = TFLITE_GPU_INFERENCE_PRIORITY_AUTO;
+        if (opt->allow_quant)
+            options.experimental_flags |= TFLITE_GPU_EXPERIMENTAL_FLAGS_ENABLE_QUANT;
+        else
+            options.experimental_flags &= ~TFLITE_GPU_EXPERIMENTAL_FLAGS_ENABLE_QUANT;
+
+        delegate = TfLiteGpuDelegateV2Create(&options);
+        break;
     }
-    DBG_LOG ("@@@@@@ TFLITE_NUM_THREADS=%d\n", num_threads);
-    p->interpreter->SetNumThreads(num_threads);
+#endif
 
-#if 0
-    std::vector<int> sizes = {1, 1280, 1280, 3};
-    int input_id = p->interpreter->inputs()[0];
-    p->interpreter->ResizeInputTensor(input_id, sizes);
+#if defined (USE_NNAPI_DELEGATE)
+    case TFLITE_DELEGATE_NNAPI:
+        delegate = tflite::NnApiDelegate ();
+        break;
 #endif
 
-    if (modify_graph_with_delegate (p, opt) < 0)
+#if defined (USE_HEXAGON_DELEGATE)
+    case TFLITE_DELEGATE_HEXAGON:
     {
-        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        //return -1;
+        // Assuming shared libraries are under "/data/local/tmp/"
+        // If files are packaged with native lib in android App then it
+        // will typically be equivalent to the path provided by
+        // "getContext().getApplicationInfo().nativeLibraryDir"
+
+        //const char library_directory_path[] = "/data/local/tmp/";
+        //TfLiteHexagonInitWithPath(library_directory_path);  // Needed once at startup.
+
+        static int s_hexagon_initialized = 0;
+        if (!s_hexagon_initialized)
+        {
+            TfLiteHexagonInit();  // Needed once at startup.
+            s_hexagon_initialized = 1;
+        }
+
+        // The delegate needs to outlive the interpreter, so it is kept in
+        // tflite_interpreter_t and never deleted.
+        TfLiteHexagonDelegateOptions params = {0};
+        delegate = TfLiteHexagonDelegateCreate(&params);
+        break;
     }
+#endif
 
-    if (p->interpreter->AllocateTensors() != kTfLiteOk)
+#if defined (USE_XNNPACK_DELEGATE)
+    case TFLITE_DELEGATE_XNNPACK:
+    {
+        // IMPORTANT: initialize options with TfLiteXNNPackDelegateOptionsDefault() for
+        // API-compatibility with future extensions of the TfLiteXNNPackDelegateOptions
+        // structure.
+        TfLiteXNNPackDelegateOptions xnnpack_options = TfLiteXNNPackDelegateOptionsDefault();
+        xnnpack_options.num_threads = p->num_threads;
+#if defined (TFLITE_XNNPACK_DELEGATE_FLAG_QS8)
+        if (opt->allow_quant)
+            xnnpack_options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_QS8 | TFLITE_XNNPACK_DELEGATE_FLAG_QU8;
+#endif
+#if defined (USE_XNNPACK_WEIGHTS_CACHE)
+        if (opt->xnnpack_weights_cache)
+            xnnpack_options.weights_cache = get_xnnpack_weights_cache (model_key);
+#endif
+
+        delegate = TfLiteXNNPackDelegateCreate (&xnnpack_options);
+        break;
+    }
+#endif
+
+    default:
+        DBG_LOGW ("delegate \"%s\" is not available in this build.\n",
+                  tflite_get_delegate_str (delegate_type));
+        break;
+    }
+
+    return delegate;
+}
+
+static void
+delete_delegate (TfLiteDelegate *delegate, int delegate_type)
+{
+    switch (delegate_type)
     {
-        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        return -1;
+#if defined (USE_GL_DELEGATE)
+    case TFLITE_DELEGATE_GL:
+        TfLiteGpuDelegateDelete (delegate);
+        break;
+#endif
+
+#if defined (USE_GPU_DELEGATEV2)
+    case TFLITE_DELEGATE_GPUV2:
+        TfLiteGpuDelegateV2Delete (delegate);
+        break;
+#endif
+
+#if defined (USE_NNAPI_DELEGATE)
+    case TFLITE_DELEGATE_NNAPI:
+        /* tflite::NnApiDelegate() is a static instance owned by TFLite. */
+        break;
+#endif
+
+#if defined (USE_HEXAGON_DELEGATE)
+    case TFLITE_DELEGATE_HEXAGON:
+        TfLiteHexagonDelegateDelete (delegate);
+        break;
+#endif
+
+#if defined (USE_XNNPACK_DELEGATE)
+    case TFLITE_DELEGATE_XNNPACK:
+        TfLiteXNNPackDelegateDelete (delegate);
+        break;
+#endif
+
+    default:
+        break;
     }
+}
 
-#if 1 /* for debug */
-    DBG_LOG ("\n");
-    DBG_LOG ("##### LOAD TFLITE FILE: \"%s\"\n", model_path);
-    tflite_print_tensor_info (p->interpreter);
+
+/*
+ *  Apply the delegates in the order of opt->delegates[].
+ *  If a delegate can't be created or rejects the graph, try the next one.
+ *  The interpreter runs on the builtin CPU kernels if no delegate is applied.
+ */
+static int
+modify_graph_with_delegate (tflite_interpreter_t *p, tflite_createopt_t *opt, const char *model_key)
+{
+    for (int i = 0; i < opt->num_delegates; i ++)
+    {
+        int delegate_type = opt->delegates[i];
+
+        if (delegate_type == TFLITE_DELEGATE_DEFAULT)
+            delegate_type = tflite_get_default_delegate ();
+
+        if (delegate_type == TFLITE_DELEGATE_NONE)
+            break;
+
+        TfLiteDelegate *delegate = create_delegate (p, delegate_type, opt, model_key);
+        if (delegate == NULL)
+        {
+            DBG_LOGE ("ERR: %s(%d): can't create %s delegate\n", __FILE__, __LINE__,
+                      tflite_get_delegate_str (delegate_type));
+            continue;
+        }
+
+        if (p->interpreter->ModifyGraphWithDelegate(delegate) != kTfLiteOk)
+        {
+            DBG_LOGE ("ERR: %s(%d): %s delegate rejected the graph\n", __FILE__, __LINE__,
+                      tflite_get_delegate_str (delegate_type));
+
+            /* the interpreter is reverted to the graph before the delegate. */
+            delete_delegate (delegate, delegate_type);
+            continue;
+        }
+
+#if defined (USE_XNNPACK_DELEGATE) && defined (USE_XNNPACK_WEIGHTS_CACHE)
+        if (delegate_type == TFLITE_DELEGATE_XNNPACK && opt->xnnpack_weights_cache)
+            TfLiteXNNPackDelegateWeightsCacheFinalizeHard (get_xnnpack_weights_cache (model_key));
 #endif
 
+        p->delegate      = delegate;
+        p->delegate_type = delegate_type;
+        break;
+    }
+
+    DBG_LOG ("@@@@@@ TFLITE_DELEGATE=%s\n", tflite_get_delegate_str (p->delegate_type));
     return 0;
 }
 
 
-int
-tflite_create_interpreter (tflite_interpreter_t *p, const char *model_buf, size_t model_size)
+/* -------------------------------------------------- *
+ *  Create TFLite Interpreter
+ * -------------------------------------------------- */
+void
+tflite_get_default_createopt (tflite_createopt_t *opt)
 {
-    p->model = FlatBufferModel::BuildFromBuffer(model_buf, model_size);
-    if (!p->model)
+    memset (opt, 0, sizeof (*opt));
+
+    opt->num_threads   = 0;     /* hardware_concurrency() */
+    opt->num_delegates = 1;
+    opt->delegates[0]  = TFLITE_DELEGATE_DEFAULT;
+    opt->allow_fp16    = 1;
+    opt->allow_quant   = 0;
+}
+
+static int
+tflite_build_interpreter (tflite_interpreter_t *p, tflite_createopt_t *opt, const char *model_key)
+{
+    tflite_createopt_t default_opt;
+    tflite_createopt_t env_opt;
+
+    if (opt == NULL)
     {
-        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        return -1;
+        tflite_get_default_createopt (&default_opt);
+        opt = &default_opt;
     }
 
+    /* environment variables take priority over the application's settings */
+    env_opt = *opt;
+    tflite_parse_delegate_env (&env_opt);
+    opt = &env_opt;
+
     InterpreterBuilder(*(p->model), p->resolver)(&(p->interpreter));
     if (!p->interpreter)
     {
@@ -364,17 +746,20 @@ tflite_create_interpreter (tflite_interpreter_t *p, const char *model_buf, size_
         return -1;
     }
 
-    int num_threads = std::thread::hardware_concurrency();
-    char *env_tflite_num_threads = getenv ("FORCE_TFLITE_NUM_THREADS");
-    if (env_tflite_num_threads)
-    {
-        num_threads = atoi (env_tflite_num_threads);
-        DBG_LOGI ("@@@@@@ FORCE_TFLITE_NUM_THREADS=%d\n", num_threads);
-    }
+    p->delegate      = NULL;
+    p->delegate_type = TFLITE_DELEGATE_NONE;
+    p->budget_slot   = 0;
+    p->batch_size    = 1;
+    p->batch_fixed   = 0;
+
+    int num_threads = tflite_get_num_threads (opt);
+    if (s_budget.enabled && opt->num_threads == 0)
+        num_threads = thread_budget_join (p);
     DBG_LOG ("@@@@@@ TFLITE_NUM_THREADS=%d\n", num_threads);
     p->interpreter->SetNumThreads(num_threads);
+    p->num_threads = num_threads;
 
-    if (modify_graph_with_delegate (p, NULL) < 0)
+    if (modify_graph_with_delegate (p, opt, model_key) < 0)
     {
         DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
         //return -1;
@@ -386,55 +771,56 @@ tflite_create_interpreter (tflite_interpreter_t *p, const char *model_buf, size_
         return -1;
     }
 
-#if 1 /* for debug */
-    DBG_LOG ("\n");
-    DBG_LOG ("##### LOAD TFLITE: %p: %zu[byte]\n", model_buf, model_size);
-    tflite_print_tensor_info (p->interpreter);
-#endif
-
     return 0;
 }
 
+
 int
-tflite_create_interpreter_ex (tflite_interpreter_t *p, const char *model_buf, size_t model_size, tflite_createopt_t *opt)
+tflite_create_interpreter_ex_from_file (tflite_interpreter_t *p, const char *model_path, tflite_createopt_t *opt)
 {
-    p->model = FlatBufferModel::BuildFromBuffer(model_buf, model_size);
+    p->model = FlatBufferModel::BuildFromFile (model_path);
     if (!p->model)
     {
         DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
     }
 
-    InterpreterBuilder(*(p->model), p->resolver)(&(p->interpreter));
-    if (!p->interpreter)
+    if (tflite_build_interpreter (p, opt, model_path) < 0)
     {
         DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
     }
 
-    int num_threads = std::thread::hardware_concurrency();
-    char *env_tflite_num_threads = getenv ("FORCE_TFLITE_NUM_THREADS");
-    if (env_tflite_num_threads)
-    {
-        num_threads = atoi (env_tflite_num_threads);
-        DBG_LOGI ("@@@@@@ FORCE_TFLITE_NUM_THREADS=%d\n", num_threads);
-    }
-    DBG_LOG ("@@@@@@ TFLITE_NUM_THREADS=%d\n", num_threads);
-    p->interpreter->SetNumThreads(num_threads);
-
-#if 0
-    std::vector<int> sizes = {1, 1280, 1280, 3};
-    int input_id = p->interpreter->inputs()[0];
-    p->interpreter->ResizeInputTensor(input_id, sizes);
+#if 1 /* for debug */
+    DBG_LOG ("\n");
+    DBG_LOG ("##### LOAD TFLITE FILE: \"%s\"\n", model_path);
+    tflite_print_tensor_info (p->interpreter);
 #endif
 
-    if (modify_graph_with_delegate (p, opt) < 0)
+    return 0;
+}
+
+int
+tflite_create_interpreter_from_file (tflite_interpreter_t *p, const char *model_path)
+{
+    return tflite_create_interpreter_ex_from_file (p, model_path, NULL);
+}
+
+
+int
+tflite_create_interpreter_ex (tflite_interpreter_t *p, const char *model_buf, size_t model_size, tflite_createopt_t *opt)
+{
+    p->model = FlatBufferModel::BuildFromBuffer(model_buf, model_size);
+    if (!p->model)
     {
         DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
-        //return -1;
+        return -1;
     }
 
-    if (p->interpreter->AllocateTensors() != kTfLiteOk)
+    char model_key[64];
+    snprintf (model_key, sizeof (model_key), "%p:%zu", model_buf, model_size);
+
+    if (tflite_build_interpreter (p, opt, model_key) < 0)
     {
         DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
@@ -449,37 +835,19 @@ tflite_create_interpreter_ex (tflite_interpreter_t *p, const char *model_buf, si
     return 0;
 }
 
-
 int
-tflite_get_tensor_by_name (tflite_interpreter_t *p, int io, const char *name, tflite_tensor_t *ptensor)
+tflite_create_interpreter (tflite_interpreter_t *p, const char *model_buf, size_t model_size)
 {
-    std::unique_ptr<Interpreter> &interpreter = p->interpreter;
-
-    memset (ptensor, 0, sizeof (*ptensor));
-
-    int tensor_idx;
-    int io_idx = -1;
-    int num_tensor = (io == 0) ? interpreter->inputs ().size() :
-                                 interpreter->outputs().size();
+    return tflite_create_interpreter_ex (p, model_buf, model_size, NULL);
+}
 
-    for (int i = 0; i < num_tensor; i ++)
-    {
-        tensor_idx = (io == 0) ? interpreter->inputs ()[i] :
-                                 interpreter->outputs()[i];
 
-        const char *tensor_name = interpreter->tensor(tensor_idx)->name;
-        if (strcmp (tensor_name, name) == 0)
-        {
-            io_idx = i;
-            break;
-        }
-    }
+static int
+fill_tensor_info (tflite_interpreter_t *p, int tensor_idx, int io, int io_idx, tflite_tensor_t *ptensor)
+{
+    std::unique_ptr<Interpreter> &interpreter = p->interpreter;
 
-    if (io_idx < 0)
-    {
-        DBG_LOGE ("can't find tensor: \"%s\"\n", name);
-        return -1;
-    }
+    memset (ptensor, 0, sizeof (*ptensor));
 
     void *ptr = NULL;
     TfLiteTensor *tensor = interpreter->tensor(tensor_idx);
@@ -518,3 +886,124 @@ tflite_get_tensor_by_name (tflite_interpreter_t *p, int io, const char *name, tf
     return 0;
 }
 
+
+int
+tflite_get_tensor_by_name (tflite_interpreter_t *p, int io, const char *name, tflite_tensor_t *ptensor)
+{
+    std::unique_ptr<Interpreter> &interpreter = p->interpreter;
+
+    memset (ptensor, 0, sizeof (*ptensor));
+
+    int tensor_idx;
+    int io_idx = -1;
+    int num_tensor = (io == 0) ? interpreter->inputs ().size() :
+                                 interpreter->outputs().size();
+
+    for (int i = 0; i < num_tensor; i ++)
+    {
+        tensor_idx = (io == 0) ? interpreter->inputs ()[i] :
+                                 interpreter->outputs()[i];
+
+        const char *tensor_name = interpreter->tensor(tensor_idx)->name;
+        if (strcmp (tensor_name, name) == 0)
+        {
+            io_idx = i;
+            break;
+        }
+    }
+
+    if (io_idx < 0)
+    {
+        DBG_LOGE ("can't find tensor: \"%s\"\n", name);
+        return -1;
+    }
+
+    return fill_tensor_info (p, tensor_idx, io, io_idx, ptensor);
+}
+
+/*
+ *  re-read the buffer address and the shape of the tensor.
+ *  (they change when the tensors are reallocated by tflite_resize_batch())
+ */
+int
+tflite_update_tensor (tflite_interpreter_t *p, tflite_tensor_t *ptensor)
+{
+    int tensor_idx = ptensor->idx;
+    int io         = ptensor->io;
+    int io_idx     = ptensor->io_idx;
+
+    return fill_tensor_info (p, tensor_idx, io, io_idx, ptensor);
+}
+
+
+
+/* -------------------------------------------------- *
+ *  Batch size of the input tensors
+ * -------------------------------------------------- */
+static int
+resize_input_batch (tflite_interpreter_t *p, int batch)
+{
+    std::unique_ptr<Interpreter> &interpreter = p->interpreter;
+
+    for (int tensor_idx : interpreter->inputs ())
+    {
+        TfLiteTensor *tensor = interpreter->tensor (tensor_idx);
+        if (tensor->dims->size < 1)
+            return -1;
+
+        std::vector<int> dims (tensor->dims->data, tensor->dims->data + tensor->dims->size);
+        dims[0] = batch;
+
+        if (interpreter->ResizeInputTensor (tensor_idx, dims) != kTfLiteOk)
+            return -1;
+    }
+
+    if (interpreter->AllocateTensors () != kTfLiteOk)
+        return -1;
+
+    return 0;
+}
+
+/*
+ *  Change dims[0] of all the input tensors to run several ROIs in one Invoke().
+ *  The tensors are reallocated only when the batch size differs from the
+ *  current one, so it is cheap to call this every frame.
+ *
+ *  Returns the batch size in effect. A graph which can't be resized
+ *  (Reshape with a fixed shape, GPU delegates) stays at batch 1 from then on.
+ *  Refresh the tensor pointers with tflite_update_tensor() after this.
+ */
+int
+tflite_resize_batch (tflite_interpreter_t *p, int batch)
+{
+    if (batch < 1 || p->batch_fixed)
+        batch = 1;
+
+    if (batch == p->batch_size)
+        return batch;
+
+    /* the delegated graphs are built for the initial input shape */
+    if (p->delegate_type != TFLITE_DELEGATE_NONE &&
+        p->delegate_type != TFLITE_DELEGATE_XNNPACK)
+    {
+        p->batch_fixed = 1;
+        return p->batch_size;
+    }
+
+    if (resize_input_batch (p, batch) < 0)
+    {
+        DBG_LOGW ("can't resize the input tensors to batch %d. keep batch 1.\n", batch);
+        p->batch_fixed = 1;
+        p->batch_size  = 1;
+
+        if (resize_input_batch (p, 1) < 0)
+        {
+            DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+            return -1;
+        }
+        return 1;
+    }
+
+    p->batch_size = batch;
+    return batch;
+}
@@ -29,16 +29,58 @@
 #endif
 
 
+/* delegate kinds selectable at runtime */
+enum tflite_delegate_type_t
+{
+    TFLITE_DELEGATE_NONE = 0,   /* builtin CPU kernels only */
+    TFLITE_DELEGATE_DEFAULT,    /* the one selected by TFLITE_DELEGATE in Makefile.env */
+    TFLITE_DELEGATE_XNNPACK,
+    TFLITE_DELEGATE_GL,
+    TFLITE_DELEGATE_GPUV2,
+    TFLITE_DELEGATE_NNAPI,
+    TFLITE_DELEGATE_HEXAGON,
+
+    TFLITE_DELEGATE_NUM
+};
+
+#define TFLITE_MAX_DELEGATES    4
+
+/* how the stages sharing the thread budget are executed */
+#define TFLITE_BUDGET_SERIAL        0
+#define TFLITE_BUDGET_CONCURRENT    1
+
 typedef struct tflite_interpreter_t
 {
     std::unique_ptr<tflite::FlatBufferModel> model;
     std::unique_ptr<tflite::Interpreter>     interpreter;
     tflite::ops::builtin::BuiltinOpResolver  resolver;
+    TfLiteDelegate                           *delegate;     /* must outlive the interpreter */
+    int                                      delegate_type; /* delegate actually applied */
+    int                                      num_threads;
+    int                                      budget_slot;   /* 1-based slot in the thread budget, 0: none */
+    int                                      batch_size;    /* current batch size of the input tensors */
+    int                                      batch_fixed;   /* the graph can't be resized to batch > 1 */
 } tflite_interpreter_t;
 
+/*
+ *  Options for tflite_create_interpreter_ex[_from_file]().
+ *  Initialize with tflite_get_default_createopt() before overriding the fields.
+ *
+ *  The environment variables FORCE_TFLITE_NUM_THREADS and
+ *  FORCE_TFLITE_DELEGATE (e.g. "gpuv2,xnnpack,none") override these settings.
+ *  Only gl2posenet and tools/stream_server pass their own options; the other
+ *  apps create their interpreters with the defaults, and are configured
+ *  through these environment variables only.
+ */
 typedef struct tflite_createopt_t
 {
-    int gpubuffer;
+    int gpubuffer;                          /* SSBO bound to the input tensor (GL delegate) */
+    int num_threads;                        /* 0: std::thread::hardware_concurrency() */
+    int num_delegates;
+    int delegates[TFLITE_MAX_DELEGATES];    /* tried in order until one is applied */
+    int allow_fp16;                         /* GPU: allow FP16 precision loss */
+    int allow_quant;                        /* GPU/XNNPACK: run quantized (INT8) graphs */
+    int xnnpack_weights_cache;              /* share packed weights between the same models */
 } tflite_createopt_t;
 
 typedef struct tflite_tensor_t
@@ -58,12 +100,24 @@ typedef struct tflite_tensor_t
 extern "C" {
 #endif
 
+void tflite_get_default_createopt (tflite_createopt_t *opt);
+
 int tflite_create_interpreter (tflite_interpreter_t *p, const char *model_buf, size_t model_size);
+int tflite_create_interpreter_ex (tflite_interpreter_t *p, const char *model_buf, size_t model_size, tflite_createopt_t *opt);
 int tflite_get_tensor_by_name (tflite_interpreter_t *p, int io, const char *name, tflite_tensor_t *ptensor);
+int tflite_update_tensor (tflite_interpreter_t *p, tflite_tensor_t *ptensor);
 
 int tflite_create_interpreter_from_file (tflite_interpreter_t *p, const char *model_path);
 int tflite_create_interpreter_ex_from_file (tflite_interpreter_t *p, const char *model_path, tflite_createopt_t *opt);
 
+int tflite_init_thread_budget (int num_threads, int mode);
+int tflite_get_thread_budget_mode ();
+int enable_tflite_concurrent_invoke ();
+int tflite_invoke (tflite_interpreter_t *p);
+double tflite_get_invoke_time_ms ();
+
+int tflite_resize_batch (tflite_interpreter_t *p, int batch);
+
 
 
 #ifdef __cplusplus
@@ -131,6 +131,7 @@ alloc_buffer_mmap (capture_dev_t *cap_dev)
         cap_frame->vaddr = mmap (NULL, buf.length, PROT_WRITE|PROT_READ, 
                                  MAP_SHARED, v4l_fd, buf.m.offset);
         
+        cap_frame->prime_fd       = -1;     /* set by v4l2_export_dmabuf() */
         cap_frame->v4l_buf.index  = i;
         cap_frame->v4l_buf.type   = buffer_type;
         cap_frame->v4l_buf.memory = V4L2_MEMORY_MMAP;
@@ -248,7 +249,8 @@ v4l2_open_capture_device (int devid)
     cap_dev->v4l_fd   = v4l_fd;
     cap_dev->dev_type = dev_type;
 
-    init_capture_stream (cap_dev, V4L2_MEMORY_MMAP, 4);
+    /* util_camera_capture may hold 2 frames (triple buffer) outside the driver. */
+    init_capture_stream (cap_dev, V4L2_MEMORY_MMAP, 6);
     alloc_buffer (cap_dev);
 
     return cap_dev;
@@ -301,10 +303,97 @@ v4l2_start_capture (capture_dev_t *cap_dev)
     return 0;
 }
 
+int
+v4l2_stop_capture (capture_dev_t *cap_dev)
+{
+    int type = cap_dev->stream.buftype;
+    int ret;
+
+    ret = ioctl (cap_dev->v4l_fd, VIDIOC_STREAMOFF, &type);
+    if (ret < 0)
+    {
+        fprintf (stderr, "STREAMOFF failed: %s\n", ERRSTR);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* the buffers of V4L2_MEMORY_MMAP are unmapped. the dmabufs exported are closed. */
+void
+v4l2_close_capture_device (capture_dev_t *cap_dev)
+{
+    int i;
+    int v4l_fd = cap_dev->v4l_fd;
+    capture_stream_t *cap_stream = &cap_dev->stream;
+
+    v4l2_stop_capture (cap_dev);
+
+    if (cap_stream->memtype == V4L2_MEMORY_MMAP)
+    {
+        for (i = 0; i < cap_stream->bufcount; i ++)
+        {
+            capture_frame_t *cap_frame = &(cap_stream->frames[i]);
+            struct v4l2_buffer buf = {0};
+
+            buf.index  = i;
+            buf.type   = cap_stream->buftype;
+            buf.memory = V4L2_MEMORY_MMAP;
+
+            if (ioctl (v4l_fd, VIDIOC_QUERYBUF, &buf) == 0 &&
+                cap_frame->vaddr && cap_frame->vaddr != MAP_FAILED)
+            {
+                munmap (cap_frame->vaddr, buf.length);
+            }
+
+            if (cap_frame->prime_fd >= 0)
+                close (cap_frame->prime_fd);
+        }
+
+        struct v4l2_requestbuffers rqbufs = {0};
+        rqbufs.type   = cap_stream->buftype;
+        rqbufs.count  = 0;
+        rqbufs.memory = V4L2_MEMORY_MMAP;
+        ioctl (v4l_fd, VIDIOC_REQBUFS, &rqbufs);
+    }
+
+    free (cap_stream->frames);
+    close (v4l_fd);
+    free (cap_dev);
+}
+
 
 /* ------------------------------------------------------------------------ *
  *  acquire/release capture buffer
  * ------------------------------------------------------------------------ */
+
+/* returns 1 if a frame is ready to acquire, 0 on timeout, -1 on error. */
+int
+v4l2_wait_capture_frame (capture_dev_t *cap_dev, int timeout_ms)
+{
+    struct pollfd fds[1] = {0};
+    fds[0].fd     = cap_dev->v4l_fd;
+    fds[0].events = POLLIN | POLLERR;
+
+    int ret = poll (fds, 1, timeout_ms);
+    if (ret < 0)
+    {
+        if (errno == EINTR)
+            return 0;
+
+        fprintf (stderr, "poll failed: %s\n", ERRSTR);
+        return -1;
+    }
+
+    if (ret == 0)
+        return 0;
+
+    if (fds[0].revents & POLLIN)
+        return 1;
+
+    return -1;
+}
+
 capture_frame_t *
 v4l2_acquire_capture_frame (capture_dev_t *cap_dev)
 {
@@ -350,6 +439,47 @@ v4l2_release_capture_frame (capture_dev_t *cap_dev, capture_frame_t *cap_frame)
 
 
 
+/* ------------------------------------------------------------------------ *
+ *  export MMAP buffers as dmabuf (to import them into EGLImage)
+ * ------------------------------------------------------------------------ */
+int
+v4l2_export_dmabuf (capture_dev_t *cap_dev)
+{
+    int i, ret;
+    int v4l_fd = cap_dev->v4l_fd;
+    capture_stream_t *cap_stream = &cap_dev->stream;
+
+    if (cap_stream->memtype != V4L2_MEMORY_MMAP)
+        return -1;
+
+    for (i = 0; i < cap_stream->bufcount; i ++)
+    {
+        struct v4l2_exportbuffer expbuf = {0};
+        expbuf.type  = cap_stream->buftype;
+        expbuf.index = i;
+        expbuf.plane = 0;
+        expbuf.flags = O_CLOEXEC | O_RDONLY;
+
+        ret = ioctl (v4l_fd, VIDIOC_EXPBUF, &expbuf);
+        if (ret < 0)
+        {
+            fprintf (stderr, "VIDIOC_EXPBUF failed: %s\n", ERRSTR);
+            for (i --; i >= 0; i --)
+            {
+                close (cap_stream->frames[i].prime_fd);
+                cap_stream->frames[i].prime_fd = -1;
+            }
+            return -1;
+        }
+
+        cap_stream->frames[i].prime_fd = expbuf.fd;
+    }
+
+    return 0;
+}
+
+
+
 /* ------------------------------------------------------------------------ *
  *  utilities
  * ------------------------------------------------------------------------ */
@@ -392,6 +522,19 @@ v4l2_get_capture_wh (capture_dev_t *cap_dev, int *w, int *h)
     return 0;
 }
 
+int
+v4l2_get_capture_bytesperline (capture_dev_t *cap_dev, int *bpl)
+{
+    struct v4l2_format *fmt = &cap_dev->stream.format;
+
+    if (cap_dev->stream.buftype == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE)
+        *bpl = fmt->fmt.pix_mp.plane_fmt[0].bytesperline;
+    else
+        *bpl = fmt->fmt.pix.bytesperline;
+
+    return 0;
+}
+
 
 void
 v4l2_show_current_capture_settings (capture_dev_t *cap_dev)
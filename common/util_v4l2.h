@@ -38,12 +38,17 @@ typedef struct _capture_dev_t
 int              v4l2_get_capture_device ();
 capture_dev_t   *v4l2_open_capture_device (int devid);
 int              v4l2_start_capture (capture_dev_t *cap_dev);
+int              v4l2_stop_capture (capture_dev_t *cap_dev);
+void             v4l2_close_capture_device (capture_dev_t *cap_dev);
+int              v4l2_wait_capture_frame (capture_dev_t *cap_dev, int timeout_ms);
 capture_frame_t *v4l2_acquire_capture_frame (capture_dev_t *cap_dev);
 int              v4l2_release_capture_frame (capture_dev_t *cap_dev, capture_frame_t *cap_frame);
+int              v4l2_export_dmabuf (capture_dev_t *cap_dev);
 
 
 int v4l2_get_capture_pixelformat (capture_dev_t *cap_dev, unsigned int *pixfmt);
 int v4l2_get_capture_wh (capture_dev_t *cap_dev, int *w, int *h);
+int v4l2_get_capture_bytesperline (capture_dev_t *cap_dev, int *bpl);
 
 void v4l2_show_current_capture_settings (capture_dev_t *cap_dev);
 
@@ -13,6 +13,7 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
 #include "tflite_age_gender.h"
 #include "util_camera_capture.h"
 #include "util_video_decode.h"
@@ -27,7 +28,7 @@
 void
 feed_face_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_face_detect_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -45,19 +46,7 @@ feed_face_detect_image(texture_2d_t *srctex, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
     float mean = 128.0f;
     float std  = 128.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
@@ -65,7 +54,7 @@ feed_face_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 void
 feed_age_gender_image(texture_2d_t *srctex, int win_w, int win_h, face_detect_result_t *detection, unsigned int face_id)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_age_gender_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -105,19 +94,7 @@ feed_age_gender_image(texture_2d_t *srctex, int win_w, int win_h, face_detect_re
     /* convert UI8 [0, 255] ==> FP32 [0, 255] */
     float mean = 0.0f;
     float std  = 1.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
@@ -7,13 +7,17 @@
 #include <unistd.h>
 #include <time.h>
 #include <float.h>
+#include <string.h>
+#include <math.h>
 #include <GLES2/gl2.h>
 #include "util_egl.h"
 #include "util_debugstr.h"
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
 #include "util_matrix.h"
+#include "util_lmfilter.h"
 #include "tflite_blazepose.h"
 #include "util_camera_capture.h"
 #include "util_video_decode.h"
@@ -29,7 +33,7 @@
 void
 feed_pose_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_pose_detect_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -47,19 +51,7 @@ feed_pose_detect_image(texture_2d_t *srctex, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
     float mean = 128.0f;
     float std  = 128.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
@@ -67,7 +59,7 @@ feed_pose_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 void
 feed_pose_landmark_image(texture_2d_t *srctex, int win_w, int win_h, pose_detect_result_t *detection, unsigned int pose_id)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_pose_landmark_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -107,21 +99,74 @@ feed_pose_landmark_image(texture_2d_t *srctex, int win_w, int win_h, pose_detect
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
     float mean = 128.0f;
     float std  = 128.0f;
-    for (y = 0; y < h; y ++)
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
+
+    return;
+}
+
+
+/*
+ *  ROI tracking (-t option)
+ *    the ROIs of the next frame are derived from the landmarks of this frame.
+ *    if any pose is lost, the detection runs again at the next frame.
+ */
+static void
+update_pose_track (pose_detect_result_t *track, pose_detect_result_t *detection,
+                   pose_landmark_result_t *landmark)
+{
+    track->num = 0;
+    for (int pose_id = 0; pose_id < detection->num; pose_id ++)
     {
-        for (x = 0; x < w; x ++)
+        detect_region_t region = detection->poses[pose_id];
+        if (track_pose_region (&region, &landmark[pose_id]) != 0)
         {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
+            track->num = 0;
+            return;
         }
+        track->poses[track->num ++] = region;
     }
+}
 
-    return;
+/*
+ *  landmark smoothing (-s option, 0: off, 1: One-Euro, 2: Kalman)
+ *    the landmarks are filtered in the image coordinates, and brought back
+ *    into the ROI of this frame, so the point drawn is the filtered point.
+ *    the ROI itself is not filtered: it only crops the next input.
+ *    the track id follows the person by the overlap of the ROI with the last frame,
+ *    because the detections are sorted by the score every frame.
+ */
+#define POSE_TRACK_IOU_MIN  0.3f
+
+static lmfilter_bank_t    s_lmfilter;
+static lmfilter_tracker_t s_lmtracker;
+
+static void
+assign_pose_track_id (pose_detect_result_t *detection, int *track_id)
+{
+    float box[MAX_POSE_NUM][4];
+
+    for (int pose_id = 0; pose_id < detection->num; pose_id ++)
+    {
+        detect_region_t *region = &detection->poses[pose_id];
+        box[pose_id][0] = region->roi_center.x;
+        box[pose_id][1] = region->roi_center.y;
+        box[pose_id][2] = region->roi_size.x;
+        box[pose_id][3] = region->roi_size.y;
+    }
+
+    lmfilter_assign_tracks (&s_lmtracker, box, detection->num, POSE_TRACK_IOU_MIN, track_id);
+}
+
+static void
+smooth_pose_landmark (detect_region_t *region, pose_landmark_result_t *landmark, int track_id, double time_ms)
+{
+    lmfilter_roi_t roi = {region->roi_center.x, region->roi_center.y,
+                          region->roi_size.x,   region->roi_size.y, region->rotation};
+    float *joint = &landmark->joint[0].x;
+
+    lmfilter_roi_to_image (&roi, joint, POSE_JOINT_NUM);
+    lmfilter_bank_apply (&s_lmfilter, track_id, joint, time_ms);
+    lmfilter_image_to_roi (&roi, joint, POSE_JOINT_NUM);
 }
 
 
@@ -402,6 +447,10 @@ main(int argc, char *argv[])
     int use_quantized_tflite = 0;
     int enable_camera = 1;
     imgui_data_t imgui_data = {0};
+    int track_interval = 0;
+    int track_age = 0;
+    int lmfilter_type = LMFILTER_NONE;
+    static pose_detect_result_t pose_track_ret = {0};
     UNUSED (argc);
     UNUSED (*argv);
 #if defined (USE_INPUT_VIDEO_DECODE)
@@ -410,7 +459,7 @@ main(int argc, char *argv[])
 
     {
         int c;
-        const char *optstring = "qv:x";
+        const char *optstring = "qs:t:v:x";
 
         while ((c = getopt (argc, argv, optstring)) != -1)
         {
@@ -419,6 +468,12 @@ main(int argc, char *argv[])
             case 'q':
                 use_quantized_tflite = 1;
                 break;
+            case 's':
+                lmfilter_type = atoi (optarg);
+                break;
+            case 't':
+                track_interval = atoi (optarg);
+                break;
 #if defined (USE_INPUT_VIDEO_DECODE)
             case 'v':
                 enable_video = 1;
@@ -446,6 +501,11 @@ main(int argc, char *argv[])
 
     init_tflite_blazepose (use_quantized_tflite, &imgui_data.blazepose_config);
 
+    lmfilter_param_t lmfilter_param;
+    lmfilter_default_param (&lmfilter_param, lmfilter_type);
+    lmfilter_init_bank (&s_lmfilter, &lmfilter_param, MAX_POSE_NUM, POSE_JOINT_NUM * 3);
+    lmfilter_init_tracker (&s_lmtracker);
+
     setup_imgui (win_w, win_h, &imgui_data);
 
 #if defined (USE_GL_DELEGATE) || defined (USE_GPU_DELEGATEV2)
@@ -522,13 +582,24 @@ main(int argc, char *argv[])
 
         /* --------------------------------------- *
          *  Pose detection
+         *  (skipped while the poses are tracked)
          * --------------------------------------- */
-        feed_pose_detect_image (&captex, win_w, win_h);
+        if (pose_track_ret.num > 0 && track_age < track_interval)
+        {
+            detect_ret = pose_track_ret;
+            invoke_ms0 = 0;
+            track_age ++;
+        }
+        else
+        {
+            feed_pose_detect_image (&captex, win_w, win_h);
 
-        ttime[2] = pmeter_get_time_ms ();
-        invoke_pose_detect (&detect_ret, &imgui_data.blazepose_config);
-        ttime[3] = pmeter_get_time_ms ();
-        invoke_ms0 = ttime[3] - ttime[2];
+            ttime[2] = pmeter_get_time_ms ();
+            invoke_pose_detect (&detect_ret, &imgui_data.blazepose_config);
+            ttime[3] = pmeter_get_time_ms ();
+            invoke_ms0 = ttime[3] - ttime[2];
+            track_age = 0;
+        }
 
         /* --------------------------------------- *
          *  Pose landmark
@@ -544,6 +615,21 @@ main(int argc, char *argv[])
             invoke_ms1 += ttime[5] - ttime[4];
         }
 
+        if (track_interval > 0)
+            update_pose_track (&pose_track_ret, &detect_ret, landmark_ret);
+
+        /* --------------------------------------- *
+         *  landmark smoothing
+         * --------------------------------------- */
+        if (lmfilter_type != LMFILTER_NONE)
+        {
+            int track_id[MAX_POSE_NUM];
+            assign_pose_track_id (&detect_ret, track_id);
+
+            for (int pose_id = 0; pose_id < detect_ret.num; pose_id ++)
+                smooth_pose_landmark (&detect_ret.poses[pose_id], &landmark_ret[pose_id], track_id[pose_id], ttime[1]);
+        }
+
         /* --------------------------------------- *
          *  render scene
          * --------------------------------------- */
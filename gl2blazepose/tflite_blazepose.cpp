@@ -3,9 +3,10 @@
  * Copyright (c) 2020 terryky1220@gmail.com
  * ------------------------------------------------ */
 #include "util_tflite.h"
+#include "util_bench.h"
 #include "tflite_blazepose.h"
-#include "glue_mediapipe.h"
-#include <list>
+#include "util_nms.h"
+#include "util_ssd_anchors.h"
 
 /* 
  * https://github.com/google/mediapipe/tree/master/mediapipe/modules/pose_detection
@@ -26,7 +27,8 @@ static tflite_tensor_t      s_landmark_tensor_input;
 static tflite_tensor_t      s_landmark_tensor_landmark;
 static tflite_tensor_t      s_landmark_tensor_landmarkflag;
 
-static std::vector<Anchor>  s_anchors;
+static const nms_anchors_t  *s_anchors;
+static nms_boxes_t          s_pose_boxes;
 
 
 static int
@@ -36,28 +38,31 @@ create_ssd_anchors(int input_w, int input_h)
      *  Anchor parameters are based on:
      *      mediapipe/modules/pose_detection/pose_detection_cpu.pbtxt
      */
-    SsdAnchorsCalculatorOptions anchor_options;
+    ssd_anchor_options_t anchor_options;
+    ssd_anchors_default_options (&anchor_options);
+
     anchor_options.num_layers = 4;
-    anchor_options.min_scale = 0.1484375;
-    anchor_options.max_scale = 0.75;
+    anchor_options.min_scale  = 0.1484375f;
+    anchor_options.max_scale  = 0.75f;
     anchor_options.input_size_height = 128;
     anchor_options.input_size_width  = 128;
-    anchor_options.anchor_offset_x  = 0.5f;
-    anchor_options.anchor_offset_y  = 0.5f;
-//  anchor_options.feature_map_width .push_back(0);
-//  anchor_options.feature_map_height.push_back(0);
-    anchor_options.strides.push_back( 8);
-    anchor_options.strides.push_back(16);
-    anchor_options.strides.push_back(16);
-    anchor_options.strides.push_back(16);
-    anchor_options.aspect_ratios.push_back(1.0);
-    anchor_options.reduce_boxes_in_lowest_layer = false;
-    anchor_options.interpolated_scale_aspect_ratio = 1.0;
-    anchor_options.fixed_anchor_size = true;
-
-    GenerateAnchors (&s_anchors, anchor_options);
+    anchor_options.anchor_offset_x   = 0.5f;
+    anchor_options.anchor_offset_y   = 0.5f;
+    anchor_options.strides[0] =  8;
+    anchor_options.strides[1] = 16;
+    anchor_options.strides[2] = 16;
+    anchor_options.strides[3] = 16;
+    anchor_options.num_aspect_ratios = 1;
+    anchor_options.aspect_ratios[0]  = 1.0f;
+    anchor_options.reduce_boxes_in_lowest_layer    = 0;
+    anchor_options.interpolated_scale_aspect_ratio = 1.0f;
+    anchor_options.fixed_anchor_size = 1;
+
+    s_anchors = ssd_anchors_get (&anchor_options);
+    if (s_anchors == NULL)
+        return -1;
 
-    return 0;
+    return s_anchors->num;
 }
 
 
@@ -71,6 +76,9 @@ init_tflite_blazepose(int use_quantized_tflite, blazepose_config_t *config)
     const char *detectpose_model;
     const char *landmark_model;
 
+    /* detection and landmark run one after another: share one CPU worker pool */
+    tflite_init_thread_budget (0, TFLITE_BUDGET_SERIAL);
+
     if (use_quantized_tflite)
     {
         detectpose_model = POSE_DETECT_QUANT_MODEL_PATH;
@@ -102,7 +110,8 @@ init_tflite_blazepose(int use_quantized_tflite, blazepose_config_t *config)
 
     int det_input_w = s_detect_tensor_input.dims[2];
     int det_input_h = s_detect_tensor_input.dims[1];
-    create_ssd_anchors (det_input_w, det_input_h);
+    int num_anchors = create_ssd_anchors (det_input_w, det_input_h);
+    nms_init_boxes (&s_pose_boxes, num_anchors, kPoseDetectKeyNum);
 
     config->score_thresh = 0.75f;
     config->iou_thresh   = 0.3f;
@@ -131,9 +140,12 @@ get_pose_landmark_input_buf (int *w, int *h)
 /* -------------------------------------------------- *
  * Invoke TensorFlow Lite (Pose detection)
  * -------------------------------------------------- */
-static float *
-get_bbox_ptr (int anchor_idx)
+static int
+decode_bounds (nms_boxes_t *boxes, float score_thresh, int input_img_w, int input_img_h)
 {
+    float *scores_ptr = (float *)s_detect_tensor_scores.ptr;
+    float *bboxes_ptr = (float *)s_detect_tensor_bboxes.ptr;
+
     /*
      *  cx, cy, width, height
      *  key0_x, key0_y
@@ -141,72 +153,10 @@ get_bbox_ptr (int anchor_idx)
      *  key2_x, key2_y
      *  key3_x, key3_y
      */
-    int numkey = kPoseDetectKeyNum;
-    int idx = (4 + 2 * numkey) * anchor_idx;
-    float *bboxes_ptr = (float *)s_detect_tensor_bboxes.ptr;
+    int stride = 4 + 2 * kPoseDetectKeyNum;
 
-    return &bboxes_ptr[idx];
-}
-
-static int
-decode_bounds (std::list<detect_region_t> &region_list, float score_thresh, int input_img_w, int input_img_h)
-{
-    detect_region_t region;
-    float  *scores_ptr = (float *)s_detect_tensor_scores.ptr;
-
-    int i = 0;
-    for (auto itr = s_anchors.begin(); itr != s_anchors.end(); i ++, itr ++)
-    {
-        Anchor anchor = *itr;
-        float score0 = scores_ptr[i];
-        float score = 1.0f / (1.0f + exp(-score0));
-
-        if (score > score_thresh)
-        {
-            float *p = get_bbox_ptr (i);
-
-            /* boundary box */
-            float sx = p[0];
-            float sy = p[1];
-            float w  = p[2];
-            float h  = p[3];
-
-            float cx = sx + anchor.x_center * input_img_w;
-            float cy = sy + anchor.y_center * input_img_h;
-
-            cx /= (float)input_img_w;
-            cy /= (float)input_img_h;
-            w  /= (float)input_img_w;
-            h  /= (float)input_img_h;
-
-            fvec2 topleft, btmright;
-            topleft.x  = cx - w * 0.5f;
-            topleft.y  = cy - h * 0.5f;
-            btmright.x = cx + w * 0.5f;
-            btmright.y = cy + h * 0.5f;
-
-            region.score    = score;
-            region.topleft  = topleft;
-            region.btmright = btmright;
-
-            /* landmark positions (6 keys) */
-            for (int j = 0; j < kPoseDetectKeyNum; j ++)
-            {
-                float lx = p[4 + (2 * j) + 0];
-                float ly = p[4 + (2 * j) + 1];
-                lx += anchor.x_center * input_img_w;
-                ly += anchor.y_center * input_img_h;
-                lx /= (float)input_img_w;
-                ly /= (float)input_img_h;
-
-                region.keys[j].x = lx;
-                region.keys[j].y = ly;
-            }
-
-            region_list.push_back (region);
-        }
-    }
-    return 0;
+    return nms_decode_anchors (boxes, s_anchors, scores_ptr, bboxes_ptr, stride,
+                               (float)input_img_w, (float)input_img_h, score_thresh);
 }
 
 
@@ -324,23 +274,32 @@ compute_detect_to_roi (detect_region_t &region)
 
 
 static void
-pack_detect_result (pose_detect_result_t *detect_result, std::list<detect_region_t> &region_list)
+pack_detect_result (pose_detect_result_t *detect_result, nms_boxes_t *boxes, int *sel, int num_sel)
 {
     int num_regions = 0;
-    for (auto itr = region_list.begin(); itr != region_list.end(); itr ++)
+    for (int i = 0; i < num_sel && num_regions < MAX_POSE_NUM; i ++)
     {
-        detect_region_t region = *itr;
+        detect_region_t *region = &detect_result->poses[num_regions];
+        int    idx   = sel[i];
+        float  *keys = nms_get_keys (boxes, idx);
 
-        compute_rotation (region);
-        compute_detect_to_roi (region);
+        region->score      = boxes->score[idx];
+        region->topleft.x  = boxes->x0[idx];
+        region->topleft.y  = boxes->y0[idx];
+        region->btmright.x = boxes->x1[idx];
+        region->btmright.y = boxes->y1[idx];
 
-        memcpy (&detect_result->poses[num_regions], &region, sizeof (region));
-        num_regions ++;
-        detect_result->num = num_regions;
+        for (int j = 0; j < kPoseDetectKeyNum; j ++)
+        {
+            region->keys[j].x = keys[2 * j + 0];
+            region->keys[j].y = keys[2 * j + 1];
+        }
 
-        if (num_regions >= MAX_POSE_NUM)
-            break;
+        compute_rotation (*region);
+        compute_detect_to_roi (*region);
+        num_regions ++;
     }
+    detect_result->num = num_regions;
 }
 
 
@@ -350,7 +309,7 @@ pack_detect_result (pose_detect_result_t *detect_result, std::list<detect_region
 int
 invoke_pose_detect (pose_detect_result_t *detect_result, blazepose_config_t *config)
 {
-    if (s_detect_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_detect_interpreter) != 0)
     {
         fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
@@ -358,22 +317,24 @@ invoke_pose_detect (pose_detect_result_t *detect_result, blazepose_config_t *con
 
     /* decode boundary box and landmark keypoints */
     float score_thresh = config->score_thresh;
-    std::list<detect_region_t> region_list;
 
     int input_img_w = s_detect_tensor_input.dims[2];
     int input_img_h = s_detect_tensor_input.dims[1];
-    decode_bounds (region_list, score_thresh, input_img_w, input_img_h);
-
+    decode_bounds (&s_pose_boxes, score_thresh, input_img_w, input_img_h);
 
-#if 1 /* USE NMS */
     float iou_thresh = config->iou_thresh;
-    std::list<detect_region_t> region_nms_list;
+    int   sel[MAX_POSE_NUM];
+    int   num_sel;
 
-    non_max_suppression (region_list, region_nms_list, iou_thresh);
-    pack_detect_result (detect_result, region_nms_list);
+    bench_lap_start (BENCH_LAP_NMS);
+#if defined (USE_WEIGHTED_NMS)
+    /* blend the overlapping detections (WEIGHTED algorithm of MediaPipe) */
+    num_sel = nms_weighted (&s_pose_boxes, iou_thresh, sel, MAX_POSE_NUM);
 #else
-    pack_detect_result (detect_result, region_list);
+    num_sel = nms_hard (&s_pose_boxes, iou_thresh, sel, MAX_POSE_NUM);
 #endif
+    bench_lap_stop (BENCH_LAP_NMS);
+    pack_detect_result (detect_result, &s_pose_boxes, sel, num_sel);
 
     return 0;
 }
@@ -386,7 +347,7 @@ invoke_pose_detect (pose_detect_result_t *detect_result, blazepose_config_t *con
 int
 invoke_pose_landmark (pose_landmark_result_t *landmark_result)
 {
-    if (s_landmark_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_landmark_interpreter) != 0)
     {
         fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
@@ -407,6 +368,76 @@ invoke_pose_landmark (pose_landmark_result_t *landmark_result)
         //    landmark_ptr[4 * i + 0], landmark_ptr[4 * i + 1], landmark_ptr[4 * i + 2]);
     }
 
+    /* auxiliary keypoints follow the body landmarks (used for ROI tracking) */
+    int num_elems = 1;
+    for (int i = 0; i < 4; i ++)
+    {
+        if (s_landmark_tensor_landmark.dims[i] > 0)
+            num_elems *= s_landmark_tensor_landmark.dims[i];
+    }
+
+    landmark_result->num_aux = 0;
+    if (num_elems >= 4 * (POSE_JOINT_NUM + 2))
+    {
+        for (int i = 0; i < 2; i ++)
+        {
+            float *aux_ptr = &landmark_ptr[4 * (POSE_JOINT_NUM + i)];
+            landmark_result->aux_joint[i].x = aux_ptr[0] / (float)img_w;
+            landmark_result->aux_joint[i].y = aux_ptr[1] / (float)img_h;
+        }
+        landmark_result->num_aux = 2;
+    }
+
     return 0;
 }
 
+
+/* -------------------------------------------------- *
+ *  ROI tracking
+ *   compute the ROI of the next frame from the landmarks, so that
+ *   the pose detection can be skipped while the pose is tracked.
+ *
+ *  based on:
+ *   - mediapipe/modules/pose_landmark/pose_landmark_upper_body_landmarks_to_roi.pbtxt
+ * -------------------------------------------------- */
+int
+track_pose_region (detect_region_t *region, pose_landmark_result_t *landmark_result)
+{
+    if (landmark_result->score < 0.5f)
+        return -1;
+
+    /* the model doesn't output the auxiliary keypoints. */
+    if (landmark_result->num_aux < 2)
+        return -1;
+
+    /* keypoints in the ROI ==> normalized image coordinates */
+    fvec2 pos[2];
+    for (int i = 0; i < 2; i ++)
+    {
+        pos[i].x = (landmark_result->aux_joint[i].x - 0.5f) * region->roi_size.x;
+        pos[i].y = (landmark_result->aux_joint[i].y - 0.5f) * region->roi_size.y;
+        rot_vec (pos[i], region->rotation);
+        pos[i].x += region->roi_center.x;
+        pos[i].y += region->roi_center.y;
+    }
+
+    /* AlignmentPointsRectsCalculator (start_keypoint: 0, end_keypoint: 1) */
+    float target_angle = M_PI * 0.5f;
+    float rotation = target_angle - std::atan2(-(pos[1].y - pos[0].y), pos[1].x - pos[0].x);
+
+    region->rotation = normalize_radians (rotation);
+    region->keys[kMidShoulderCenter] = pos[0];
+    region->keys[kUpperBodySizeRot]  = pos[1];
+
+    compute_detect_to_roi (*region);
+
+    /* axis aligned box of the ROI (only for drawing) */
+    float box_w = region->roi_size.x / 1.5f;
+    float box_h = region->roi_size.y / 1.5f;
+    region->topleft.x  = region->roi_center.x - box_w * 0.5f;
+    region->topleft.y  = region->roi_center.y - box_h * 0.5f;
+    region->btmright.x = region->roi_center.x + box_w * 0.5f;
+    region->btmright.y = region->roi_center.y + box_h * 0.5f;
+
+    return 0;
+}
@@ -54,6 +54,9 @@ typedef struct _pose_landmark_result_t
 {
     float score;
     fvec3 joint[POSE_JOINT_NUM];
+
+    int   num_aux;              /* 2 if the model outputs the auxiliary keypoints */
+    fvec2 aux_joint[2];         /* [0] ROI center, [1] ROI size and rotation      */
 } pose_landmark_result_t;
 
 
@@ -71,6 +74,9 @@ int  invoke_pose_detect (pose_detect_result_t *detect_result, blazepose_config_t
 void *get_pose_landmark_input_buf (int *w, int *h);
 int  invoke_pose_landmark (pose_landmark_result_t *pose_landmark_result);
 
+/* ROI of the next frame from the landmarks (-1: the pose is lost) */
+int  track_pose_region (detect_region_t *region, pose_landmark_result_t *pose_landmark_result);
+
 #ifdef __cplusplus
 }
 #endif
@@ -13,6 +13,7 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
 #include "util_matrix.h"
 #include "tflite_blazepose.h"
 #include "util_camera_capture.h"
@@ -29,7 +30,7 @@
 void
 feed_pose_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_pose_detect_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -47,19 +48,7 @@ feed_pose_detect_image(texture_2d_t *srctex, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
     float mean = 128.0f;
     float std  = 128.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
@@ -67,7 +56,7 @@ feed_pose_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 void
 feed_pose_landmark_image(texture_2d_t *srctex, int win_w, int win_h, pose_detect_result_t *detection, unsigned int pose_id)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_pose_landmark_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -107,19 +96,7 @@ feed_pose_landmark_image(texture_2d_t *srctex, int win_w, int win_h, pose_detect
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
     float mean = 128.0f;
     float std  = 128.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
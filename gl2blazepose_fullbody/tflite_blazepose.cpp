@@ -71,6 +71,9 @@ init_tflite_blazepose(int use_quantized_tflite, blazepose_config_t *config)
     const char *detectpose_model;
     const char *landmark_model;
 
+    /* detection and landmark run one after another: share one CPU worker pool */
+    tflite_init_thread_budget (0, TFLITE_BUDGET_SERIAL);
+
     if (use_quantized_tflite)
     {
         detectpose_model = POSE_DETECT_MODEL_PATH;
@@ -348,7 +351,7 @@ pack_detect_result (pose_detect_result_t *detect_result, std::list<detect_region
 int
 invoke_pose_detect (pose_detect_result_t *detect_result, blazepose_config_t *config)
 {
-    if (s_detect_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_detect_interpreter) != 0)
     {
         fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
@@ -384,7 +387,7 @@ invoke_pose_detect (pose_detect_result_t *detect_result, blazepose_config_t *con
 int
 invoke_pose_landmark (pose_landmark_result_t *landmark_result)
 {
-    if (s_landmark_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_landmark_interpreter) != 0)
     {
         fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
@@ -2,379 +2,387 @@
  * The MIT License (MIT)
  * Copyright (c) 2020 terryky1220@gmail.com
  * ------------------------------------------------ */
-#include <iostream>
 #include <vector>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include <numeric>
 #include <cmath>
+#include <string.h>
+#include <stdint.h>
 #include "detect_postprocess.h"
+#include "util_bench.h"
 
-static float    *s_anchors;
-static int      s_anchors_count;
+#if defined (__SSE2__)
+#define DETECT_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define DETECT_NEON
+#include <arm_neon.h>
+#endif
 
-static float    *s_decoded_boxes;
+/*
+ *  software routine for "TFLite_Detection_PostProcess" Op.
+ *
+ *  the result is the same as detection_postprocess.cc (detect_postprocess_ref.cpp),
+ *  but the work is limited to the anchors which can make a detection:
+ *
+ *    1. the best class score of every anchor is taken with SIMD max, and the
+ *       anchors below ATTR_NMS_SCORE_THRESHOLD are dropped. (typically > 99%)
+ *    2. only the surviving candidates are decoded, into SoA boxes.
+ *    3. the NMS sorts and compares the candidates only.
+ *
+ *  the candidates are kept in the ascending anchor order and sorted with the
+ *  same DecreasingPartialArgSort() as TFLite, so even the boxes of equal scores
+ *  come out in the same order.
+ *  all the scratch buffers are allocated in init_detect_postprocess().
+ */
+static float    *s_anchors;             /* [num_anchors] {ycenter, xcenter, h, w} */
+static int      s_anchors_count;
+static int      s_use_regular_nms = ATTR_USE_REGULAR_NMS;
+
+/* candidates: the anchors whose best class score passes the threshold */
+static int      s_num_cand;
+static int      *s_cand_anchor;
+static float    *s_cand_score;
+static float    *s_cand_ymin, *s_cand_xmin;
+static float    *s_cand_ymax, *s_cand_xmax;
+static float    *s_cand_area;
+
+/* single class NMS */
+static int      *s_keep_cand;
+static float    *s_keep_score;
+static int      *s_sorted_indices;
 static uint8_t  *s_active_candidate;
+static int      *s_selected;
 
-/* Attrubutes of TFLite_Detection_PostProcess */
-#define ATTR_X_SCALE                      10.0
-#define ATTR_Y_SCALE                      10.0
-#define ATTR_W_SCALE                       5.0
-#define ATTR_H_SCALE                       5.0
-#define ATTR_NUM_CLASSES                  90
-#define ATTR_MAX_CLASSES_PER_DETECTION    1
-#define ATTR_DETECTIONS_PER_CLASS         100
-#define ATTR_MAX_DETECTIONS               100
-#define ATTR_NMS_SCORE_THRESHOLD          0.5
-#define ATTR_NMS_IOU_THRESHOLD            0.6
-#define ATTR_USE_REGULAR_NMS              false
+/* regular NMS: the top detections over the classes */
+#define MAX_MERGE_NUM   (ATTR_MAX_DETECTIONS + ATTR_DETECTIONS_PER_CLASS)
+static float    s_merge_score[MAX_MERGE_NUM];
+static int      s_merge_cand [MAX_MERGE_NUM];
+static int      s_merge_class[MAX_MERGE_NUM];
+static int      s_merge_sorted[MAX_MERGE_NUM];
 
-/* -------------------------------------------------------------------- *
- *  Decode detection boxes and apply NMS.
- *    These functions are clone codes of: 
- *    https://github.com/tensorflow/tensorflow/blob/master/tensorflow/lite/kernels/detection_postprocess.cc
- * -------------------------------------------------------------------- */
 
-/* Copyright 2018 The TensorFlow Authors. All Rights Reserved.
-
-Licensed under the Apache License, Version 2.0 (the "License");
-you may not use this file except in compliance with the License.
-You may obtain a copy of the License at
-    http://www.apache.org/licenses/LICENSE-2.0
-Unless required by applicable law or agreed to in writing, software
-distributed under the License is distributed on an "AS IS" BASIS,
-WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
-See the License for the specific language governing permissions and
-limitations under the License.
-==============================================================================*/
-
-struct BoxCornerEncoding {
-    float ymin;
-    float xmin;
-    float ymax;
-    float xmax;
-};
-
-struct CenterSizeEncoding {
-    float y;
-    float x;
-    float h;
-    float w;
-};
+static void
+DecreasingPartialArgSort (const float *values, int num_values, int num_to_sort, int *indices)
+{
+    std::iota (indices, indices + num_values, 0);
+    std::partial_sort (
+        indices, indices + num_to_sort, indices + num_values,
+        [&values](const int i, const int j) { return values[i] > values[j]; });
+}
+
 
-int
-DecodeCenterSizeBoxes (float *decoded_boxes, const float *input_box_encodings) 
+/* -------------------------------------------------------------------- *
+ *  1. threshold the anchors by the best class score
+ * -------------------------------------------------------------------- */
+static inline float
+get_max_score (const float *scores, int num)
 {
-    int num_boxes        = s_anchors_count;
-    float *input_anchors = s_anchors;
+    float max_score;
+    int i;
 
-    // Decode the boxes to get (ymin, xmin, ymax, xmax) based on the anchors
-    CenterSizeEncoding box_centersize;
-    CenterSizeEncoding scale_values = {ATTR_X_SCALE, ATTR_Y_SCALE,
-                                       ATTR_W_SCALE, ATTR_H_SCALE};
-    CenterSizeEncoding anchor;
+#if defined (DETECT_SSE2)
+    if (num >= 4)
+    {
+        __m128 vmax = _mm_loadu_ps (scores);
+        for (i = 4; i + 4 <= num; i += 4)
+            vmax = _mm_max_ps (vmax, _mm_loadu_ps (scores + i));
 
-    for (int idx = 0; idx < num_boxes; ++idx) 
+        vmax = _mm_max_ps (vmax, _mm_shuffle_ps (vmax, vmax, _MM_SHUFFLE (1, 0, 3, 2)));
+        vmax = _mm_max_ps (vmax, _mm_shuffle_ps (vmax, vmax, _MM_SHUFFLE (2, 3, 0, 1)));
+        max_score = _mm_cvtss_f32 (vmax);
+    }
+#elif defined (DETECT_NEON)
+    if (num >= 4)
     {
-        box_centersize = reinterpret_cast<const CenterSizeEncoding*>(input_box_encodings)[idx];
-        anchor         = reinterpret_cast<const CenterSizeEncoding*>(input_anchors)[idx];
-
-        float ycenter = box_centersize.y / scale_values.y * anchor.h + anchor.y;
-        float xcenter = box_centersize.x / scale_values.x * anchor.w + anchor.x;
-        float half_h =
-            0.5f * static_cast<float>(std::exp(box_centersize.h / scale_values.h)) *
-            anchor.h;
-        float half_w =
-            0.5f * static_cast<float>(std::exp(box_centersize.w / scale_values.w)) *
-            anchor.w;
-
-        auto& box = reinterpret_cast<BoxCornerEncoding*>(decoded_boxes)[idx];
-        box.ymin = ycenter - half_h;
-        box.xmin = xcenter - half_w;
-        box.ymax = ycenter + half_h;
-        box.xmax = xcenter + half_w;
+        float32x4_t vmax = vld1q_f32 (scores);
+        for (i = 4; i + 4 <= num; i += 4)
+            vmax = vmaxq_f32 (vmax, vld1q_f32 (scores + i));
+
+        float32x2_t vmax2 = vpmax_f32 (vget_low_f32 (vmax), vget_high_f32 (vmax));
+        vmax2 = vpmax_f32 (vmax2, vmax2);
+        max_score = vget_lane_f32 (vmax2, 0);
     }
-    return 0;
+#else
+    if (0)
+    {
+    }
+#endif
+    else
+    {
+        max_score = scores[0];
+        i = 1;
+    }
+
+    for (; i < num; i ++)
+        max_score = std::max (max_score, scores[i]);
+
+    return max_score;
 }
 
+static int
+select_candidates (const float *scores)
+{
+    const int   label_offset = 1;   /* background class */
+    const int   num_classes_with_background = ATTR_NUM_CLASSES + label_offset;
+    const float score_thresh = ATTR_NMS_SCORE_THRESHOLD;
+    int num_cand = 0;
+
+    for (int i = 0; i < s_anchors_count; i ++)
+    {
+        const float *box_scores = scores + i * num_classes_with_background + label_offset;
+        float max_score = get_max_score (box_scores, ATTR_NUM_CLASSES);
+
+        if (max_score < score_thresh)
+            continue;
 
-void DecreasingPartialArgSort(const float* values, int num_values,
-                              int num_to_sort, int* indices) {
-  std::iota(indices, indices + num_values, 0);
-  std::partial_sort(
-      indices, indices + num_to_sort, indices + num_values,
-      [&values](const int i, const int j) { return values[i] > values[j]; });
+        s_cand_anchor[num_cand] = i;
+        s_cand_score [num_cand] = max_score;
+        num_cand ++;
+    }
+    return num_cand;
 }
 
 
-void SelectDetectionsAboveScoreThreshold(const std::vector<float>& values,
-                                         const float threshold,
-                                         std::vector<float>* keep_values,
-                                         std::vector<int>* keep_indices) {
-  for (unsigned int i = 0; i < values.size(); i++) {
-    if (values[i] >= threshold) {
-      keep_values->emplace_back(values[i]);
-      keep_indices->emplace_back(i);
+/* -------------------------------------------------------------------- *
+ *  2. decode the candidate boxes
+ *      (same arithmetic as DecodeCenterSizeBoxes() of TFLite)
+ * -------------------------------------------------------------------- */
+static void
+decode_candidates (const float *box_encodings, int num_cand)
+{
+    const float y_scale = ATTR_Y_SCALE;
+    const float x_scale = ATTR_X_SCALE;
+    const float h_scale = ATTR_H_SCALE;
+    const float w_scale = ATTR_W_SCALE;
+
+    for (int i = 0; i < num_cand; i ++)
+    {
+        const float *enc    = box_encodings + s_cand_anchor[i] * 4;   /* {y, x, h, w} */
+        const float *anchor = s_anchors     + s_cand_anchor[i] * 4;
+
+        float ycenter = enc[0] / y_scale * anchor[2] + anchor[0];
+        float xcenter = enc[1] / x_scale * anchor[3] + anchor[1];
+        float half_h  = 0.5f * expf (enc[2] / h_scale) * anchor[2];
+        float half_w  = 0.5f * expf (enc[3] / w_scale) * anchor[3];
+
+        s_cand_ymin[i] = ycenter - half_h;
+        s_cand_xmin[i] = xcenter - half_w;
+        s_cand_ymax[i] = ycenter + half_h;
+        s_cand_xmax[i] = xcenter + half_w;
+        s_cand_area[i] = (s_cand_ymax[i] - s_cand_ymin[i]) * (s_cand_xmax[i] - s_cand_xmin[i]);
     }
-  }
 }
 
 
-float ComputeIntersectionOverUnion(const float* decoded_boxes,
-                                   const int i, const int j) {
-  auto& box_i = reinterpret_cast<const BoxCornerEncoding*>(decoded_boxes)[i];
-  auto& box_j = reinterpret_cast<const BoxCornerEncoding*>(decoded_boxes)[j];
-  const float area_i = (box_i.ymax - box_i.ymin) * (box_i.xmax - box_i.xmin);
-  const float area_j = (box_j.ymax - box_j.ymin) * (box_j.xmax - box_j.xmin);
-  if (area_i <= 0 || area_j <= 0) return 0.0;
-  const float intersection_ymin = std::max<float>(box_i.ymin, box_j.ymin);
-  const float intersection_xmin = std::max<float>(box_i.xmin, box_j.xmin);
-  const float intersection_ymax = std::min<float>(box_i.ymax, box_j.ymax);
-  const float intersection_xmax = std::min<float>(box_i.xmax, box_j.xmax);
-  const float intersection_area =
-      std::max<float>(intersection_ymax - intersection_ymin, 0.0) *
-      std::max<float>(intersection_xmax - intersection_xmin, 0.0);
-  return intersection_area / (area_i + area_j - intersection_area);
+/* -------------------------------------------------------------------- *
+ *  3. NMS
+ * -------------------------------------------------------------------- */
+static inline float
+calc_intersection_over_union (int i, int j)
+{
+    const float area_i = s_cand_area[i];
+    const float area_j = s_cand_area[j];
+    if (area_i <= 0 || area_j <= 0)
+        return 0.0f;
+
+    const float intersection_ymin = std::max<float> (s_cand_ymin[i], s_cand_ymin[j]);
+    const float intersection_xmin = std::max<float> (s_cand_xmin[i], s_cand_xmin[j]);
+    const float intersection_ymax = std::min<float> (s_cand_ymax[i], s_cand_ymax[j]);
+    const float intersection_xmax = std::min<float> (s_cand_xmax[i], s_cand_xmax[j]);
+    const float intersection_area =
+        std::max<float> (intersection_ymax - intersection_ymin, 0.0) *
+        std::max<float> (intersection_xmax - intersection_xmin, 0.0);
+    return intersection_area / (area_i + area_j - intersection_area);
 }
 
+/*
+ *  greedy NMS over the candidates keep_cand[] (in the ascending anchor order,
+ *  all of them pass the score threshold). the selected candidates are written
+ *  to s_selected[] in the descending score order.
+ */
+static int
+nms_single_class (const int *keep_cand, const float *keep_score, int num_keep, int max_detections)
+{
+    const float iou_thresh = ATTR_NMS_IOU_THRESHOLD;
+    int     *sorted = s_sorted_indices;
+    uint8_t *active = s_active_candidate;
+    int num_selected = 0;
 
-// NonMaxSuppressionSingleClass() prunes out the box locations with high overlap
-// before selecting the highest scoring boxes (max_detections in number)
-// It assumes all boxes are good in beginning and sorts based on the scores.
-// If lower-scoring box has too much overlap with a higher-scoring box,
-// we get rid of the lower-scoring box.
-// Complexity is O(N^2) pairwise comparison between boxes
-int
-NonMaxSuppressionSingleClassHelper(const float *decoded_boxes,
-                                   const std::vector<float>& scores, 
-                                   std::vector<int>* selected, int max_detections) {
-
-    const float non_max_suppression_score_threshold = ATTR_NMS_SCORE_THRESHOLD;
-    const float intersection_over_union_threshold   = ATTR_NMS_IOU_THRESHOLD;
-
-    // threshold scores
-    std::vector<int> keep_indices;
-    // TODO (chowdhery): Remove the dynamic allocation and replace it
-    // with temporaries, esp for std::vector<float>
-    std::vector<float> keep_scores;
-    SelectDetectionsAboveScoreThreshold(
-        scores, non_max_suppression_score_threshold, &keep_scores, &keep_indices);
-
-    int num_scores_kept = keep_scores.size();
-    std::vector<int> sorted_indices;
-    sorted_indices.resize(num_scores_kept);
-    DecreasingPartialArgSort(keep_scores.data(), num_scores_kept, num_scores_kept,
-                                sorted_indices.data());
-    const int num_boxes_kept = num_scores_kept;
-    const unsigned int output_size = std::min(num_boxes_kept, max_detections);
-    selected->clear();
-
-    int num_active_candidate = num_boxes_kept;
-    uint8_t* active_box_candidate = s_active_candidate;
-    for (int row = 0; row < num_boxes_kept; row++) {
-        active_box_candidate[row] = 1;
-    }
+    DecreasingPartialArgSort (keep_score, num_keep, num_keep, sorted);
+
+    const int output_size = std::min (num_keep, max_detections);
+    int num_active = num_keep;
+    memset (active, 1, num_keep);
+
+    for (int i = 0; i < num_keep; i ++)
+    {
+        if (num_active == 0 || num_selected >= output_size)
+            break;
 
-    for (int i = 0; i < num_boxes_kept; ++i) {
-        if (num_active_candidate == 0 || selected->size() >= output_size) break;
-        if (active_box_candidate[i] == 1) {
-            selected->push_back(keep_indices[sorted_indices[i]]);
-            active_box_candidate[i] = 0;
-            num_active_candidate--;
-        } else {
+        if (active[i] == 0)
             continue;
-        }
 
-        for (int j = i + 1; j < num_boxes_kept; ++j) {
-            if (active_box_candidate[j] == 1) {
-                float intersection_over_union = ComputeIntersectionOverUnion(
-                    decoded_boxes, keep_indices[sorted_indices[i]],
-                    keep_indices[sorted_indices[j]]);
+        int cand_i = keep_cand[sorted[i]];
+        s_selected[num_selected ++] = cand_i;
+        active[i] = 0;
+        num_active --;
+
+        for (int j = i + 1; j < num_keep; j ++)
+        {
+            if (active[j] == 0)
+                continue;
 
-                if (intersection_over_union > intersection_over_union_threshold) {
-                    active_box_candidate[j] = 0;
-                    num_active_candidate--;
-                }
+            if (calc_intersection_over_union (cand_i, keep_cand[sorted[j]]) > iou_thresh)
+            {
+                active[j] = 0;
+                num_active --;
             }
         }
     }
-    return 0;
+    return num_selected;
 }
 
+static void
+pack_detection (DetectionBox *det, int cand, float score, int class_index)
+{
+    det->x1       = s_cand_xmin[cand];
+    det->y1       = s_cand_ymin[cand];
+    det->x2       = s_cand_xmax[cand];
+    det->y2       = s_cand_ymax[cand];
+    det->score    = score;
+    det->class_id = class_index;
+}
 
-// This function implements a regular version of Non Maximal Suppression (NMS)
-// for multiple classes where
-// 1) we do NMS separately for each class across all anchors and
-// 2) keep only the highest anchor scores across all classes
-// 3) The worst runtime of the regular NMS is O(K*N^2)
-// where N is the number of anchors and K the number of
-// classes.
-int
-NonMaxSuppressionMultiClassRegularHelper(std::vector<DetectionBox> &detection_boxes, 
-                                         const float *decoded_boxes, const float* scores) {
-    const int num_boxes   = s_anchors_count;
-    const int num_classes = ATTR_NUM_CLASSES;
-    const int num_detections_per_class = ATTR_DETECTIONS_PER_CLASS;
-    const int max_detections = ATTR_MAX_DETECTIONS;
-
-    // The row index offset is 1 if background class is included and 0 otherwise.
+/*
+ *  fast NMS: one NMS over the best class score of each anchor.
+ *  (NonMaxSuppressionMultiClassFastHelper)
+ */
+static int
+nms_multiclass_fast (DetectionBox *detection_boxes, int max_boxes, const float *scores)
+{
     const int label_offset = 1;
-    const int num_classes_with_background = num_classes + label_offset;
+    const int num_classes_with_background = ATTR_NUM_CLASSES + label_offset;
+    const int num_categories_per_anchor   = std::min (ATTR_MAX_CLASSES_PER_DETECTION, ATTR_NUM_CLASSES);
+    int class_indices[ATTR_NUM_CLASSES];
+    int num_boxes = 0;
 
-    // For each class, perform non-max suppression.
-    std::vector<float> class_scores(num_boxes);
+    for (int i = 0; i < s_num_cand; i ++)
+        s_keep_cand[i] = i;
 
-    std::vector<int> box_indices_after_regular_non_max_suppression(num_boxes + max_detections);
-    std::vector<float> scores_after_regular_non_max_suppression(num_boxes +  max_detections);
+    int num_selected = nms_single_class (s_keep_cand, s_cand_score, s_num_cand, ATTR_MAX_DETECTIONS);
 
-    int size_of_sorted_indices = 0;
-    std::vector<int> sorted_indices;
-    sorted_indices.resize(num_boxes + max_detections);
-    std::vector<float> sorted_values;
-    sorted_values.resize(max_detections);
+    for (int i = 0; i < num_selected; i ++)
+    {
+        int cand = s_selected[i];
+        const float *box_scores = scores + s_cand_anchor[cand] * num_classes_with_background + label_offset;
 
-    for (int col = 0; col < num_classes; col++) {
-        for (int row = 0; row < num_boxes; row++) {
-            // Get scores of boxes corresponding to all anchors for single class
-            class_scores[row] =
-                *(scores + row * num_classes_with_background + col + label_offset);
-        }
-        // Perform non-maximal suppression on single class
-        std::vector<int> selected;
-        NonMaxSuppressionSingleClassHelper(decoded_boxes, class_scores, &selected, num_detections_per_class);
-
-        // Add selected indices from non-max suppression of boxes in this class
-        int output_index = size_of_sorted_indices;
-        for (const auto& selected_index : selected) {
-            box_indices_after_regular_non_max_suppression[output_index] =
-                (selected_index * num_classes_with_background + col + label_offset);
-            scores_after_regular_non_max_suppression[output_index] =
-                class_scores[selected_index];
-            output_index++;
-        }
+        /* sort the classes of the selected anchors only */
+        DecreasingPartialArgSort (box_scores, ATTR_NUM_CLASSES, num_categories_per_anchor, class_indices);
 
-        // Sort the max scores among the selected indices
-        // Get the indices for top scores
-        int num_indices_to_sort = std::min(output_index, max_detections);
-        DecreasingPartialArgSort(scores_after_regular_non_max_suppression.data(),
-                             output_index, num_indices_to_sort,
-                             sorted_indices.data());
-
-        // Copy values to temporary vectors
-        for (int row = 0; row < num_indices_to_sort; row++) {
-            int temp = sorted_indices[row];
-            sorted_indices[row] = box_indices_after_regular_non_max_suppression[temp];
-            sorted_values[row] = scores_after_regular_non_max_suppression[temp];
-        }
-        // Copy scores and indices from temporary vectors
-        for (int row = 0; row < num_indices_to_sort; row++) {
-            box_indices_after_regular_non_max_suppression[row] = sorted_indices[row];
-            scores_after_regular_non_max_suppression[row] = sorted_values[row];
-        }
-        size_of_sorted_indices = num_indices_to_sort;
-    }
+        for (int col = 0; col < num_categories_per_anchor; col ++)
+        {
+            if (num_boxes >= max_boxes)
+                return num_boxes;
 
-    // Allocate output tensors
-    for (int output_box_index = 0; output_box_index < max_detections; output_box_index++) {
-        if (output_box_index < size_of_sorted_indices) {
-            const int anchor_index = floor(
-                        box_indices_after_regular_non_max_suppression[output_box_index] /
-                        num_classes_with_background);
-            const int class_index =
-                        box_indices_after_regular_non_max_suppression[output_box_index] -
-                        anchor_index * num_classes_with_background - label_offset;
-            const float selected_score =
-                        scores_after_regular_non_max_suppression[output_box_index];
-
-            BoxCornerEncoding box = reinterpret_cast<const BoxCornerEncoding*>(s_decoded_boxes)[anchor_index];
-
-            detection_boxes.push_back({box.xmin, box.ymin,
-                                       box.xmax, box.ymax,
-                                       selected_score, class_index});
-        } else {
+            int class_index = class_indices[col];
+            pack_detection (&detection_boxes[num_boxes ++], cand, box_scores[class_index], class_index);
         }
     }
-
-    box_indices_after_regular_non_max_suppression.clear();
-    scores_after_regular_non_max_suppression.clear();
-
-    return 0;
+    return num_boxes;
 }
 
+/*
+ *  regular NMS: NMS of each class, then the top ATTR_MAX_DETECTIONS over the classes.
+ *  (NonMaxSuppressionMultiClassRegularHelper)
+ */
+static int
+nms_multiclass_regular (DetectionBox *detection_boxes, int max_boxes, const float *scores)
+{
+    const int   label_offset = 1;
+    const int   num_classes_with_background = ATTR_NUM_CLASSES + label_offset;
+    const float score_thresh = ATTR_NMS_SCORE_THRESHOLD;
+    int num_merged = 0;
 
-// This function implements a fast version of Non Maximal Suppression for
-// multiple classes where
-// 1) we keep the top-k scores for each anchor and
-// 2) during NMS, each anchor only uses the highest class score for sorting.
-// 3) Compared to standard NMS, the worst runtime of this version is O(N^2)
-// instead of O(KN^2) where N is the number of anchors and K the number of
-// classes.
-int
-NonMaxSuppressionMultiClassFastHelper (std::vector<DetectionBox> &detection_boxes, 
-                                       const float *decoded_boxes, const float* scores) {
-    const int num_boxes   = s_anchors_count;
-    const int num_classes = ATTR_NUM_CLASSES;
-    const int max_categories_per_anchor = ATTR_MAX_CLASSES_PER_DETECTION;
-
-    // The row index offset is 1 if background class is included and 0 otherwise.
-    const int label_offset = 1;
-    const int num_classes_with_background = num_classes + label_offset;
-    const int num_categories_per_anchor   = std::min(max_categories_per_anchor, num_classes);
-
-    std::vector<float> max_scores;
-    max_scores.resize(num_boxes);
-    std::vector<int> sorted_class_indices;
-    sorted_class_indices.resize(num_boxes * num_classes);
-
-    for (int row = 0; row < num_boxes; row++) {
-        const float* box_scores =
-                    scores + row * num_classes_with_background + label_offset;
-        int* class_indices = sorted_class_indices.data() + row * num_classes;
-        DecreasingPartialArgSort(box_scores, num_classes, num_categories_per_anchor,
-                             class_indices);
-        max_scores[row] = box_scores[class_indices[0]];
-    }
-
-    // Perform non-maximal suppression on max scores
-    std::vector<int> selected;
-    NonMaxSuppressionSingleClassHelper(decoded_boxes, max_scores, &selected, ATTR_MAX_DETECTIONS);
-
-    // Allocate output tensors
-    for (const auto& selected_index : selected) {
-        const float* box_scores =
-                scores + selected_index * num_classes_with_background + label_offset;
-        const int* class_indices =
-                sorted_class_indices.data() + selected_index * num_classes;
-
-        for (int col = 0; col < num_categories_per_anchor; ++col) {
+    for (int col = 0; col < ATTR_NUM_CLASSES; col ++)
+    {
+        /* the class scores of the candidates (no other anchor can pass the threshold) */
+        int num_keep = 0;
+        for (int i = 0; i < s_num_cand; i ++)
+        {
+            float score = scores[s_cand_anchor[i] * num_classes_with_background + col + label_offset];
+            if (score >= score_thresh)
+            {
+                s_keep_cand [num_keep] = i;
+                s_keep_score[num_keep] = score;
+                num_keep ++;
+            }
+        }
+        int num_selected = 0;
+        if (num_keep > 0)
+            num_selected = nms_single_class (s_keep_cand, s_keep_score, num_keep, ATTR_DETECTIONS_PER_CLASS);
+
+        /* merge the selected boxes into the top detections */
+        int output_index = num_merged;
+        for (int i = 0; i < num_selected; i ++)
+        {
+            int cand = s_selected[i];
+            float score = scores[s_cand_anchor[cand] * num_classes_with_background + col + label_offset];
+
+            s_merge_score[output_index] = score;
+            s_merge_cand [output_index] = cand;
+            s_merge_class[output_index] = col;
+            output_index ++;
+        }
 
-            // detection_boxes
-            BoxCornerEncoding box = reinterpret_cast<const BoxCornerEncoding*>(decoded_boxes)[selected_index];
+        /*
+         *  sort even if nothing is added: TFLite does, and the heap sort can
+         *  swap the equal scores, which decides the order (and the cut at
+         *  ATTR_MAX_DETECTIONS) of the equal scores.
+         */
+        int num_to_sort = std::min (output_index, ATTR_MAX_DETECTIONS);
+        if (num_to_sort == 0)
+            continue;
 
-            // detection_classes
-            int class_index = class_indices[col];
+        DecreasingPartialArgSort (s_merge_score, output_index, num_to_sort, s_merge_sorted);
 
-            // detection_scores
-            float score = box_scores[class_index];
+        float sorted_score[ATTR_MAX_DETECTIONS];
+        int   sorted_cand [ATTR_MAX_DETECTIONS];
+        int   sorted_class[ATTR_MAX_DETECTIONS];
 
-            detection_boxes.push_back({box.xmin, box.ymin,
-                                       box.xmax, box.ymax,
-                                       score, class_index});
+        for (int i = 0; i < num_to_sort; i ++)
+        {
+            int idx = s_merge_sorted[i];
+            sorted_score[i] = s_merge_score[idx];
+            sorted_cand [i] = s_merge_cand [idx];
+            sorted_class[i] = s_merge_class[idx];
+        }
+        for (int i = 0; i < num_to_sort; i ++)
+        {
+            s_merge_score[i] = sorted_score[i];
+            s_merge_cand [i] = sorted_cand [i];
+            s_merge_class[i] = sorted_class[i];
         }
+        num_merged = num_to_sort;
     }
 
-    return 0;
-}
-
+    int num_boxes = std::min (num_merged, max_boxes);
+    for (int i = 0; i < num_boxes; i ++)
+        pack_detection (&detection_boxes[i], s_merge_cand[i], s_merge_score[i], s_merge_class[i]);
 
+    return num_boxes;
+}
 
 
 /* -------------------------------------------------------------------- *
  *  software routine for "TFLite_Detection_PostProcess" Op.
  * -------------------------------------------------------------------- */
 float *
-read_anchors_file (std::string filename, int& size) 
+read_anchors_file (std::string filename, int& size)
 {
     std::vector<std::string> lines;
     std::ifstream file (filename);
@@ -388,7 +396,7 @@ read_anchors_file (std::string filename, int& size)
     size = lines.size();
     float *result = new float[size * 4]();
 
-    for (int i = 0; i < size; i++) 
+    for (int i = 0; i < size; i++)
     {
         int index = i * 4;
         std::stringstream(lines[i]) >> result[index]
@@ -413,35 +421,60 @@ init_detect_postprocess (std::string filename)
     }
 #endif
 
-    s_decoded_boxes    = new float  [s_anchors_count * 4];
-    s_active_candidate = new uint8_t[s_anchors_count];
+    /* scratch buffers (every anchor can be a candidate in the worst case) */
+    int num = s_anchors_count;
+    s_cand_anchor      = new int    [num];
+    s_cand_score       = new float  [num];
+    s_cand_ymin        = new float  [num];
+    s_cand_xmin        = new float  [num];
+    s_cand_ymax        = new float  [num];
+    s_cand_xmax        = new float  [num];
+    s_cand_area        = new float  [num];
+    s_keep_cand        = new int    [num];
+    s_keep_score       = new float  [num];
+    s_sorted_indices   = new int    [num];
+    s_active_candidate = new uint8_t[num];
+    s_selected         = new int    [num];
 
     return 0;
 }
 
 
+void
+set_detect_postprocess_regular_nms (int use_regular_nms)
+{
+    s_use_regular_nms = use_regular_nms;
+}
+
+
+const float *
+get_detect_postprocess_anchors (int *num_anchors)
+{
+    *num_anchors = s_anchors_count;
+    return s_anchors;
+}
+
+
 int
-invoke_detection_postprocess (std::vector<DetectionBox> &detection_boxes,  /* [OUT] */
+invoke_detection_postprocess (DetectionBox *detection_boxes, int max_boxes, /* [OUT] */
                               const float *boxes_ptr,                      /* [IN ] */
                               const float *scores_ptr)                     /* [IN ] */
 {
-    float *decoded_boxes = s_decoded_boxes;
+    int num_boxes;
 
     /*
-     *  decode detected bbox. 
+     *  decode detected bbox of the candidates.
      *      (decoded_boxes) = (boxes_ptr) * (anchor.wh) + (anchor.xy);
      */
-    DecodeCenterSizeBoxes (decoded_boxes, boxes_ptr);
+    s_num_cand = select_candidates (scores_ptr);
+    decode_candidates (boxes_ptr, s_num_cand);
 
-    if (ATTR_USE_REGULAR_NMS)
-    {
-        NonMaxSuppressionMultiClassRegularHelper(detection_boxes, decoded_boxes, scores_ptr);
-    }
+    bench_lap_start (BENCH_LAP_NMS);
+    if (s_use_regular_nms)
+        num_boxes = nms_multiclass_regular (detection_boxes, max_boxes, scores_ptr);
     else
-    {
-        NonMaxSuppressionMultiClassFastHelper (detection_boxes, decoded_boxes, scores_ptr);
-    }
+        num_boxes = nms_multiclass_fast (detection_boxes, max_boxes, scores_ptr);
+    bench_lap_stop (BENCH_LAP_NMS);
 
-    return 0;
+    return num_boxes;
 }
-
@@ -5,6 +5,21 @@
 #ifndef _DETECT_POSTPROCESS_H_
 #define _DETECT_POSTPROCESS_H_
 
+#include <string>
+#include <vector>
+
+/* Attrubutes of TFLite_Detection_PostProcess */
+#define ATTR_X_SCALE                      10.0
+#define ATTR_Y_SCALE                      10.0
+#define ATTR_W_SCALE                       5.0
+#define ATTR_H_SCALE                       5.0
+#define ATTR_NUM_CLASSES                  90
+#define ATTR_MAX_CLASSES_PER_DETECTION    1
+#define ATTR_DETECTIONS_PER_CLASS         100
+#define ATTR_MAX_DETECTIONS               100
+#define ATTR_NMS_SCORE_THRESHOLD          0.5
+#define ATTR_NMS_IOU_THRESHOLD            0.6
+#define ATTR_USE_REGULAR_NMS              false
 
 struct DetectionBox {
     float x1;
@@ -16,10 +31,21 @@ struct DetectionBox {
 };
 
 int init_detect_postprocess (std::string filename);
+void set_detect_postprocess_regular_nms (int use_regular_nms);
+const float *get_detect_postprocess_anchors (int *num_anchors);
 
+/* returns the number of the detections written (in the descending score order) */
 int
-invoke_detection_postprocess (std::vector<DetectionBox> &detection_boxes,  /* [OUT] */
+invoke_detection_postprocess (DetectionBox *detection_boxes, int max_boxes, /* [OUT] */
                               const float *boxes_ptr,                      /* [IN ] */
-                              const float *_scores_ptr);                   /* [IN ] */
+                              const float *scores_ptr);                    /* [IN ] */
+
+/* the clone of detection_postprocess.cc (detect_postprocess_ref.cpp) */
+int
+invoke_detection_postprocess_ref (std::vector<DetectionBox> &detection_boxes,  /* [OUT] */
+                                  const float *anchors, int num_anchors,       /* [IN ] */
+                                  const float *boxes_ptr,                      /* [IN ] */
+                                  const float *scores_ptr,                     /* [IN ] */
+                                  int use_regular_nms);
 
 #endif /* _DETECT_POSTPROCESS_H_ */
@@ -245,14 +245,14 @@ get_detect_class_color (int class_idx)
 int
 invoke_detect (detect_result_t *detection)
 {
-    if (s_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_interpreter) != 0)
     {
         DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
     }
 
 #if defined (INVOKE_POSTPROCESS_AFTER_TFLITE)
-    std::vector<DetectionBox> detection_boxes = {};
+    DetectionBox detection_boxes[MAX_DETECT_OBJS];
     float *scores = (float *)s_tensor_scores.ptr;
     float *boxes  = (float *)s_tensor_boxes.ptr;
 
@@ -274,10 +274,7 @@ invoke_detect (detect_result_t *detection)
             boxes[i] = (boxes_u8[i] - s_tensor_boxes.quant_zerop) * s_tensor_boxes.quant_scale;
     }
 
-    invoke_detection_postprocess (detection_boxes, boxes, scores);
-
-    int num = detection_boxes.size();
-    num = std::min (num, MAX_DETECT_OBJS);
+    int num = invoke_detection_postprocess (detection_boxes, MAX_DETECT_OBJS, boxes, scores);
 
     detection->num = num;
     for (int i = 0; i < num; i ++)
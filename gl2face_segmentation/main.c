@@ -13,6 +13,8 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
+#include "util_segmap.h"
 #include "util_matrix.h"
 #include "tflite_face_segmentation.h"
 #include "util_camera_capture.h"
@@ -28,7 +30,7 @@
 void
 feed_face_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_face_detect_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -46,19 +48,7 @@ feed_face_detect_image(texture_2d_t *srctex, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
     float mean = 128.0f;
     float std  = 128.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
@@ -66,7 +56,7 @@ feed_face_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 void
 feed_bisenetv2_image(texture_2d_t *srctex, int win_w, int win_h, face_detect_result_t *detection, unsigned int face_id)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_bisenetv2_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -106,19 +96,7 @@ feed_bisenetv2_image(texture_2d_t *srctex, int win_w, int win_h, face_detect_res
     /* convert UI8 [0, 255] ==> FP32 [0, 1] */
     float mean = 128.0f;
     float std  = 128.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
@@ -206,8 +184,8 @@ render_animface_image (texture_2d_t *srctex, int ofstx, int ofsty, int texw, int
     int64_t *segmap = bisenetv2_ret->segmentmap;
     int segmap_w  = bisenetv2_ret->segmentmap_dims[0];
     int segmap_h  = bisenetv2_ret->segmentmap_dims[1];
-    int x, y;
-    unsigned int imgbuf[segmap_h][segmap_w];
+    int i;
+    static segmap_t s_segmap;
 
 #if 1
     unsigned char alpha = 200;
@@ -258,24 +236,34 @@ render_animface_image (texture_2d_t *srctex, int ofstx, int ofsty, int texw, int
         0,   192, 0,   0,      /* [18] hat */
     };
 #endif
-    /* find the most confident class for each pixel. */
-    for (y = 0; y < segmap_h; y ++)
+    if (s_segmap.class_map == NULL)
     {
-        for (x = 0; x < segmap_w; x ++)
+        unsigned int palette[19];
+        for (i = 0; i < 19; i ++)
         {
-            int64_t val = segmap[y * segmap_w + x];
-            if (val > 18)
-                val = 0;
-            
-            unsigned char r = color[4 * val + 0];
-            unsigned char g = color[4 * val + 1];
-            unsigned char b = color[4 * val + 2];
-            unsigned char a = color[4 * val + 3];
-
-            imgbuf[y][x] = (a << 24) | (b << 16) | (g << 8) | (r);
+            unsigned char r = color[4 * i + 0];
+            unsigned char g = color[4 * i + 1];
+            unsigned char b = color[4 * i + 2];
+            unsigned char a = color[4 * i + 3];
+
+            palette[i] = (a << 24) | (b << 16) | (g << 8) | (r);
         }
+
+        segmap_init (&s_segmap, segmap_w, segmap_h);
+        segmap_set_palette (&s_segmap, palette, 19);
     }
 
+    /* class of each pixel. the colors are looked up on GPU. */
+    for (i = 0; i < segmap_w * segmap_h; i ++)
+    {
+        int64_t val = segmap[i];
+        if (val > 18)
+            val = 0;
+
+        s_segmap.class_map[i] = val;
+    }
+    segmap_upload (&s_segmap);
+
     face_t *face = &(detection->faces[face_id]);
     float cx     = face->face_cx * texw; //    0--------1
     float cy     = face->face_cy * texh; //    |        |
@@ -285,11 +273,8 @@ render_animface_image (texture_2d_t *srctex, int ofstx, int ofsty, int texw, int
     float by     = cy - face_h * 0.5f;
     float rot    = RAD_TO_DEG (face->rotation);
 
-    texture_2d_t animtex;
-    create_2d_texture_ex (&animtex, imgbuf, segmap_w, segmap_h, pixfmt_fourcc ('R', 'G', 'B', 'A'));
-    draw_2d_texture_ex_texcoord_rot (&animtex, ofstx + bx, ofsty + by, face_w, face_h, 0, 0.5, 0.5, rot);
-
-    glDeleteTextures (1, &animtex.texid);
+    draw_2d_classmap_rot (&s_segmap.classtex, s_segmap.palette_texid,
+                          ofstx + bx, ofsty + by, face_w, face_h, 1.0f, 0.5, 0.5, rot);
 }
 
 /* Adjust the texture size to fit the window size
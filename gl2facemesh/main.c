@@ -8,21 +8,38 @@
 #include <time.h>
 #include <float.h>
 #include <math.h>
+#include <string.h>
 #include <GLES2/gl2.h>
 #include "util_egl.h"
 #include "util_debugstr.h"
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_preprocess.h"
+#include "util_pipeline.h"
 #include "util_matrix.h"
+#include "util_lmfilter.h"
+#include "util_sched.h"
 #include "tflite_facemesh.h"
 #include "render_facemesh.h"
 #include "util_camera_capture.h"
 #include "util_video_decode.h"
 #include "render_imgui.h"
 
+#if defined (__SSE2__)
+#define FACEMESH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define FACEMESH_NEON
+#include <arm_neon.h>
+#endif
+
 #define UNUSED(x) (void)(x)
 
+#define MAX_INFER_INTERVAL  8   /* -r option: the inference runs at least once in 8 frames */
+
 static imgui_data_t s_gui_prop = {0};
 
 typedef struct maskimage_t
@@ -46,106 +63,320 @@ static int s_num_maskimages = sizeof (s_maskimages) / sizeof (maskimage_t);
 
 
 
+static preproc_t s_preproc_detect;
+static preproc_t s_preproc_landmark[MAX_FACE_NUM];  /* one per face, for the PBO readback latency */
+
 /* resize image to DNN network input size and convert to fp32. */
 void
 feed_face_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_face_detect_input_buf (&w, &h);
-    unsigned char *buf_ui8 = NULL;
-    static unsigned char *pui8 = NULL;
+    UNUSED (win_w);
+    UNUSED (win_h);
 
-    if (pui8 == NULL)
-        pui8 = (unsigned char *)malloc(w * h * 4);
+    /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
+    if (s_preproc_detect.buf_ui8 == NULL)
+        init_preprocess (&s_preproc_detect, PREPROC_BACKEND_DEFAULT, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
 
-    buf_ui8 = pui8;
+    preprocess_texture (&s_preproc_detect, srctex, NULL);
+    preprocess_get_tensor (&s_preproc_detect, buf_fp32);
 
-    draw_2d_texture_ex (srctex, 0, win_h - h, w, h, 1);
+    return;
+}
 
-    glPixelStorei (GL_PACK_ALIGNMENT, 4);
-    glReadPixels (0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, buf_ui8);
+void
+feed_face_landmark_image(texture_2d_t *srctex, int win_w, int win_h, face_detect_result_t *detection, unsigned int face_id,
+                         int batch_idx)
+{
+    int w, h;
+    float *buf_fp32 = (float *)get_facemesh_landmark_input_buf (&w, &h);
+    float *roi = NULL;
+    UNUSED (win_w);
+    UNUSED (win_h);
+
+    buf_fp32 += batch_idx * (w * h * 3);
 
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
-    float mean = 128.0f;
-    float std  = 128.0f;
-    for (y = 0; y < h; y ++)
+    preproc_t *pp = &s_preproc_landmark[face_id];
+    if (pp->buf_ui8 == NULL)
+        init_preprocess (pp, PREPROC_BACKEND_DEFAULT, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    /*
+     *    0--------1
+     *    |        |
+     *    |        |
+     *    3--------2
+     */
+    face_t *face = NULL;
+    if (detection->num > face_id)
     {
-        for (x = 0; x < w; x ++)
+        face = &detection->faces[face_id];
+        roi = (float *)face->face_pos;
+        preprocess_set_tag (pp, face, sizeof (face_t));
+    }
+
+    preprocess_texture (pp, srctex, roi);
+    preprocess_get_tensor (pp, buf_fp32);
+
+    /*
+     *  the landmarks are relative to the ROI the tensor was cropped with.
+     *  the PBO backend returns the previous frame's tensor, so give back the
+     *  whole face_t it came from (ROI, center, size and rotation).
+     */
+    if (face)
+        preprocess_get_tensor_tag (pp, face, sizeof (face_t));
+
+    return;
+}
+
+/* the faces not fed on this frame: their next readback must not return an old image */
+static void
+reset_face_landmark_preproc (int num_faces)
+{
+    for (int face_id = num_faces; face_id < MAX_FACE_NUM; face_id ++)
+        preprocess_reset (&s_preproc_landmark[face_id]);
+}
+
+
+/*
+ *  ROI tracking (-t option)
+ *    the ROIs of the next frame are derived from the landmarks of this frame.
+ *    if any face is lost, the detection runs again at the next frame.
+ */
+static void
+update_face_track (face_detect_result_t *track, face_detect_result_t *detection,
+                   face_landmark_result_t *facemesh)
+{
+    track->num = 0;
+    for (int face_id = 0; face_id < detection->num; face_id ++)
+    {
+        face_t face = detection->faces[face_id];
+        if (track_face_region (&face, &facemesh[face_id]) != 0)
         {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
+            track->num = 0;
+            return;
         }
+        track->faces[track->num ++] = face;
+    }
+}
+
+/*
+ *  landmark smoothing (-s option, 0: off, 1: One-Euro, 2: Kalman)
+ *    the landmarks are filtered in the image coordinates, and brought back
+ *    into the ROI of this frame, so the point drawn is the filtered point.
+ *    the ROI itself is not filtered: it only crops the next input.
+ *    the track id follows the face by the overlap of the ROI with the last frame,
+ *    because the detections are sorted by the score every frame.
+ *    on the frames without the inference (-r option), the landmarks are
+ *    extrapolated from the filter instead.
+ */
+#define FACE_TRACK_IOU_MIN  0.3f
+
+static lmfilter_bank_t    s_lmfilter;
+static lmfilter_tracker_t s_lmtracker;
+
+static void
+assign_face_track_id (face_detect_result_t *detection, int *track_id)
+{
+    float box[MAX_FACE_NUM][4];
+
+    for (int face_id = 0; face_id < detection->num; face_id ++)
+    {
+        face_t *face = &detection->faces[face_id];
+        box[face_id][0] = face->face_cx;
+        box[face_id][1] = face->face_cy;
+        box[face_id][2] = face->face_w;
+        box[face_id][3] = face->face_h;
     }
 
-    return;
+    lmfilter_assign_tracks (&s_lmtracker, box, detection->num, FACE_TRACK_IOU_MIN, track_id);
 }
 
-void
-feed_face_landmark_image(texture_2d_t *srctex, int win_w, int win_h, face_detect_result_t *detection, unsigned int face_id)
+static void
+smooth_face_landmark (face_t *face, face_landmark_result_t *facemesh, int track_id, double time_ms,
+                      int predict)
+{
+    lmfilter_roi_t roi = {face->face_cx, face->face_cy, face->face_w, face->face_h, face->rotation};
+    float *joint = &facemesh->joint[0].x;
+
+    lmfilter_roi_to_image (&roi, joint, FACE_KEY_NUM);
+
+    if (predict)
+        lmfilter_bank_predict (&s_lmfilter, track_id, joint, time_ms);
+    else
+        lmfilter_bank_apply (&s_lmfilter, track_id, joint, time_ms);
+
+    lmfilter_image_to_roi (&roi, joint, FACE_KEY_NUM);
+}
+
+/* --------------------------------------------------------------------------- *
+ *  pipelined inference (-p option)
+ *
+ *    render thread : readback frame[N+2]
+ *    stage[0]      : face detect   frame[N+1]
+ *    stage[1]      : face landmark frame[N]
+ *
+ *  the throughput is bound by the slowest stage instead of the sum of them.
+ *  the stages crop their input on CPU from the RGBA copy of the frame,
+ *  because GL calls are allowed only on the render thread.
+ * --------------------------------------------------------------------------- */
+#define PIPELINE_NUM_FRAMES     3
+
+typedef struct _facemesh_frame_t
+{
+    unsigned char           *rgba;          /* input image (top row first) */
+    int                     w, h;
+    face_detect_result_t    detect;
+    face_landmark_result_t  mesh[MAX_FACE_NUM];
+    double                  invoke_ms[2];
+} facemesh_frame_t;
+
+static pipeline_t             s_pipeline;
+static preproc_t              s_preproc_frame;          /* render thread */
+static preproc_t              s_preproc_detect_cpu;     /* stage[0] */
+static preproc_t              s_preproc_landmark_cpu;   /* stage[1] */
+
+static face_detect_result_t   s_pipeline_detect;        /* the latest result */
+static face_landmark_result_t s_pipeline_mesh[MAX_FACE_NUM];
+static double                 s_pipeline_invoke_ms[2];
+
+static int
+stage_face_detect (void *frame_ptr, void *usr)
+{
+    facemesh_frame_t *frame = (facemesh_frame_t *)frame_ptr;
+    int w, h;
+    float *buf_fp32 = (float *)get_face_detect_input_buf (&w, &h);
+    UNUSED (usr);
+
+    preprocess_buffer (&s_preproc_detect_cpu, frame->rgba, frame->w, frame->h, NULL);
+    preprocess_get_tensor (&s_preproc_detect_cpu, buf_fp32);
+
+    double t0 = pmeter_get_time_ms ();
+    int ret = invoke_face_detect (&frame->detect);
+    frame->invoke_ms[0] = pmeter_get_time_ms () - t0;
+
+    return ret;
+}
+
+static int
+stage_face_landmark (void *frame_ptr, void *usr)
 {
-    int x, y, w, h;
+    facemesh_frame_t *frame = (facemesh_frame_t *)frame_ptr;
+    int w, h;
+    UNUSED (usr);
+
+    frame->invoke_ms[1] = 0;
+    if (pipeline_frame_failed (&s_pipeline, frame))
+        return -1;
+
+    /* all the faces in one batch */
+    int num_faces = frame->detect.num;
+    int num_batch = (num_faces > 0) ? set_facemesh_landmark_batch (num_faces) : 1;
     float *buf_fp32 = (float *)get_facemesh_landmark_input_buf (&w, &h);
-    unsigned char *buf_ui8 = NULL;
-    static unsigned char *pui8 = NULL;
 
-    if (pui8 == NULL)
-        pui8 = (unsigned char *)malloc(w * h * 4);
+    for (int face_id = 0; face_id < num_faces; face_id += num_batch)
+    {
+        int batch = (num_faces - face_id < num_batch) ? num_faces - face_id : num_batch;
+
+        for (int i = 0; i < batch; i ++)
+        {
+            float *roi = (float *)frame->detect.faces[face_id + i].face_pos;
 
-    buf_ui8 = pui8;
+            preprocess_buffer (&s_preproc_landmark_cpu, frame->rgba, frame->w, frame->h, roi);
+            preprocess_get_tensor (&s_preproc_landmark_cpu, buf_fp32 + i * (w * h * 3));
+        }
 
-    float texcoord[] = { 0.0f, 1.0f,
-                         0.0f, 0.0f,
-                         1.0f, 1.0f,
-                         1.0f, 0.0f };
+        double t0 = pmeter_get_time_ms ();
+        invoke_facemesh_landmark_batch (&frame->mesh[face_id], batch);
+        frame->invoke_ms[1] += pmeter_get_time_ms () - t0;
+    }
 
-    if (detection->num > face_id)
+    return 0;
+}
+
+static int
+init_facemesh_pipeline (texture_2d_t *srctex)
+{
+    int w, h;
+
+    get_face_detect_input_buf (&w, &h);
+    init_preprocess (&s_preproc_detect_cpu, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    get_facemesh_landmark_input_buf (&w, &h);
+    init_preprocess (&s_preproc_landmark_cpu, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    w = srctex->width;
+    h = srctex->height;
+    init_preprocess (&s_preproc_frame, PREPROC_BACKEND_DEFAULT, w, h, PREPROC_TYPE_RGBA8, 0.0f, 1.0f);
+
+    if (pipeline_init (&s_pipeline, PIPELINE_NUM_FRAMES, sizeof (facemesh_frame_t)) != 0)
+        return -1;
+
+    for (int i = 0; i < PIPELINE_NUM_FRAMES; i ++)
     {
-        face_t *face = &(detection->faces[face_id]);
-        float x0 = face->face_pos[0].x;
-        float y0 = face->face_pos[0].y;
-        float x1 = face->face_pos[1].x; //    0--------1
-        float y1 = face->face_pos[1].y; //    |        |
-        float x2 = face->face_pos[2].x; //    |        |
-        float y2 = face->face_pos[2].y; //    3--------2
-        float x3 = face->face_pos[3].x;
-        float y3 = face->face_pos[3].y;
-        texcoord[0] = x3;   texcoord[1] = y3;
-        texcoord[2] = x0;   texcoord[3] = y0;
-        texcoord[4] = x2;   texcoord[5] = y2;
-        texcoord[6] = x1;   texcoord[7] = y1;
+        facemesh_frame_t *frame = (facemesh_frame_t *)pipeline_get_frame (&s_pipeline, i);
+        frame->w    = w;
+        frame->h    = h;
+        frame->rgba = (unsigned char *)malloc (w * h * 4);
+        if (frame->rgba == NULL)
+        {
+            fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+            return -1;
+        }
     }
 
-    draw_2d_texture_ex_texcoord (srctex, 0, win_h - h, w, h, texcoord);
+    pipeline_add_stage (&s_pipeline, "face_detect",   stage_face_detect,   NULL);
+    pipeline_add_stage (&s_pipeline, "face_landmark", stage_face_landmark, NULL);
+
+    return pipeline_start (&s_pipeline);
+}
 
-    glPixelStorei (GL_PACK_ALIGNMENT, 4);
-    glReadPixels (0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, buf_ui8);
+/*
+ *  push the current frame into the pipeline (skipped if all the contexts are busy),
+ *  and return the latest result which has come out of it.
+ */
+static void
+run_facemesh_pipeline (texture_2d_t *srctex, face_detect_result_t *detection,
+                       face_landmark_result_t *facemesh, double *invoke_ms)
+{
+    facemesh_frame_t *frame = (facemesh_frame_t *)pipeline_acquire_frame (&s_pipeline, 0);
+    if (frame)
+    {
+        preprocess_texture (&s_preproc_frame, srctex, NULL);
+        preprocess_get_tensor (&s_preproc_frame, frame->rgba);
+        pipeline_submit_frame (&s_pipeline, frame);
+    }
+    else
+    {
+        /* the frame is dropped. don't hand its readback to the next one. */
+        preprocess_reset (&s_preproc_frame);
+    }
 
-    /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
-    float mean = 128.0f;
-    float std  = 128.0f;
-    for (y = 0; y < h; y ++)
+    while ((frame = (facemesh_frame_t *)pipeline_poll_frame (&s_pipeline, 0)) != NULL)
     {
-        for (x = 0; x < w; x ++)
+        if (!pipeline_frame_failed (&s_pipeline, frame))
         {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
+            s_pipeline_detect = frame->detect;
+            for (int face_id = 0; face_id < frame->detect.num; face_id ++)
+                s_pipeline_mesh[face_id] = frame->mesh[face_id];
+
+            s_pipeline_invoke_ms[0] = frame->invoke_ms[0];
+            s_pipeline_invoke_ms[1] = frame->invoke_ms[1];
         }
+        pipeline_release_frame (&s_pipeline, frame);
     }
 
-    return;
+    *detection = s_pipeline_detect;
+    for (int face_id = 0; face_id < s_pipeline_detect.num; face_id ++)
+        facemesh[face_id] = s_pipeline_mesh[face_id];
+
+    invoke_ms[0] = s_pipeline_invoke_ms[0];
+    invoke_ms[1] = s_pipeline_invoke_ms[1];
 }
 
 
+
 static void
 render_detect_region (int ofstx, int ofsty, int texw, int texh,
                       face_detect_result_t *detection)
@@ -184,57 +415,96 @@ render_detect_region (int ofstx, int ofsty, int texw, int texh,
 }
 
 
+/*
+ *  transform from the landmark (normalized in the face ROI) to the screen:
+ *      rotate ((x, y) - 0.5) * (face_w, face_h) + (face_cx, face_cy)
+ *      then  * (scale_x, scale_y) + (ofstx, ofsty)
+ *  it is done by the vertex shader, so the landmarks are uploaded as they are.
+ */
 static void
-rot_vec (float *x, float *y, float rotation)
+compute_face_xform (float *mtx, face_t *face, float scale_x, float scale_y, float ofstx, float ofsty)
 {
-    *x = (*x) * cos(rotation) - (*y) * sin(rotation);
-    *y = (*x) * sin(rotation) + (*y) * cos(rotation);
+    float c  = cosf (face->rotation);
+    float s  = sinf (face->rotation);
+    float sx = face->face_w * scale_x;
+    float sy = face->face_h * scale_y;
+
+    matrix_identity (mtx);
+    mtx[ 0] =  c * sx;
+    mtx[ 1] =  s * sy;
+    mtx[ 4] = -s * sx;
+    mtx[ 5] =  c * sy;
+    mtx[12] = (face->face_cx - 0.5f * (c - s) * face->face_w) * scale_x + ofstx;
+    mtx[13] = (face->face_cy - 0.5f * (s + c) * face->face_h) * scale_y + ofsty;
 }
 
+/* CPU version of the transform (for the mesh lines) */
 static void
-compute_3d_face_pos (face_landmark_result_t *dst_facemesh, int texw, int texh,
-                     face_landmark_result_t *src_facemesh, face_t *face)
+transform_face_landmark (fvec3 *dst, fvec3 *src, float *mtx)
 {
-    float xoffset   = face->face_cx;// - 0.5f;
-    float yoffset   = face->face_cy;// - 0.5f;
-    float xsize     = face->face_w;
-    float ysize     = face->face_h;
-    float rotation  = face->rotation;
+    int i = 0;
+
+#if defined (FACEMESH_SSE2)
+    /* 4 landmarks at once. SSE2 has no deinterleaving load, so gather {x}, {y} */
+    __m128 m0  = _mm_set1_ps (mtx[0]);
+    __m128 m1  = _mm_set1_ps (mtx[1]);
+    __m128 m4  = _mm_set1_ps (mtx[4]);
+    __m128 m5  = _mm_set1_ps (mtx[5]);
+    __m128 m12 = _mm_set1_ps (mtx[12]);
+    __m128 m13 = _mm_set1_ps (mtx[13]);
+
+    for (; i + 4 <= FACE_KEY_NUM; i += 4)
+    {
+        __m128 x = _mm_setr_ps (src[i].x, src[i + 1].x, src[i + 2].x, src[i + 3].x);
+        __m128 y = _mm_setr_ps (src[i].y, src[i + 1].y, src[i + 2].y, src[i + 3].y);
+        float dx[4], dy[4];
 
-    for (int i = 0; i < FACE_KEY_NUM; i ++)
+        _mm_storeu_ps (dx, _mm_add_ps (_mm_add_ps (_mm_mul_ps (x, m0), _mm_mul_ps (y, m4)), m12));
+        _mm_storeu_ps (dy, _mm_add_ps (_mm_add_ps (_mm_mul_ps (x, m1), _mm_mul_ps (y, m5)), m13));
+
+        for (int j = 0; j < 4; j ++)
+        {
+            dst[i + j].x = dx[j];
+            dst[i + j].y = dy[j];
+            dst[i + j].z = src[i + j].z;
+        }
+    }
+#elif defined (FACEMESH_NEON)
+    /* 4 landmarks at once. vld3q deinterleaves {x, y, z} */
+    for (; i + 4 <= FACE_KEY_NUM; i += 4)
     {
-        float x = src_facemesh->joint[i].x;
-        float y = src_facemesh->joint[i].y;
-        float z = src_facemesh->joint[i].z;
-
-        x = x - 0.5f;
-        y = y - 0.5f;
-        rot_vec (&x, &y, rotation);
-        x *= xsize;
-        y *= ysize;
-        x += xoffset;
-        y += yoffset;
-
-        dst_facemesh->joint[i].x = x;
-        dst_facemesh->joint[i].y = y;
-        dst_facemesh->joint[i].z = z;
+        float32x4x3_t v = vld3q_f32 (&src[i].x);
+        float32x4x3_t d;
+
+        d.val[0] = vmlaq_n_f32 (vmlaq_n_f32 (vdupq_n_f32 (mtx[12]), v.val[0], mtx[0]), v.val[1], mtx[4]);
+        d.val[1] = vmlaq_n_f32 (vmlaq_n_f32 (vdupq_n_f32 (mtx[13]), v.val[0], mtx[1]), v.val[1], mtx[5]);
+        d.val[2] = v.val[2];
+        vst3q_f32 (&dst[i].x, d);
+    }
+#endif
+
+    for (; i < FACE_KEY_NUM; i ++)
+    {
+        float x = src[i].x;
+        float y = src[i].y;
+
+        dst[i].x = mtx[0] * x + mtx[4] * y + mtx[12];
+        dst[i].y = mtx[1] * x + mtx[5] * y + mtx[13];
+        dst[i].z = src[i].z;
     }
 }
 
 static void
 render_face_landmark (int ofstx, int ofsty, int texw, int texh,
-                      face_landmark_result_t *facemesh, face_t *face,
-                      int texid_mask,
-                      face_landmark_result_t *facemesh_mask, face_t *face_mask,
+                      face_landmark_result_t *facemesh, face_t *face, unsigned int vbo_mesh,
+                      int texid_mask, face_t *face_mask, unsigned int vbo_mask,
                       int meshline)
 {
     int eyehole = s_gui_prop.mask_eye_hole;
+    float mtx_vtx[16], mtx_uv[16];
 
-    face_landmark_result_t facemesh_draw;
-    compute_3d_face_pos (&facemesh_draw, texw, texh, facemesh, face);
-
-    face_landmark_result_t facemesh_draw_mask;
-    compute_3d_face_pos (&facemesh_draw_mask, texw, texh, facemesh_mask, face_mask);
+    compute_face_xform (mtx_vtx, face, texw, texh, ofstx, ofsty);
+    compute_face_xform (mtx_uv,  face_mask, 1.0f, 1.0f, 0.0f, 0.0f);
 
 #if 0
     float col_red[]   = {0.0f, 1.0f, 0.0f, 1.0f};
@@ -245,24 +515,15 @@ render_face_landmark (int ofstx, int ofsty, int texw, int texh,
     draw_dbgstr_ex (buf, texw - 120, 0, 1.0f, col_white, col_red);
 #endif
 
-    for (int i = 0; i < FACE_KEY_NUM; i ++)
-    {
-        float x = facemesh_draw.joint[i].x  * texw + ofstx;
-        float y = facemesh_draw.joint[i].y  * texh + ofsty;
-        facemesh_draw.joint[i].x = x;
-        facemesh_draw.joint[i].y = y;
-
-        //int r = 4;
-        //draw_2d_fillrect (x - (r/2), y - (r/2), r, r, col_red);
-    }
-
     float mask_color[] = {1.0f, 1.0f, 1.0f, s_gui_prop.mask_alpha};
-    draw_facemesh_tri_tex (texid_mask, facemesh_draw.joint, facemesh_draw_mask.joint,
+    draw_facemesh_tri_tex (texid_mask, vbo_mesh, mtx_vtx, vbo_mask, mtx_uv,
                            mask_color, eyehole);
 
     if (meshline)
     {
         float col_white[] = {1.0f, 1.0f, 1.0f, 0.3f};
+        face_landmark_result_t facemesh_draw;
+        transform_face_landmark (facemesh_draw.joint, facemesh->joint, mtx_vtx);
         draw_facemesh_line (facemesh_draw.joint, col_white, eyehole);
     }
 }
@@ -415,12 +676,21 @@ main(int argc, char *argv[])
     int enable_video = 0;
     int enable_camera = 1;
     int mask_eye_hole = 0;
+    int enable_pipeline = 0;
+    int track_interval = 0;
+    int track_age = 0;
+    int lmfilter_type = LMFILTER_NONE;
+    float target_fps = 0;
+    sched_t sched;
+    face_detect_result_t face_track_ret = {0};
+    face_detect_result_t face_detect_last = {0};
+    static face_landmark_result_t face_mesh_last[MAX_FACE_NUM];
     UNUSED (argc);
     UNUSED (*argv);
 
     {
         int c;
-        const char *optstring = "eqv:x";
+        const char *optstring = "epr:s:t:qv:x";
 
         while ((c = getopt (argc, argv, optstring)) != -1)
         {
@@ -429,6 +699,18 @@ main(int argc, char *argv[])
             case 'e':
                 mask_eye_hole = 1;
                 break;
+            case 'p':
+                enable_pipeline = 1;
+                break;
+            case 'r':
+                target_fps = atof (optarg);
+                break;
+            case 's':
+                lmfilter_type = atoi (optarg);
+                break;
+            case 't':
+                track_interval = atoi (optarg);
+                break;
             case 'q':
                 use_quantized_tflite = 1;
                 break;
@@ -459,10 +741,45 @@ main(int argc, char *argv[])
     init_2d_renderer (win_w, win_h);
     init_facemesh_renderer (win_w, win_h);
     init_pmeter (win_w, win_h, 500);
+
+    /* landmarks of the faces, transformed by the vertex shader */
+    unsigned int vbo_face[MAX_FACE_NUM];
+    for (int face_id = 0; face_id < MAX_FACE_NUM; face_id ++)
+        vbo_face[face_id] = create_facemesh_vbo ();
     init_dbgstr (win_w, win_h);
     init_cube ((float)win_w / (float)win_h);
 
+#if defined (USE_GL_DELEGATE) || defined (USE_GPU_DELEGATEV2)
+    if (enable_pipeline)
+    {
+        /* GPU Delegate must be invoked on the thread which owns the EGL context */
+        fprintf (stderr, "pipelined inference is not available with GPU Delegate.\n");
+        enable_pipeline = 0;
+    }
+#endif
+    if (enable_pipeline && track_interval > 0)
+    {
+        /* the ROI of a frame depends on the landmarks of the previous frame */
+        fprintf (stderr, "ROI tracking is not available with pipelined inference.\n");
+        track_interval = 0;
+    }
+    if (enable_pipeline && target_fps > 0)
+    {
+        /* the pipeline already decouples the inference from the rendering */
+        fprintf (stderr, "adaptive inference rate is not available with pipelined inference.\n");
+        target_fps = 0;
+    }
+    if (enable_pipeline)
+        enable_tflite_concurrent_invoke ();
+
+    sched_init (&sched, target_fps, MAX_INFER_INTERVAL);
+
     init_tflite_facemesh (use_quantized_tflite);
+
+    lmfilter_param_t lmfilter_param;
+    lmfilter_default_param (&lmfilter_param, lmfilter_type);
+    lmfilter_init_bank (&s_lmfilter, &lmfilter_param, MAX_FACE_NUM, FACE_KEY_NUM * 3);
+    lmfilter_init_tracker (&s_lmtracker);
     setup_imgui (win_w * 2, win_h);
     s_gui_prop.mask_eye_hole = mask_eye_hole;
 
@@ -515,10 +832,12 @@ main(int argc, char *argv[])
     face_detect_result_t    *face_detect_mask;
     face_landmark_result_t  *face_mesh_mask;
     int *texid_mask;
+    unsigned int *vbo_mask;
 
     face_detect_mask = (face_detect_result_t *)calloc (s_num_maskimages, sizeof(face_detect_result_t));
     face_mesh_mask = (face_landmark_result_t *)calloc (s_num_maskimages, sizeof(face_landmark_result_t));
     texid_mask = (int *)calloc (s_num_maskimages, sizeof (int));
+    vbo_mask = (unsigned int *)calloc (s_num_maskimages, sizeof (unsigned int));
 
     for (int mask_id = 0; mask_id < s_num_maskimages; mask_id ++)
     {
@@ -536,11 +855,15 @@ main(int argc, char *argv[])
             masktex.height = th;
             masktex.format = pixfmt_fourcc ('R', 'G', 'B', 'A');
 
+            /* still images: read back the current image, not the previous one */
+            preprocess_reset (&s_preproc_detect);
+            reset_face_landmark_preproc (0);
+
             feed_face_detect_image (&masktex, win_w, win_h);
             invoke_face_detect (&face_detect_mask[mask_id]);
 
             int face_id = 0;
-            feed_face_landmark_image (&masktex, win_w, win_h, &face_detect_mask[mask_id], face_id);
+            feed_face_landmark_image (&masktex, win_w, win_h, &face_detect_mask[mask_id], face_id, 0);
 
             invoke_facemesh_landmark (&face_mesh_mask[mask_id]);
         }
@@ -548,9 +871,21 @@ main(int argc, char *argv[])
         {
             get_static_facemesh_landmark (&face_detect_mask[mask_id], &face_mesh_mask[mask_id]);
         }
+
+        /* the landmarks of the masks never change */
+        vbo_mask[mask_id] = create_facemesh_vbo ();
+        update_facemesh_vbo (vbo_mask[mask_id], face_mesh_mask[mask_id].joint);
     }
+    preprocess_reset (&s_preproc_detect);
+    reset_face_landmark_preproc (0);
 
 
+    if (enable_pipeline && init_facemesh_pipeline (&captex) != 0)
+    {
+        fprintf (stderr, "failed to start the pipeline. run serially.\n");
+        enable_pipeline = 0;
+    }
+
     /* --------------------------------------- *
      *  Render Loop
      * --------------------------------------- */
@@ -558,12 +893,13 @@ main(int argc, char *argv[])
     {
         face_detect_result_t    face_detect_ret = {0};
         face_landmark_result_t  face_mesh_ret[MAX_FACE_NUM] = {0};
+        int run_infer = 1;
 
         int mask_id = (count / 100) % s_num_maskimages;
         mask_id = s_gui_prop.cur_mask_id;
         face_detect_result_t   *cur_face_detect_mask = &face_detect_mask[mask_id];
-        face_landmark_result_t *cur_face_mesh_mask = &face_mesh_mask[mask_id];
         int cur_texid_mask = texid_mask[mask_id];
+        unsigned int cur_vbo_mask = vbo_mask[mask_id];
 
         char strbuf[512];
 
@@ -591,44 +927,113 @@ main(int argc, char *argv[])
         }
 #endif
 
-        /* --------------------------------------- *
-         *  face detection
-         * --------------------------------------- */
-        feed_face_detect_image (&captex, win_w, win_h);
+        if (enable_pipeline)
+        {
+            double invoke_ms[2];
+            run_facemesh_pipeline (&captex, &face_detect_ret, face_mesh_ret, invoke_ms);
+            invoke_ms0 = invoke_ms[0];
+            invoke_ms1 = invoke_ms[1];
+        }
+        else if (!sched_begin_frame (&sched))
+        {
+            /* no inference in this frame (-r option): reuse the last results */
+            face_detect_ret = face_detect_last;
+            memcpy (face_mesh_ret, face_mesh_last, sizeof (face_mesh_ret));
+            run_infer = 0;
+        }
+        else
+        {
+            /* --------------------------------------- *
+             *  face detection
+             *  (skipped while the faces are tracked)
+             * --------------------------------------- */
+            sched_stage_begin (&sched, 0);
+            if (face_track_ret.num > 0 && track_age < track_interval)
+            {
+                face_detect_ret = face_track_ret;
+                invoke_ms0 = 0;
+                track_age ++;
+                preprocess_reset (&s_preproc_detect);
+            }
+            else
+            {
+                feed_face_detect_image (&captex, win_w, win_h);
+
+                ttime[2] = pmeter_get_time_ms ();
+                invoke_face_detect (&face_detect_ret);
+                ttime[3] = pmeter_get_time_ms ();
+                invoke_ms0 = ttime[3] - ttime[2];
+                track_age = 0;
+            }
+            sched_stage_end (&sched, 0);
+
+            /* --------------------------------------- *
+             *  face landmark (all the faces in one batch)
+             * --------------------------------------- */
+            int num_faces = face_detect_ret.num;
+            int num_batch = (num_faces > 0) ? set_facemesh_landmark_batch (num_faces) : 1;
+
+            invoke_ms1 = 0;
+            sched_stage_begin (&sched, 1);
+            for (int face_id = 0; face_id < num_faces; face_id += num_batch)
+            {
+                int batch = (num_faces - face_id < num_batch) ? num_faces - face_id : num_batch;
+
+                for (int i = 0; i < batch; i ++)
+                    feed_face_landmark_image (&captex, win_w, win_h, &face_detect_ret, face_id + i, i);
+
+                ttime[4] = pmeter_get_time_ms ();
+                invoke_facemesh_landmark_batch (&face_mesh_ret[face_id], batch);
+                ttime[5] = pmeter_get_time_ms ();
+                invoke_ms1 += ttime[5] - ttime[4];
+            }
+            reset_face_landmark_preproc (num_faces);
+            sched_stage_end (&sched, 1);
 
-        ttime[2] = pmeter_get_time_ms ();
-        invoke_face_detect (&face_detect_ret);
-        ttime[3] = pmeter_get_time_ms ();
-        invoke_ms0 = ttime[3] - ttime[2];
+            if (track_interval > 0)
+                update_face_track (&face_track_ret, &face_detect_ret, face_mesh_ret);
+
+            face_detect_last = face_detect_ret;
+            memcpy (face_mesh_last, face_mesh_ret, sizeof (face_mesh_ret));
+        }
 
         /* --------------------------------------- *
-         *  face landmark
+         *  landmark smoothing
          * --------------------------------------- */
-        invoke_ms1 = 0;
-        for (int face_id = 0; face_id < face_detect_ret.num; face_id ++)
+        if (lmfilter_type != LMFILTER_NONE)
         {
-            feed_face_landmark_image (&captex, win_w, win_h, &face_detect_ret, face_id);
+            int track_id[MAX_FACE_NUM];
+            assign_face_track_id (&face_detect_ret, track_id);
 
-            ttime[4] = pmeter_get_time_ms ();
-            invoke_facemesh_landmark (&face_mesh_ret[face_id]);
-            ttime[5] = pmeter_get_time_ms ();
-            invoke_ms1 += ttime[5] - ttime[4];
+            for (int face_id = 0; face_id < face_detect_ret.num; face_id ++)
+                smooth_face_landmark (&face_detect_ret.faces[face_id], &face_mesh_ret[face_id], track_id[face_id], ttime[1], !run_infer);
         }
 
+        /* upload the landmarks once. both halves of the scene draw them. */
+        for (int face_id = 0; face_id < face_detect_ret.num; face_id ++)
+            update_facemesh_vbo (vbo_face[face_id], face_mesh_ret[face_id].joint);
+
         /* --------------------------------------- *
          *  render scene (left half)
          * --------------------------------------- */
         glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        /* all the strings of the left half in one draw call */
+        begin_dbgstr_batch ();
+
         /* visualize the face pose estimation results. */
         draw_2d_texture_ex (&captex, draw_x, draw_y, draw_w, draw_h, 0);
 
         for (int face_id = 0; face_id < face_detect_ret.num; face_id ++)
         {
-            render_face_landmark (draw_x, draw_y, draw_w, draw_h, &face_mesh_ret[face_id], &face_detect_ret.faces[face_id],
-                                  cur_texid_mask, cur_face_mesh_mask, &cur_face_detect_mask->faces[0], 0);
+            render_face_landmark (draw_x, draw_y, draw_w, draw_h,
+                                  &face_mesh_ret[face_id], &face_detect_ret.faces[face_id], vbo_face[face_id],
+                                  cur_texid_mask, &cur_face_detect_mask->faces[0], cur_vbo_mask, 0);
         }
 
+        /* all the 2D overlays of the left half in one draw call */
+        begin_2d_batch ();
+
         if (s_gui_prop.draw_detect_rect)
         {
             render_detect_region (draw_x, draw_y, draw_w, draw_h, &face_detect_ret);
@@ -650,6 +1055,9 @@ main(int argc, char *argv[])
         /* --------------------------------------- *
          *  render scene  (right half)
          * --------------------------------------- */
+        /* the batched primitives are mapped with the viewport of the left half */
+        end_2d_batch ();
+        end_dbgstr_batch ();
         glViewport (win_w, 0, win_w, win_h);
 
         render_3d_scene (draw_x, draw_y, draw_w, draw_h);
@@ -657,8 +1065,8 @@ main(int argc, char *argv[])
         for (int face_id = 0; face_id < face_detect_ret.num; face_id ++)
         {
             render_face_landmark (draw_x, draw_y, draw_w, draw_h,
-                                  &face_mesh_ret[face_id], &face_detect_ret.faces[face_id],
-                                  cur_texid_mask, cur_face_mesh_mask, &cur_face_detect_mask->faces[0],
+                                  &face_mesh_ret[face_id], &face_detect_ret.faces[face_id], vbo_face[face_id],
+                                  cur_texid_mask, &cur_face_detect_mask->faces[0], cur_vbo_mask,
                                   s_gui_prop.draw_mesh_line);
         }
 
@@ -676,6 +1084,7 @@ main(int argc, char *argv[])
          *  post process
          * --------------------------------------- */
         glViewport (0, 0, win_w, win_h);
+        begin_dbgstr_batch ();
 
         if (s_gui_prop.draw_pmeter)
         {
@@ -686,6 +1095,8 @@ main(int argc, char *argv[])
             interval, invoke_ms0, invoke_ms1);
         draw_dbgstr (strbuf, 10, 10);
 
+        end_dbgstr_batch ();
+
 #if defined (USE_IMGUI)
         invoke_imgui (&s_gui_prop);
 #endif
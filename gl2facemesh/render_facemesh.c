@@ -33,6 +33,8 @@ static GLint        s_loc_alpha;
 static GLint        s_loc_lightpos;
 
 static GLuint       s_vbo_vtxalpha[2];
+static GLuint       s_vbo_tris[2];
+static int          s_num_tris_idx[2];
 
 static GLfloat s_vtx[] =
 {
@@ -261,16 +263,17 @@ draw_floor (float *mtxGlobal, float div_u, float div_v)
  * ------------------------------------------------------ */
 static char vs_tex[] = "                              \n\
 attribute    vec4    a_Vertex;                        \n\
-attribute    vec2    a_TexCoord;                      \n\
+attribute    vec4    a_TexCoord;                      \n\
 attribute    float   a_vtxalpha;                      \n\
 varying      vec2    v_TexCoord;                      \n\
 varying      float   v_vtxalpha;                      \n\
 uniform      mat4    u_PMVMatrix;                     \n\
+uniform      mat4    u_TexMatrix;                     \n\
                                                       \n\
 void main (void)                                      \n\
 {                                                     \n\
     gl_Position = u_PMVMatrix * a_Vertex;             \n\
-    v_TexCoord  = a_TexCoord;                         \n\
+    v_TexCoord  = vec2(u_TexMatrix * a_TexCoord);     \n\
     v_vtxalpha  = a_vtxalpha;                         \n\
 }                                                     \n";
 
@@ -292,6 +295,7 @@ void main (void)                                      \n\
 static shader_obj_t s_sobj2;
 static float s_matprj2[16];
 static GLint        s_loc_mtx;
+static GLint        s_loc_mtx_tex;
 static GLint        s_loc_col;
 static GLint        s_loc_vtxalpha;
 
@@ -356,6 +360,27 @@ create_vbo_alpha_array (int drill_eye_hole)
     return vboid;
 }
 
+static GLuint
+create_ibo_tris (int drill_eye_hole, int *num_idx)
+{
+    int *mesh_tris = get_facemesh_tri_indicies (num_idx, drill_eye_hole);
+    unsigned short *idx_array = (unsigned short *)malloc (*num_idx * sizeof(unsigned short));
+
+    /* FACE_KEY_NUM vertices fit in 16bit (GL_UNSIGNED_INT is an extension on GLES2) */
+    for (int i = 0; i < *num_idx; i ++)
+        idx_array[i] = mesh_tris[i];
+
+    GLuint vboid;
+    glGenBuffers (1, &vboid);
+
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, vboid);
+    glBufferData (GL_ELEMENT_ARRAY_BUFFER, *num_idx * sizeof(unsigned short), idx_array, GL_STATIC_DRAW);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    free (idx_array);
+    return vboid;
+}
+
 
 int
 init_facemesh_renderer (int w, int h)
@@ -367,6 +392,7 @@ init_facemesh_renderer (int w, int h)
     }
 
     s_loc_mtx = glGetUniformLocation(s_sobj2.program, "u_PMVMatrix" );
+    s_loc_mtx_tex = glGetUniformLocation(s_sobj2.program, "u_TexMatrix" );
     s_loc_col = glGetUniformLocation(s_sobj2.program, "u_Color" );
     s_loc_vtxalpha = glGetAttribLocation (s_sobj2.program, "a_vtxalpha");
 
@@ -375,20 +401,58 @@ init_facemesh_renderer (int w, int h)
     s_vbo_vtxalpha[0] = create_vbo_alpha_array (0);
     s_vbo_vtxalpha[1] = create_vbo_alpha_array (1);
 
+    s_vbo_tris[0] = create_ibo_tris (0, &s_num_tris_idx[0]);
+    s_vbo_tris[1] = create_ibo_tris (1, &s_num_tris_idx[1]);
+
+    return 0;
+}
+
+
+/* ------------------------------------------------------ *
+ *  VBO of the landmarks.
+ *  the landmarks are uploaded as they are (normalized in the face ROI),
+ *  and transformed to the screen by the vertex shader.
+ * ------------------------------------------------------ */
+unsigned int
+create_facemesh_vbo ()
+{
+    GLuint vboid;
+    glGenBuffers (1, &vboid);
+
+    glBindBuffer (GL_ARRAY_BUFFER, vboid);
+    glBufferData (GL_ARRAY_BUFFER, FACE_KEY_NUM * sizeof(fvec3), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+
+    GLASSERT ();
+    return vboid;
+}
+
+int
+update_facemesh_vbo (unsigned int vbo, fvec3 *joint)
+{
+    glBindBuffer (GL_ARRAY_BUFFER, vbo);
+
+    /* orphan the storage not to wait for the draw of the previous frame */
+    glBufferData (GL_ARRAY_BUFFER, FACE_KEY_NUM * sizeof(fvec3), NULL, GL_DYNAMIC_DRAW);
+    glBufferSubData (GL_ARRAY_BUFFER, 0, FACE_KEY_NUM * sizeof(fvec3), joint);
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+
+    GLASSERT ();
     return 0;
 }
 
 
+/*
+ *  vbo_vtx, vbo_uv : landmarks in VBOs of create_facemesh_vbo().
+ *  mtx_vtx         : landmark --> screen coordinate.
+ *  mtx_uv          : landmark --> texture coordinate.
+ */
 int
-draw_facemesh_tri_tex (int texid, fvec3 *vtx, fvec3 *uv, float *color, int drill_eye_hole)
+draw_facemesh_tri_tex (int texid, unsigned int vbo_vtx, float *mtx_vtx,
+                       unsigned int vbo_uv, float *mtx_uv, float *color, int drill_eye_hole)
 {
     shader_obj_t *sobj = &s_sobj2;
     float matrix[16];
-    int num_idx;
-    int *mesh_tris = get_facemesh_tri_indicies (&num_idx, drill_eye_hole);
-
-    glBindBuffer (GL_ARRAY_BUFFER, 0);
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
 
     glUseProgram (sobj->program);
     glUniform1i(sobj->loc_tex, 0);
@@ -397,30 +461,34 @@ draw_facemesh_tri_tex (int texid, fvec3 *vtx, fvec3 *uv, float *color, int drill
 
     if (sobj->loc_uv >= 0)
     {
+        glBindBuffer (GL_ARRAY_BUFFER, vbo_uv);
         glEnableVertexAttribArray (sobj->loc_uv);
-        glVertexAttribPointer (sobj->loc_uv, 3, GL_FLOAT, GL_FALSE, 0, uv);
+        glVertexAttribPointer (sobj->loc_uv, 3, GL_FLOAT, GL_FALSE, 0, 0);
     }
 
     glEnable (GL_BLEND);
     glEnable (GL_CULL_FACE);
 
-    matrix_identity (matrix);
-    matrix_mult (matrix, s_matprj2, matrix);
+    matrix_mult (matrix, s_matprj2, mtx_vtx);
 
     glUniformMatrix4fv (s_loc_mtx, 1, GL_FALSE, matrix);
+    glUniformMatrix4fv (s_loc_mtx_tex, 1, GL_FALSE, mtx_uv);
     glUniform4fv (s_loc_col, 1, color);
 
+    glBindBuffer (GL_ARRAY_BUFFER, vbo_vtx);
     glEnableVertexAttribArray (sobj->loc_vtx);
-    glVertexAttribPointer (sobj->loc_vtx, 3, GL_FLOAT, GL_FALSE, 0, vtx);
+    glVertexAttribPointer (sobj->loc_vtx, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
     glBindBuffer (GL_ARRAY_BUFFER, s_vbo_vtxalpha[drill_eye_hole]);
     glEnableVertexAttribArray (s_loc_vtxalpha);
     glVertexAttribPointer (s_loc_vtxalpha, 1, GL_FLOAT, GL_FALSE, 0, 0);
 
-    glDrawElements (GL_TRIANGLES, num_idx, GL_UNSIGNED_INT, mesh_tris);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, s_vbo_tris[drill_eye_hole]);
+    glDrawElements (GL_TRIANGLES, s_num_tris_idx[drill_eye_hole], GL_UNSIGNED_SHORT, 0);
 
     glDisable (GL_BLEND);
     glBindBuffer (GL_ARRAY_BUFFER, 0);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
 
     GLASSERT ();
     return 0;
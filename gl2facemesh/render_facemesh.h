@@ -9,7 +9,10 @@ int init_cube (float aspect);
 int draw_floor (float *mtxGlobal, float div_u, float div_v);
 
 int init_facemesh_renderer (int w, int h);
-int draw_facemesh_tri_tex (int texid, fvec3 *vtx, fvec3 *uv, float *color, int drill_eye_hole);
+unsigned int create_facemesh_vbo ();
+int update_facemesh_vbo (unsigned int vbo, fvec3 *joint);
+int draw_facemesh_tri_tex (int texid, unsigned int vbo_vtx, float *mtx_vtx,
+                           unsigned int vbo_uv, float *mtx_uv, float *color, int drill_eye_hole);
 int draw_facemesh_line (fvec3 *joint, float *color, int drill_eye_hole);
 
 #endif /* _RENDER_FACEMESH_H_ */
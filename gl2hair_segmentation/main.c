@@ -14,6 +14,8 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
+#include "util_segmap.h"
 #include "util_matrix.h"
 #include "tflite_hair_segmentation.h"
 #include "render_hair.h"
@@ -30,7 +32,7 @@
 void
 feed_segmentation_image (texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_segmentation_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -48,20 +50,10 @@ feed_segmentation_image (texture_2d_t *srctex, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [0, 1] */
     float mean =   0.0f;
     float std  = 255.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-            *buf_fp32 ++ = 0.0f;
-        }
-    }
+    pixconv_param_t prm;
+    pixconv_init_param (&prm, PIXCONV_SRC_RGBA8, PIXCONV_DST_FP32, mean, std);
+    prm.dst_ch = 4;     /* 4th channel is zero */
+    convert_pixels (&prm, buf_ui8, w, h, buf_fp32);
 
     return;
 }
@@ -151,11 +143,17 @@ render_segment_result (int ofstx, int ofsty, int draw_w, int draw_h,
     int segmap_w  = segment_ret->segmentmap_dims[0];
     int segmap_h  = segment_ret->segmentmap_dims[1];
     int segmap_c  = segment_ret->segmentmap_dims[2];
-    int x, y, c;
+    int i;
     unsigned int imgbuf[segmap_h][segmap_w];
+    unsigned int palette[MAX_SEGMENT_CLASS];
     float hair_color[4] = {0};
     float back_color[4] = {0};
     static float s_hsv_h = 0.0f;
+    static unsigned char *s_class_map = NULL;
+    static GLuint s_hair_texid = 0;
+    static segmap_t s_segmap;
+    static int s_gpu_argmax = -1;
+    GLuint texid;
 
     s_hsv_h += 5.0f;
     if (s_hsv_h >= 360.0f)
@@ -168,47 +166,65 @@ render_segment_result (int ofstx, int ofsty, int draw_w, int draw_h,
     hair_color[3] = lumi;
 #endif
 
-    /* find the most confident class for each pixel. */
-    for (y = 0; y < segmap_h; y ++)
+    for (i = 0; i < MAX_SEGMENT_CLASS; i ++)
     {
-        for (x = 0; x < segmap_w; x ++)
-        {
-            int max_id;
-            float conf_max = 0;
-            for (c = 0; c < MAX_SEGMENT_CLASS; c ++)
-            {
-                float confidence = segmap[(y * segmap_w * segmap_c)+ (x * segmap_c) + c];
-                if (c == 0 || confidence > conf_max)
-                {
-                    conf_max = confidence;
-                    max_id = c;
-                }
-            }
+        float *col = (i > 0) ? hair_color : back_color;
+        unsigned char r = ((int)(col[0] * 255)) & 0xff;
+        unsigned char g = ((int)(col[1] * 255)) & 0xff;
+        unsigned char b = ((int)(col[2] * 255)) & 0xff;
+        unsigned char a = ((int)(col[3] * 255)) & 0xff;
 
-            float *col = (max_id > 0) ? hair_color : back_color;
-            unsigned char r = ((int)(col[0] * 255)) & 0xff;
-            unsigned char g = ((int)(col[1] * 255)) & 0xff;
-            unsigned char b = ((int)(col[2] * 255)) & 0xff;
-            unsigned char a = ((int)(col[3] * 255)) & 0xff;
+        palette[i] = (a << 24) | (b << 16) | (g << 8) | (r);
+    }
 
-            imgbuf[y][x] = (a << 24) | (b << 16) | (g << 8) | (r);
+    /* find the most confident class for each pixel, and color it on GPU. */
+    if (s_gpu_argmax < 0)
+    {
+        s_gpu_argmax = 0;
+        if (segmap_init (&s_segmap, segmap_w, segmap_h) == 0)
+        {
+            if (segmap_init_gpu (&s_segmap, segmap_c) == 0)
+                s_gpu_argmax = 1;
+            else
+                segmap_destroy (&s_segmap);
         }
     }
 
-    GLuint texid;
-    glGenTextures (1, &texid );
-    glBindTexture (GL_TEXTURE_2D, texid);
+    if (s_gpu_argmax)
+    {
+        segmap_set_palette (&s_segmap, palette, MAX_SEGMENT_CLASS);
+        segmap_update_gpu (&s_segmap, segmap, MAX_SEGMENT_CLASS);
+        texid = s_segmap.colortex.texid;
+    }
+    else
+    {
+        if (s_class_map == NULL)
+        {
+            s_class_map = (unsigned char *)malloc (segmap_w * segmap_h);
 
-    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glGenTextures (1, &s_hair_texid);
+            glBindTexture (GL_TEXTURE_2D, s_hair_texid);
 
-    glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+            glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA,
-        segmap_w, segmap_h, 0, GL_RGBA,
-        GL_UNSIGNED_BYTE, imgbuf);
+            glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA,
+                segmap_w, segmap_h, 0, GL_RGBA,
+                GL_UNSIGNED_BYTE, NULL);
+        }
+
+        /* fallback: find the most confident class for each pixel on CPU, and color it. */
+        segmap_argmax (segmap, segmap_w * segmap_h, segmap_c, MAX_SEGMENT_CLASS, s_class_map);
+        segmap_colorize (s_class_map, segmap_w * segmap_h, palette, &imgbuf[0][0]);
+
+        texid = s_hair_texid;
+        glBindTexture (GL_TEXTURE_2D, texid);
+        glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D (GL_TEXTURE_2D, 0, 0, 0, segmap_w, segmap_h,
+            GL_RGBA, GL_UNSIGNED_BYTE, imgbuf);
+    }
 
 #if !defined (RENDER_BY_BLEND)
     draw_colored_hair (srctex, texid, ofstx, ofsty, draw_w, draw_h, 0, hair_color);
@@ -219,8 +235,6 @@ render_segment_result (int ofstx, int ofsty, int draw_w, int draw_h,
     draw_2d_texture_blendfunc (texid, ofstx, ofsty, draw_w, draw_h, 0, blend_add);
 #endif
 
-    glDeleteTextures (1, &texid);
-
     render_hsv_circle (ofstx + draw_w - 100, ofsty + 100, s_hsv_h);
 }
 
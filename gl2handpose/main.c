@@ -7,13 +7,19 @@
 #include <unistd.h>
 #include <time.h>
 #include <float.h>
+#include <string.h>
+#include <math.h>
 #include <GLES2/gl2.h>
 #include "util_egl.h"
 #include "util_debugstr.h"
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_preprocess.h"
+#include "util_pipeline.h"
 #include "util_matrix.h"
+#include "util_lmfilter.h"
+#include "util_sched.h"
 #include "tflite_handpose.h"
 #include "util_camera_capture.h"
 #include "util_video_decode.h"
@@ -23,111 +29,333 @@
 
 #define UNUSED(x) (void)(x)
 
+#define MAX_INFER_INTERVAL  8   /* -r option: the inference runs at least once in 8 frames */
+
 static imgui_data_t s_gui_prop = {0};
 
 
 
 
+static preproc_t s_preproc_detect;
+static preproc_t s_preproc_landmark[MAX_PALM_NUM];  /* one per hand, for the PBO readback latency */
+
 /* resize image to DNN network input size and convert to fp32. */
 void
 feed_palm_detection_image(texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_palm_detection_input_buf (&w, &h);
-    unsigned char *buf_ui8 = NULL;
-    static unsigned char *pui8 = NULL;
+    UNUSED (win_w);
+    UNUSED (win_h);
 
-    if (pui8 == NULL)
-        pui8 = (unsigned char *)malloc(w * h * 4);
+    /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
+    if (s_preproc_detect.buf_ui8 == NULL)
+        init_preprocess (&s_preproc_detect, PREPROC_BACKEND_DEFAULT, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
 
-    buf_ui8 = pui8;
+    preprocess_texture (&s_preproc_detect, srctex, NULL);
+    preprocess_get_tensor (&s_preproc_detect, buf_fp32);
+
+    return;
+}
 
-    draw_2d_texture_ex (srctex, 0, win_h - h, w, h, 1);
+void
+feed_hand_landmark_image(texture_2d_t *srctex, int win_w, int win_h, palm_detection_result_t *detection, unsigned int hand_id,
+                         int batch_idx)
+{
+    int w, h;
+    float *buf_fp32 = (float *)get_hand_landmark_input_buf (&w, &h);
+    float *roi = NULL;
+    UNUSED (win_w);
+    UNUSED (win_h);
 
-    glPixelStorei (GL_PACK_ALIGNMENT, 4);
-    glReadPixels (0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, buf_ui8);
+    buf_fp32 += batch_idx * (w * h * 3);
 
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
-    float mean = 128.0f;
-    float std  = 128.0f;
-    for (y = 0; y < h; y ++)
+    preproc_t *pp = &s_preproc_landmark[hand_id];
+    if (pp->buf_ui8 == NULL)
+        init_preprocess (pp, PREPROC_BACKEND_DEFAULT, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    /*
+     *    0--------1
+     *    |        |
+     *    |        |
+     *    3--------2
+     */
+    palm_t *hand = NULL;
+    if (detection->num > hand_id)
+    {
+        hand = &detection->palms[hand_id];
+        roi = (float *)hand->hand_pos;
+        preprocess_set_tag (pp, hand, sizeof (palm_t));
+    }
+
+    preprocess_texture (pp, srctex, roi);
+    preprocess_get_tensor (pp, buf_fp32);
+
+    /*
+     *  the landmarks are relative to the ROI the tensor was cropped with.
+     *  the PBO backend returns the previous frame's tensor, so give back the
+     *  whole palm_t it came from (ROI, center, size and rotation).
+     */
+    if (hand)
+        preprocess_get_tensor_tag (pp, hand, sizeof (palm_t));
+
+    return;
+}
+
+/* the hands not fed on this frame: their next readback must not return an old image */
+static void
+reset_hand_landmark_preproc (int num_hands)
+{
+    for (int hand_id = num_hands; hand_id < MAX_PALM_NUM; hand_id ++)
+        preprocess_reset (&s_preproc_landmark[hand_id]);
+}
+
+
+/*
+ *  ROI tracking (-t option)
+ *    the ROIs of the next frame are derived from the landmarks of this frame.
+ *    if any hand is lost, the detection runs again at the next frame.
+ */
+static void
+update_hand_track (palm_detection_result_t *track, palm_detection_result_t *detection,
+                   hand_landmark_result_t *hand_landmark)
+{
+    track->num = 0;
+    for (int hand_id = 0; hand_id < detection->num; hand_id ++)
     {
-        for (x = 0; x < w; x ++)
+        palm_t palm = detection->palms[hand_id];
+        if (track_hand_region (&palm, &hand_landmark[hand_id]) != 0)
         {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
+            track->num = 0;
+            return;
         }
+        track->palms[track->num ++] = palm;
     }
+}
 
-    return;
+/*
+ *  landmark smoothing (-s option, 0: off, 1: One-Euro, 2: Kalman)
+ *    the landmarks are filtered in the image coordinates, and brought back
+ *    into the ROI of this frame, so the point drawn is the filtered point.
+ *    the ROI itself is not filtered: it only crops the next input.
+ *    the track id follows the hand by the overlap of the ROI with the last frame,
+ *    because the detections are sorted by the score every frame.
+ *    on the frames without the inference (-r option), the landmarks are
+ *    extrapolated from the filter instead.
+ */
+#define HAND_TRACK_IOU_MIN  0.3f
+
+static lmfilter_bank_t    s_lmfilter;
+static lmfilter_tracker_t s_lmtracker;
+
+static void
+assign_hand_track_id (palm_detection_result_t *detection, int *track_id)
+{
+    float box[MAX_PALM_NUM][4];
+
+    for (int hand_id = 0; hand_id < detection->num; hand_id ++)
+    {
+        palm_t *palm = &detection->palms[hand_id];
+        box[hand_id][0] = palm->hand_cx;
+        box[hand_id][1] = palm->hand_cy;
+        box[hand_id][2] = palm->hand_w;
+        box[hand_id][3] = palm->hand_h;
+    }
+
+    lmfilter_assign_tracks (&s_lmtracker, box, detection->num, HAND_TRACK_IOU_MIN, track_id);
 }
 
-void
-feed_hand_landmark_image(texture_2d_t *srctex, int win_w, int win_h, palm_detection_result_t *detection, unsigned int hand_id)
+static void
+smooth_hand_landmark (palm_t *palm, hand_landmark_result_t *hand_landmark, int track_id, double time_ms,
+                      int predict)
+{
+    lmfilter_roi_t roi = {palm->hand_cx, palm->hand_cy, palm->hand_w, palm->hand_h, palm->rotation};
+    float *joint = &hand_landmark->joint[0].x;
+
+    lmfilter_roi_to_image (&roi, joint, HAND_JOINT_NUM);
+
+    if (predict)
+        lmfilter_bank_predict (&s_lmfilter, track_id, joint, time_ms);
+    else
+        lmfilter_bank_apply (&s_lmfilter, track_id, joint, time_ms);
+
+    lmfilter_image_to_roi (&roi, joint, HAND_JOINT_NUM);
+}
+
+/* --------------------------------------------------------------------------- *
+ *  pipelined inference (-p option)
+ *
+ *    render thread : readback frame[N+2]
+ *    stage[0]      : palm detect   frame[N+1]
+ *    stage[1]      : hand landmark frame[N]
+ *
+ *  the throughput is bound by the slowest stage instead of the sum of them.
+ *  the stages crop their input on CPU from the RGBA copy of the frame,
+ *  because GL calls are allowed only on the render thread.
+ * --------------------------------------------------------------------------- */
+#define PIPELINE_NUM_FRAMES     3
+
+typedef struct _handpose_frame_t
+{
+    unsigned char           *rgba;          /* input image (top row first) */
+    int                     w, h;
+    int                     palm_detect;    /* 0: use the whole image as a hand ROI */
+    palm_detection_result_t palm;
+    hand_landmark_result_t  hand[MAX_PALM_NUM];
+    double                  invoke_ms[2];
+} handpose_frame_t;
+
+static pipeline_t              s_pipeline;
+static preproc_t               s_preproc_frame;         /* render thread */
+static preproc_t               s_preproc_detect_cpu;    /* stage[0] */
+static preproc_t               s_preproc_landmark_cpu;  /* stage[1] */
+
+static palm_detection_result_t s_pipeline_palm;         /* the latest result */
+static hand_landmark_result_t  s_pipeline_hand[MAX_PALM_NUM];
+static double                  s_pipeline_invoke_ms[2];
+
+static int
+stage_palm_detection (void *frame_ptr, void *usr)
 {
-    int x, y, w, h;
+    handpose_frame_t *frame = (handpose_frame_t *)frame_ptr;
+    int w, h;
+    float *buf_fp32 = (float *)get_palm_detection_input_buf (&w, &h);
+    UNUSED (usr);
+
+    frame->invoke_ms[0] = 0;
+    if (frame->palm_detect == 0)
+        return invoke_palm_detection (&frame->palm, 1);
+
+    preprocess_buffer (&s_preproc_detect_cpu, frame->rgba, frame->w, frame->h, NULL);
+    preprocess_get_tensor (&s_preproc_detect_cpu, buf_fp32);
+
+    double t0 = pmeter_get_time_ms ();
+    int ret = invoke_palm_detection (&frame->palm, 0);
+    frame->invoke_ms[0] = pmeter_get_time_ms () - t0;
+
+    return ret;
+}
+
+static int
+stage_hand_landmark (void *frame_ptr, void *usr)
+{
+    handpose_frame_t *frame = (handpose_frame_t *)frame_ptr;
+    int w, h;
+    UNUSED (usr);
+
+    frame->invoke_ms[1] = 0;
+    if (pipeline_frame_failed (&s_pipeline, frame))
+        return -1;
+
+    /* all the hands in one batch */
+    int num_hands = frame->palm.num;
+    int num_batch = (num_hands > 0) ? set_hand_landmark_batch (num_hands) : 1;
     float *buf_fp32 = (float *)get_hand_landmark_input_buf (&w, &h);
-    unsigned char *buf_ui8 = NULL;
-    static unsigned char *pui8 = NULL;
 
-    if (pui8 == NULL)
-        pui8 = (unsigned char *)malloc(w * h * 4);
+    for (int hand_id = 0; hand_id < num_hands; hand_id += num_batch)
+    {
+        int batch = (num_hands - hand_id < num_batch) ? num_hands - hand_id : num_batch;
+
+        for (int i = 0; i < batch; i ++)
+        {
+            float *roi = (float *)frame->palm.palms[hand_id + i].hand_pos;
 
-    buf_ui8 = pui8;
+            preprocess_buffer (&s_preproc_landmark_cpu, frame->rgba, frame->w, frame->h, roi);
+            preprocess_get_tensor (&s_preproc_landmark_cpu, buf_fp32 + i * (w * h * 3));
+        }
 
-    float texcoord[] = { 0.0f, 1.0f,
-                         0.0f, 0.0f,
-                         1.0f, 1.0f,
-                         1.0f, 0.0f };
+        double t0 = pmeter_get_time_ms ();
+        invoke_hand_landmark_batch (&frame->hand[hand_id], batch);
+        frame->invoke_ms[1] += pmeter_get_time_ms () - t0;
+    }
 
-    if (detection->num > hand_id)
+    return 0;
+}
+
+static int
+init_handpose_pipeline (texture_2d_t *srctex)
+{
+    int w, h;
+
+    get_palm_detection_input_buf (&w, &h);
+    init_preprocess (&s_preproc_detect_cpu, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    get_hand_landmark_input_buf (&w, &h);
+    init_preprocess (&s_preproc_landmark_cpu, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    w = srctex->width;
+    h = srctex->height;
+    init_preprocess (&s_preproc_frame, PREPROC_BACKEND_DEFAULT, w, h, PREPROC_TYPE_RGBA8, 0.0f, 1.0f);
+
+    if (pipeline_init (&s_pipeline, PIPELINE_NUM_FRAMES, sizeof (handpose_frame_t)) != 0)
+        return -1;
+
+    for (int i = 0; i < PIPELINE_NUM_FRAMES; i ++)
     {
-        palm_t *palm = &(detection->palms[hand_id]);
-        float x0 = palm->hand_pos[0].x;
-        float y0 = palm->hand_pos[0].y;
-        float x1 = palm->hand_pos[1].x; //    0--------1
-        float y1 = palm->hand_pos[1].y; //    |        |
-        float x2 = palm->hand_pos[2].x; //    |        |
-        float y2 = palm->hand_pos[2].y; //    3--------2
-        float x3 = palm->hand_pos[3].x;
-        float y3 = palm->hand_pos[3].y;
-        texcoord[0] = x3;   texcoord[1] = y3;
-        texcoord[2] = x0;   texcoord[3] = y0;
-        texcoord[4] = x2;   texcoord[5] = y2;
-        texcoord[6] = x1;   texcoord[7] = y1;
+        handpose_frame_t *frame = (handpose_frame_t *)pipeline_get_frame (&s_pipeline, i);
+        frame->w    = w;
+        frame->h    = h;
+        frame->rgba = (unsigned char *)malloc (w * h * 4);
+        if (frame->rgba == NULL)
+        {
+            fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+            return -1;
+        }
     }
 
-    draw_2d_texture_ex_texcoord (srctex, 0, win_h - h, w, h, texcoord);
+    pipeline_add_stage (&s_pipeline, "palm_detection", stage_palm_detection, NULL);
+    pipeline_add_stage (&s_pipeline, "hand_landmark",  stage_hand_landmark,  NULL);
 
-    glPixelStorei (GL_PACK_ALIGNMENT, 4);
-    glReadPixels (0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, buf_ui8);
+    return pipeline_start (&s_pipeline);
+}
 
-    /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
-    float mean = 128.0f;
-    float std  = 128.0f;
-    for (y = 0; y < h; y ++)
+/*
+ *  push the current frame into the pipeline (skipped if all the contexts are busy),
+ *  and return the latest result which has come out of it.
+ */
+static void
+run_handpose_pipeline (texture_2d_t *srctex, int palm_detect, palm_detection_result_t *palm_ret,
+                       hand_landmark_result_t *hand_ret, double *invoke_ms)
+{
+    handpose_frame_t *frame = (handpose_frame_t *)pipeline_acquire_frame (&s_pipeline, 0);
+    if (frame)
+    {
+        preprocess_texture (&s_preproc_frame, srctex, NULL);
+        preprocess_get_tensor (&s_preproc_frame, frame->rgba);
+        frame->palm_detect = palm_detect;
+        pipeline_submit_frame (&s_pipeline, frame);
+    }
+    else
+    {
+        /* the frame is dropped. don't hand its readback to the next one. */
+        preprocess_reset (&s_preproc_frame);
+    }
+
+    while ((frame = (handpose_frame_t *)pipeline_poll_frame (&s_pipeline, 0)) != NULL)
     {
-        for (x = 0; x < w; x ++)
+        if (!pipeline_frame_failed (&s_pipeline, frame))
         {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
+            s_pipeline_palm = frame->palm;
+            for (int hand_id = 0; hand_id < frame->palm.num; hand_id ++)
+                s_pipeline_hand[hand_id] = frame->hand[hand_id];
+
+            s_pipeline_invoke_ms[0] = frame->invoke_ms[0];
+            s_pipeline_invoke_ms[1] = frame->invoke_ms[1];
         }
+        pipeline_release_frame (&s_pipeline, frame);
     }
 
-    return;
+    *palm_ret = s_pipeline_palm;
+    for (int hand_id = 0; hand_id < s_pipeline_palm.num; hand_id ++)
+        hand_ret[hand_id] = s_pipeline_hand[hand_id];
+
+    invoke_ms[0] = s_pipeline_invoke_ms[0];
+    invoke_ms[1] = s_pipeline_invoke_ms[1];
 }
 
 
+
 static void
 render_palm_region (int ofstx, int ofsty, int texw, int texh, palm_t *palm)
 {
@@ -377,7 +605,6 @@ render_skelton_3d (int ofstx, int ofsty, hand_landmark_result_t *hand_landmark,
     float col_green [] = {0.0f, 1.0f, 0.0f, 1.0f};
     float col_cyan  [] = {0.0f, 1.0f, 1.0f, 1.0f};
     float col_violet[] = {1.0f, 0.0f, 1.0f, 1.0f};
-    float col_palm[]   = {0.8f, 0.8f, 0.8f, 0.8f};
     float col_gray[]   = {0.0f, 0.0f, 0.0f, 0.5f};
     float col_node[]   = {1.0f, 1.0f, 1.0f, 1.0f};
 
@@ -392,7 +619,6 @@ render_skelton_3d (int ofstx, int ofsty, hand_landmark_result_t *hand_landmark,
     {
         float *colj;
         float *coln = col_node;
-        float *colp = col_palm;
 
         matrix_identity (mtxGlobal);
         matrix_translate (mtxGlobal, 0.0, 0.0, -s_gui_prop.camera_pos_z);
@@ -414,7 +640,6 @@ render_skelton_3d (int ofstx, int ofsty, hand_landmark_result_t *hand_landmark,
 
             colj = col_gray;
             coln = col_gray;
-            colp = col_gray;
         }
 
         /* joint point */
@@ -453,18 +678,31 @@ render_skelton_3d (int ofstx, int ofsty, hand_landmark_result_t *hand_landmark,
             render_3d_bone (mtxGlobal, &hand_draw, idx0+1,idx1+1, coln, rad, is_shadow);
             render_3d_bone (mtxGlobal, &hand_draw, idx0+2,idx1+2, coln, rad, is_shadow);
         }
-
-        /* palm region */
-        if (!is_shadow)
-        {
-            render_palm_tri (mtxGlobal, &hand_draw, 0,  1,  5, colp);
-            render_palm_tri (mtxGlobal, &hand_draw, 0,  5,  9, colp);
-            render_palm_tri (mtxGlobal, &hand_draw, 0,  9, 13, colp);
-            render_palm_tri (mtxGlobal, &hand_draw, 0, 13, 17, colp);
-        }
     }
 }
 
+/* translucent palm region. drawn after the shape batch to be over the bones. */
+static void
+render_palm_3d (hand_landmark_result_t *hand_landmark, palm_t *palm)
+{
+    float mtxGlobal[16], mtxTouch[16];
+    float col_palm[] = {0.8f, 0.8f, 0.8f, 0.8f};
+
+    get_touch_event_matrix (mtxTouch);
+
+    hand_landmark_result_t hand_draw;
+    compute_3d_skelton_pos (&hand_draw, hand_landmark, palm);
+
+    matrix_identity (mtxGlobal);
+    matrix_translate (mtxGlobal, 0.0, 0.0, -s_gui_prop.camera_pos_z);
+    matrix_mult (mtxGlobal, mtxGlobal, mtxTouch);
+
+    render_palm_tri (mtxGlobal, &hand_draw, 0,  1,  5, col_palm);
+    render_palm_tri (mtxGlobal, &hand_draw, 0,  5,  9, col_palm);
+    render_palm_tri (mtxGlobal, &hand_draw, 0,  9, 13, col_palm);
+    render_palm_tri (mtxGlobal, &hand_draw, 0, 13, 17, col_palm);
+}
+
 static void
 render_3d_scene (int ofstx, int ofsty,
                  hand_landmark_result_t  *landmark,
@@ -486,6 +724,7 @@ render_3d_scene (int ofstx, int ofsty,
     matrix_translate (mtxGlobal, 0, 1.0, 0);
     draw_floor (mtxGlobal, floor_size_x/10, floor_size_y/10);
 
+    begin_shape_batch ();
     for (int hand_id = 0; hand_id < detection->num; hand_id ++)
     {
         hand_landmark_result_t *hand_landmark = &landmark[hand_id];
@@ -535,6 +774,11 @@ render_3d_scene (int ofstx, int ofsty,
             }
         }
     }
+
+    end_shape_batch ();
+
+    for (int hand_id = 0; hand_id < detection->num; hand_id ++)
+        render_palm_3d (&landmark[hand_id], &detection->palms[hand_id]);
 }
 
 
@@ -682,6 +926,15 @@ main(int argc, char *argv[])
     int use_quantized_tflite = 0;
     int enable_palm_detect = 0;
     int enable_camera = 1;
+    int enable_pipeline = 0;
+    int track_interval = 0;
+    int track_age = 0;
+    int lmfilter_type = LMFILTER_NONE;
+    float target_fps = 0;
+    sched_t sched;
+    palm_detection_result_t palm_track_ret = {0};
+    palm_detection_result_t palm_last = {0};
+    static hand_landmark_result_t hand_last[MAX_PALM_NUM];
     UNUSED (argc);
     UNUSED (*argv);
 #if defined (USE_INPUT_VIDEO_DECODE)
@@ -690,7 +943,7 @@ main(int argc, char *argv[])
 
     {
         int c;
-        const char *optstring = "mqv:x";
+        const char *optstring = "mpr:s:t:qv:x";
 
         while ((c = getopt (argc, argv, optstring)) != -1)
         {
@@ -699,6 +952,18 @@ main(int argc, char *argv[])
             case 'm':
                 enable_palm_detect = 1;
                 break;
+            case 'p':
+                enable_pipeline = 1;
+                break;
+            case 'r':
+                target_fps = atof (optarg);
+                break;
+            case 's':
+                lmfilter_type = atoi (optarg);
+                break;
+            case 't':
+                track_interval = atoi (optarg);
+                break;
             case 'q':
                 use_quantized_tflite = 1;
                 break;
@@ -728,7 +993,37 @@ main(int argc, char *argv[])
     init_dbgstr (win_w, win_h);
     init_cube ((float)win_w / (float)win_h);
 
+#if defined (USE_GL_DELEGATE) || defined (USE_GPU_DELEGATEV2)
+    if (enable_pipeline)
+    {
+        /* GPU Delegate must be invoked on the thread which owns the EGL context */
+        fprintf (stderr, "pipelined inference is not available with GPU Delegate.\n");
+        enable_pipeline = 0;
+    }
+#endif
+    if (enable_pipeline && track_interval > 0)
+    {
+        /* the ROI of a frame depends on the landmarks of the previous frame */
+        fprintf (stderr, "ROI tracking is not available with pipelined inference.\n");
+        track_interval = 0;
+    }
+    if (enable_pipeline && target_fps > 0)
+    {
+        /* the pipeline already decouples the inference from the rendering */
+        fprintf (stderr, "adaptive inference rate is not available with pipelined inference.\n");
+        target_fps = 0;
+    }
+    if (enable_pipeline)
+        enable_tflite_concurrent_invoke ();
+
+    sched_init (&sched, target_fps, MAX_INFER_INTERVAL);
+
     init_tflite_hand_landmark (use_quantized_tflite);
+
+    lmfilter_param_t lmfilter_param;
+    lmfilter_default_param (&lmfilter_param, lmfilter_type);
+    lmfilter_init_bank (&s_lmfilter, &lmfilter_param, MAX_PALM_NUM, HAND_JOINT_NUM * 3);
+    lmfilter_init_tracker (&s_lmtracker);
     setup_imgui (win_w * 2, win_h);
 
 #if defined (USE_GL_DELEGATE) || defined (USE_GPU_DELEGATEV2)
@@ -771,6 +1066,12 @@ main(int argc, char *argv[])
 
     glClearColor (0.f, 0.f, 0.f, 1.0f);
 
+    if (enable_pipeline && init_handpose_pipeline (&captex) != 0)
+    {
+        fprintf (stderr, "failed to start the pipeline. run serially.\n");
+        enable_pipeline = 0;
+    }
+
     /* --------------------------------------- *
      *  Render Loop
      * --------------------------------------- */
@@ -778,6 +1079,7 @@ main(int argc, char *argv[])
     {
         palm_detection_result_t palm_ret = {0};
         hand_landmark_result_t  hand_ret[MAX_PALM_NUM] = {0};
+        int run_infer = 1;
         char strbuf[512];
 
         PMETER_RESET_LAP ();
@@ -804,35 +1106,92 @@ main(int argc, char *argv[])
         }
 #endif
 
-        /* --------------------------------------- *
-         *  palm detection
-         * --------------------------------------- */
-        if (enable_palm_detect)
+        if (enable_pipeline)
         {
-            feed_palm_detection_image (&captex, win_w, win_h);
-
-            ttime[2] = pmeter_get_time_ms ();
-            invoke_palm_detection (&palm_ret, 0);
-            ttime[3] = pmeter_get_time_ms ();
-            invoke_ms0 = ttime[3] - ttime[2];
+            double invoke_ms[2];
+            run_handpose_pipeline (&captex, enable_palm_detect, &palm_ret, hand_ret, invoke_ms);
+            invoke_ms0 = invoke_ms[0];
+            invoke_ms1 = invoke_ms[1];
+        }
+        else if (!sched_begin_frame (&sched))
+        {
+            /* no inference in this frame (-r option): reuse the last results */
+            palm_ret = palm_last;
+            memcpy (hand_ret, hand_last, sizeof (hand_ret));
+            run_infer = 0;
         }
         else
         {
-            invoke_palm_detection (&palm_ret, 1);
+            /* --------------------------------------- *
+             *  palm detection
+             *  (skipped while the hands are tracked)
+             * --------------------------------------- */
+            sched_stage_begin (&sched, 0);
+            if (palm_track_ret.num > 0 && track_age < track_interval)
+            {
+                palm_ret = palm_track_ret;
+                invoke_ms0 = 0;
+                track_age ++;
+                preprocess_reset (&s_preproc_detect);
+            }
+            else if (enable_palm_detect)
+            {
+                feed_palm_detection_image (&captex, win_w, win_h);
+
+                ttime[2] = pmeter_get_time_ms ();
+                invoke_palm_detection (&palm_ret, 0);
+                ttime[3] = pmeter_get_time_ms ();
+                invoke_ms0 = ttime[3] - ttime[2];
+                track_age = 0;
+            }
+            else
+            {
+                invoke_palm_detection (&palm_ret, 1);
+                track_age = 0;
+                preprocess_reset (&s_preproc_detect);
+            }
+            sched_stage_end (&sched, 0);
+
+            /* --------------------------------------- *
+             *  hand landmark (all the hands in one batch)
+             * --------------------------------------- */
+            int num_hands = palm_ret.num;
+            int num_batch = (num_hands > 0) ? set_hand_landmark_batch (num_hands) : 1;
+
+            invoke_ms1 = 0;
+            sched_stage_begin (&sched, 1);
+            for (int hand_id = 0; hand_id < num_hands; hand_id += num_batch)
+            {
+                int batch = (num_hands - hand_id < num_batch) ? num_hands - hand_id : num_batch;
+
+                for (int i = 0; i < batch; i ++)
+                    feed_hand_landmark_image (&captex, win_w, win_h, &palm_ret, hand_id + i, i);
+
+                ttime[4] = pmeter_get_time_ms ();
+                invoke_hand_landmark_batch (&hand_ret[hand_id], batch);
+                ttime[5] = pmeter_get_time_ms ();
+                invoke_ms1 += ttime[5] - ttime[4];
+            }
+            reset_hand_landmark_preproc (num_hands);
+            sched_stage_end (&sched, 1);
+
+            if (track_interval > 0)
+                update_hand_track (&palm_track_ret, &palm_ret, hand_ret);
+
+            palm_last = palm_ret;
+            memcpy (hand_last, hand_ret, sizeof (hand_ret));
         }
 
         /* --------------------------------------- *
-         *  hand landmark
+         *  landmark smoothing
          * --------------------------------------- */
-        invoke_ms1 = 0;
-        for (int hand_id = 0; hand_id < palm_ret.num; hand_id ++)
+        if (lmfilter_type != LMFILTER_NONE)
         {
-            feed_hand_landmark_image (&captex, win_w, win_h, &palm_ret, hand_id);
+            int track_id[MAX_PALM_NUM];
+            assign_hand_track_id (&palm_ret, track_id);
 
-            ttime[4] = pmeter_get_time_ms ();
-            invoke_hand_landmark (&hand_ret[hand_id]);
-            ttime[5] = pmeter_get_time_ms ();
-            invoke_ms1 += ttime[5] - ttime[4];
+            for (int hand_id = 0; hand_id < palm_ret.num; hand_id ++)
+                smooth_hand_landmark (&palm_ret.palms[hand_id], &hand_ret[hand_id], track_id[hand_id], ttime[1], !run_infer);
         }
 
         /* --------------------------------------- *
@@ -840,9 +1199,15 @@ main(int argc, char *argv[])
          * --------------------------------------- */
         glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        /* all the strings of the left half in one draw call */
+        begin_dbgstr_batch ();
+
         /* visualize the hand pose estimation results. */
         draw_2d_texture_ex (&captex, draw_x, draw_y, draw_w, draw_h, 0);
 
+        /* all the 2D overlays of the left half in one draw call */
+        begin_2d_batch ();
+
         for (int hand_id = 0; hand_id < palm_ret.num; hand_id ++)
         {
             palm_t *palm = &(palm_ret.palms[hand_id]);
@@ -866,6 +1231,9 @@ main(int argc, char *argv[])
         /* --------------------------------------- *
          *  render scene  (right half)
          * --------------------------------------- */
+        /* the batched primitives are mapped with the viewport of the left half */
+        end_2d_batch ();
+        end_dbgstr_batch ();
         glViewport (win_w, 0, win_w, win_h);
         render_3d_scene (draw_x, draw_y, hand_ret, &palm_ret);
 
@@ -874,6 +1242,7 @@ main(int argc, char *argv[])
          *  post process
          * --------------------------------------- */
         glViewport (0, 0, win_w, win_h);
+        begin_dbgstr_batch ();
 
         if (s_gui_prop.draw_pmeter)
         {
@@ -884,6 +1253,8 @@ main(int argc, char *argv[])
             interval, invoke_ms0, invoke_ms1);
         draw_dbgstr (strbuf, 10, 10);
 
+        end_dbgstr_batch ();
+
 #if defined (USE_IMGUI)
         invoke_imgui (&s_gui_prop);
 #endif
@@ -6,8 +6,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stddef.h>
 #include <pthread.h>
+#if defined (USE_GLES_31)
+#include <GLES3/gl31.h>
+#elif defined (USE_GLES_30)
+#include <GLES3/gl3.h>
+#else
 #include <GLES2/gl2.h>
+#endif
 #include "util_egl.h"
 #include "assertgl.h"
 #include "util_shader.h"
@@ -35,6 +42,80 @@ static GLint        s_loc_lightpos;
 static shape_obj_t  s_sphere;
 static shape_obj_t  s_cylinder;
 
+/* ---------------------------------------------------------------- *
+ *  batch of bones and joints.
+ *
+ *  between begin_shape_batch() and end_shape_batch(), draw_bone() and
+ *  draw_sphere() only queue their transforms. there is one queue for
+ *  each (shape, pass), and end_shape_batch() draws each queue once:
+ *    GLES3: one glDrawElementsInstanced() with per-instance attributes.
+ *    GLES2: the shapes are transformed on CPU and merged into one VBO.
+ *  the passes are drawn in the order of shadow, opaque and translucent.
+ *  the floor, lines and triangles are not queued, so the ones drawn in
+ *  the batch are under the queued shapes.
+ * ---------------------------------------------------------------- */
+#define MAX_SHAPE_INSTANCE  256
+
+enum shape_pass
+{
+    SHAPE_PASS_SHADOW = 0,      /* projected on the floor, no depth test */
+    SHAPE_PASS_OPAQUE,
+    SHAPE_PASS_BLEND,           /* alpha < 1.0 */
+    SHAPE_PASS_NUM
+};
+
+enum shape_id
+{
+    SHAPE_ID_SPHERE = 0,
+    SHAPE_ID_CYLINDER,
+    SHAPE_ID_NUM
+};
+
+typedef struct _shape_instance_t
+{
+    float   mtx_mv[16];         /* mtxGlobal * model         */
+    float   mtx_nrm[9];         /* inverse transpose of model */
+    float   color[4];
+} shape_instance_t;
+
+typedef struct _shape_queue_t
+{
+    int             num_inst;
+    shape_instance_t inst[MAX_SHAPE_INSTANCE];
+} shape_queue_t;
+
+typedef struct _shape_batch_t
+{
+    int             active;
+    shape_queue_t   queue[SHAPE_PASS_NUM][SHAPE_ID_NUM];
+} shape_batch_t;
+
+#if !defined (USE_GLES_30) && !defined (USE_GLES_31)
+typedef struct _merged_vtx_t
+{
+    float   pos[3];             /* eye coordinate */
+    float   nrm[3];
+    float   col[4];
+} merged_vtx_t;
+#endif
+
+static shape_batch_t s_batch;
+static shader_obj_t  s_sobj_inst;
+static GLint        s_loc_inst_prj;
+static GLint        s_loc_inst_lightpos;
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+static GLint        s_loc_inst_mtx_mv;
+static GLint        s_loc_inst_mtx_nrm;
+static GLuint       s_vbo_inst;
+#else
+static GLuint       s_vbo_merged_vtx;
+static GLuint       s_vbo_merged_idx;
+static merged_vtx_t   *s_merged_vtx;
+static unsigned short *s_merged_idx;
+static int          s_merged_max_vtx;
+static int          s_merged_max_idx;
+#endif
+
 static GLfloat s_vtx[] =
 {
     -1.0f, 1.0f,  1.0f,
@@ -168,6 +249,109 @@ void main(void)                                             \n\
     gl_FragColor = vec4(color, u_alpha);                    \n\
 }                                                           ";
 
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+/* model-view matrices and colors are per-instance attributes */
+static char s_strVS_inst[] = "                              \n\
+                                                            \n\
+attribute vec4  a_Vertex;                                   \n\
+attribute vec3  a_Normal;                                   \n\
+attribute vec4  a_Color;                                    \n\
+attribute mat4  a_MVMatrix;                                 \n\
+attribute mat3  a_ModelViewIT;                              \n\
+uniform   mat4  u_PrjMatrix;                                \n\
+varying   vec3  v_diffuse;                                  \n\
+varying   vec3  v_specular;                                 \n\
+varying   vec4  v_color;                                    \n\
+const     float shiness = 16.0;                             \n\
+uniform   vec3  u_LightPos;                                 \n\
+const     vec3  LightCol = vec3(1.0, 1.0, 1.0);             \n\
+                                                            \n\
+void DirectionalLight (vec3 normal, vec3 eyePos)            \n\
+{                                                           \n\
+    vec3  lightDir = normalize (u_LightPos);                \n\
+    vec3  halfV    = normalize (u_LightPos - eyePos);       \n\
+    float dVP      = max(dot(normal, lightDir), 0.0);       \n\
+    float dHV      = max(dot(normal, halfV   ), 0.0);       \n\
+                                                            \n\
+    float pf = 0.0;                                         \n\
+    if(dVP > 0.0)                                           \n\
+        pf = pow(dHV, shiness);                             \n\
+                                                            \n\
+    v_diffuse += dVP * LightCol;                            \n\
+    v_specular+= pf  * LightCol * 0.5;                      \n\
+}                                                           \n\
+                                                            \n\
+void main(void)                                             \n\
+{                                                           \n\
+    vec4 eyePos = a_MVMatrix * a_Vertex;                    \n\
+    gl_Position = u_PrjMatrix * eyePos;                     \n\
+    vec3 normal = normalize(a_ModelViewIT * a_Normal);      \n\
+                                                            \n\
+    v_diffuse  = vec3(0.5);                                 \n\
+    v_specular = vec3(0.0);                                 \n\
+    DirectionalLight(normal, eyePos.xyz);                   \n\
+                                                            \n\
+    v_diffuse = clamp(v_diffuse, 0.0, 1.0);                 \n\
+    v_color   = a_Color;                                    \n\
+}                                                           ";
+#else
+/* the vertices are already transformed to the eye coordinate on CPU */
+static char s_strVS_inst[] = "                              \n\
+                                                            \n\
+attribute vec4  a_Vertex;                                   \n\
+attribute vec3  a_Normal;                                   \n\
+attribute vec4  a_Color;                                    \n\
+uniform   mat4  u_PrjMatrix;                                \n\
+varying   vec3  v_diffuse;                                  \n\
+varying   vec3  v_specular;                                 \n\
+varying   vec4  v_color;                                    \n\
+const     float shiness = 16.0;                             \n\
+uniform   vec3  u_LightPos;                                 \n\
+const     vec3  LightCol = vec3(1.0, 1.0, 1.0);             \n\
+                                                            \n\
+void DirectionalLight (vec3 normal, vec3 eyePos)            \n\
+{                                                           \n\
+    vec3  lightDir = normalize (u_LightPos);                \n\
+    vec3  halfV    = normalize (u_LightPos - eyePos);       \n\
+    float dVP      = max(dot(normal, lightDir), 0.0);       \n\
+    float dHV      = max(dot(normal, halfV   ), 0.0);       \n\
+                                                            \n\
+    float pf = 0.0;                                         \n\
+    if(dVP > 0.0)                                           \n\
+        pf = pow(dHV, shiness);                             \n\
+                                                            \n\
+    v_diffuse += dVP * LightCol;                            \n\
+    v_specular+= pf  * LightCol * 0.5;                      \n\
+}                                                           \n\
+                                                            \n\
+void main(void)                                             \n\
+{                                                           \n\
+    gl_Position = u_PrjMatrix * a_Vertex;                   \n\
+    vec3 normal = normalize(a_Normal);                      \n\
+                                                            \n\
+    v_diffuse  = vec3(0.5);                                 \n\
+    v_specular = vec3(0.0);                                 \n\
+    DirectionalLight(normal, a_Vertex.xyz);                 \n\
+                                                            \n\
+    v_diffuse = clamp(v_diffuse, 0.0, 1.0);                 \n\
+    v_color   = a_Color;                                    \n\
+}                                                           ";
+#endif
+
+static char s_strFS_inst[] = "                              \n\
+precision mediump float;                                    \n\
+                                                            \n\
+varying vec3    v_diffuse;                                  \n\
+varying vec3    v_specular;                                 \n\
+varying vec4    v_color;                                    \n\
+                                                            \n\
+void main(void)                                             \n\
+{                                                           \n\
+    vec3 color = v_color.rgb * v_diffuse;                   \n\
+    //color += v_specular;                                  \n\
+    gl_FragColor = vec4(color, v_color.a);                  \n\
+}                                                           ";
+
 
 static void
 compute_invmat3x3 (float *matMVI3x3, float *matMV)
@@ -188,6 +372,366 @@ compute_invmat3x3 (float *matMVI3x3, float *matMV)
     matMVI3x3[8] = matMVI4x4[10];
 }
 
+
+/* ---------------------------------------------------------------- *
+ *  draw a sphere or a cylinder with its own draw call.
+ * ---------------------------------------------------------------- */
+static int
+draw_shape (shape_obj_t *shape, float *mtxGlobal, float *matModel, float *color, int is_shadow)
+{
+    float matMV[16], matPMV[16], matMVI3x3[9];
+
+    if (is_shadow)
+        glDisable (GL_DEPTH_TEST);
+    else
+        glEnable (GL_DEPTH_TEST);
+
+    glEnable (GL_CULL_FACE);
+    glFrontFace (GL_CW);
+
+    glUseProgram( s_sobj.program );
+
+    glEnableVertexAttribArray (s_sobj.loc_vtx);
+    glEnableVertexAttribArray (s_sobj.loc_nrm);
+    glEnableVertexAttribArray (s_sobj.loc_uv );
+
+    compute_invmat3x3 (matMVI3x3, matModel);
+
+    matrix_mult (matMV, mtxGlobal, matModel);
+    matrix_mult (matPMV, s_matPrj, matMV);
+
+    glUniformMatrix4fv (s_loc_mtx_mv,   1, GL_FALSE, matMV );
+    glUniformMatrix4fv (s_loc_mtx_pmv,  1, GL_FALSE, matPMV);
+    glUniformMatrix3fv (s_loc_mtx_nrm,  1, GL_FALSE, matMVI3x3);
+    glUniform3f (s_loc_lightpos, 1.0f, 1.0f, 1.0f);
+    glUniform3f (s_loc_color, color[0], color[1], color[2]);
+    glUniform1f (s_loc_alpha, color[3]);
+
+    if (color[3] < 1.0f)
+        glEnable (GL_BLEND);
+
+    glBindTexture (GL_TEXTURE_2D, s_texid_dummy);
+
+    glBindBuffer (GL_ARRAY_BUFFER, shape->vbo_vtx);
+    glVertexAttribPointer (s_sobj.loc_vtx, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glBindBuffer (GL_ARRAY_BUFFER, shape->vbo_nrm);
+    glVertexAttribPointer (s_sobj.loc_nrm, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glBindBuffer (GL_ARRAY_BUFFER, shape->vbo_uv);
+    glVertexAttribPointer (s_sobj.loc_uv,  2, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, shape->vbo_idx);
+    glDrawElements (GL_TRIANGLES, shape->num_faces * 3, GL_UNSIGNED_SHORT, 0);
+
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glFrontFace (GL_CCW);
+    glDisable (GL_BLEND);
+    glDisable (GL_DEPTH_TEST);
+    glDisable (GL_CULL_FACE);
+
+    return 0;
+}
+
+
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+/* ---------------------------------------------------------------- *
+ *  GLES3: one instanced draw. the transforms and colors are
+ *  per-instance attributes.
+ * ---------------------------------------------------------------- */
+static int
+draw_shape_instanced (shape_obj_t *shape, shape_instance_t *inst, int num_inst)
+{
+    GLsizei stride = sizeof (shape_instance_t);
+    GLint   loc_clr = s_sobj_inst.loc_clr;
+
+    glBindBuffer (GL_ARRAY_BUFFER, s_vbo_inst);
+    glBufferData (GL_ARRAY_BUFFER, sizeof (shape_instance_t) * MAX_SHAPE_INSTANCE, NULL, GL_STREAM_DRAW);
+    glBufferSubData (GL_ARRAY_BUFFER, 0, stride * num_inst, inst);
+
+    /* a mat4 attribute occupies 4 locations, a mat3 occupies 3 */
+    for (int i = 0; i < 4; i ++)
+    {
+        GLint loc = s_loc_inst_mtx_mv + i;
+        glEnableVertexAttribArray (loc);
+        glVertexAttribPointer (loc, 4, GL_FLOAT, GL_FALSE, stride,
+                               (void *)(offsetof (shape_instance_t, mtx_mv) + sizeof (float) * 4 * i));
+        glVertexAttribDivisor (loc, 1);
+    }
+    for (int i = 0; i < 3; i ++)
+    {
+        GLint loc = s_loc_inst_mtx_nrm + i;
+        glEnableVertexAttribArray (loc);
+        glVertexAttribPointer (loc, 3, GL_FLOAT, GL_FALSE, stride,
+                               (void *)(offsetof (shape_instance_t, mtx_nrm) + sizeof (float) * 3 * i));
+        glVertexAttribDivisor (loc, 1);
+    }
+    glEnableVertexAttribArray (loc_clr);
+    glVertexAttribPointer (loc_clr, 4, GL_FLOAT, GL_FALSE, stride, (void *)offsetof (shape_instance_t, color));
+    glVertexAttribDivisor (loc_clr, 1);
+
+    glEnableVertexAttribArray (s_sobj_inst.loc_vtx);
+    glBindBuffer (GL_ARRAY_BUFFER, shape->vbo_vtx);
+    glVertexAttribPointer (s_sobj_inst.loc_vtx, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glEnableVertexAttribArray (s_sobj_inst.loc_nrm);
+    glBindBuffer (GL_ARRAY_BUFFER, shape->vbo_nrm);
+    glVertexAttribPointer (s_sobj_inst.loc_nrm, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, shape->vbo_idx);
+    glDrawElementsInstanced (GL_TRIANGLES, shape->num_faces * 3, GL_UNSIGNED_SHORT, 0, num_inst);
+
+    /* the divisor is a state of the attribute location, not of the program */
+    for (int i = 0; i < 4; i ++)
+    {
+        glVertexAttribDivisor (s_loc_inst_mtx_mv + i, 0);
+        glDisableVertexAttribArray (s_loc_inst_mtx_mv + i);
+    }
+    for (int i = 0; i < 3; i ++)
+    {
+        glVertexAttribDivisor (s_loc_inst_mtx_nrm + i, 0);
+        glDisableVertexAttribArray (s_loc_inst_mtx_nrm + i);
+    }
+    glVertexAttribDivisor (loc_clr, 0);
+    glDisableVertexAttribArray (loc_clr);
+    glDisableVertexAttribArray (s_sobj_inst.loc_vtx);
+    glDisableVertexAttribArray (s_sobj_inst.loc_nrm);
+
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    return 0;
+}
+
+#else
+/* ---------------------------------------------------------------- *
+ *  GLES2: transform the shapes on CPU and merge them into one VBO.
+ *  the indices are 16bit, so it is split into several draws if the
+ *  merged vertices exceed 65536.
+ * ---------------------------------------------------------------- */
+static int
+alloc_merged_buffer (int num_inst, shape_obj_t *shape)
+{
+    int num_vtx = num_inst * shape->num_vertex;
+    int num_idx = num_inst * shape->num_faces * 3;
+
+    if (num_vtx > s_merged_max_vtx)
+    {
+        merged_vtx_t *p = (merged_vtx_t *)realloc (s_merged_vtx, sizeof (merged_vtx_t) * num_vtx);
+        if (p == NULL)
+        {
+            fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+            return -1;
+        }
+        s_merged_vtx     = p;
+        s_merged_max_vtx = num_vtx;
+    }
+
+    if (num_idx > s_merged_max_idx)
+    {
+        unsigned short *p = (unsigned short *)realloc (s_merged_idx, sizeof (unsigned short) * num_idx);
+        if (p == NULL)
+        {
+            fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+            return -1;
+        }
+        s_merged_idx     = p;
+        s_merged_max_idx = num_idx;
+    }
+    return 0;
+}
+
+static int
+draw_shape_merged (shape_obj_t *shape, shape_instance_t *inst, int num_inst)
+{
+    int num_vtx = shape->num_vertex;
+    int num_idx = shape->num_faces * 3;
+    int max_inst = 65536 / num_vtx;
+    GLsizei stride = sizeof (merged_vtx_t);
+
+    if (max_inst > num_inst)
+        max_inst = num_inst;
+
+    if (alloc_merged_buffer (max_inst, shape) < 0)
+        return -1;
+
+    glBindBuffer (GL_ARRAY_BUFFER, s_vbo_merged_vtx);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, s_vbo_merged_idx);
+
+    glEnableVertexAttribArray (s_sobj_inst.loc_vtx);
+    glEnableVertexAttribArray (s_sobj_inst.loc_nrm);
+    glEnableVertexAttribArray (s_sobj_inst.loc_clr);
+    glVertexAttribPointer (s_sobj_inst.loc_vtx, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof (merged_vtx_t, pos));
+    glVertexAttribPointer (s_sobj_inst.loc_nrm, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof (merged_vtx_t, nrm));
+    glVertexAttribPointer (s_sobj_inst.loc_clr, 4, GL_FLOAT, GL_FALSE, stride, (void *)offsetof (merged_vtx_t, col));
+
+    for (int i0 = 0; i0 < num_inst; i0 += max_inst)
+    {
+        int n = num_inst - i0;
+        if (n > max_inst)
+            n = max_inst;
+
+        merged_vtx_t   *vtx = s_merged_vtx;
+        unsigned short *idx = s_merged_idx;
+        for (int i = 0; i < n; i ++)
+        {
+            float *m  = inst[i0 + i].mtx_mv;
+            float *mn = inst[i0 + i].mtx_nrm;
+            float *col= inst[i0 + i].color;
+
+            for (int j = 0; j < num_vtx; j ++, vtx ++)
+            {
+                float *v  = &shape->vertex[j * 3];
+                float *vn = &shape->normal[j * 3];
+
+                vtx->pos[0] = m[0] * v[0] + m[4] * v[1] + m[ 8] * v[2] + m[12];
+                vtx->pos[1] = m[1] * v[0] + m[5] * v[1] + m[ 9] * v[2] + m[13];
+                vtx->pos[2] = m[2] * v[0] + m[6] * v[1] + m[10] * v[2] + m[14];
+
+                vtx->nrm[0] = mn[0] * vn[0] + mn[3] * vn[1] + mn[6] * vn[2];
+                vtx->nrm[1] = mn[1] * vn[0] + mn[4] * vn[1] + mn[7] * vn[2];
+                vtx->nrm[2] = mn[2] * vn[0] + mn[5] * vn[1] + mn[8] * vn[2];
+
+                memcpy (vtx->col, col, sizeof (float) * 4);
+            }
+
+            for (int j = 0; j < num_idx; j ++)
+                *idx ++ = i * num_vtx + shape->index[j];
+        }
+
+        /* orphan the buffers not to wait for the previous draw */
+        glBufferData (GL_ARRAY_BUFFER, sizeof (merged_vtx_t) * s_merged_max_vtx, NULL, GL_STREAM_DRAW);
+        glBufferSubData (GL_ARRAY_BUFFER, 0, sizeof (merged_vtx_t) * n * num_vtx, s_merged_vtx);
+        glBufferData (GL_ELEMENT_ARRAY_BUFFER, sizeof (unsigned short) * s_merged_max_idx, NULL, GL_STREAM_DRAW);
+        glBufferSubData (GL_ELEMENT_ARRAY_BUFFER, 0, sizeof (unsigned short) * n * num_idx, s_merged_idx);
+
+        glDrawElements (GL_TRIANGLES, n * num_idx, GL_UNSIGNED_SHORT, 0);
+    }
+
+    glDisableVertexAttribArray (s_sobj_inst.loc_vtx);
+    glDisableVertexAttribArray (s_sobj_inst.loc_nrm);
+    glDisableVertexAttribArray (s_sobj_inst.loc_clr);
+
+    glBindBuffer (GL_ARRAY_BUFFER, 0);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    return 0;
+}
+#endif
+
+
+static shape_obj_t *
+get_shape (int shape_id)
+{
+    return (shape_id == SHAPE_ID_SPHERE) ? &s_sphere : &s_cylinder;
+}
+
+static void
+begin_shape_pass (int pass)
+{
+    if (pass == SHAPE_PASS_SHADOW)
+        glDisable (GL_DEPTH_TEST);
+    else
+        glEnable (GL_DEPTH_TEST);
+
+    glEnable (GL_CULL_FACE);
+    glFrontFace (GL_CW);
+
+    if (pass != SHAPE_PASS_OPAQUE)
+        glEnable (GL_BLEND);
+
+    glUseProgram (s_sobj_inst.program);
+    glUniformMatrix4fv (s_loc_inst_prj, 1, GL_FALSE, s_matPrj);
+    glUniform3f (s_loc_inst_lightpos, 1.0f, 1.0f, 1.0f);
+}
+
+static void
+end_shape_pass ()
+{
+    glFrontFace (GL_CCW);
+    glDisable (GL_BLEND);
+    glDisable (GL_DEPTH_TEST);
+    glDisable (GL_CULL_FACE);
+}
+
+static int
+draw_shape_queue (int pass, int shape_id)
+{
+    shape_queue_t *queue = &s_batch.queue[pass][shape_id];
+    int ret;
+
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+    ret = draw_shape_instanced (get_shape (shape_id), queue->inst, queue->num_inst);
+#else
+    ret = draw_shape_merged (get_shape (shape_id), queue->inst, queue->num_inst);
+#endif
+
+    queue->num_inst = 0;
+    return ret;
+}
+
+int
+begin_shape_batch ()
+{
+    memset (s_batch.queue, 0, sizeof (s_batch.queue));
+    s_batch.active = 1;
+    return 0;
+}
+
+int
+end_shape_batch ()
+{
+    int ret = 0;
+
+    for (int pass = 0; pass < SHAPE_PASS_NUM; pass ++)
+    {
+        int num_inst = 0;
+        for (int shape_id = 0; shape_id < SHAPE_ID_NUM; shape_id ++)
+            num_inst += s_batch.queue[pass][shape_id].num_inst;
+
+        if (num_inst == 0)
+            continue;
+
+        begin_shape_pass (pass);
+        for (int shape_id = 0; shape_id < SHAPE_ID_NUM; shape_id ++)
+        {
+            if (s_batch.queue[pass][shape_id].num_inst > 0)
+                ret |= draw_shape_queue (pass, shape_id);
+        }
+        end_shape_pass ();
+    }
+
+    s_batch.active = 0;
+    return ret;
+}
+
+static int
+submit_shape (int shape_id, float *mtxGlobal, float *matModel, float *color, int is_shadow)
+{
+    if (!s_batch.active)
+        return draw_shape (get_shape (shape_id), mtxGlobal, matModel, color, is_shadow);
+
+    int pass = is_shadow ? SHAPE_PASS_SHADOW : (color[3] < 1.0f) ? SHAPE_PASS_BLEND : SHAPE_PASS_OPAQUE;
+    shape_queue_t *queue = &s_batch.queue[pass][shape_id];
+
+    /* a full queue is drawn ahead. it happens only with too many subjects. */
+    if (queue->num_inst >= MAX_SHAPE_INSTANCE)
+    {
+        begin_shape_pass (pass);
+        draw_shape_queue (pass, shape_id);
+        end_shape_pass ();
+    }
+
+    shape_instance_t *inst = &queue->inst[queue->num_inst ++];
+    compute_invmat3x3 (inst->mtx_nrm, matModel);
+    matrix_mult (inst->mtx_mv, mtxGlobal, matModel);
+    memcpy (inst->color, color, sizeof (float) * 4);
+
+    return 0;
+}
+
 int
 draw_cube (float *mtxGlobal, float *color)
 {
@@ -265,6 +809,19 @@ init_cube (float aspect)
     shape_create (SHAPE_SPHERE,   20, 20, &s_sphere);
     shape_create (SHAPE_CYLINDER, 20, 20, &s_cylinder);
 
+    /* batch of bones and joints */
+    generate_shader (&s_sobj_inst, s_strVS_inst, s_strFS_inst);
+    s_loc_inst_prj      = glGetUniformLocation (s_sobj_inst.program, "u_PrjMatrix");
+    s_loc_inst_lightpos = glGetUniformLocation (s_sobj_inst.program, "u_LightPos" );
+#if defined (USE_GLES_30) || defined (USE_GLES_31)
+    s_loc_inst_mtx_mv   = glGetAttribLocation  (s_sobj_inst.program, "a_MVMatrix" );
+    s_loc_inst_mtx_nrm  = glGetAttribLocation  (s_sobj_inst.program, "a_ModelViewIT");
+    glGenBuffers (1, &s_vbo_inst);
+#else
+    glGenBuffers (1, &s_vbo_merged_vtx);
+    glGenBuffers (1, &s_vbo_merged_idx);
+#endif
+
     GLASSERT ();
     return 0;
 }
@@ -273,23 +830,9 @@ init_cube (float aspect)
 int
 draw_bone (float *mtxGlobal, float *p0, float *p1, float radius, float *color, int is_shadow)
 {
-    float matMV[16], matPMV[16], matMVI3x3[9];
-
-    if (is_shadow)
-        glDisable (GL_DEPTH_TEST);
-    else
-        glEnable (GL_DEPTH_TEST);
-
-    glEnable (GL_CULL_FACE);
-    glFrontFace (GL_CW);
+    float matModel[16];
 
-    glUseProgram( s_sobj.program );
-
-    glEnableVertexAttribArray (s_sobj.loc_vtx);
-    glEnableVertexAttribArray (s_sobj.loc_uv );
-    glEnableVertexAttribArray (s_sobj.loc_nrm);
-
-    matrix_identity (matMV);
+    matrix_identity (matModel);
 
     {
         float dp[3];
@@ -298,116 +841,28 @@ draw_bone (float *mtxGlobal, float *p0, float *p1, float radius, float *color, i
         dp[2] = p1[2] - p0[2];
 
         float len = vec3_length (dp);
-        matrix_scale     (matMV, radius * 2, radius * 2, 0.5f * len);
-        matrix_translate (matMV, 0, 0, 1.0f);
+        matrix_scale     (matModel, radius * 2, radius * 2, 0.5f * len);
+        matrix_translate (matModel, 0, 0, 1.0f);
 
         float matLook[16];
         matrix_modellookat (matLook, p0, p1, 0.0f);
-        matrix_mult (matMV, matLook, matMV);
+        matrix_mult (matModel, matLook, matModel);
     }
 
-    compute_invmat3x3 (matMVI3x3, matMV);
-
-    matrix_mult (matMV, mtxGlobal, matMV);
-    matrix_mult (matPMV, s_matPrj, matMV);
-
-    glUniformMatrix4fv (s_loc_mtx_mv,   1, GL_FALSE, matMV );
-    glUniformMatrix4fv (s_loc_mtx_pmv,  1, GL_FALSE, matPMV);
-    glUniformMatrix3fv (s_loc_mtx_nrm,  1, GL_FALSE, matMVI3x3);
-    glUniform3f (s_loc_lightpos, 1.0f, 1.0f, 1.0f);
-    glUniform3f (s_loc_color, color[0], color[1], color[2]);
-    glUniform1f (s_loc_alpha, color[3]);
-
-    if (color[3] < 1.0f)
-        glEnable (GL_BLEND);
-
-    glBindTexture (GL_TEXTURE_2D, s_texid_dummy);
-
-    glBindBuffer (GL_ARRAY_BUFFER, s_cylinder.vbo_vtx);
-    glVertexAttribPointer (s_sobj.loc_vtx, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer (GL_ARRAY_BUFFER, s_cylinder.vbo_nrm);
-    glVertexAttribPointer (s_sobj.loc_nrm, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer (GL_ARRAY_BUFFER, s_cylinder.vbo_uv);
-    glVertexAttribPointer (s_sobj.loc_uv,  2, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, s_cylinder.vbo_idx);
-    glDrawElements (GL_TRIANGLES, s_cylinder.num_faces * 3, GL_UNSIGNED_SHORT, 0);
-
-    glBindBuffer (GL_ARRAY_BUFFER, 0);
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
-
-    glFrontFace (GL_CCW);
-    glDisable (GL_BLEND);
-    glDisable (GL_DEPTH_TEST);
-    glDisable (GL_CULL_FACE);
-
-    return 0;
+    return submit_shape (SHAPE_ID_CYLINDER, mtxGlobal, matModel, color, is_shadow);
 }
 
 
 int
 draw_sphere (float *mtxGlobal, float *p0, float radius, float *color, int is_shadow)
 {
-    float matMV[16], matPMV[16], matMVI3x3[9];
+    float matModel[16];
 
-    if (is_shadow)
-        glDisable (GL_DEPTH_TEST);
-    else
-        glEnable (GL_DEPTH_TEST);
+    matrix_identity (matModel);
+    matrix_translate (matModel, p0[0], p0[1], p0[2]);
+    matrix_scale     (matModel, radius, radius, radius);
 
-    glEnable (GL_CULL_FACE);
-    glFrontFace (GL_CW);
-
-    glUseProgram( s_sobj.program );
-
-    glEnableVertexAttribArray (s_sobj.loc_vtx);
-    glEnableVertexAttribArray (s_sobj.loc_nrm);
-    glEnableVertexAttribArray (s_sobj.loc_uv );
-
-    matrix_identity (matMV);
-    matrix_translate (matMV, p0[0], p0[1], p0[2]);
-    matrix_scale     (matMV, radius, radius, radius);
-
-    compute_invmat3x3 (matMVI3x3, matMV);
-
-    matrix_mult (matMV, mtxGlobal, matMV);
-    matrix_mult (matPMV, s_matPrj, matMV);
-
-    glUniformMatrix4fv (s_loc_mtx_mv,   1, GL_FALSE, matMV );
-    glUniformMatrix4fv (s_loc_mtx_pmv,  1, GL_FALSE, matPMV);
-    glUniformMatrix3fv (s_loc_mtx_nrm,  1, GL_FALSE, matMVI3x3);
-    glUniform3f (s_loc_lightpos, 1.0f, 1.0f, 1.0f);
-    glUniform3f (s_loc_color, color[0], color[1], color[2]);
-    glUniform1f (s_loc_alpha, color[3]);
-
-    if (color[3] < 1.0f)
-        glEnable (GL_BLEND);
-
-    glBindTexture (GL_TEXTURE_2D, s_texid_dummy);
-
-    glBindBuffer (GL_ARRAY_BUFFER, s_sphere.vbo_vtx);
-    glVertexAttribPointer (s_sobj.loc_vtx, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer (GL_ARRAY_BUFFER, s_sphere.vbo_nrm);
-    glVertexAttribPointer (s_sobj.loc_nrm, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer (GL_ARRAY_BUFFER, s_sphere.vbo_uv);
-    glVertexAttribPointer (s_sobj.loc_uv,  2, GL_FLOAT, GL_FALSE, 0, 0);
-
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, s_sphere.vbo_idx);
-    glDrawElements (GL_TRIANGLES, s_sphere.num_faces * 3, GL_UNSIGNED_SHORT, 0);
-
-    glBindBuffer (GL_ARRAY_BUFFER, 0);
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
-
-    glFrontFace (GL_CCW);
-    glDisable (GL_BLEND);
-    glDisable (GL_DEPTH_TEST);
-    glDisable (GL_CULL_FACE);
-
-    return 0;
+    return submit_shape (SHAPE_ID_SPHERE, mtxGlobal, matModel, color, is_shadow);
 }
 
 
@@ -13,5 +13,9 @@ int draw_triangle (float *mtxGlobal, float *p0, float *p1, float *p2, float *col
 int draw_bone (float *mtxGlobal, float *p0, float *p1, float radius, float *color, int is_shadow);
 int draw_sphere (float *mtxGlobal, float *p0, float radius, float *color, int is_shadow);
 
+/* draw_bone() and draw_sphere() between begin/end are queued, and drawn with one draw per (shape, pass) at the end */
+int begin_shape_batch ();
+int end_shape_batch ();
+
 #endif /* _RENDER_HANDPOSE_H_ */
  
\ No newline at end of file
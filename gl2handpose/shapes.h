@@ -26,6 +26,12 @@ typedef struct shape_obj_t
     GLuint  vbo_tng;
     GLuint  vbo_idx;
     int     num_faces;
+
+    /* CPU copy of the geometry (to merge several shapes into one VBO) */
+    int             num_vertex;
+    float           *vertex;
+    float           *normal;
+    unsigned short  *index;
 } shape_obj_t;
 
 int
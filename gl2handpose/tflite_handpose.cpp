@@ -3,9 +3,12 @@
  * Copyright (c) 2020 terryky1220@gmail.com
  * ------------------------------------------------ */
 #include "util_tflite.h"
+#include "util_bench.h"
 #include "tflite_handpose.h"
 #include "custom_ops/transpose_conv_bias.h"
-#include <list>
+#include "util_nms.h"
+#include "util_ssd_anchors.h"
+#include <float.h>
 
 /* 
  * https://github.com/google/mediapipe/tree/master/mediapipe/models/hand_landmark_3d.tflite
@@ -27,188 +30,39 @@ static tflite_tensor_t      s_hand_tensor_landmark;
 static tflite_tensor_t      s_hand_tensor_handflag;
 
 
-typedef struct Anchor
-{
-    float x_center, y_center, w, h;
-} Anchor;
-
-static std::vector<Anchor>  s_anchors;
-
-typedef struct SsdAnchorsCalculatorOptions 
-{
-    int input_size_width;
-    int input_size_height;
-    float min_scale;
-    float max_scale;
-    float anchor_offset_x;
-    float anchor_offset_y;
-
-    int num_layers;
-    std::vector<int> feature_map_width;
-    std::vector<int> feature_map_height;
-
-    std::vector<int>   strides;
-    std::vector<float> aspect_ratios;
-    bool reduce_boxes_in_lowest_layer;
-    float interpolated_scale_aspect_ratio;
-    bool fixed_anchor_size;
-
-} SsdAnchorsCalculatorOptions;
-
-
-
-/* ---------------------------------------------------------------------- *
- *   mediapipe/calculators/tflite/ssd_anchors_calculator_test.cc
- * ---------------------------------------------------------------------- */
- 
-// Copyright 2019 The MediaPipe Authors.
-//
-// Licensed under the Apache License, Version 2.0 (the "License");
-// you may not use this file except in compliance with the License.
-// You may obtain a copy of the License at
-//
-//      http://www.apache.org/licenses/LICENSE-2.0
-//
-// Unless required by applicable law or agreed to in writing, software
-// distributed under the License is distributed on an "AS IS" BASIS,
-// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
-// See the License for the specific language governing permissions and
-// limitations under the License.
-
-
-float
-CalculateScale(float min_scale, float max_scale, int stride_index, int num_strides) 
-{
-    return min_scale + (max_scale - min_scale) * 1.0 * stride_index / (num_strides - 1.0f);
-}
-
-
-int
-GenerateAnchors(std::vector<Anchor>* anchors, const SsdAnchorsCalculatorOptions& options)
-{
-    int layer_id = 0;
-    while (layer_id < (int)options.strides.size()) {
-        std::vector<float> anchor_height;
-        std::vector<float> anchor_width;
-        std::vector<float> aspect_ratios;
-        std::vector<float> scales;
-
-        // For same strides, we merge the anchors in the same order.
-        int last_same_stride_layer = layer_id;
-        while (last_same_stride_layer < (int)options.strides.size() &&
-               options.strides[last_same_stride_layer] == options.strides[layer_id]) 
-        {
-          const float scale =
-              CalculateScale(options.min_scale, options.max_scale,
-                last_same_stride_layer, options.strides.size());
-          if (last_same_stride_layer == 0 && options.reduce_boxes_in_lowest_layer) {
-            // For first layer, it can be specified to use predefined anchors.
-            aspect_ratios.push_back(1.0);
-            aspect_ratios.push_back(2.0);
-            aspect_ratios.push_back(0.5);
-            scales.push_back(0.1);
-            scales.push_back(scale);
-            scales.push_back(scale);
-          } else {
-            for (int aspect_ratio_id = 0;
-                aspect_ratio_id < (int)options.aspect_ratios.size();
-                 ++aspect_ratio_id) {
-              aspect_ratios.push_back(options.aspect_ratios[aspect_ratio_id]);
-              scales.push_back(scale);
-            }
-            if (options.interpolated_scale_aspect_ratio > 0.0) {
-              const float scale_next =
-                last_same_stride_layer == (int)options.strides.size() - 1
-                      ? 1.0f
-                      : CalculateScale(options.min_scale, options.max_scale,
-                                       last_same_stride_layer + 1,
-                                       options.strides.size());
-              scales.push_back(std::sqrt(scale * scale_next));
-              aspect_ratios.push_back(options.interpolated_scale_aspect_ratio);
-            }
-          }
-          last_same_stride_layer++;
-        }
-
-        for (int i = 0; i < (int)aspect_ratios.size(); ++i) {
-          const float ratio_sqrts = std::sqrt(aspect_ratios[i]);
-          anchor_height.push_back(scales[i] / ratio_sqrts);
-          anchor_width .push_back(scales[i] * ratio_sqrts);
-        }
-
-        int feature_map_height = 0;
-        int feature_map_width  = 0;
-        if (options.feature_map_height.size()) {
-          feature_map_height = options.feature_map_height[layer_id];
-          feature_map_width  = options.feature_map_width [layer_id];
-        } else {
-          const int stride = options.strides[layer_id];
-          feature_map_height = std::ceil(1.0f * options.input_size_height / stride);
-          feature_map_width  = std::ceil(1.0f * options.input_size_width  / stride);
-        }
-
-        for (int y = 0; y < feature_map_height; ++y) {
-          for (int x = 0; x < feature_map_width; ++x) {
-            for (int anchor_id = 0; anchor_id < (int)anchor_height.size(); ++anchor_id) {
-              // TODO: Support specifying anchor_offset_x, anchor_offset_y.
-              const float x_center = (x + options.anchor_offset_x) * 1.0f / feature_map_width;
-              const float y_center = (y + options.anchor_offset_y) * 1.0f / feature_map_height;
-
-              Anchor new_anchor;
-              new_anchor.x_center = x_center;
-              new_anchor.y_center = y_center;
-
-              if (options.fixed_anchor_size) {
-                new_anchor.w = 1.0f;
-                new_anchor.h = 1.0f;
-              } else {
-                new_anchor.w = anchor_width [anchor_id];
-                new_anchor.h = anchor_height[anchor_id];
-              }
-              anchors->push_back(new_anchor);
-            }
-          }
-        }
-        layer_id = last_same_stride_layer;
-    }
-    return 0;
-}
+static const nms_anchors_t  *s_anchors;
+static nms_boxes_t          s_palm_boxes;
 
 
 static int
 generate_ssd_anchors ()
 {
-    SsdAnchorsCalculatorOptions anchor_options;
+    ssd_anchor_options_t anchor_options;
+    ssd_anchors_default_options (&anchor_options);
+
     anchor_options.num_layers = 5;
-    anchor_options.min_scale = 0.1171875;
-    anchor_options.max_scale = 0.75;
+    anchor_options.min_scale  = 0.1171875f;
+    anchor_options.max_scale  = 0.75f;
     anchor_options.input_size_height = 256;
     anchor_options.input_size_width  = 256;
-    anchor_options.anchor_offset_x  = 0.5f;
-    anchor_options.anchor_offset_y  = 0.5f;
-//  anchor_options.feature_map_width .push_back(0);
-//  anchor_options.feature_map_height.push_back(0);
-    anchor_options.strides.push_back( 8);
-    anchor_options.strides.push_back(16);
-    anchor_options.strides.push_back(32);
-    anchor_options.strides.push_back(32);
-    anchor_options.strides.push_back(32);
-    anchor_options.aspect_ratios.push_back(1.0);
-    anchor_options.reduce_boxes_in_lowest_layer = false;
-    anchor_options.interpolated_scale_aspect_ratio = 1.0;
-    anchor_options.fixed_anchor_size = true;
-
-    GenerateAnchors (&s_anchors, anchor_options);
-
-#if 0
-    for (int i = 0; i < (int)s_anchors.size(); i ++)
-    {
-        fprintf (stderr, "[%4d](%f, %f, %f, %f)\n", i,
-            s_anchors[i].x_center, s_anchors[i].y_center, s_anchors[i].w, s_anchors[i].h);
-    }
-#endif
+    anchor_options.anchor_offset_x   = 0.5f;
+    anchor_options.anchor_offset_y   = 0.5f;
+    anchor_options.strides[0] =  8;
+    anchor_options.strides[1] = 16;
+    anchor_options.strides[2] = 32;
+    anchor_options.strides[3] = 32;
+    anchor_options.strides[4] = 32;
+    anchor_options.num_aspect_ratios = 1;
+    anchor_options.aspect_ratios[0]  = 1.0f;
+    anchor_options.reduce_boxes_in_lowest_layer    = 0;
+    anchor_options.interpolated_scale_aspect_ratio = 1.0f;
+    anchor_options.fixed_anchor_size = 1;
+
+    s_anchors = ssd_anchors_get (&anchor_options);
+    if (s_anchors == NULL)
+        return -1;
 
-    return 0;
+    return s_anchors->num;
 }
 
 
@@ -221,6 +75,13 @@ init_tflite_hand_landmark(int use_quantized_tflite)
     const char *palm_model;
     const char *hand_model;
 
+    /*
+     *  detection and landmark run one after another: share one CPU worker pool.
+     *  (unless enable_tflite_concurrent_invoke() has been called beforehand)
+     */
+    if (tflite_get_thread_budget_mode () < 0)
+        tflite_init_thread_budget (0, TFLITE_BUDGET_SERIAL);
+
     if (use_quantized_tflite)
     {
         palm_model = PALM_DETECTION_QUANT_MODEL_PATH;
@@ -247,7 +108,8 @@ init_tflite_hand_landmark(int use_quantized_tflite)
     tflite_get_tensor_by_name (&s_hand_interpreter, 1, "ld_21_3d",        &s_hand_tensor_landmark);
     tflite_get_tensor_by_name (&s_hand_interpreter, 1, "output_handflag", &s_hand_tensor_handflag);
 
-    generate_ssd_anchors ();
+    int num_anchors = generate_ssd_anchors ();
+    nms_init_boxes (&s_palm_boxes, num_anchors, 7);
 
     return 0;
 }
@@ -271,152 +133,18 @@ get_hand_landmark_input_buf (int *w, int *h)
 
 /* -------------------------------------------------- *
  *  Decode palm detection result
- * -------------------------------------------------- */static int
-decode_keypoints (std::list<palm_t> &palm_list, float score_thresh)
+ * -------------------------------------------------- */
+static int
+decode_keypoints (nms_boxes_t *boxes, float score_thresh)
 {
-    palm_t palm_item;
     float *scores_ptr = (float *)s_palm_tensor_scores.ptr;
     float *points_ptr = (float *)s_palm_tensor_points.ptr;
     int img_w = s_palm_tensor_input.dims[2];
     int img_h = s_palm_tensor_input.dims[1];
 
-    int i = 0;
-    for (auto itr = s_anchors.begin(); itr != s_anchors.end(); i ++, itr ++)
-    {
-        Anchor anchor = *itr;
-        float score0 = scores_ptr[i];
-        float score = 1.0f / (1.0f + exp(-score0));
-
-        if (score > score_thresh)
-        {
-            float *p = points_ptr + (i * 18);
-
-            /* boundary box */
-            float sx = p[0];
-            float sy = p[1];
-            float w  = p[2];
-            float h  = p[3];
-
-            float cx = sx + anchor.x_center * img_w;
-            float cy = sy + anchor.y_center * img_h;
-
-            cx /= (float)img_w;
-            cy /= (float)img_h;
-            w  /= (float)img_w;
-            h  /= (float)img_h;
-
-            fvec2 topleft, btmright;
-            topleft.x  = cx - w * 0.5f;
-            topleft.y  = cy - h * 0.5f;
-            btmright.x = cx + w * 0.5f;
-            btmright.y = cy + h * 0.5f;
-
-            palm_item.score         = score;
-            palm_item.rect.topleft  = topleft;
-            palm_item.rect.btmright = btmright;
-
-            /* landmark positions (7 keys) */
-            for (int j = 0; j < 7; j ++)
-            {
-                float lx = p[4 + (2 * j) + 0];
-                float ly = p[4 + (2 * j) + 1];
-                lx += anchor.x_center * img_w;
-                ly += anchor.y_center * img_h;
-                lx /= (float)img_w;
-                ly /= (float)img_h;
-
-                palm_item.keys[j].x = lx;
-                palm_item.keys[j].y = ly;
-            }
-
-            palm_list.push_back (palm_item);
-        }
-    }
-    return 0;
-}
-
-
-
-/* -------------------------------------------------- *
- *  Apply NonMaxSuppression:
- * -------------------------------------------------- */
-static float
-calc_intersection_over_union (rect_t &rect0, rect_t &rect1)
-{
-    float sx0 = rect0.topleft.x;
-    float sy0 = rect0.topleft.y;
-    float ex0 = rect0.btmright.x;
-    float ey0 = rect0.btmright.y;
-    float sx1 = rect1.topleft.x;
-    float sy1 = rect1.topleft.y;
-    float ex1 = rect1.btmright.x;
-    float ey1 = rect1.btmright.y;
-    
-    float xmin0 = std::min (sx0, ex0);
-    float ymin0 = std::min (sy0, ey0);
-    float xmax0 = std::max (sx0, ex0);
-    float ymax0 = std::max (sy0, ey0);
-    float xmin1 = std::min (sx1, ex1);
-    float ymin1 = std::min (sy1, ey1);
-    float xmax1 = std::max (sx1, ex1);
-    float ymax1 = std::max (sy1, ey1);
-    
-    float area0 = (ymax0 - ymin0) * (xmax0 - xmin0);
-    float area1 = (ymax1 - ymin1) * (xmax1 - xmin1);
-    if (area0 <= 0 || area1 <= 0)
-        return 0.0f;
-
-    float intersect_xmin = std::max (xmin0, xmin1);
-    float intersect_ymin = std::max (ymin0, ymin1);
-    float intersect_xmax = std::min (xmax0, xmax1);
-    float intersect_ymax = std::min (ymax0, ymax1);
-
-    float intersect_area = std::max (intersect_ymax - intersect_ymin, 0.0f) *
-                           std::max (intersect_xmax - intersect_xmin, 0.0f);
-    
-    return intersect_area / (area0 + area1 - intersect_area);
-}
-
-static bool
-compare (palm_t &v1, palm_t &v2)
-{
-    if (v1.score > v2.score)
-        return true;
-    else
-        return false;
-}
-
-static int
-non_max_suppression (std::list<palm_t> &face_list, std::list<palm_t> &face_sel_list, float iou_thresh)
-{
-    face_list.sort (compare);
-
-    for (auto itr = face_list.begin(); itr != face_list.end(); itr ++)
-    {
-        palm_t face_candidate = *itr;
-
-        int ignore_candidate = false;
-        for (auto itr_sel = face_sel_list.rbegin(); itr_sel != face_sel_list.rend(); itr_sel ++)
-        {
-            palm_t face_sel = *itr_sel;
-
-            float iou = calc_intersection_over_union (face_candidate.rect, face_sel.rect);
-            if (iou >= iou_thresh)
-            {
-                ignore_candidate = true;
-                break;
-            }
-        }
-
-        if (!ignore_candidate)
-        {
-            face_sel_list.push_back(face_candidate);
-            if (face_sel_list.size() >= MAX_PALM_NUM)
-                break;
-        }
-    }
-
-    return 0;
+    /* boundary box and landmark positions (7 keys), 18 floats per anchor */
+    return nms_decode_anchors (boxes, s_anchors, scores_ptr, points_ptr, 18,
+                               (float)img_w, (float)img_h, score_thresh);
 }
 
 
@@ -453,7 +181,7 @@ rot_vec (fvec2 &vec, float rotation)
 }
 
 static void
-compute_hand_rect (palm_t &palm)
+compute_hand_rect (palm_t &palm, float shift_y, float scale)
 {
     float width    = palm.rect.btmright.x - palm.rect.topleft.x;
     float height   = palm.rect.btmright.y - palm.rect.topleft.y;
@@ -463,7 +191,6 @@ compute_hand_rect (palm_t &palm)
     float hand_cy;
     float rotation = palm.rotation;
     float shift_x =  0.0f;
-    float shift_y = -0.5f;
     
     if (rotation == 0.0f)
     {
@@ -483,8 +210,8 @@ compute_hand_rect (palm_t &palm)
     float long_side = std::max (width, height);
     width  = long_side;
     height = long_side;
-    float hand_w = width  * 2.6f;
-    float hand_h = height * 2.6f;
+    float hand_w = width  * scale;
+    float hand_h = height * scale;
 
     palm.hand_cx = hand_cx;
     palm.hand_cy = hand_cy;
@@ -508,23 +235,32 @@ compute_hand_rect (palm_t &palm)
 }
 
 static void
-pack_palm_result (palm_detection_result_t *palm_result, std::list<palm_t> &palm_list)
+pack_palm_result (palm_detection_result_t *palm_result, nms_boxes_t *boxes, int *sel, int num_sel)
 {
     int num_palms = 0;
-    for (auto itr = palm_list.begin(); itr != palm_list.end(); itr ++)
+    for (int i = 0; i < num_sel && num_palms < MAX_PALM_NUM; i ++)
     {
-        palm_t palm = *itr;
-        
-        compute_rotation (palm);
-        compute_hand_rect (palm);
+        palm_t *palm = &palm_result->palms[num_palms];
+        int    idx   = sel[i];
+        float  *keys = nms_get_keys (boxes, idx);
 
-        memcpy (&palm_result->palms[num_palms], &palm, sizeof (palm));
-        num_palms ++;
-        palm_result->num = num_palms;
+        palm->score           = boxes->score[idx];
+        palm->rect.topleft.x  = boxes->x0[idx];
+        palm->rect.topleft.y  = boxes->y0[idx];
+        palm->rect.btmright.x = boxes->x1[idx];
+        palm->rect.btmright.y = boxes->y1[idx];
 
-        if (num_palms >= MAX_PALM_NUM)
-            break;
+        for (int j = 0; j < 7; j ++)
+        {
+            palm->keys[j].x = keys[2 * j + 0];
+            palm->keys[j].y = keys[2 * j + 1];
+        }
+
+        compute_rotation (*palm);
+        compute_hand_rect (*palm, -0.5f, 2.6f);
+        num_palms ++;
     }
+    palm_result->num = num_palms;
 }
 
 
@@ -535,26 +271,24 @@ pack_palm_result (palm_detection_result_t *palm_result, std::list<palm_t> &palm_
 static int
 detect_palm (palm_detection_result_t *palm_result)
 {
-    if (s_palm_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_palm_interpreter) != 0)
     {
         fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
     }
 
     float score_thresh = 0.7f;
-    std::list<palm_t> palm_list;
 
-    decode_keypoints (palm_list, score_thresh);
+    decode_keypoints (&s_palm_boxes, score_thresh);
 
-#if 1 /* USE NMS */
     float iou_thresh = 0.03f;
-    std::list<palm_t> palm_nms_list;
+    int   sel[MAX_PALM_NUM];
+    int   num_sel;
 
-    non_max_suppression (palm_list, palm_nms_list, iou_thresh);
-    pack_palm_result (palm_result, palm_nms_list);
-#else
-    pack_palm_result (palm_result, palm_list);
-#endif
+    bench_lap_start (BENCH_LAP_NMS);
+    num_sel = nms_hard (&s_palm_boxes, iou_thresh, sel, MAX_PALM_NUM);
+    bench_lap_stop (BENCH_LAP_NMS);
+    pack_palm_result (palm_result, &s_palm_boxes, sel, num_sel);
 
     return 0;
 }
@@ -596,32 +330,115 @@ invoke_palm_detection (palm_detection_result_t *palm_result, int flag)
 /* -------------------------------------------------- *
  * Invoke TensorFlow Lite (Hand landmark)
  * -------------------------------------------------- */
+/*
+ *  set the number of hands processed by one invoke_hand_landmark_batch().
+ *  returns the batch size in effect (1 if the model can't be batched).
+ *  the input image of the n-th hand goes to
+ *      get_hand_landmark_input_buf() + n * (w * h * 3)
+ */
 int
-invoke_hand_landmark (hand_landmark_result_t *hand_result)
+set_hand_landmark_batch (int batch)
+{
+    batch = tflite_resize_batch (&s_hand_interpreter, batch);
+
+    tflite_update_tensor (&s_hand_interpreter, &s_hand_tensor_input);
+    tflite_update_tensor (&s_hand_interpreter, &s_hand_tensor_landmark);
+    tflite_update_tensor (&s_hand_interpreter, &s_hand_tensor_handflag);
+
+    return (batch > 0) ? batch : 1;
+}
+
+int
+invoke_hand_landmark_batch (hand_landmark_result_t *hand_result, int batch)
 {
-    if (s_hand_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_hand_interpreter) != 0)
     {
         fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
     }
 
-    float *handflag_ptr = (float *)s_hand_tensor_handflag.ptr;
-    float *landmark_ptr = (float *)s_hand_tensor_landmark.ptr;
     int img_w = s_hand_tensor_input.dims[2];
     int img_h = s_hand_tensor_input.dims[1];
-    
-    hand_result->score = *handflag_ptr;
-    //fprintf (stderr, "handflag = %f\n", *handflag_ptr);
-    
-    for (int i = 0; i < HAND_JOINT_NUM; i ++)
+
+    for (int n = 0; n < batch; n ++)
     {
-        hand_result->joint[i].x = landmark_ptr[3 * i + 0] / (float)img_w;
-        hand_result->joint[i].y = landmark_ptr[3 * i + 1] / (float)img_h;
-        hand_result->joint[i].z = landmark_ptr[3 * i + 2] / (float)img_w;
-        //fprintf (stderr, "[%2d] (%8.1f, %8.1f, %8.1f)\n", i, 
-        //    landmark_ptr[3 * i + 0], landmark_ptr[3 * i + 1], landmark_ptr[3 * i + 2]);
+        float *handflag_ptr = (float *)s_hand_tensor_handflag.ptr + n;
+        float *landmark_ptr = (float *)s_hand_tensor_landmark.ptr + n * HAND_JOINT_NUM * 3;
+
+        hand_result[n].score = *handflag_ptr;
+
+        for (int i = 0; i < HAND_JOINT_NUM; i ++)
+        {
+            hand_result[n].joint[i].x = landmark_ptr[3 * i + 0] / (float)img_w;
+            hand_result[n].joint[i].y = landmark_ptr[3 * i + 1] / (float)img_h;
+            hand_result[n].joint[i].z = landmark_ptr[3 * i + 2] / (float)img_w;
+        }
     }
 
     return 0;
 }
 
+int
+invoke_hand_landmark (hand_landmark_result_t *hand_result)
+{
+    return invoke_hand_landmark_batch (hand_result, 1);
+}
+
+
+/* -------------------------------------------------- *
+ *  ROI tracking
+ *   compute the ROI of the next frame from the landmarks, so that
+ *   the palm detection can be skipped while the hand is tracked.
+ *
+ *  based on:
+ *   - mediapipe/modules/hand_landmark/hand_landmark_landmarks_to_roi.pbtxt
+ * -------------------------------------------------- */
+int
+track_hand_region (palm_t *palm, hand_landmark_result_t *hand_result)
+{
+    /* landmarks which are stable regardless of the finger pose */
+    static const int s_track_keys[] = {0, 1, 2, 3, 5, 6, 9, 10, 13, 14, 17, 18};
+    int num_keys = sizeof (s_track_keys) / sizeof (s_track_keys[0]);
+
+    if (hand_result->score < 0.5f)
+        return -1;
+
+    /* landmarks in the ROI ==> normalized image coordinates */
+    fvec2 pos[HAND_JOINT_NUM];
+    for (int i = 0; i < HAND_JOINT_NUM; i ++)
+    {
+        pos[i].x = (hand_result->joint[i].x - 0.5f) * palm->hand_w;
+        pos[i].y = (hand_result->joint[i].y - 0.5f) * palm->hand_h;
+        rot_vec (pos[i], palm->rotation);
+        pos[i].x += palm->hand_cx;
+        pos[i].y += palm->hand_cy;
+    }
+
+    palm->keys[0] = pos[0];     // Center of wrist.
+    palm->keys[2] = pos[9];     // MCP of middle finger.
+    compute_rotation (*palm);
+
+    /* bounding box of the landmarks in the rotated coordinates */
+    float xmin = FLT_MAX, ymin = FLT_MAX, xmax = -FLT_MAX, ymax = -FLT_MAX;
+    for (int i = 0; i < num_keys; i ++)
+    {
+        fvec2 p = pos[s_track_keys[i]];
+        rot_vec (p, -palm->rotation);
+        xmin = std::min (xmin, p.x);  xmax = std::max (xmax, p.x);
+        ymin = std::min (ymin, p.y);  ymax = std::max (ymax, p.y);
+    }
+
+    fvec2 center = {(xmin + xmax) * 0.5f, (ymin + ymax) * 0.5f};
+    rot_vec (center, palm->rotation);
+
+    float w = xmax - xmin;
+    float h = ymax - ymin;
+    palm->rect.topleft.x  = center.x - w * 0.5f;
+    palm->rect.topleft.y  = center.y - h * 0.5f;
+    palm->rect.btmright.x = center.x + w * 0.5f;
+    palm->rect.btmright.y = center.y + h * 0.5f;
+
+    compute_hand_rect (*palm, -0.1f, 2.0f);
+
+    return 0;
+}
@@ -63,12 +63,18 @@ typedef struct _pose3d_config_t
 } pose3d_config_t;
 
 int   init_tflite_hand_landmark (int use_quantized_tflite);
+int   enable_tflite_concurrent_invoke ();   /* util_tflite.cpp */
 
 void  *get_palm_detection_input_buf (int *w, int *h);
 int   invoke_palm_detection (palm_detection_result_t *palm_result, int flag);
 
 void  *get_hand_landmark_input_buf (int *w, int *h);
 int   invoke_hand_landmark (hand_landmark_result_t *hand_landmark_result);
+int   set_hand_landmark_batch (int batch);
+int   invoke_hand_landmark_batch (hand_landmark_result_t *hand_landmark_result, int batch);
+
+/* ROI of the next frame from the landmarks (-1: the hand is lost) */
+int   track_hand_region (palm_t *palm, hand_landmark_result_t *hand_landmark_result);
 
 #ifdef __cplusplus
 }
@@ -14,6 +14,9 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
+#include "util_preprocess.h"
+#include "util_pipeline.h"
 #include "util_matrix.h"
 #include "tflite_facemesh.h"
 #include "util_camera_capture.h"
@@ -29,7 +32,7 @@
 void
 feed_face_detect_image(texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_face_detect_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -47,31 +50,22 @@ feed_face_detect_image(texture_2d_t *srctex, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
     float mean = 128.0f;
     float std  = 128.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
 
 void
-feed_face_landmark_image(texture_2d_t *srctex, int win_w, int win_h, face_detect_result_t *detection, unsigned int face_id)
+feed_face_landmark_image(texture_2d_t *srctex, int win_w, int win_h, face_detect_result_t *detection, unsigned int face_id,
+                         int batch_idx)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_facemesh_landmark_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
 
+    buf_fp32 += batch_idx * (w * h * 3);
+
     if (pui8 == NULL)
         pui8 = (unsigned char *)malloc(w * h * 4);
 
@@ -107,89 +101,82 @@ feed_face_landmark_image(texture_2d_t *srctex, int win_w, int win_h, face_detect
     /* convert UI8 [0, 255] ==> FP32 [0, 1] */
     float mean = 0.0f;
     float std  = 255.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
 
 
-void
-feed_iris_landmark_image(texture_2d_t *srctex, int win_w, int win_h, 
-                         face_t *face, face_landmark_result_t *facemesh, int eye_id)
+/*
+ *  quad of the eye region in the input image (normalized).
+ *  the right eye is flipped horizontally to look like the left eye.
+ */
+static void
+compute_eye_roi (face_t *face, face_landmark_result_t *facemesh, int eye_id, float *roi)
 {
-    int x, y, w, h;
-    float *buf_fp32 = (float *)get_irismesh_landmark_input_buf (&w, &h);
-    unsigned char *buf_ui8 = NULL;
-    static unsigned char *pui8 = NULL;
-
-    if (pui8 == NULL)
-        pui8 = (unsigned char *)malloc(w * h * 4);
-
-    buf_ui8 = pui8;
-
-    float texcoord[8];
-
     float scale_x = face->face_w;
     float scale_y = face->face_h;
     float pivot_x = face->face_cx;
     float pivot_y = face->face_cy;
     float rotation= face->rotation;
-    
-    float x0 = facemesh->eye_pos[eye_id][0].x;
-    float y0 = facemesh->eye_pos[eye_id][0].y;
-    float x1 = facemesh->eye_pos[eye_id][1].x; //    0--------1
-    float y1 = facemesh->eye_pos[eye_id][1].y; //    |        |
-    float x2 = facemesh->eye_pos[eye_id][2].x; //    |        |
-    float y2 = facemesh->eye_pos[eye_id][2].y; //    3--------2
-    float x3 = facemesh->eye_pos[eye_id][3].x;
-    float y3 = facemesh->eye_pos[eye_id][3].y;
 
     float mat[16];
-    float vec[4][2] = {{x0, y0}, {x1, y1}, {x2, y2}, {x3, y3}};
+    float vec[4][2];
+    for (int i = 0; i < 4; i ++)
+    {
+        vec[i][0] = facemesh->eye_pos[eye_id][i].x;     //    0--------1
+        vec[i][1] = facemesh->eye_pos[eye_id][i].y;     //    |        |
+    }                                                   //    3--------2
+
     matrix_identity (mat);
-    
     matrix_translate (mat, pivot_x, pivot_y, 0);
     matrix_rotate (mat, RAD_TO_DEG(rotation), 0, 0, 1);
     matrix_scale (mat, scale_x, scale_y, 1.0f);
     matrix_translate (mat, -0.5f, -0.5f, 0);
 
-    matrix_multvec2 (mat, vec[0], vec[0]);
-    matrix_multvec2 (mat, vec[1], vec[1]);
-    matrix_multvec2 (mat, vec[2], vec[2]);
-    matrix_multvec2 (mat, vec[3], vec[3]);
-
-    x0 = vec[0][0];  y0 = vec[0][1];
-    x1 = vec[1][0];  y1 = vec[1][1];
-    x2 = vec[2][0];  y2 = vec[2][1];
-    x3 = vec[3][0];  y3 = vec[3][1];
+    for (int i = 0; i < 4; i ++)
+        matrix_multvec2 (mat, vec[i], vec[i]);
 
-    /* Upside down */
     if (eye_id == 0)
     {
-        texcoord[0] = x3;   texcoord[1] = y3;
-        texcoord[2] = x0;   texcoord[3] = y0;
-        texcoord[4] = x2;   texcoord[5] = y2;
-        texcoord[6] = x1;   texcoord[7] = y1;
+        roi[0] = vec[0][0];  roi[1] = vec[0][1];
+        roi[2] = vec[1][0];  roi[3] = vec[1][1];
+        roi[4] = vec[2][0];  roi[5] = vec[2][1];
+        roi[6] = vec[3][0];  roi[7] = vec[3][1];
     }
     else /* need to horizontal flip for right eye */
     {
-        texcoord[0] = x2;   texcoord[1] = y2;
-        texcoord[2] = x1;   texcoord[3] = y1;
-        texcoord[4] = x3;   texcoord[5] = y3;
-        texcoord[6] = x0;   texcoord[7] = y0;
+        roi[0] = vec[1][0];  roi[1] = vec[1][1];
+        roi[2] = vec[0][0];  roi[3] = vec[0][1];
+        roi[4] = vec[3][0];  roi[5] = vec[3][1];
+        roi[6] = vec[2][0];  roi[7] = vec[2][1];
     }
+}
+
+void
+feed_iris_landmark_image(texture_2d_t *srctex, int win_w, int win_h, 
+                         face_t *face, face_landmark_result_t *facemesh, int eye_id, int batch_idx)
+{
+    int w, h;
+    float *buf_fp32 = (float *)get_irismesh_landmark_input_buf (&w, &h);
+    unsigned char *buf_ui8 = NULL;
+    static unsigned char *pui8 = NULL;
+
+    buf_fp32 += batch_idx * (w * h * 3);
+
+    if (pui8 == NULL)
+        pui8 = (unsigned char *)malloc(w * h * 4);
+
+    buf_ui8 = pui8;
+
+    float roi[8], texcoord[8];
+    compute_eye_roi (face, facemesh, eye_id, roi);
+
+    /* Upside down */
+    texcoord[0] = roi[6];   texcoord[1] = roi[7];
+    texcoord[2] = roi[0];   texcoord[3] = roi[1];
+    texcoord[4] = roi[4];   texcoord[5] = roi[5];
+    texcoord[6] = roi[2];   texcoord[7] = roi[3];
 
     draw_2d_texture_ex_texcoord (srctex, 0, win_h - h, w, h, texcoord);
 
@@ -199,19 +186,7 @@ feed_iris_landmark_image(texture_2d_t *srctex, int win_w, int win_h,
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
     float mean = 0.0f;
     float std  = 255.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
@@ -653,6 +628,232 @@ adjust_texture (int win_w, int win_h, int texw, int texh,
 }
 
 
+/* --------------------------------------------------------------------------- *
+ *  pipelined inference (-p option)
+ *
+ *    render thread : readback frame[N+3]
+ *    stage[0]      : face detect   frame[N+2]
+ *    stage[1]      : face landmark frame[N+1]
+ *    stage[2]      : iris landmark frame[N]
+ *
+ *  the throughput is bound by the slowest stage instead of the sum of them.
+ *  the stages crop their input on CPU from the RGBA copy of the frame,
+ *  because GL calls are allowed only on the render thread.
+ * --------------------------------------------------------------------------- */
+#define PIPELINE_NUM_FRAMES     4
+
+typedef struct _iris_frame_t
+{
+    unsigned char           *rgba;          /* input image (top row first) */
+    int                     w, h;
+    face_detect_result_t    detect;
+    face_landmark_result_t  mesh[MAX_FACE_NUM];
+    irismesh_result_t       iris[MAX_FACE_NUM][2];
+    double                  invoke_ms[3];
+} iris_frame_t;
+
+static pipeline_t             s_pipeline;
+static preproc_t              s_preproc_frame;          /* render thread */
+static preproc_t              s_preproc_detect_cpu;     /* stage[0] */
+static preproc_t              s_preproc_landmark_cpu;   /* stage[1] */
+static preproc_t              s_preproc_iris_cpu;       /* stage[2] */
+
+static face_detect_result_t   s_pipeline_detect;        /* the latest result */
+static face_landmark_result_t s_pipeline_mesh[MAX_FACE_NUM];
+static irismesh_result_t      s_pipeline_iris[MAX_FACE_NUM][2];
+static double                 s_pipeline_invoke_ms[3];
+
+static int
+stage_face_detect (void *frame_ptr, void *usr)
+{
+    iris_frame_t *frame = (iris_frame_t *)frame_ptr;
+    int w, h;
+    float *buf_fp32 = (float *)get_face_detect_input_buf (&w, &h);
+    UNUSED (usr);
+
+    preprocess_buffer (&s_preproc_detect_cpu, frame->rgba, frame->w, frame->h, NULL);
+    preprocess_get_tensor (&s_preproc_detect_cpu, buf_fp32);
+
+    double t0 = pmeter_get_time_ms ();
+    int ret = invoke_face_detect (&frame->detect);
+    frame->invoke_ms[0] = pmeter_get_time_ms () - t0;
+
+    return ret;
+}
+
+static int
+stage_face_landmark (void *frame_ptr, void *usr)
+{
+    iris_frame_t *frame = (iris_frame_t *)frame_ptr;
+    int w, h;
+    UNUSED (usr);
+
+    frame->invoke_ms[1] = 0;
+    if (pipeline_frame_failed (&s_pipeline, frame))
+        return -1;
+
+    /* all the faces in one batch */
+    int num_faces = frame->detect.num;
+    int num_batch = (num_faces > 0) ? set_facemesh_landmark_batch (num_faces) : 1;
+    float *buf_fp32 = (float *)get_facemesh_landmark_input_buf (&w, &h);
+
+    for (int face_id = 0; face_id < num_faces; face_id += num_batch)
+    {
+        int batch = (num_faces - face_id < num_batch) ? num_faces - face_id : num_batch;
+
+        for (int i = 0; i < batch; i ++)
+        {
+            float *roi = (float *)frame->detect.faces[face_id + i].face_pos;
+
+            preprocess_buffer (&s_preproc_landmark_cpu, frame->rgba, frame->w, frame->h, roi);
+            preprocess_get_tensor (&s_preproc_landmark_cpu, buf_fp32 + i * (w * h * 3));
+        }
+
+        double t0 = pmeter_get_time_ms ();
+        invoke_facemesh_landmark_batch (&frame->mesh[face_id], batch);
+        frame->invoke_ms[1] += pmeter_get_time_ms () - t0;
+    }
+
+    return 0;
+}
+
+static int
+stage_iris_landmark (void *frame_ptr, void *usr)
+{
+    iris_frame_t *frame = (iris_frame_t *)frame_ptr;
+    int w, h;
+    UNUSED (usr);
+
+    frame->invoke_ms[2] = 0;
+    if (pipeline_frame_failed (&s_pipeline, frame))
+        return -1;
+
+    /* both eyes of all the faces in one batch. eye[k] = iris[k / 2][k % 2] */
+    int num_eyes  = frame->detect.num * 2;
+    int num_batch = (num_eyes > 0) ? set_irismesh_landmark_batch (num_eyes) : 1;
+    float *buf_fp32 = (float *)get_irismesh_landmark_input_buf (&w, &h);
+
+    for (int eye_idx = 0; eye_idx < num_eyes; eye_idx += num_batch)
+    {
+        int batch = (num_eyes - eye_idx < num_batch) ? num_eyes - eye_idx : num_batch;
+
+        for (int i = 0; i < batch; i ++)
+        {
+            int face_id = (eye_idx + i) / 2;
+            int eye_id  = (eye_idx + i) % 2;
+            float roi[8];
+            compute_eye_roi (&frame->detect.faces[face_id], &frame->mesh[face_id], eye_id, roi);
+
+            preprocess_buffer (&s_preproc_iris_cpu, frame->rgba, frame->w, frame->h, roi);
+            preprocess_get_tensor (&s_preproc_iris_cpu, buf_fp32 + i * (w * h * 3));
+        }
+
+        double t0 = pmeter_get_time_ms ();
+        invoke_irismesh_landmark_batch (&frame->iris[0][0] + eye_idx, batch);
+        frame->invoke_ms[2] += pmeter_get_time_ms () - t0;
+    }
+
+    /* need to horizontal flip for right eye */
+    for (int face_id = 0; face_id < frame->detect.num; face_id ++)
+        flip_horizontal_iris_landmark (&frame->iris[face_id][1]);
+
+    return 0;
+}
+
+static int
+init_iris_pipeline (texture_2d_t *srctex)
+{
+    int w, h;
+
+    get_face_detect_input_buf (&w, &h);
+    init_preprocess (&s_preproc_detect_cpu, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    get_facemesh_landmark_input_buf (&w, &h);
+    init_preprocess (&s_preproc_landmark_cpu, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 0.0f, 255.0f);
+
+    get_irismesh_landmark_input_buf (&w, &h);
+    init_preprocess (&s_preproc_iris_cpu, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 0.0f, 255.0f);
+
+    w = srctex->width;
+    h = srctex->height;
+    init_preprocess (&s_preproc_frame, PREPROC_BACKEND_DEFAULT, w, h, PREPROC_TYPE_RGBA8, 0.0f, 1.0f);
+
+    if (pipeline_init (&s_pipeline, PIPELINE_NUM_FRAMES, sizeof (iris_frame_t)) != 0)
+        return -1;
+
+    for (int i = 0; i < PIPELINE_NUM_FRAMES; i ++)
+    {
+        iris_frame_t *frame = (iris_frame_t *)pipeline_get_frame (&s_pipeline, i);
+        frame->w    = w;
+        frame->h    = h;
+        frame->rgba = (unsigned char *)malloc (w * h * 4);
+        if (frame->rgba == NULL)
+        {
+            fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+            return -1;
+        }
+    }
+
+    pipeline_add_stage (&s_pipeline, "face_detect",   stage_face_detect,   NULL);
+    pipeline_add_stage (&s_pipeline, "face_landmark", stage_face_landmark, NULL);
+    pipeline_add_stage (&s_pipeline, "iris_landmark", stage_iris_landmark, NULL);
+
+    return pipeline_start (&s_pipeline);
+}
+
+/*
+ *  push the current frame into the pipeline (skipped if all the contexts are busy),
+ *  and return the latest result which has come out of it.
+ */
+static void
+run_iris_pipeline (texture_2d_t *srctex, face_detect_result_t *detection,
+                   face_landmark_result_t *facemesh, irismesh_result_t (*irismesh)[2],
+                   double *invoke_ms)
+{
+    iris_frame_t *frame = (iris_frame_t *)pipeline_acquire_frame (&s_pipeline, 0);
+    if (frame)
+    {
+        preprocess_texture (&s_preproc_frame, srctex, NULL);
+        preprocess_get_tensor (&s_preproc_frame, frame->rgba);
+        pipeline_submit_frame (&s_pipeline, frame);
+    }
+    else
+    {
+        /* the frame is dropped. don't hand its readback to the next one. */
+        preprocess_reset (&s_preproc_frame);
+    }
+
+    while ((frame = (iris_frame_t *)pipeline_poll_frame (&s_pipeline, 0)) != NULL)
+    {
+        if (!pipeline_frame_failed (&s_pipeline, frame))
+        {
+            s_pipeline_detect = frame->detect;
+            for (int face_id = 0; face_id < frame->detect.num; face_id ++)
+            {
+                s_pipeline_mesh[face_id]    = frame->mesh[face_id];
+                s_pipeline_iris[face_id][0] = frame->iris[face_id][0];
+                s_pipeline_iris[face_id][1] = frame->iris[face_id][1];
+            }
+
+            for (int i = 0; i < 3; i ++)
+                s_pipeline_invoke_ms[i] = frame->invoke_ms[i];
+        }
+        pipeline_release_frame (&s_pipeline, frame);
+    }
+
+    *detection = s_pipeline_detect;
+    for (int face_id = 0; face_id < s_pipeline_detect.num; face_id ++)
+    {
+        facemesh[face_id]    = s_pipeline_mesh[face_id];
+        irismesh[face_id][0] = s_pipeline_iris[face_id][0];
+        irismesh[face_id][1] = s_pipeline_iris[face_id][1];
+    }
+
+    for (int i = 0; i < 3; i ++)
+        invoke_ms[i] = s_pipeline_invoke_ms[i];
+}
+
+
 /*--------------------------------------------------------------------------- *
  *      M A I N    F U N C T I O N
  *--------------------------------------------------------------------------- */
@@ -670,17 +871,21 @@ main(int argc, char *argv[])
     int use_quantized_tflite = 0;
     int enable_video = 0;
     int enable_camera = 1;
+    int enable_pipeline = 0;
     UNUSED (argc);
     UNUSED (*argv);
 
     {
         int c;
-        const char *optstring = "qv:x";
+        const char *optstring = "pqv:x";
 
         while ((c = getopt (argc, argv, optstring)) != -1)
         {
             switch (c)
             {
+            case 'p':
+                enable_pipeline = 1;
+                break;
             case 'q':
                 use_quantized_tflite = 1;
                 break;
@@ -712,6 +917,17 @@ main(int argc, char *argv[])
     init_pmeter (win_w, win_h, 500);
     init_dbgstr (win_w, win_h);
 
+#if defined (USE_GL_DELEGATE) || defined (USE_GPU_DELEGATEV2)
+    if (enable_pipeline)
+    {
+        /* GPU Delegate must be invoked on the thread which owns the EGL context */
+        fprintf (stderr, "pipelined inference is not available with GPU Delegate.\n");
+        enable_pipeline = 0;
+    }
+#endif
+    if (enable_pipeline)
+        enable_tflite_concurrent_invoke ();
+
     init_tflite_facemesh (use_quantized_tflite);
 
 #if defined (USE_GL_DELEGATE) || defined (USE_GPU_DELEGATEV2)
@@ -757,6 +973,12 @@ main(int argc, char *argv[])
     glClear (GL_COLOR_BUFFER_BIT);
     glViewport (0, 0, win_w, win_h);
 
+    if (enable_pipeline && init_iris_pipeline (&captex) != 0)
+    {
+        fprintf (stderr, "failed to start the pipeline. run serially.\n");
+        enable_pipeline = 0;
+    }
+
 
     /* --------------------------------------- *
      *  Render Loop
@@ -792,47 +1014,73 @@ main(int argc, char *argv[])
         }
 #endif
 
-        /* --------------------------------------- *
-         *  face detection
-         * --------------------------------------- */
-        feed_face_detect_image (&captex, win_w, win_h);
+        if (enable_pipeline)
+        {
+            double invoke_ms[3];
+            run_iris_pipeline (&captex, &face_detect_ret, face_mesh_ret, iris_mesh_ret, invoke_ms);
+            invoke_ms0 = invoke_ms[0];
+            invoke_ms1 = invoke_ms[1];
+            invoke_ms2 = invoke_ms[2];
+        }
+        else
+        {
+            /* --------------------------------------- *
+             *  face detection
+             * --------------------------------------- */
+            feed_face_detect_image (&captex, win_w, win_h);
+
+            ttime[2] = pmeter_get_time_ms ();
+            invoke_face_detect (&face_detect_ret);
+            ttime[3] = pmeter_get_time_ms ();
+            invoke_ms0 = ttime[3] - ttime[2];
+
+            /* --------------------------------------- *
+             *  face landmark
+             * --------------------------------------- */
+            int num_faces = face_detect_ret.num;
+            int num_batch = (num_faces > 0) ? set_facemesh_landmark_batch (num_faces) : 1;
+
+            invoke_ms1 = 0;
+            for (int face_id = 0; face_id < num_faces; face_id += num_batch)
+            {
+                int batch = (num_faces - face_id < num_batch) ? num_faces - face_id : num_batch;
 
-        ttime[2] = pmeter_get_time_ms ();
-        invoke_face_detect (&face_detect_ret);
-        ttime[3] = pmeter_get_time_ms ();
-        invoke_ms0 = ttime[3] - ttime[2];
+                for (int i = 0; i < batch; i ++)
+                    feed_face_landmark_image (&captex, win_w, win_h, &face_detect_ret, face_id + i, i);
 
-        /* --------------------------------------- *
-         *  face landmark
-         * --------------------------------------- */
-        invoke_ms1 = 0;
-        for (int face_id = 0; face_id < face_detect_ret.num; face_id ++)
-        {
-            feed_face_landmark_image (&captex, win_w, win_h, &face_detect_ret, face_id);
+                ttime[4] = pmeter_get_time_ms ();
+                invoke_facemesh_landmark_batch (&face_mesh_ret[face_id], batch);
+                ttime[5] = pmeter_get_time_ms ();
+                invoke_ms1 += ttime[5] - ttime[4];
+            }
 
-            ttime[4] = pmeter_get_time_ms ();
-            invoke_facemesh_landmark (&face_mesh_ret[face_id]);
-            ttime[5] = pmeter_get_time_ms ();
-            invoke_ms1 += ttime[5] - ttime[4];
-        }
+            /* --------------------------------------- *
+             *  Iris landmark (both eyes of all the faces in one batch)
+             * --------------------------------------- */
+            int num_eyes = num_faces * 2;
+            num_batch = (num_eyes > 0) ? set_irismesh_landmark_batch (num_eyes) : 1;
 
-        /* --------------------------------------- *
-         *  Iris landmark
-         * --------------------------------------- */
-        invoke_ms2 = 0;
-        for (int face_id = 0; face_id < face_detect_ret.num; face_id ++)
-        {
-            for (int eye_id = 0; eye_id < 2; eye_id ++)
+            invoke_ms2 = 0;
+            for (int eye_idx = 0; eye_idx < num_eyes; eye_idx += num_batch)
             {
-                feed_iris_landmark_image (&captex, win_w, win_h, &face_detect_ret.faces[face_id], &face_mesh_ret[face_id], eye_id);
+                int batch = (num_eyes - eye_idx < num_batch) ? num_eyes - eye_idx : num_batch;
+
+                for (int i = 0; i < batch; i ++)
+                {
+                    int face_id = (eye_idx + i) / 2;
+                    int eye_id  = (eye_idx + i) % 2;
+                    feed_iris_landmark_image (&captex, win_w, win_h, &face_detect_ret.faces[face_id], &face_mesh_ret[face_id], eye_id, i);
+                }
 
                 ttime[6] = pmeter_get_time_ms ();
-                invoke_irismesh_landmark (&iris_mesh_ret[face_id][eye_id]);
+                invoke_irismesh_landmark_batch (&iris_mesh_ret[0][0] + eye_idx, batch);
                 ttime[7] = pmeter_get_time_ms ();
                 invoke_ms2 += ttime[7] - ttime[6];
             }
+
             /* need to horizontal flip for right eye */
-            flip_horizontal_iris_landmark (&iris_mesh_ret[face_id][1]);
+            for (int face_id = 0; face_id < num_faces; face_id ++)
+                flip_horizontal_iris_landmark (&iris_mesh_ret[face_id][1]);
         }
 
 
@@ -4,7 +4,9 @@
  * ------------------------------------------------ */
 #include "util_tflite.h"
 #include "tflite_facemesh.h"
-#include <list>
+#include "util_nms.h"
+#include "util_ssd_anchors.h"
+#include <algorithm>
 
 /* 
  * https://github.com/google/mediapipe/tree/master/mediapipe/models/face_detection_front.tflite
@@ -33,44 +35,40 @@ static tflite_tensor_t      s_iris_tensor_input;
 static tflite_tensor_t      s_iris_tensor_iris;
 static tflite_tensor_t      s_iris_tensor_eye;
 
-static std::list<fvec2> s_anchors;
+static const nms_anchors_t  *s_anchors;
+static nms_boxes_t          s_face_boxes;
 
 /*
  * determine where the anchor points are scatterd.
  *   https://github.com/tensorflow/tfjs-models/blob/master/blazeface/src/face.ts
+ *
+ *   the same anchors are generated from the SSD options of
+ *   mediapipe/modules/face_detection/face_detection_front_cpu.pbtxt
  */
 static int
 create_blazeface_anchors(int input_w, int input_h)
 {
-    /* ANCHORS_CONFIG  */
-    int strides[2] = {8, 16};
-    int anchors[2] = {2,  6};
-
-    int numtotal = 0;
-
-    for (int i = 0; i < 2; i ++)
-    {
-        int stride = strides[i];
-        int gridCols = (input_w + stride -1) / stride;
-        int gridRows = (input_h + stride -1) / stride;
-        int anchorNum = anchors[i];
+    ssd_anchor_options_t anchor_options;
+    ssd_anchors_default_options (&anchor_options);
+
+    anchor_options.num_layers = 4;
+    anchor_options.min_scale  = 0.1484375f;
+    anchor_options.max_scale  = 0.75f;
+    anchor_options.input_size_width  = input_w;
+    anchor_options.input_size_height = input_h;
+    anchor_options.strides[0] =  8;
+    anchor_options.strides[1] = 16;
+    anchor_options.strides[2] = 16;
+    anchor_options.strides[3] = 16;
+    anchor_options.num_aspect_ratios = 1;
+    anchor_options.aspect_ratios[0]  = 1.0f;
+    anchor_options.fixed_anchor_size = 1;
+
+    s_anchors = ssd_anchors_get (&anchor_options);
+    if (s_anchors == NULL)
+        return -1;
 
-        fvec2 anchor;
-        for (int gridY = 0; gridY < gridRows; gridY ++)
-        {
-            anchor.y = stride * (gridY + 0.5f);
-            for (int gridX = 0; gridX < gridCols; gridX ++)
-            {
-                anchor.x = stride * (gridX + 0.5f);
-                for (int n = 0; n < anchorNum; n ++)
-                {
-                    s_anchors.push_back (anchor);
-                    numtotal ++;
-                }
-            }
-        }
-    }
-    return numtotal;
+    return s_anchors->num;
 }
 
 
@@ -85,6 +83,13 @@ init_tflite_facemesh (int use_quantized_tflite)
     const char *mesh_model;
     const char *iris_model;
 
+    /*
+     *  detection and landmark run one after another: share one CPU worker pool.
+     *  (unless enable_tflite_concurrent_invoke() has been called beforehand)
+     */
+    if (tflite_get_thread_budget_mode () < 0)
+        tflite_init_thread_budget (0, TFLITE_BUDGET_SERIAL);
+
     if (use_quantized_tflite)
     {
         detect_model = FACE_DETECTL_QUANT_MODEL_PATH;
@@ -118,7 +123,8 @@ init_tflite_facemesh (int use_quantized_tflite)
 
     int det_input_w = s_detect_tensor_input.dims[2];
     int det_input_h = s_detect_tensor_input.dims[1];
-    create_blazeface_anchors (det_input_w, det_input_h);
+    int num_anchors = create_blazeface_anchors (det_input_w, det_input_h);
+    nms_init_boxes (&s_face_boxes, num_anchors, kFaceKeyNum);
 
     return 0;
 }
@@ -184,157 +190,15 @@ capture_to_img (char *lpFName, int nW, int nH, float *lpBuf)
 /* -------------------------------------------------- *
  * Invoke TensorFlow Lite (Face detection)
  * -------------------------------------------------- */
-static float *
-get_bbox_ptr (int anchor_idx)
-{
-    int idx = 16 * anchor_idx;
-    float *bboxes_ptr = (float *)s_detect_tensor_bboxes.ptr;
-
-    return &bboxes_ptr[idx];
-}
-
-static int
-decode_bounds (std::list<face_t> &face_list, float score_thresh, int input_img_w, int input_img_h)
-{
-    face_t face_item;
-    float  *scores_ptr = (float *)s_detect_tensor_scores.ptr;
-    
-    int i = 0;
-    for (auto itr = s_anchors.begin(); itr != s_anchors.end(); i ++, itr ++)
-    {
-        fvec2 anchor = *itr;
-        float score0 = scores_ptr[i];
-        float score = 1.0f / (1.0f + exp(-score0));
-
-        if (score > score_thresh)
-        {
-            float *p = get_bbox_ptr (i);
-
-            /* boundary box */
-            float sx = p[0];
-            float sy = p[1];
-            float w  = p[2];
-            float h  = p[3];
-
-            float cx = sx + anchor.x;
-            float cy = sy + anchor.y;
-
-            cx /= (float)input_img_w;
-            cy /= (float)input_img_h;
-            w  /= (float)input_img_w;
-            h  /= (float)input_img_h;
-
-            fvec2 topleft, btmright;
-            topleft.x  = cx - w * 0.5f;
-            topleft.y  = cy - h * 0.5f;
-            btmright.x = cx + w * 0.5f;
-            btmright.y = cy + h * 0.5f;
-
-            face_item.score    = score;
-            face_item.topleft  = topleft;
-            face_item.btmright = btmright;
-
-            /* landmark positions (6 keys) */
-            for (int j = 0; j < kFaceKeyNum; j ++)
-            {
-                float lx = p[4 + (2 * j) + 0];
-                float ly = p[4 + (2 * j) + 1];
-                lx += anchor.x;
-                ly += anchor.y;
-                lx /= (float)input_img_w;
-                ly /= (float)input_img_h;
-
-                face_item.keys[j].x = lx;
-                face_item.keys[j].y = ly;
-            }
-
-            face_list.push_back (face_item);
-        }
-    }
-    return 0;
-}
-
-/* -------------------------------------------------- *
- *  Apply NonMaxSuppression:
- *      https://github.com/tensorflow/tfjs/blob/master/tfjs-core/src/ops/image_ops.ts
- * -------------------------------------------------- */
-static float
-calc_intersection_over_union (face_t &face0, face_t &face1)
-{
-    float sx0 = face0.topleft.x;
-    float sy0 = face0.topleft.y;
-    float ex0 = face0.btmright.x;
-    float ey0 = face0.btmright.y;
-    float sx1 = face1.topleft.x;
-    float sy1 = face1.topleft.y;
-    float ex1 = face1.btmright.x;
-    float ey1 = face1.btmright.y;
-    
-    float xmin0 = std::min (sx0, ex0);
-    float ymin0 = std::min (sy0, ey0);
-    float xmax0 = std::max (sx0, ex0);
-    float ymax0 = std::max (sy0, ey0);
-    float xmin1 = std::min (sx1, ex1);
-    float ymin1 = std::min (sy1, ey1);
-    float xmax1 = std::max (sx1, ex1);
-    float ymax1 = std::max (sy1, ey1);
-    
-    float area0 = (ymax0 - ymin0) * (xmax0 - xmin0);
-    float area1 = (ymax1 - ymin1) * (xmax1 - xmin1);
-    if (area0 <= 0 || area1 <= 0)
-        return 0.0f;
-
-    float intersect_xmin = std::max (xmin0, xmin1);
-    float intersect_ymin = std::max (ymin0, ymin1);
-    float intersect_xmax = std::min (xmax0, xmax1);
-    float intersect_ymax = std::min (ymax0, ymax1);
-
-    float intersect_area = std::max (intersect_ymax - intersect_ymin, 0.0f) *
-                           std::max (intersect_xmax - intersect_xmin, 0.0f);
-    
-    return intersect_area / (area0 + area1 - intersect_area);
-}
-
-static bool
-compare (face_t &v1, face_t &v2)
-{
-    if (v1.score > v2.score)
-        return true;
-    else
-        return false;
-}
-
 static int
-non_max_suppression (std::list<face_t> &face_list, std::list<face_t> &face_sel_list, float iou_thresh)
+decode_bounds (nms_boxes_t *boxes, float score_thresh, int input_img_w, int input_img_h)
 {
-    face_list.sort (compare);
-
-    for (auto itr = face_list.begin(); itr != face_list.end(); itr ++)
-    {
-        face_t face_candidate = *itr;
-
-        int ignore_candidate = false;
-        for (auto itr_sel = face_sel_list.rbegin(); itr_sel != face_sel_list.rend(); itr_sel ++)
-        {
-            face_t face_sel = *itr_sel;
-
-            float iou = calc_intersection_over_union (face_candidate, face_sel);
-            if (iou >= iou_thresh)
-            {
-                ignore_candidate = true;
-                break;
-            }
-        }
-
-        if (!ignore_candidate)
-        {
-            face_sel_list.push_back(face_candidate);
-            if (face_sel_list.size() >= MAX_FACE_NUM)
-                break;
-        }
-    }
+    float *scores_ptr = (float *)s_detect_tensor_scores.ptr;
+    float *bboxes_ptr = (float *)s_detect_tensor_bboxes.ptr;
 
-    return 0;
+    /* boundary box and landmark positions (6 keys), 16 floats per anchor */
+    return nms_decode_anchors (boxes, s_anchors, scores_ptr, bboxes_ptr, 16,
+                               (float)input_img_w, (float)input_img_h, score_thresh);
 }
 
 /* -------------------------------------------------- *
@@ -425,7 +289,7 @@ compute_face_rect (face_t &face)
 }
 
 static bool
-sort_right_major (face_t &v1, face_t &v2)
+sort_right_major (const face_t &v1, const face_t &v2)
 {
     if (v1.keys[kRightEye].x > v2.keys[kRightEye].x)
         return true;
@@ -434,25 +298,34 @@ sort_right_major (face_t &v1, face_t &v2)
 }
 
 static void
-pack_face_result (face_detect_result_t *facedet_result, std::list<face_t> &face_list)
+pack_face_result (face_detect_result_t *facedet_result, nms_boxes_t *boxes, int *sel, int num_sel)
 {
-    face_list.sort (sort_right_major);
-
     int num_faces = 0;
-    for (auto itr = face_list.begin(); itr != face_list.end(); itr ++)
+    for (int i = 0; i < num_sel && num_faces < MAX_FACE_NUM; i ++)
     {
-        face_t face = *itr;
+        face_t *face = &facedet_result->faces[num_faces];
+        int    idx   = sel[i];
+        float  *keys = nms_get_keys (boxes, idx);
 
-        compute_rotation (face);
-        compute_face_rect (face);
+        face->score      = boxes->score[idx];
+        face->topleft.x  = boxes->x0[idx];
+        face->topleft.y  = boxes->y0[idx];
+        face->btmright.x = boxes->x1[idx];
+        face->btmright.y = boxes->y1[idx];
 
-        memcpy (&facedet_result->faces[num_faces], &face, sizeof (face));
-        num_faces ++;
-        facedet_result->num = num_faces;
+        for (int j = 0; j < kFaceKeyNum; j ++)
+        {
+            face->keys[j].x = keys[2 * j + 0];
+            face->keys[j].y = keys[2 * j + 1];
+        }
 
-        if (num_faces >= MAX_FACE_NUM)
-            break;
+        compute_rotation (*face);
+        compute_face_rect (*face);
+        num_faces ++;
     }
+    facedet_result->num = num_faces;
+
+    std::stable_sort (facedet_result->faces, facedet_result->faces + num_faces, sort_right_major);
 }
 
 
@@ -463,7 +336,7 @@ int
 invoke_face_detect (face_detect_result_t *facedet_result)
 {
     //capture_to_img ("detect", s_detect_tensor_input.dims[2], s_detect_tensor_input.dims[1], (float *)s_detect_tensor_input.ptr);
-    if (s_detect_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_detect_interpreter) != 0)
     {
         fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
@@ -471,22 +344,17 @@ invoke_face_detect (face_detect_result_t *facedet_result)
 
     /* decode boundary box and landmark keypoints */
     float score_thresh = 0.75f;
-    std::list<face_t> face_list;
 
     int input_img_w = s_detect_tensor_input.dims[2];
     int input_img_h = s_detect_tensor_input.dims[1];
-    decode_bounds (face_list, score_thresh, input_img_w, input_img_h);
-
+    decode_bounds (&s_face_boxes, score_thresh, input_img_w, input_img_h);
 
-#if 1 /* USE NMS */
     float iou_thresh = 0.3f;
-    std::list<face_t> face_nms_list;
+    int   sel[MAX_FACE_NUM];
+    int   num_sel;
 
-    non_max_suppression (face_list, face_nms_list, iou_thresh);
-    pack_face_result (facedet_result, face_nms_list);
-#else
-    pack_face_result (facedet_result, face_list);
-#endif
+    num_sel = nms_hard (&s_face_boxes, iou_thresh, sel, MAX_FACE_NUM);
+    pack_face_result (facedet_result, &s_face_boxes, sel, num_sel);
 
     return 0;
 }
@@ -550,82 +418,129 @@ compute_eye_roi (face_landmark_result_t *facemesh_result)
     compute_eye_roi_one (facemesh_result, 1, 362, 263);
 }
  
+/*
+ *  set the number of faces processed by one invoke_facemesh_landmark_batch().
+ *  returns the batch size in effect (1 if the model can't be batched).
+ *  the input image of the n-th face goes to
+ *      get_facemesh_landmark_input_buf() + n * (w * h * 3)
+ */
 int
-invoke_facemesh_landmark (face_landmark_result_t *facemesh_result)
+set_facemesh_landmark_batch (int batch)
+{
+    batch = tflite_resize_batch (&s_mesh_interpreter, batch);
+
+    tflite_update_tensor (&s_mesh_interpreter, &s_mesh_tensor_input);
+    tflite_update_tensor (&s_mesh_interpreter, &s_mesh_tensor_landmark);
+    tflite_update_tensor (&s_mesh_interpreter, &s_mesh_tensor_score);
+
+    return (batch > 0) ? batch : 1;
+}
+
+int
+invoke_facemesh_landmark_batch (face_landmark_result_t *facemesh_result, int batch)
 {
     //capture_to_img ("mesh", s_mesh_tensor_input.dims[2], s_mesh_tensor_input.dims[1], (float *)s_mesh_tensor_input.ptr);
-    if (s_mesh_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_mesh_interpreter) != 0)
     {
         fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
     }
 
-    float *meshscore_ptr = (float *)s_mesh_tensor_score.ptr;
-    float *landmark_ptr  = (float *)s_mesh_tensor_landmark.ptr;
     int img_w = s_mesh_tensor_input.dims[2];
     int img_h = s_mesh_tensor_input.dims[1];
 
-    facemesh_result->score = *meshscore_ptr;
-    //fprintf (stderr, "meshscore = %f\n", *meshscore_ptr);
-    
-    for (int i = 0; i < FACE_KEY_NUM; i ++)
+    for (int n = 0; n < batch; n ++)
     {
-        facemesh_result->joint[i].x = landmark_ptr[3 * i + 0] / (float)img_w;
-        facemesh_result->joint[i].y = landmark_ptr[3 * i + 1] / (float)img_h;
-        facemesh_result->joint[i].z = landmark_ptr[3 * i + 2];
-        //fprintf (stderr, "[%2d] (%8.1f, %8.1f, %8.1f)\n", i, 
-        //    landmark_ptr[3 * i + 0], landmark_ptr[3 * i + 1], landmark_ptr[3 * i + 2]);
-    }
+        float *meshscore_ptr = (float *)s_mesh_tensor_score.ptr + n;
+        float *landmark_ptr  = (float *)s_mesh_tensor_landmark.ptr + n * FACE_KEY_NUM * 3;
+        face_landmark_result_t *result = &facemesh_result[n];
 
-    compute_eye_roi (facemesh_result);
+        result->score = *meshscore_ptr;
+
+        for (int i = 0; i < FACE_KEY_NUM; i ++)
+        {
+            result->joint[i].x = landmark_ptr[3 * i + 0] / (float)img_w;
+            result->joint[i].y = landmark_ptr[3 * i + 1] / (float)img_h;
+            result->joint[i].z = landmark_ptr[3 * i + 2];
+        }
+
+        compute_eye_roi (result);
+    }
 
     return 0;
 }
 
+int
+invoke_facemesh_landmark (face_landmark_result_t *facemesh_result)
+{
+    return invoke_facemesh_landmark_batch (facemesh_result, 1);
+}
+
 /* -------------------------------------------------- *
  * Invoke TensorFlow Lite (Irismesh landmark)
  * -------------------------------------------------- */
 
 
 
+/*
+ *  set the number of eyes processed by one invoke_irismesh_landmark_batch().
+ *  returns the batch size in effect (1 if the model can't be batched).
+ */
 int
-invoke_irismesh_landmark (irismesh_result_t *irismesh_result)
+set_irismesh_landmark_batch (int batch)
+{
+    batch = tflite_resize_batch (&s_iris_interpreter, batch);
+
+    tflite_update_tensor (&s_iris_interpreter, &s_iris_tensor_input);
+    tflite_update_tensor (&s_iris_interpreter, &s_iris_tensor_eye);
+    tflite_update_tensor (&s_iris_interpreter, &s_iris_tensor_iris);
+
+    return (batch > 0) ? batch : 1;
+}
+
+int
+invoke_irismesh_landmark_batch (irismesh_result_t *irismesh_result, int batch)
 {
     //capture_to_img ("iris", 64, 64, (float *)s_iris_tensor_input.ptr);
-    //fprintf (stderr, "DUMP: %p\n", s_iris_tensor_input.ptr);
-    
-    if (s_iris_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_iris_interpreter) != 0)
     {
         fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
     }
 
-    float *eye_landmark_ptr = (float *)s_iris_tensor_eye.ptr;
-    float *landmark_ptr     = (float *)s_iris_tensor_iris.ptr;
     int img_w = s_iris_tensor_input.dims[2];
     int img_h = s_iris_tensor_input.dims[1];
 
-    for (int i = 0; i < 71; i ++)
+    for (int n = 0; n < batch; n ++)
     {
-        irismesh_result->eye_landmark[i].x = eye_landmark_ptr[3 * i + 0] / (float)img_w;
-        irismesh_result->eye_landmark[i].y = eye_landmark_ptr[3 * i + 1] / (float)img_h;
-        irismesh_result->eye_landmark[i].z = eye_landmark_ptr[3 * i + 2];
-        // fprintf (stderr, "[%2d] (%8.1f, %8.1f, %8.1f)\n", i, 
-        //    eye_landmark_ptr[3 * i + 0], eye_landmark_ptr[3 * i + 1], eye_landmark_ptr[3 * i + 2]);
-    }
+        float *eye_landmark_ptr = (float *)s_iris_tensor_eye.ptr  + n * 71 * 3;
+        float *landmark_ptr     = (float *)s_iris_tensor_iris.ptr + n *  5 * 3;
+        irismesh_result_t *result = &irismesh_result[n];
 
-    for (int i = 0; i < 5; i ++)
-    {
-        irismesh_result->iris_landmark[i].x = landmark_ptr[3 * i + 0] / (float)img_w;
-        irismesh_result->iris_landmark[i].y = landmark_ptr[3 * i + 1] / (float)img_h;
-        irismesh_result->iris_landmark[i].z = landmark_ptr[3 * i + 2];
-        //fprintf (stderr, "[%2d] (%8.1f, %8.1f, %8.1f)\n", i, 
-        //    landmark_ptr[3 * i + 0], landmark_ptr[3 * i + 1], landmark_ptr[3 * i + 2]);
+        for (int i = 0; i < 71; i ++)
+        {
+            result->eye_landmark[i].x = eye_landmark_ptr[3 * i + 0] / (float)img_w;
+            result->eye_landmark[i].y = eye_landmark_ptr[3 * i + 1] / (float)img_h;
+            result->eye_landmark[i].z = eye_landmark_ptr[3 * i + 2];
+        }
+
+        for (int i = 0; i < 5; i ++)
+        {
+            result->iris_landmark[i].x = landmark_ptr[3 * i + 0] / (float)img_w;
+            result->iris_landmark[i].y = landmark_ptr[3 * i + 1] / (float)img_h;
+            result->iris_landmark[i].z = landmark_ptr[3 * i + 2];
+        }
     }
 
     return 0;
 }
 
+int
+invoke_irismesh_landmark (irismesh_result_t *irismesh_result)
+{
+    return invoke_irismesh_landmark_batch (irismesh_result, 1);
+}
+
 
 
 /*
@@ -88,15 +88,20 @@ typedef struct _irismesh_result_t
 
 
 int  init_tflite_facemesh (int use_quantized_tflite);
+int  enable_tflite_concurrent_invoke ();    /* util_tflite.cpp */
 
 void *get_face_detect_input_buf (int *w, int *h);
 int  invoke_face_detect (face_detect_result_t *facedet_result);
 
 void *get_facemesh_landmark_input_buf (int *w, int *h);
 int  invoke_facemesh_landmark (face_landmark_result_t *facemesh_result);
+int  set_facemesh_landmark_batch (int batch);
+int  invoke_facemesh_landmark_batch (face_landmark_result_t *facemesh_result, int batch);
 
 void *get_irismesh_landmark_input_buf (int *w, int *h);
 int  invoke_irismesh_landmark (irismesh_result_t *eyemesh_result);
+int  set_irismesh_landmark_batch (int batch);
+int  invoke_irismesh_landmark_batch (irismesh_result_t *eyemesh_result, int batch);
 
 int
 get_static_facemesh_landmark (face_detect_result_t   *facedet_result,
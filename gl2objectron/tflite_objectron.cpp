@@ -20,9 +20,19 @@
 
 #include "util_tflite.h"
 #include "tflite_objectron.h"
-#include <list>
+#include "util_heatmap.h"
 #include "Eigen/Dense"
 
+#if defined (__SSE2__)
+#define VOTING_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#define VOTING_NEON
+#include <arm_neon.h>
+#endif
+
 /* 
  * https://github.com/google/mediapipe/blob/master/mediapipe/models/object_detection_3d_chair.tflite
  * https://github.com/google/mediapipe/blob/master/mediapipe/models/object_detection_3d_sneakers.tflite
@@ -43,6 +53,13 @@ static tflite_tensor_t      s_detect_tensor_heatmap;
 
 static int s_need_post_logistic = 0;
 
+/*
+ *  scratch of the post process. it is sized once in init_tflite_objectron(),
+ *  and the decode of a frame makes no heap allocation.
+ */
+static heatmap_filter_t     s_hmp_filter;   /* belief of each tile, and its (5x5) max */
+static heatmap_peak_t       *s_hmp_peaks;   /* center keypoints */
+
 /*
  * https://github.com/google/mediapipe/tree/master/mediapipe/graphs/object_detection_3d/calculators/tflite_tensors_to_objects_calculator.cc
  */
@@ -71,6 +88,19 @@ init_tflite_objectron (int use_quantized_tflite)
         tflite_get_tensor_by_name (&s_detect_interpreter, 1, "Identity_1", &s_detect_tensor_offsetmap); /*  40x 30x16 */
     }
 
+    /* (5x5) MAX filter to find the center keypoints */
+    int hmp_w = s_detect_tensor_heatmap.dims[2];
+    int hmp_h = s_detect_tensor_heatmap.dims[1];
+    int local_max_distance = 2;
+    if (heatmap_init_filter (&s_hmp_filter, hmp_w, hmp_h, local_max_distance) < 0)
+        return -1;
+    s_hmp_peaks = (heatmap_peak_t *)malloc (hmp_w * hmp_h * sizeof (heatmap_peak_t));
+    if (s_hmp_peaks == NULL)
+    {
+        fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
     projection_matrix_ <<
       1.5731,     0,       0,    0,
       0,     2.0975,       0,    0,
@@ -121,77 +151,98 @@ get_heatmap_val (int x, int y)
     return val;
 }
 
-static float
-get_max_value (int cx, int cy, int hmp_w, int hmp_h, int kern_size)
+/*
+ *  s_hmp_filter.plane keeps the belief of each tile after this, and the
+ *  voting reads it from there.
+ */
+static int
+extract_center_keypoints ()
 {
-    int sx = cx - (kern_size / 2);
-    int ex = cx + (kern_size / 2) + 1;
-    int sy = cy - (kern_size / 2);
-    int ey = cy + (kern_size / 2) + 1;
-
-    sx = std::max (sx, 0);
-    ex = std::min (ex, hmp_w);
-    sy = std::max (sy, 0);
-    ey = std::min (ey, hmp_h);
-
-    float max_val = 0;
-    for (int y = sy; y < ey; y ++)
-    {
-        for (int x = sx; x < ex; x ++)
-        {
-            float val = get_heatmap_val (x, y);
-            max_val = std::max (val, max_val);
-        }
-    }
-
-    return max_val;
-}
+    int hmp_w = s_hmp_filter.w;
+    int hmp_h = s_hmp_filter.h;
 
-static void
-dilate_heatmap (float *dst_hmp, int hmp_w, int hmp_h, int kern_size)
-{
+    /* the belief of each tile (the logistic is applied once per tile here) */
     for (int y = 0; y < hmp_h; y ++)
     {
         for (int x = 0; x < hmp_w; x ++)
         {
-            dst_hmp[hmp_w * y + x] = get_max_value (x, y, hmp_w, hmp_h, kern_size);
+            s_hmp_filter.plane[hmp_w * y + x] = get_heatmap_val (x, y);
         }
     }
+
+    /* apply (5x5) MAX filter */
+    heatmap_max_filter (&s_hmp_filter);
+
+    float heatmap_threshold = 0.6f;
+    return heatmap_find_peaks (&s_hmp_filter, heatmap_threshold, s_hmp_peaks, hmp_w * hmp_h);
 }
 
+/*
+ *  accumulate the votes of one tile for the 8 keypoints.
+ *  all the arrays are (x, y) interleaved like the offsetmap: [2 * 8]
+ *  a keypoint takes the vote only when both x and y are in the allowance.
+ */
 static void
-extract_center_keypoints (std::list<fvec2> &center_points)
+vote_tile (const float *offsets, float base_x, float base_y, float belief,
+           const float *scale, const float *center_votes, float allowance,
+           float *sum, float *votes)
 {
-    int hmp_w = s_detect_tensor_heatmap.dims[2];
-    int hmp_h = s_detect_tensor_heatmap.dims[1];
-
-    float *max_filtered_heatmap = (float *)malloc (hmp_w * hmp_h * sizeof (float));
-
-    /* apply (5x5) MAX filter */
-    int local_max_distance = 2;
-    int kernel_size = static_cast<int>(local_max_distance * 2 + 1 + 0.5f);
-    dilate_heatmap (max_filtered_heatmap, hmp_w, hmp_h, kernel_size);
+#if defined (VOTING_SSE2)
+    __m128 vbase  = _mm_setr_ps (base_x, base_y, base_x, base_y);
+    __m128 vbelief= _mm_set1_ps (belief);
+    __m128 vallow = _mm_set1_ps (allowance);
+    __m128 vabs   = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
 
-    float heatmap_threshold = 0.6f;
-    for (int y = 0; y < hmp_h; y ++)
+    for (int j = 0; j < 16; j += 4)
     {
-        for (int x = 0; x < hmp_w; x ++)
-        {
-            float center_hmp_val = get_heatmap_val (x, y);
-            float max_hmp_val    = max_filtered_heatmap[hmp_w * y + x];
+        __m128 vote = _mm_add_ps (vbase, _mm_mul_ps (_mm_loadu_ps (&offsets[j]), _mm_loadu_ps (&scale[j])));
+        __m128 diff = _mm_and_ps (_mm_sub_ps (vote, _mm_loadu_ps (&center_votes[j])), vabs);
+        __m128 ok   = _mm_cmple_ps (diff, vallow);
+        ok = _mm_and_ps (ok, _mm_shuffle_ps (ok, ok, _MM_SHUFFLE (2, 3, 0, 1)));
+
+        __m128 vsum = _mm_add_ps (_mm_loadu_ps (&sum[j]),   _mm_and_ps (ok, _mm_mul_ps (vote, vbelief)));
+        __m128 vcnt = _mm_add_ps (_mm_loadu_ps (&votes[j]), _mm_and_ps (ok, vbelief));
+        _mm_storeu_ps (&sum[j],   vsum);
+        _mm_storeu_ps (&votes[j], vcnt);
+    }
+#elif defined (VOTING_NEON)
+    float32x4_t vbelief = vdupq_n_f32 (belief);
+    float32x4_t vallow  = vdupq_n_f32 (allowance);
+    float32x2_t vbase2  = {base_x, base_y};
+    float32x4_t vbase   = vcombine_f32 (vbase2, vbase2);
 
-            if ((center_hmp_val >= heatmap_threshold) &&
-                (center_hmp_val >= max_hmp_val))
-            {
-                fvec2 locations;
-                locations.x = x;
-                locations.y = y;
-                center_points.push_back (locations);
-            }
-        }
+    for (int j = 0; j < 16; j += 4)
+    {
+        float32x4_t vote = vaddq_f32 (vbase, vmulq_f32 (vld1q_f32 (&offsets[j]), vld1q_f32 (&scale[j])));
+        float32x4_t diff = vabdq_f32 (vote, vld1q_f32 (&center_votes[j]));
+        uint32x4_t  ok   = vcleq_f32 (diff, vallow);
+        ok = vandq_u32 (ok, vrev64q_u32 (ok));
+
+        float32x4_t wvote = vmulq_f32 (vote, vbelief);
+        float32x4_t vsum = vaddq_f32 (vld1q_f32 (&sum[j]),
+                                      vreinterpretq_f32_u32 (vandq_u32 (ok, vreinterpretq_u32_f32 (wvote))));
+        float32x4_t vcnt = vaddq_f32 (vld1q_f32 (&votes[j]),
+                                      vreinterpretq_f32_u32 (vandq_u32 (ok, vreinterpretq_u32_f32 (vbelief))));
+        vst1q_f32 (&sum[j],   vsum);
+        vst1q_f32 (&votes[j], vcnt);
     }
+#else
+    for (int j = 0; j < 16; j += 2)
+    {
+        float vote_x = base_x + offsets[j    ] * scale[j    ];
+        float vote_y = base_y + offsets[j + 1] * scale[j + 1];
+        float x_diff = std::abs (vote_x - center_votes[j    ]);
+        float y_diff = std::abs (vote_y - center_votes[j + 1]);
+
+        if (x_diff > allowance || y_diff > allowance)
+            continue;
 
-    free (max_filtered_heatmap);
+        sum[j    ] += vote_x * belief;
+        sum[j + 1] += vote_y * belief;
+        votes[j    ] += belief;
+        votes[j + 1] += belief;
+    }
+#endif
 }
 
 /*
@@ -201,14 +252,20 @@ void
 decode_by_voting (int cx, int cy, float offset_scale_x, float offset_scale_y, object_t *obj)
 {
     float *offsetmap = (float *)s_detect_tensor_offsetmap.ptr;
+    float *beliefmap = s_hmp_filter.plane;
     int   map_w = s_detect_tensor_offsetmap.dims[2];
     int   map_h = s_detect_tensor_offsetmap.dims[1];
+    int   hmp_w = s_hmp_filter.w;
     float *center_offset = &offsetmap[16 * ((cy * map_w) + cx)];
 
     /* transform BBOX offsetmap. (relative offset) --> (absolute offset) */
-    float *center_votes = (float *)malloc (16 * map_w * map_h * sizeof (float));
+    float scale[16], center_votes[16];
+    float sum[16]   = {0};
+    float votes[16] = {0};
     for (int i = 0; i < 8; i ++)
     {
+        scale[2 * i    ] = offset_scale_x;
+        scale[2 * i + 1] = offset_scale_y;
         center_votes[2 * i    ] = cx + center_offset[2 * i    ] * offset_scale_x;
         center_votes[2 * i + 1] = cy + center_offset[2 * i + 1] * offset_scale_y;
     }
@@ -222,45 +279,28 @@ decode_by_voting (int cx, int cy, float offset_scale_x, float offset_scale_y, ob
 
     float voting_threshold = 0.2f;
     float voting_allowance = 1.0f;
-    for (int i = 0; i < 8; i ++)
+    for (int r = 0; r < height; r ++)
     {
-        float x_sum = 0.0f;
-        float y_sum = 0.0f;
-        float votes = 0.0f;
-
-        for (int r = 0; r < height; r ++)
+        for (int c = 0; c < width; c ++)
         {
-            for (int c = 0; c < width; c ++)
-            {
-                int idx_x = c + x_min;
-                int idx_y = r + y_min;
-
-                float belief = get_heatmap_val (idx_x, idx_y);
-                if (belief < voting_threshold)
-                    continue;
-
-                float *cur_offsetmap = &offsetmap[16 * ((idx_y * map_w) + idx_x)];
+            int idx_x = c + x_min;
+            int idx_y = r + y_min;
 
-                float offset_x = cur_offsetmap[2 * i    ] * offset_scale_x;
-                float offset_y = cur_offsetmap[2 * i + 1] * offset_scale_y;
-                float vote_x   = c + x_min + offset_x;
-                float vote_y   = r + y_min + offset_y;
-                float x_diff   = std::abs (vote_x - center_votes[2 * i    ]);
-                float y_diff   = std::abs (vote_y - center_votes[2 * i + 1]);
+            float belief = beliefmap[hmp_w * idx_y + idx_x];
+            if (belief < voting_threshold)
+                continue;
 
-                if (x_diff > voting_allowance || y_diff > voting_allowance)
-                    continue;
-
-                x_sum += vote_x * belief;
-                y_sum += vote_y * belief;
-                votes += belief;
-            }
+            float *cur_offsetmap = &offsetmap[16 * ((idx_y * map_w) + idx_x)];
+            vote_tile (cur_offsetmap, (float)idx_x, (float)idx_y, belief,
+                       scale, center_votes, voting_allowance, sum, votes);
         }
-        obj->bbox[i].x = x_sum / votes;
-        obj->bbox[i].y = y_sum / votes;
     }
 
-    free (center_votes);
+    for (int i = 0; i < 8; i ++)
+    {
+        obj->bbox[i].x = sum[2 * i    ] / votes[2 * i    ];
+        obj->bbox[i].y = sum[2 * i + 1] / votes[2 * i + 1];
+    }
 }
 
 
@@ -282,10 +322,11 @@ IsIdentical (const object_t& box_1, const object_t& box_2)
 
 
 static bool
-IsNewBox (std::list<object_t> *obj_list, object_t *obj_item)
+IsNewBox (object_t *obj_list, int num_obj, object_t *obj_item)
 {
-    for (auto& b : *obj_list)
+    for (int i = 0; i < num_obj; i ++)
     {
+        object_t &b = obj_list[i];
         if (IsIdentical (b, *obj_item))
         {
             if (b.belief < obj_item->belief)
@@ -359,7 +400,7 @@ Lift2DTo3D(
     // only! If you use other Eigen Solvers, it's not guaranteed to be in
     // increasing order. Here, we just take the eigen vector corresponding
     // to first/smallest eigen value, since we used SelfAdjointEigenSolver.
-    Eigen::VectorXf eigen_vec = eigen_solver.eigenvectors().col(0);
+    Eigen::Matrix<float, 12, 1> eigen_vec = eigen_solver.eigenvectors().col(0);
     Eigen::Map<Eigen::Matrix<float, 4, 3, Eigen::RowMajor>> control_matrix(
         eigen_vec.data());
     if (control_matrix(0, 2) > 0) {
@@ -418,25 +459,6 @@ Project3DTo2D (bool portrait, object_t *object)
 
 
 
-static void
-pack_objectron_result (objectron_result_t *objectron_result, std::list<object_t> &bbox_list)
-{
-    int num_obj = 0;
-    for (auto itr = bbox_list.begin(); itr != bbox_list.end(); itr ++)
-    {
-        object_t obj_item = *itr;
-
-        memcpy (&objectron_result->objects[num_obj], &obj_item, sizeof (obj_item));
-
-        num_obj++;
-        objectron_result->num = num_obj;
-
-        if (num_obj >= MAX_OBJECT_NUM)
-            break;
-    }
-}
-
-
 /* -------------------------------------------------- *
  * Invoke TensorFlow Lite
  * -------------------------------------------------- */
@@ -459,21 +481,29 @@ invoke_objectron (objectron_result_t *objectron_result)
     float offset_scaley = ofstmap_h;
 #endif
 
-    std::list<fvec2> center_points;
-    extract_center_keypoints (center_points);
+    int num_peaks = extract_center_keypoints ();
 
-    std::list<object_t> obj_list;
-    for (auto &center_point : center_points)
+    /*
+     *  the objects go to the result directly. a new box after MAX_OBJECT_NUM
+     *  is dropped, but it still can replace the identical one in the result.
+     */
+    object_t *obj_list = objectron_result->objects;
+    int num_obj = 0;
+    for (int n = 0; n < num_peaks; n ++)
     {
+        fvec2 center_point;
+        center_point.x = s_hmp_peaks[n].x;
+        center_point.y = s_hmp_peaks[n].y;
+
         int cx = static_cast<int>(std::round(center_point.x));
         int cy = static_cast<int>(std::round(center_point.y));
         object_t obj_item = {0};
 
-        obj_item.belief = get_heatmap_val (cx, cy);
+        obj_item.belief = s_hmp_filter.plane[s_hmp_filter.w * cy + cx];
         decode_by_voting (cx, cy, offset_scalex, offset_scaley, &obj_item);
 
         /* eliminate duplicate bbox */
-        if (!IsNewBox (&obj_list, &obj_item))
+        if (!IsNewBox (obj_list, num_obj, &obj_item) || num_obj >= MAX_OBJECT_NUM)
         {
             continue;
         }
@@ -489,10 +519,9 @@ invoke_objectron (objectron_result_t *objectron_result)
 
         obj_item.center_x = center_point.x / (float)ofstmap_w;
         obj_item.center_y = center_point.y / (float)ofstmap_h;
-        obj_list.push_back (obj_item);
+        obj_list[num_obj ++] = obj_item;
     }
-
-    pack_objectron_result (objectron_result, obj_list);
+    objectron_result->num = num_obj;
 
     return 0;
 }
@@ -97,6 +97,8 @@ gen_shape_buffers (int nDivU, int nDivV, shape_obj_t *pshape)
     glBufferData (GL_ELEMENT_ARRAY_BUFFER, bufSize, pIndex, GL_STATIC_DRAW);
     glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
 
+    pshape->index = pIndex;
+
     return 0;
 }
 
@@ -240,12 +242,14 @@ generate_shape (PFUNCTION function, shape_param_t *sparam, shape_obj_t *shape)
 
     glBindBuffer (GL_ARRAY_BUFFER, 0 );
 
-    shape->num_faces = get_num_faces(nSampleU, nSampleV);
+    shape->num_faces  = get_num_faces(nSampleU, nSampleV);
+    shape->num_vertex = nVertex;
+    shape->vertex     = pVertex;
+    shape->normal     = pNormal;
 
-    free (pVertex);
     free (pColor );
-    free (pNormal);
     free (pUV    );
+    free (pTangent);
 }
 
 static void func_Plan(float u,float v, float* x,float* y,float* z)
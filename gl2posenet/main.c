@@ -13,8 +13,9 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
 #include "tflite_posenet.h"
-#include "ssbo_tensor.h"
+#include "util_preprocess.h"
 #include "util_camera_capture.h"
 #include "util_video_decode.h"
 #include "particle.h"
@@ -27,14 +28,31 @@
 
 
 
+#if defined (USE_INPUT_SSBO)
+static preproc_t s_preproc_ssbo;
+#endif
+
 /* resize image to DNN network input size and convert to fp32. */
 void
-feed_posenet_image(texture_2d_t *srctex, ssbo_t *ssbo, int win_w, int win_h)
+feed_posenet_image(texture_2d_t *srctex, int win_w, int win_h)
 {
+    int w, h;
 #if defined (USE_INPUT_SSBO)
-    resize_texture_to_ssbo (srctex->texid, ssbo);
-#else
-    int x, y, w, h;
+    if (s_preproc_ssbo.ssbo_id)
+    {
+        /*
+         *  the compute shader writes the input tensor into the SSBO, which the
+         *  GL delegate reads directly. (NULL: the SSBO is bound to the delegate)
+         */
+        void *buf_fp32 = get_posenet_input_buf (&w, &h);
+        UNUSED (win_w);
+        UNUSED (win_h);
+
+        preprocess_texture (&s_preproc_ssbo, srctex, NULL);
+        preprocess_get_tensor (&s_preproc_ssbo, buf_fp32);
+        return;
+    }
+#endif
 #if defined (USE_QUANT_TFLITE_MODEL)
     unsigned char *buf_u8 = (unsigned char *)get_posenet_input_buf (&w, &h);
 #else
@@ -56,27 +74,12 @@ feed_posenet_image(texture_2d_t *srctex, ssbo_t *ssbo, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [0, 1] */
     float mean =   0.0f;
     float std  = 255.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
 #if defined (USE_QUANT_TFLITE_MODEL)
-            *buf_u8 ++ = r;
-            *buf_u8 ++ = g;
-            *buf_u8 ++ = b;
+    pixconv_rgba8_to_rgb8 (buf_ui8, w * h, buf_u8);
 #else
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 #endif
-        }
-    }
 
-#endif
     return;
 }
 
@@ -141,7 +144,10 @@ render_posenet_result (int x, int y, int w, int h, posenet_result_t *pose_ret)
     float col_lime[]   = {0.0f, 1.0f, 0.3f, 1.0f};
     float col_pink[]   = {1.0f, 0.0f, 1.0f, 1.0f};
     float col_blue[]   = {0.0f, 0.5f, 1.0f, 1.0f};
-    
+
+    /* the bones and the key points of all the poses in one draw call */
+    begin_2d_batch ();
+
     for (int i = 0; i < pose_ret->num; i ++)
     {
         /* draw skelton */
@@ -179,11 +185,14 @@ render_posenet_result (int x, int y, int w, int h, posenet_result_t *pose_ret)
             float y0 = pose_ret->pose[i].key[kRightWrist].y * h + y;
             float x1 = pose_ret->pose[i].key[kLeftWrist].x * w + x;
             float y1 = pose_ret->pose[i].key[kLeftWrist].y * h + y;
+            flush_2d_batch ();
             render_posenet_particle (x0, y0, x1, y1);
         }
 #endif
     }
 
+    end_2d_batch ();
+
 #if defined (USE_FACE_MASK)
     render_facemask (x, y, w, h, pose_ret);
 #endif
@@ -318,7 +327,7 @@ main(int argc, char *argv[])
     int win_h = 600;
     int texw, texh, draw_x, draw_y, draw_w, draw_h;
     texture_2d_t captex = {0};
-    ssbo_t *ssbo = NULL;
+    unsigned int input_ssbo = 0;
     double ttime[10] = {0}, interval, invoke_ms;
     int use_quantized_tflite = 0;
     int enable_camera = 1;
@@ -365,10 +374,16 @@ main(int argc, char *argv[])
     init_dbgstr (win_w, win_h);
 
 #if defined (USE_INPUT_SSBO)
-    ssbo = init_ssbo_tensor (512, 512);
+    /* the SSBO tensor is FP32 only */
+    if (!use_quantized_tflite)
+    {
+        init_preprocess (&s_preproc_ssbo, PREPROC_BACKEND_SSBO, POSENET_INPUT_W, POSENET_INPUT_H,
+                         PREPROC_TYPE_FP32, 0.0f, 255.0f);
+        input_ssbo = preprocess_get_ssbo (&s_preproc_ssbo);
+    }
 #endif
 
-    init_tflite_posenet (use_quantized_tflite, ssbo);
+    init_tflite_posenet (use_quantized_tflite, input_ssbo);
 
 #if defined (USE_GL_DELEGATE) || defined (USE_GPU_DELEGATEV2)
     /* we need to recover framebuffer because GPU Delegate changes the FBO binding */
@@ -448,7 +463,7 @@ main(int argc, char *argv[])
         /* --------------------------------------- *
          *  pose estimation
          * --------------------------------------- */
-        feed_posenet_image (&captex, ssbo, win_w, win_h);
+        feed_posenet_image (&captex, win_w, win_h);
 
         ttime[2] = pmeter_get_time_ms ();
         invoke_posenet (&pose_ret);
@@ -459,11 +474,8 @@ main(int argc, char *argv[])
          *  render scene
          * --------------------------------------- */
         glClear (GL_COLOR_BUFFER_BIT);
+        begin_dbgstr_batch ();
 
-#if defined (USE_INPUT_SSBO) /* for Debug. */
-        /* visualize the contents of SSBO for input tensor. */
-        visualize_ssbo (ssbo);
-#endif
         /* visualize the object detection results. */
         draw_2d_texture_ex (&captex, draw_x, draw_y, draw_w, draw_h, 0);
         render_posenet_result (draw_x, draw_y, draw_w, draw_h, &pose_ret);
@@ -479,6 +491,7 @@ main(int argc, char *argv[])
 
         sprintf (strbuf, "Interval:%5.1f [ms]\nTFLite  :%5.1f [ms]", interval, invoke_ms);
         draw_dbgstr (strbuf, 10, 10);
+        end_dbgstr_batch ();
 
         egl_swap();
     }
@@ -0,0 +1,442 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "posenet_decode.h"
+#include "util_debug.h"
+
+/* the part candidates are the local max in (2 * LOCAL_MAX_RAD + 1)^2 window */
+#define LOCAL_MAX_RAD   1
+
+typedef struct keypoint_t {
+    float pos_x;
+    float pos_y;
+    float score;
+    int   valid;
+} keypoint_t;
+
+
+static int pose_edges[][2] =
+{
+    /* parent,        child */
+    { kNose,          kLeftEye      },  //  0
+    { kLeftEye,       kLeftEar      },  //  1
+    { kNose,          kRightEye     },  //  2
+    { kRightEye,      kRightEar     },  //  3
+    { kNose,          kLeftShoulder },  //  4
+    { kLeftShoulder,  kLeftElbow    },  //  5
+    { kLeftElbow,     kLeftWrist    },  //  6
+    { kLeftShoulder,  kLeftHip      },  //  7
+    { kLeftHip,       kLeftKnee     },  //  8
+    { kLeftKnee,      kLeftAnkle    },  //  9
+    { kNose,          kRightShoulder},  // 10
+    { kRightShoulder, kRightElbow   },  // 11
+    { kRightElbow,    kRightWrist   },  // 12
+    { kRightShoulder, kRightHip     },  // 13
+    { kRightHip,      kRightKnee    },  // 14
+    { kRightKnee,     kRightAnkle   },  // 15
+};
+
+
+int
+posenet_init_decoder (posenet_decoder_t *dec, int img_w, int img_h,
+                      int hmp_w, int hmp_h, int edge_num, int max_poses)
+{
+    memset (dec, 0, sizeof (*dec));
+
+    dec->img_w    = img_w;
+    dec->img_h    = img_h;
+    dec->hmp_w    = hmp_w;
+    dec->hmp_h    = hmp_h;
+    dec->edge_num = edge_num;
+    posenet_set_max_poses (dec, max_poses);
+
+    if (heatmap_init_filter (&dec->filter, hmp_w, hmp_h, LOCAL_MAX_RAD) < 0)
+        return -1;
+
+    dec->peaks = (heatmap_peak_t *)malloc (hmp_w * hmp_h * sizeof (heatmap_peak_t));
+    dec->parts = (part_score_t   *)malloc (hmp_w * hmp_h * kPoseKeyNum * sizeof (part_score_t));
+    if (dec->peaks == NULL || dec->parts == NULL)
+    {
+        DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
+        posenet_destroy_decoder (dec);
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+posenet_destroy_decoder (posenet_decoder_t *dec)
+{
+    heatmap_destroy_filter (&dec->filter);
+    free (dec->peaks);
+    free (dec->parts);
+    memset (dec, 0, sizeof (*dec));
+}
+
+void
+posenet_set_max_poses (posenet_decoder_t *dec, int max_poses)
+{
+    dec->max_poses = std::min (std::max (max_poses, 1), MAX_POSE_NUM);
+}
+
+
+static float
+get_heatmap_score (posenet_decoder_t *dec, int idx_y, int idx_x, int key_id)
+{
+    int idx = (idx_y * dec->hmp_w * kPoseKeyNum) + (idx_x * kPoseKeyNum) + key_id;
+    return dec->heatmap[idx];
+}
+
+static void
+get_displacement_vector (posenet_decoder_t *dec, const float *disp_buf, float *dis_x, float *dis_y,
+                         int idx_y, int idx_x, int edge_id)
+{
+    int edge_num = dec->edge_num;
+    int idx0 = (idx_y * dec->hmp_w * edge_num*2) + (idx_x * edge_num*2) + (edge_id + edge_num);
+    int idx1 = (idx_y * dec->hmp_w * edge_num*2) + (idx_x * edge_num*2) + (edge_id);
+
+    *dis_x = disp_buf[idx0];
+    *dis_y = disp_buf[idx1];
+}
+
+static void
+get_offset_vector (posenet_decoder_t *dec, float *ofst_x, float *ofst_y, int idx_y, int idx_x, int pose_id)
+{
+    int idx0 = (idx_y * dec->hmp_w * kPoseKeyNum*2) + (idx_x * kPoseKeyNum*2) + (pose_id + kPoseKeyNum);
+    int idx1 = (idx_y * dec->hmp_w * kPoseKeyNum*2) + (idx_x * kPoseKeyNum*2) + (pose_id);
+
+    *ofst_x = dec->offsets[idx0];
+    *ofst_y = dec->offsets[idx1];
+}
+
+
+/* -------------------------------------------------- *
+ *  root candidates
+ *
+ *   all the candidates go into a binary heap at once (O(N)), and only the
+ *   roots actually visited are popped (O(log N) each). the decode usually
+ *   stops after a few poses, long before the queue gets empty.
+ * -------------------------------------------------- */
+
+/*
+ *  (a) comes later than (b): the lower score first, and the equal scores
+ *  in the raster order of (y, x, key).
+ */
+static bool
+part_comes_later (const part_score_t &a, const part_score_t &b)
+{
+    if (a.score != b.score) return a.score < b.score;
+    if (a.idx_y != b.idx_y) return a.idx_y > b.idx_y;
+    if (a.idx_x != b.idx_x) return a.idx_x > b.idx_x;
+    return a.key_id > b.key_id;
+}
+
+int
+posenet_build_root_queue (posenet_decoder_t *dec, float score_thresh)
+{
+    heatmap_filter_t *filter = &dec->filter;
+    int num_parts = 0;
+
+    for (int key = 0; key < kPoseKeyNum; key ++)
+    {
+        heatmap_load_channel (filter, dec->heatmap, kPoseKeyNum, key);
+        heatmap_max_filter (filter);
+
+        /* the scores above the thresh, and no higher score near the pixel */
+        int num_peaks = heatmap_find_peaks (filter, score_thresh, dec->peaks, dec->hmp_w * dec->hmp_h);
+        for (int i = 0; i < num_peaks; i ++)
+        {
+            part_score_t *item = &dec->parts[num_parts ++];
+            item->score = dec->peaks[i].score;
+            item->idx_x = dec->peaks[i].x;
+            item->idx_y = dec->peaks[i].y;
+            item->key_id= key;
+        }
+    }
+
+    std::make_heap (dec->parts, dec->parts + num_parts, part_comes_later);
+    dec->num_parts = num_parts;
+
+    return num_parts;
+}
+
+int
+posenet_pop_root (posenet_decoder_t *dec, part_score_t *root)
+{
+    if (dec->num_parts <= 0)
+        return 0;
+
+    *root = dec->parts[0];
+    std::pop_heap (dec->parts, dec->parts + dec->num_parts, part_comes_later);
+    dec->num_parts --;
+
+    return 1;
+}
+
+
+/*
+ *  0      28.5    57.1    85.6   114.2   142.7   171.3   199.9   228.4   257   [pos_x]
+ *  |---+---|---+---|---+---|---+---|---+---|---+---|---+---|---+---|---+---|
+ *     0.0     1.0     2.0     3.0     4.0     5.0     6.0     7.0     8.0      [hmp_pos_x]
+ */
+static void
+get_pos_to_near_index (posenet_decoder_t *dec, float pos_x, float pos_y, int *idx_x, int *idx_y)
+{
+    float ratio_x = pos_x / (float)dec->img_w;
+    float ratio_y = pos_y / (float)dec->img_h;
+
+    float hmp_pos_x = ratio_x * (dec->hmp_w - 1);
+    float hmp_pos_y = ratio_y * (dec->hmp_h - 1);
+
+    int hmp_idx_x = roundf (hmp_pos_x);
+    int hmp_idx_y = roundf (hmp_pos_y);
+
+    hmp_idx_x = std::min (hmp_idx_x, dec->hmp_w -1);
+    hmp_idx_y = std::min (hmp_idx_y, dec->hmp_h -1);
+    hmp_idx_x = std::max (hmp_idx_x, 0);
+    hmp_idx_y = std::max (hmp_idx_y, 0);
+
+    *idx_x = hmp_idx_x;
+    *idx_y = hmp_idx_y;
+}
+
+static void
+get_index_to_pos (posenet_decoder_t *dec, int idx_x, int idx_y, int key_id, float *pos_x, float *pos_y)
+{
+    float ofst_x, ofst_y;
+    get_offset_vector (dec, &ofst_x, &ofst_y, idx_y, idx_x, key_id);
+
+    float rel_x = (float)idx_x / (float)(dec->hmp_w -1);
+    float rel_y = (float)idx_y / (float)(dec->hmp_h -1);
+
+    float pos0_x = rel_x * dec->img_w;
+    float pos0_y = rel_y * dec->img_h;
+
+    *pos_x = pos0_x + ofst_x;
+    *pos_y = pos0_y + ofst_y;
+}
+
+
+static keypoint_t
+traverse_to_tgt_key (posenet_decoder_t *dec, int edge, keypoint_t src_key, int tgt_key_id, const float *disp)
+{
+    float src_pos_x = src_key.pos_x;
+    float src_pos_y = src_key.pos_y;
+
+    int src_idx_x, src_idx_y;
+    get_pos_to_near_index (dec, src_pos_x, src_pos_y, &src_idx_x, &src_idx_y);
+
+    /* get displacement vector from source to target */
+    float disp_x, disp_y;
+    get_displacement_vector (dec, disp, &disp_x, &disp_y, src_idx_y, src_idx_x, edge);
+
+    /* calculate target position */
+    float tgt_pos_x = src_pos_x + disp_x;
+    float tgt_pos_y = src_pos_y + disp_y;
+
+    int tgt_idx_x, tgt_idx_y;
+    int offset_refine_step = 2;
+    for (int i = 0; i < offset_refine_step; i ++)
+    {
+        get_pos_to_near_index (dec, tgt_pos_x, tgt_pos_y, &tgt_idx_x, &tgt_idx_y);
+        get_index_to_pos (dec, tgt_idx_x, tgt_idx_y, tgt_key_id, &tgt_pos_x, &tgt_pos_y);
+    }
+
+    keypoint_t tgt_key = {0};
+    tgt_key.pos_x = tgt_pos_x;
+    tgt_key.pos_y = tgt_pos_y;
+    tgt_key.score = get_heatmap_score (dec, tgt_idx_y, tgt_idx_x, tgt_key_id);
+    tgt_key.valid = 1;
+
+    return tgt_key;
+}
+
+static void
+decode_pose (posenet_decoder_t *dec, part_score_t &root, keypoint_t *keys)
+{
+    /* calculate root key position. */
+    int idx_x = root.idx_x;
+    int idx_y = root.idx_y;
+    int keyid = root.key_id;
+
+    float pos_x, pos_y;
+    get_index_to_pos (dec, idx_x, idx_y, keyid, &pos_x, &pos_y);
+
+    keys[keyid].pos_x = pos_x;
+    keys[keyid].pos_y = pos_y;
+    keys[keyid].score = root.score;
+    keys[keyid].valid = 1;
+
+    for (int edge = dec->edge_num - 1; edge >= 0; edge --)
+    {
+        int src_key_id = pose_edges[edge][1];
+        int tgt_key_id = pose_edges[edge][0];
+
+        if ( keys[src_key_id].valid &&
+            !keys[tgt_key_id].valid)
+        {
+            keys[tgt_key_id] = traverse_to_tgt_key (dec, edge, keys[src_key_id], tgt_key_id, dec->bw_disp);
+        }
+    }
+
+    for (int edge = 0; edge < dec->edge_num; edge ++)
+    {
+        int src_key_id = pose_edges[edge][0];
+        int tgt_key_id = pose_edges[edge][1];
+
+        if ( keys[src_key_id].valid &&
+            !keys[tgt_key_id].valid)
+        {
+            keys[tgt_key_id] = traverse_to_tgt_key (dec, edge, keys[src_key_id], tgt_key_id, dec->fw_disp);
+        }
+    }
+}
+
+static bool
+within_nms_of_corresponding_point (posenet_decoder_t *dec, posenet_result_t *pose_result,
+                        float pos_x, float pos_y, int key_id, float nms_rad)
+{
+    for (int i = 0; i < pose_result->num; i ++)
+    {
+        pose_t *pose = &pose_result->pose[i];
+        float prev_pos_x = pose->key[key_id].x * dec->img_w;
+        float prev_pos_y = pose->key[key_id].y * dec->img_h;
+
+        float dx = pos_x - prev_pos_x;
+        float dy = pos_y - prev_pos_y;
+        float len = (dx * dx) + (dy * dy);
+
+        if (len <= (nms_rad * nms_rad))
+            return true;
+    }
+    return false;
+}
+
+static float
+get_instance_score (posenet_decoder_t *dec, posenet_result_t *pose_result, keypoint_t *keys, float nms_rad)
+{
+    float score_total = 0.0f;
+    for (int i = 0; i < kPoseKeyNum; i ++)
+    {
+        float pos_x = keys[i].pos_x;
+        float pos_y = keys[i].pos_y;
+        if (within_nms_of_corresponding_point (dec, pose_result, pos_x, pos_y, i, nms_rad))
+            continue;
+
+        score_total += keys[i].score;
+    }
+    return score_total / (float)kPoseKeyNum;
+}
+
+static int
+regist_detected_pose (posenet_decoder_t *dec, posenet_result_t *pose_result, keypoint_t *keys, float score)
+{
+    int pose_id = pose_result->num;
+    if (pose_id >= MAX_POSE_NUM)
+    {
+        DBG_LOGE ("ERR: %s(%d): pose_num overflow.\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    for (int i = 0; i < kPoseKeyNum; i++)
+    {
+        pose_result->pose[pose_id].key[i].x     = keys[i].pos_x / (float)dec->img_w;
+        pose_result->pose[pose_id].key[i].y     = keys[i].pos_y / (float)dec->img_h;
+        pose_result->pose[pose_id].key[i].score = keys[i].score;
+    }
+
+    pose_result->pose[pose_id].pose_score = score;
+    pose_result->num ++;
+
+    return 0;
+}
+
+
+void
+posenet_decode_multiple_poses (posenet_decoder_t *dec, posenet_result_t *pose_result)
+{
+    float score_thresh  = 0.5f;
+    posenet_build_root_queue (dec, score_thresh);
+
+    memset (pose_result, 0, sizeof (posenet_result_t));
+
+    part_score_t root;
+    while (pose_result->num < dec->max_poses && posenet_pop_root (dec, &root))
+    {
+        float pos_x, pos_y;
+        get_index_to_pos (dec, root.idx_x, root.idx_y, root.key_id, &pos_x, &pos_y);
+
+        float nms_rad = 20.0f;
+        if (within_nms_of_corresponding_point (dec, pose_result, pos_x, pos_y, root.key_id, nms_rad))
+            continue;
+
+        keypoint_t key_points[kPoseKeyNum] = {0};
+        decode_pose (dec, root, key_points);
+
+        float score = get_instance_score (dec, pose_result, key_points, nms_rad);
+        regist_detected_pose (dec, pose_result, key_points, score);
+    }
+}
+
+void
+posenet_decode_single_pose (posenet_decoder_t *dec, posenet_result_t *pose_result)
+{
+    int   max_block_idx[kPoseKeyNum][2] = {0};
+    float max_block_cnf[kPoseKeyNum]    = {0};
+
+    /* find the highest heatmap block for each key */
+    for (int i = 0; i < kPoseKeyNum; i ++)
+    {
+        heatmap_peak_t peak;
+        heatmap_load_channel (&dec->filter, dec->heatmap, kPoseKeyNum, i);
+        heatmap_find_max (&dec->filter, &peak);
+
+        max_block_cnf[i]    = peak.score;
+        max_block_idx[i][0] = peak.x;
+        max_block_idx[i][1] = peak.y;
+    }
+
+#if 0
+    for (int i = 0; i < kPoseKeyNum; i ++)
+    {
+        fprintf (stderr, "---------[%d] --------\n", i);
+        for (int y = 0; y < dec->hmp_h; y ++)
+        {
+            fprintf (stderr, "[%d] ", y);
+            for (int x = 0; x < dec->hmp_w; x ++)
+            {
+                float confidence = get_heatmap_score (dec, y, x, i);
+                fprintf (stderr, "%6.3f ", confidence);
+
+                if (x == max_block_idx[i][0] && y == max_block_idx[i][1])
+                    fprintf (stderr, "#");
+                else
+                    fprintf (stderr, " ");
+            }
+            fprintf (stderr, "\n");
+        }
+    }
+#endif
+
+    /* find the offset vector and calculate the keypoint coordinates. */
+    for (int i = 0; i < kPoseKeyNum;i ++ )
+    {
+        int idx_x = max_block_idx[i][0];
+        int idx_y = max_block_idx[i][1];
+        float key_posex, key_posey;
+        get_index_to_pos (dec, idx_x, idx_y, i, &key_posex, &key_posey);
+
+        pose_result->pose[0].key[i].x     = key_posex / (float)dec->img_w;
+        pose_result->pose[0].key[i].y     = key_posey / (float)dec->img_h;
+        pose_result->pose[0].key[i].score = max_block_cnf[i];
+    }
+    pose_result->num = 1;
+    pose_result->pose[0].pose_score = 1.0f;
+}
@@ -0,0 +1,62 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _POSENET_DECODE_H_
+#define _POSENET_DECODE_H_
+
+#include "tflite_posenet.h"
+#include "util_heatmap.h"
+
+/*
+ *  multi-pose decoder of PoseNet.
+ *    https://github.com/tensorflow/tfjs-models/tree/master/posenet/src/multi_pose
+ *
+ *  it takes the raw output tensors only, so that it can run apart from
+ *  the interpreter (tools/posenet_decode_bench).
+ */
+typedef struct _part_score_t
+{
+    float score;
+    int   idx_x;
+    int   idx_y;
+    int   key_id;
+} part_score_t;
+
+typedef struct _posenet_decoder_t
+{
+    int     img_w, img_h;       /* model input size */
+    int     hmp_w, hmp_h;       /* heatmap size     */
+    int     edge_num;
+    int     max_poses;          /* 1 - MAX_POSE_NUM */
+
+    /* output tensors of the current frame */
+    const float *heatmap;       /* [hmp_h][hmp_w][kPoseKeyNum]     */
+    const float *offsets;       /* [hmp_h][hmp_w][kPoseKeyNum * 2] */
+    const float *fw_disp;       /* [hmp_h][hmp_w][edge_num * 2]    */
+    const float *bw_disp;       /* [hmp_h][hmp_w][edge_num * 2]    */
+
+    /* preallocated storage */
+    heatmap_filter_t filter;
+    heatmap_peak_t  *peaks;     /* [hmp_h * hmp_w]               */
+    part_score_t    *parts;     /* [hmp_h * hmp_w * kPoseKeyNum] */
+    int             num_parts;  /* heap of the root candidates   */
+} posenet_decoder_t;
+
+int  posenet_init_decoder (posenet_decoder_t *dec, int img_w, int img_h,
+                           int hmp_w, int hmp_h, int edge_num, int max_poses);
+void posenet_destroy_decoder (posenet_decoder_t *dec);
+void posenet_set_max_poses (posenet_decoder_t *dec, int max_poses);
+
+void posenet_decode_multiple_poses (posenet_decoder_t *dec, posenet_result_t *pose_result);
+void posenet_decode_single_pose    (posenet_decoder_t *dec, posenet_result_t *pose_result);
+
+/*
+ *  the root candidates: the local max parts above the thresh.
+ *  posenet_pop_root() returns them in the descending score order
+ *  (the equal scores in the raster order of (y, x, key)), 0 when empty.
+ */
+int  posenet_build_root_queue (posenet_decoder_t *dec, float score_thresh);
+int  posenet_pop_root (posenet_decoder_t *dec, part_score_t *root);
+
+#endif /* _POSENET_DECODE_H_ */
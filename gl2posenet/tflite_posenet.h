@@ -5,8 +5,6 @@
 #ifndef TFLITE_DETECT_H_
 #define TFLITE_DETECT_H_
 
-#include "ssbo_tensor.h"
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -59,10 +57,14 @@ typedef struct _posenet_result_t
 
 
 
-int   init_tflite_posenet (int use_quantized_tflite, ssbo_t *ssbo);
+#define POSENET_INPUT_W     257
+#define POSENET_INPUT_H     257
+
+int   init_tflite_posenet (int use_quantized_tflite, unsigned int input_ssbo);
 void  *get_posenet_input_buf (int *w, int *h);
 
 int invoke_posenet (posenet_result_t *pose_result);
+void set_posenet_max_poses (int max_poses);
 
 #ifdef __cplusplus
 }
@@ -13,6 +13,8 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
+#include "util_segmap.h"
 #include "tflite_deeplab.h"
 #include "util_camera_capture.h"
 #include "util_video_decode.h"
@@ -27,7 +29,7 @@
 void
 feed_deeplab_image(texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_deeplab_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -45,19 +47,7 @@ feed_deeplab_image(texture_2d_t *srctex, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [ 0, 1] */
     float mean =   0.0f;
     float std  = 255.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, w * h, buf_fp32, mean, std);
 
     return;
 }
@@ -71,50 +61,41 @@ render_deeplab_result (int ofstx, int ofsty, int draw_w, int draw_h,
     int segmap_w  = deeplab_ret->segmentmap_dims[0];
     int segmap_h  = deeplab_ret->segmentmap_dims[1];
     int segmap_c  = deeplab_ret->segmentmap_dims[2];
-    int x, y, c;
-    unsigned int imgbuf[segmap_h][segmap_w];
+    int c;
+    static segmap_t s_segmap;
+    static int s_gpu_argmax = 0;
 
-    /* find the most confident class for each pixel. */
-    for (y = 0; y < segmap_h; y ++)
+    if (s_segmap.class_map == NULL)
     {
-        for (x = 0; x < segmap_w; x ++)
+        unsigned int palette[21];
+        for (c = 0; c < 21; c ++)
         {
-            int max_id;
-            float conf_max = 0;
-            for (c = 0; c < 21; c ++)
-            {
-                float confidence = segmap[(y * segmap_w * segmap_c)+ (x * segmap_c) + c];
-                if (c == 0 || confidence > conf_max)
-                {
-                    conf_max = confidence;
-                    max_id = c;
-                }
-            }
-            float *col = get_deeplab_class_color (max_id);
+            float *col = get_deeplab_class_color (c);
             unsigned char r = ((int)(col[0] * 255)) & 0xff;
             unsigned char g = ((int)(col[1] * 255)) & 0xff;
             unsigned char b = ((int)(col[2] * 255)) & 0xff;
             unsigned char a = ((int)(col[3] * 255)) & 0xff;
-            imgbuf[y][x] = (a << 24) | (b << 16) | (g << 8) | (r);
+            palette[c] = (a << 24) | (b << 16) | (g << 8) | (r);
         }
-    }
-    
-    GLuint texid;
-    glGenTextures (1, &texid );
-    glBindTexture (GL_TEXTURE_2D, texid);
 
-    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameterf (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+        segmap_init (&s_segmap, segmap_w, segmap_h);
+        segmap_set_palette (&s_segmap, palette, 21);
 
-    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA,
-        segmap_w, segmap_h, 0, GL_RGBA,
-        GL_UNSIGNED_BYTE, imgbuf);
+        if (segmap_init_gpu (&s_segmap, segmap_c) == 0)
+            s_gpu_argmax = 1;
+    }
 
-    draw_2d_texture (texid, ofstx, ofsty, draw_w, draw_h, 0);
+    /* find the most confident class for each pixel, and color it on GPU. */
+    if (s_gpu_argmax)
+    {
+        segmap_update_gpu (&s_segmap, segmap, 21);
+        draw_2d_texture_ex (&s_segmap.colortex, ofstx, ofsty, draw_w, draw_h, 0);
+    }
+    else
+    {
+        segmap_update (&s_segmap, segmap, segmap_c, 21);
+        draw_2d_classmap (&s_segmap.classtex, s_segmap.palette_texid, ofstx, ofsty, draw_w, draw_h, 1.0f, 0);
+    }
 
     /* class name */
     for (c = 0; c < 21; c ++)
@@ -126,8 +107,6 @@ render_deeplab_result (int ofstx, int ofsty, int draw_w, int draw_h,
         sprintf (buf, "%2d:%s", c, name);
         draw_dbgstr_ex (buf, ofstx, ofsty + c * 22 * 0.7, 0.7f, col_str, col);
     }
-
-    glDeleteTextures (1, &texid);
 }
 
 void
@@ -113,7 +113,7 @@ get_deeplab_class_color (int class_idx)
 int
 invoke_deeplab (deeplab_result_t *deeplab_result)
 {
-    if (s_interpreter.interpreter->Invoke() != kTfLiteOk)
+    if (tflite_invoke (&s_interpreter) != 0)
     {
         DBG_LOGE ("ERR: %s(%d)\n", __FILE__, __LINE__);
         return -1;
@@ -13,6 +13,7 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
 #include "util_matrix.h"
 #include "tflite_textdet.h"
 #include "util_camera_capture.h"
@@ -29,7 +30,7 @@
 void
 feed_textdet_image(texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_textdet_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -44,19 +45,13 @@ feed_textdet_image(texture_2d_t *srctex, int win_w, int win_h)
     glPixelStorei (GL_PACK_ALIGNMENT, 4);
     glReadPixels (0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, buf_ui8);
 
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)r - 123.68;
-            *buf_fp32 ++ = (float)g - 116.779;
-            *buf_fp32 ++ = (float)b - 103.939;
-        }
-    }
+    /* convert UI8 [0, 255] ==> FP32 (subtract ImageNet mean) */
+    pixconv_param_t prm;
+    pixconv_init_param (&prm, PIXCONV_SRC_RGBA8, PIXCONV_DST_FP32, 0.0f, 1.0f);
+    prm.mean[0] = 123.68f;
+    prm.mean[1] = 116.779f;
+    prm.mean[2] = 103.939f;
+    convert_pixels (&prm, buf_ui8, w, h, buf_fp32);
 
     return;
 }
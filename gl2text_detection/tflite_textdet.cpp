@@ -4,7 +4,7 @@
  * ------------------------------------------------ */
 #include "util_tflite.h"
 #include "tflite_textdet.h"
-#include <list>
+#include "util_nms.h"
 
 /* 
  * https://tfhub.dev/sayakpaul/lite-model/east-text-detector/int8/1
@@ -19,6 +19,8 @@ static tflite_tensor_t      s_detect_tensor_scores;
 static tflite_tensor_t      s_detect_tensor_geometry;
 static tflite_tensor_t      s_detect_tensor_angle;
 
+static nms_boxes_t          s_text_boxes;
+
 
 
 
@@ -52,6 +54,9 @@ init_tflite_textdet(int use_quantized_tflite, detect_config_t *config)
         tflite_get_tensor_by_name (&s_detect_interpreter, 1, "feature_fusion/concat_3",       &s_detect_tensor_geometry);
     }
 
+    /* a candidate box for each cell of the score map */
+    int num_cells = s_detect_tensor_scores.dims[1] * s_detect_tensor_scores.dims[2];
+    nms_init_boxes (&s_text_boxes, num_cells, 0);
 
     config->score_thresh = 0.75f;
     config->iou_thresh   = 0.3f;
@@ -111,152 +116,68 @@ get_angle_ptr (int x, int y)
  * https://colab.research.google.com/github/sayakpaul/Adventures-in-TensorFlow-Lite/blob/master/EAST_TFLite.ipynb
  */
 static int
-decode_bounds (std::list<detect_region_t> &detect_list, float score_thresh, int input_img_w, int input_img_h)
+decode_bounds (nms_boxes_t *boxes, float score_thresh, int input_img_w, int input_img_h)
 {
-    detect_region_t detect_item;
     float  *scores_ptr = (float *)s_detect_tensor_scores.ptr;
     float img_w = (float)s_detect_tensor_input.dims[2];
     float img_h = (float)s_detect_tensor_input.dims[1];
     int score_w = s_detect_tensor_scores.dims[2];
     int score_h = s_detect_tensor_scores.dims[1];
 
-    for (int y = 0; y < score_h; y ++) 
-    {
-        for (int x = 0; x < score_w; x ++)
-        {
-            float score = scores_ptr[score_w * y + x];
-
-            if (score < score_thresh)
-                continue;
-
-            float *geom_ptr  = get_geometry_ptr (x, y);
-            float *angle_ptr = get_angle_ptr (x, y);
-
-            float offset_x = x * 4;
-            float offset_y = y * 4;
-            float angle = angle_ptr[0];
-            float h = geom_ptr[0] + geom_ptr[2];
-            float w = geom_ptr[1] + geom_ptr[3];
-
-            float end_x = offset_x + cos(angle) * geom_ptr[1] + sin(angle) * geom_ptr[2];
-            float end_y = offset_y - sin(angle) * geom_ptr[1] + cos(angle) * geom_ptr[2];
-            float start_x = end_x - w;
-            float start_y = end_y - h;
-
-            fvec2 topleft, btmright;
-            topleft.x  = start_x / img_w;
-            topleft.y  = start_y / img_h;
-            btmright.x = end_x   / img_w;
-            btmright.y = end_y   / img_h;
-
-            detect_item.score    = score;
-            detect_item.topleft  = topleft;
-            detect_item.btmright = btmright;
-            detect_item.angle    = angle;
-
-            detect_list.push_back (detect_item);
-        }
-    }
-    return 0;
-}
-
-/* -------------------------------------------------- *
- *  Apply NonMaxSuppression:
- *      https://github.com/tensorflow/tfjs/blob/master/tfjs-core/src/ops/image_ops.ts
- * -------------------------------------------------- */
-static float
-calc_intersection_over_union (detect_region_t &region0, detect_region_t &region1)
-{
-    float sx0 = region0.topleft.x;
-    float sy0 = region0.topleft.y;
-    float ex0 = region0.btmright.x;
-    float ey0 = region0.btmright.y;
-    float sx1 = region1.topleft.x;
-    float sy1 = region1.topleft.y;
-    float ex1 = region1.btmright.x;
-    float ey1 = region1.btmright.y;
-    
-    float xmin0 = std::min (sx0, ex0);
-    float ymin0 = std::min (sy0, ey0);
-    float xmax0 = std::max (sx0, ex0);
-    float ymax0 = std::max (sy0, ey0);
-    float xmin1 = std::min (sx1, ex1);
-    float ymin1 = std::min (sy1, ey1);
-    float xmax1 = std::max (sx1, ex1);
-    float ymax1 = std::max (sy1, ey1);
-    
-    float area0 = (ymax0 - ymin0) * (xmax0 - xmin0);
-    float area1 = (ymax1 - ymin1) * (xmax1 - xmin1);
-    if (area0 <= 0 || area1 <= 0)
-        return 0.0f;
-
-    float intersect_xmin = std::max (xmin0, xmin1);
-    float intersect_ymin = std::max (ymin0, ymin1);
-    float intersect_xmax = std::min (xmax0, xmax1);
-    float intersect_ymax = std::min (ymax0, ymax1);
-
-    float intersect_area = std::max (intersect_ymax - intersect_ymin, 0.0f) *
-                           std::max (intersect_xmax - intersect_xmin, 0.0f);
-    
-    return intersect_area / (area0 + area1 - intersect_area);
-}
-
-static bool
-compare (detect_region_t &v1, detect_region_t &v2)
-{
-    if (v1.score > v2.score)
-        return true;
-    else
-        return false;
-}
-
-static int
-non_max_suppression (std::list<detect_region_t> &detect_list, std::list<detect_region_t> &detect_sel_list, float iou_thresh)
-{
-    detect_list.sort (compare);
+    int num = nms_filter_scores (scores_ptr, score_w * score_h, score_thresh,
+                                 boxes->index, boxes->max_num);
 
-    for (auto itr = detect_list.begin(); itr != detect_list.end(); itr ++)
+    for (int i = 0; i < num; i ++)
     {
-        detect_region_t detect_candidate = *itr;
-
-        int ignore_candidate = false;
-        for (auto itr_sel = detect_sel_list.rbegin(); itr_sel != detect_sel_list.rend(); itr_sel ++)
-        {
-            detect_region_t detect_sel = *itr_sel;
-
-            float iou = calc_intersection_over_union (detect_candidate, detect_sel);
-            if (iou >= iou_thresh)
-            {
-                ignore_candidate = true;
-                break;
-            }
-        }
-
-        if (!ignore_candidate)
-        {
-            detect_sel_list.push_back(detect_candidate);
-            if (detect_sel_list.size() >= MAX_TEXT_NUM)
-                break;
-        }
+        int idx = boxes->index[i];
+        int x   = idx % score_w;
+        int y   = idx / score_w;
+
+        float *geom_ptr  = get_geometry_ptr (x, y);
+        float *angle_ptr = get_angle_ptr (x, y);
+
+        float offset_x = x * 4;
+        float offset_y = y * 4;
+        float angle = angle_ptr[0];
+        float h = geom_ptr[0] + geom_ptr[2];
+        float w = geom_ptr[1] + geom_ptr[3];
+
+        float end_x = offset_x + cos(angle) * geom_ptr[1] + sin(angle) * geom_ptr[2];
+        float end_y = offset_y - sin(angle) * geom_ptr[1] + cos(angle) * geom_ptr[2];
+        float start_x = end_x - w;
+        float start_y = end_y - h;
+
+        boxes->score[i] = scores_ptr[idx];
+        boxes->x0[i]    = start_x / img_w;
+        boxes->y0[i]    = start_y / img_h;
+        boxes->x1[i]    = end_x   / img_w;
+        boxes->y1[i]    = end_y   / img_h;
     }
 
+    boxes->num = num;
     return 0;
 }
 
 static void
-pack_detect_result (detect_result_t *detect_result, std::list<detect_region_t> &detect_list)
+pack_detect_result (detect_result_t *detect_result, nms_boxes_t *boxes, int *sel, int num_sel)
 {
+    int score_w = s_detect_tensor_scores.dims[2];
+
     int num_detects = 0;
-    for (auto itr = detect_list.begin(); itr != detect_list.end(); itr ++)
+    for (int i = 0; i < num_sel && num_detects < MAX_TEXT_NUM; i ++)
     {
-        detect_region_t detect = *itr;
-        memcpy (&detect_result->texts[num_detects], &detect, sizeof (detect));
+        detect_region_t *detect = &detect_result->texts[num_detects];
+        int idx = boxes->index[sel[i]];
+
+        detect->score      = boxes->score[sel[i]];
+        detect->topleft.x  = boxes->x0[sel[i]];
+        detect->topleft.y  = boxes->y0[sel[i]];
+        detect->btmright.x = boxes->x1[sel[i]];
+        detect->btmright.y = boxes->y1[sel[i]];
+        detect->angle      = get_angle_ptr (idx % score_w, idx / score_w)[0];
         num_detects ++;
-        detect_result->num = num_detects;
-
-        if (num_detects >= MAX_TEXT_NUM)
-            break;
     }
+    detect_result->num = num_detects;
 }
 
 
@@ -272,23 +193,19 @@ invoke_textdet (detect_result_t *detect_result, detect_config_t *config)
         return -1;
     }
 
-    /* decode boundary box and landmark keypoints */
+    /* decode boundary box */
     float score_thresh = config->score_thresh;
-    std::list<detect_region_t> detect_list;
 
     int input_img_w = s_detect_tensor_input.dims[2];
     int input_img_h = s_detect_tensor_input.dims[1];
-    decode_bounds (detect_list, score_thresh, input_img_w, input_img_h);
+    decode_bounds (&s_text_boxes, score_thresh, input_img_w, input_img_h);
 
-#if 1 /* USE NMS */
     float iou_thresh = config->iou_thresh;
-    std::list<detect_region_t> detect_nms_list;
+    int   sel[MAX_TEXT_NUM];
+    int   num_sel;
 
-    non_max_suppression (detect_list, detect_nms_list, iou_thresh);
-    pack_detect_result (detect_result, detect_nms_list);
-#else
-    pack_detect_result (detect_result, detect_list);
-#endif
+    num_sel = nms_hard (&s_text_boxes, iou_thresh, sel, MAX_TEXT_NUM);
+    pack_detect_result (detect_result, &s_text_boxes, sel, num_sel);
 
     return 0;
 }
@@ -0,0 +1,297 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "util_bench.h"
+#include "detect_postprocess.h"
+
+/*
+ *  microbenchmark of the detection post process of gl2detection.
+ *
+ *  the optimized engine (detect_postprocess.cpp) and the clone of
+ *  detection_postprocess.cc (detect_postprocess_ref.cpp) are run on the
+ *  same synthetic SSD outputs, and the results are compared:
+ *    exact   : same detections in the same order, bit identical.
+ *    reorder : same detections, only the order of equal scores differs.
+ *    MISMATCH: anything else. (the tool returns -1)
+ */
+#define NUM_CLASSES_WITH_BG     (ATTR_NUM_CLASSES + 1)
+
+typedef struct _compare_stat_t
+{
+    int     num_exact;
+    int     num_reorder;
+    int     num_mismatch;
+    int     num_detections;
+} compare_stat_t;
+
+
+static double
+get_time_ms ()
+{
+    struct timespec tv;
+    clock_gettime (CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec * 1000.0 + tv.tv_nsec / 1000000.0);
+}
+
+static float
+frand ()
+{
+    return (float)rand () / RAND_MAX;
+}
+
+
+/* -------------------------------------------------- *
+ *  synthetic SSD outputs
+ * -------------------------------------------------- */
+/*
+ *  low scores everywhere, and a few objects which light up the anchors
+ *  around them with one class, so that the NMS has overlapping boxes.
+ *  with (quantize), the scores and the encodings are rounded like the
+ *  outputs of the uint8 model, which makes many equal scores.
+ */
+static void
+generate_frame (const float *anchors, int num_anchors, int num_objects, int quantize,
+                float *boxes, float *scores)
+{
+    for (int i = 0; i < num_anchors; i ++)
+    {
+        for (int j = 0; j < 4; j ++)
+            boxes[i * 4 + j] = (frand () - 0.5f) * 0.5f;
+
+        for (int j = 0; j < NUM_CLASSES_WITH_BG; j ++)
+            scores[i * NUM_CLASSES_WITH_BG + j] = frand () * 0.3f;
+    }
+
+    for (int n = 0; n < num_objects; n ++)
+    {
+        float cy = frand ();
+        float cx = frand ();
+        float r  = 0.02f + frand () * 0.05f;
+        int   class_id = 1 + rand () % ATTR_NUM_CLASSES;
+
+        for (int i = 0; i < num_anchors; i ++)
+        {
+            float dy = anchors[i * 4 + 0] - cy;
+            float dx = anchors[i * 4 + 1] - cx;
+            if (dy * dy + dx * dx > r * r)
+                continue;
+
+            float *s = &scores[i * NUM_CLASSES_WITH_BG];
+            s[class_id] = std::max (s[class_id], 0.3f + frand () * 0.7f);
+
+            /* a second class for some anchors */
+            if (rand () % 4 == 0)
+                s[1 + rand () % ATTR_NUM_CLASSES] = 0.3f + frand () * 0.7f;
+        }
+    }
+
+    if (quantize)
+    {
+        for (int i = 0; i < num_anchors * NUM_CLASSES_WITH_BG; i ++)
+            scores[i] = roundf (scores[i] * 255.0f) / 255.0f;
+        for (int i = 0; i < num_anchors * 4; i ++)
+            boxes[i] = roundf (boxes[i] * 64.0f) / 64.0f;
+    }
+}
+
+
+/* -------------------------------------------------- *
+ *  compare
+ * -------------------------------------------------- */
+static bool
+is_same_box (const DetectionBox &a, const DetectionBox &b)
+{
+    return (a.x1 == b.x1 && a.y1 == b.y1 && a.x2 == b.x2 && a.y2 == b.y2 &&
+            a.score == b.score && a.class_id == b.class_id);
+}
+
+static bool
+compare_box (const DetectionBox &a, const DetectionBox &b)
+{
+    if (a.score    != b.score)    return a.score    > b.score;
+    if (a.class_id != b.class_id) return a.class_id < b.class_id;
+    if (a.y1       != b.y1)       return a.y1       < b.y1;
+    return a.x1 < b.x1;
+}
+
+static void
+compare_result (std::vector<DetectionBox> &ref, DetectionBox *opt, int num_opt, compare_stat_t *stat)
+{
+    int num_ref = std::min ((int)ref.size (), ATTR_MAX_DETECTIONS);
+    bool same = (num_ref == num_opt);
+
+    stat->num_detections += num_opt;
+
+    for (int i = 0; same && i < num_ref; i ++)
+        same = is_same_box (ref[i], opt[i]);
+
+    if (same)
+    {
+        stat->num_exact ++;
+        return;
+    }
+
+    if (num_ref == num_opt)
+    {
+        std::vector<DetectionBox> sorted_opt (opt, opt + num_opt);
+        std::sort (ref.begin (), ref.end (), compare_box);
+        std::sort (sorted_opt.begin (), sorted_opt.end (), compare_box);
+
+        same = true;
+        for (int i = 0; same && i < num_ref; i ++)
+            same = is_same_box (ref[i], sorted_opt[i]);
+
+        if (same)
+        {
+            stat->num_reorder ++;
+            return;
+        }
+    }
+
+    stat->num_mismatch ++;
+}
+
+
+/* -------------------------------------------------- *
+ *  main
+ * -------------------------------------------------- */
+static void
+print_usage (const char *argv0)
+{
+    fprintf (stderr, "usage: %s [options]\n", argv0);
+    fprintf (stderr, "  -a file   : anchors file (default ../../gl2detection/detect_model/mobilenetv1_1.0/anchors.txt)\n");
+    fprintf (stderr, "  -n num    : number of frames  (default 200)\n");
+    fprintf (stderr, "  -k num    : objects per frame (default 10)\n");
+    fprintf (stderr, "  -s seed   : random seed       (default 1)\n");
+    fprintf (stderr, "  -q        : quantize the inputs like the uint8 model\n");
+}
+
+static int
+run_bench (const float *anchors, int num_anchors, int num_frames, int num_objects,
+           int quantize, int use_regular_nms)
+{
+    float *boxes  = new float[num_anchors * 4];
+    float *scores = new float[num_anchors * NUM_CLASSES_WITH_BG];
+    DetectionBox detections[ATTR_MAX_DETECTIONS];
+    compare_stat_t stat = {0};
+    bench_t bench_ref, bench_opt;
+
+    bench_init (&bench_ref, num_frames);
+    bench_init (&bench_opt, num_frames);
+    set_detect_postprocess_regular_nms (use_regular_nms);
+
+    for (int frame = 0; frame < num_frames; frame ++)
+    {
+        std::vector<DetectionBox> ref_boxes;
+
+        generate_frame (anchors, num_anchors, num_objects, quantize, boxes, scores);
+
+        double ttime0 = get_time_ms ();
+        invoke_detection_postprocess_ref (ref_boxes, anchors, num_anchors, boxes, scores, use_regular_nms);
+        double ttime1 = get_time_ms ();
+        bench_lap_add (BENCH_LAP_TOTAL, ttime1 - ttime0);
+        bench_commit_frame (&bench_ref);
+
+        ttime0 = get_time_ms ();
+        int num = invoke_detection_postprocess (detections, ATTR_MAX_DETECTIONS, boxes, scores);
+        ttime1 = get_time_ms ();
+        bench_lap_add (BENCH_LAP_TOTAL, ttime1 - ttime0);
+        bench_commit_frame (&bench_opt);
+
+        compare_result (ref_boxes, detections, num, &stat);
+    }
+
+    fprintf (stdout, "[%s NMS] %d frames, %.1f detections/frame\n",
+             use_regular_nms ? "regular" : "fast", num_frames,
+             (double)stat.num_detections / num_frames);
+    fprintf (stdout, "  reference: mean %.3f ms, p50 %.3f ms, p99 %.3f ms\n",
+             bench_get_mean (&bench_ref, BENCH_LAP_TOTAL),
+             bench_get_percentile (&bench_ref, BENCH_LAP_TOTAL, 50.0),
+             bench_get_percentile (&bench_ref, BENCH_LAP_TOTAL, 99.0));
+    fprintf (stdout, "  optimized: mean %.3f ms, p50 %.3f ms, p99 %.3f ms (NMS p50 %.3f ms)\n",
+             bench_get_mean (&bench_opt, BENCH_LAP_TOTAL),
+             bench_get_percentile (&bench_opt, BENCH_LAP_TOTAL, 50.0),
+             bench_get_percentile (&bench_opt, BENCH_LAP_TOTAL, 99.0),
+             bench_get_percentile (&bench_opt, BENCH_LAP_NMS,   50.0));
+    fprintf (stdout, "  exact %d, reorder %d, MISMATCH %d\n",
+             stat.num_exact, stat.num_reorder, stat.num_mismatch);
+
+    bench_destroy (&bench_ref);
+    bench_destroy (&bench_opt);
+    delete[] boxes;
+    delete[] scores;
+
+    return (stat.num_mismatch > 0) ? -1 : 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    const char *anchors_file = "../../gl2detection/detect_model/mobilenetv1_1.0/anchors.txt";
+    int num_frames  = 200;
+    int num_objects = 10;
+    int quantize    = 0;
+    int seed        = 1;
+    int c;
+
+    const char *optstring = "a:n:k:s:q";
+    while ((c = getopt (argc, argv, optstring)) != -1)
+    {
+        switch (c)
+        {
+        case 'a':
+            anchors_file = optarg;
+            break;
+        case 'n':
+            num_frames = atoi (optarg);
+            break;
+        case 'k':
+            num_objects = atoi (optarg);
+            break;
+        case 's':
+            seed = atoi (optarg);
+            break;
+        case 'q':
+            quantize = 1;
+            break;
+        default:
+            print_usage (argv[0]);
+            return -1;
+        }
+    }
+
+    if (num_frames <= 0)
+    {
+        print_usage (argv[0]);
+        return -1;
+    }
+
+    init_detect_postprocess (anchors_file);
+
+    int num_anchors;
+    const float *anchors = get_detect_postprocess_anchors (&num_anchors);
+    if (num_anchors <= 0)
+    {
+        fprintf (stderr, "ERR: %s(%d): can't read %s\n", __FILE__, __LINE__, anchors_file);
+        return -1;
+    }
+
+    bench_lap_enable (1);
+
+    int ret = 0;
+    srand (seed);
+    ret |= run_bench (anchors, num_anchors, num_frames, num_objects, quantize, 0);
+    srand (seed);
+    ret |= run_bench (anchors, num_anchors, num_frames, num_objects, quantize, 1);
+
+    return ret;
+}
@@ -0,0 +1,317 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include "util_bench.h"
+#include "posenet_decode.h"
+
+/*
+ *  microbenchmark of the multi-pose decoder of gl2posenet.
+ *
+ *  synthetic PoseNet outputs with (1 - 64) persons are decoded, and the
+ *  root candidate queue of the decoder (binary heap) is compared with the
+ *  sorted std::list which the decoder used before:
+ *    - the order of the roots must be identical. (the tool returns -1)
+ *    - the time to build the queue is measured for both. the peak search
+ *      of the heatmap is common to both, and is included.
+ */
+#define EDGE_NUM    16
+
+typedef struct _tensors_t
+{
+    float   *heatmap;
+    float   *offsets;
+    float   *fw_disp;
+    float   *bw_disp;
+} tensors_t;
+
+
+static double
+get_time_ms ()
+{
+    struct timespec tv;
+    clock_gettime (CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec * 1000.0 + tv.tv_nsec / 1000000.0);
+}
+
+static float
+frand ()
+{
+    return (float)rand () / RAND_MAX;
+}
+
+
+/* -------------------------------------------------- *
+ *  synthetic PoseNet outputs
+ * -------------------------------------------------- */
+/*
+ *  low noise everywhere, and a blob of each key for every person, around
+ *  the center of the person. the offsets and the displacements are small
+ *  random vectors, which is enough to drive the pose traversal.
+ */
+static void
+generate_frame (posenet_decoder_t *dec, tensors_t *t, int num_persons)
+{
+    int hmp_w = dec->hmp_w;
+    int hmp_h = dec->hmp_h;
+    int num = hmp_w * hmp_h;
+
+    for (int i = 0; i < num * kPoseKeyNum; i ++)
+        t->heatmap[i] = frand () * 0.3f;
+    for (int i = 0; i < num * kPoseKeyNum * 2; i ++)
+        t->offsets[i] = (frand () - 0.5f) * 8.0f;
+    for (int i = 0; i < num * EDGE_NUM * 2; i ++)
+    {
+        t->fw_disp[i] = (frand () - 0.5f) * 32.0f;
+        t->bw_disp[i] = (frand () - 0.5f) * 32.0f;
+    }
+
+    for (int n = 0; n < num_persons; n ++)
+    {
+        float cx = frand () * (hmp_w - 1);
+        float cy = frand () * (hmp_h - 1);
+
+        for (int key = 0; key < kPoseKeyNum; key ++)
+        {
+            int kx = (int)(cx + (frand () - 0.5f) * 4.0f);
+            int ky = (int)(cy + (frand () - 0.5f) * 6.0f);
+            float peak = 0.5f + frand () * 0.5f;
+
+            for (int y = ky - 1; y <= ky + 1; y ++)
+            {
+                for (int x = kx - 1; x <= kx + 1; x ++)
+                {
+                    if (x < 0 || x >= hmp_w || y < 0 || y >= hmp_h)
+                        continue;
+
+                    float s = (x == kx && y == ky) ? peak : peak * 0.6f;
+                    float *dst = &t->heatmap[(y * hmp_w + x) * kPoseKeyNum + key];
+                    if (*dst < s)
+                        *dst = s;
+                }
+            }
+        }
+    }
+
+    dec->heatmap = t->heatmap;
+    dec->offsets = t->offsets;
+    dec->fw_disp = t->fw_disp;
+    dec->bw_disp = t->bw_disp;
+}
+
+
+/* -------------------------------------------------- *
+ *  reference: the candidates sorted into a std::list
+ * -------------------------------------------------- */
+static bool
+compare_part_score (const part_score_t &a, const part_score_t &b)
+{
+    if (a.score != b.score) return a.score > b.score;
+    if (a.idx_y != b.idx_y) return a.idx_y < b.idx_y;
+    if (a.idx_x != b.idx_x) return a.idx_x < b.idx_x;
+    return a.key_id < b.key_id;
+}
+
+static void
+build_score_queue_ref (posenet_decoder_t *dec, std::list<part_score_t> &queue, float thresh)
+{
+    std::vector<part_score_t> parts;
+    int num_pix = dec->hmp_w * dec->hmp_h;
+
+    for (int key = 0; key < kPoseKeyNum; key ++)
+    {
+        heatmap_load_channel (&dec->filter, dec->heatmap, kPoseKeyNum, key);
+        heatmap_max_filter (&dec->filter);
+
+        int num_peaks = heatmap_find_peaks (&dec->filter, thresh, dec->peaks, num_pix);
+        for (int i = 0; i < num_peaks; i ++)
+        {
+            part_score_t item;
+            item.score = dec->peaks[i].score;
+            item.idx_x = dec->peaks[i].x;
+            item.idx_y = dec->peaks[i].y;
+            item.key_id= key;
+            parts.push_back (item);
+        }
+    }
+
+    std::sort (parts.begin(), parts.end(), compare_part_score);
+    queue.assign (parts.begin(), parts.end());
+}
+
+
+/* -------------------------------------------------- *
+ *  main
+ * -------------------------------------------------- */
+static void
+print_usage (const char *argv0)
+{
+    fprintf (stderr, "usage: %s [options]\n", argv0);
+    fprintf (stderr, "  -i size   : input image size (default 513)\n");
+    fprintf (stderr, "  -m size   : heatmap size     (default 33)\n");
+    fprintf (stderr, "  -n num    : number of frames (default 100)\n");
+    fprintf (stderr, "  -p num    : max poses to decode, 1 - %d (default %d)\n", MAX_POSE_NUM, MAX_POSE_NUM);
+    fprintf (stderr, "  -s seed   : random seed      (default 1)\n");
+}
+
+static int
+run_bench (posenet_decoder_t *dec, tensors_t *t, int num_frames, int num_persons)
+{
+    float score_thresh = 0.5f;
+    int   num_mismatch = 0;
+    int   num_roots = 0;
+    int   num_poses = 0;
+    bench_t bench_ref, bench_opt, bench_dec;
+    posenet_result_t pose_result;
+
+    bench_init (&bench_ref, num_frames);
+    bench_init (&bench_opt, num_frames);
+    bench_init (&bench_dec, num_frames);
+
+    for (int frame = 0; frame < num_frames; frame ++)
+    {
+        std::list<part_score_t> queue;
+
+        generate_frame (dec, t, num_persons);
+
+        /* root queue, and the order of the roots */
+        double ttime0 = get_time_ms ();
+        build_score_queue_ref (dec, queue, score_thresh);
+        double ttime1 = get_time_ms ();
+        bench_lap_add (BENCH_LAP_TOTAL, ttime1 - ttime0);
+        bench_commit_frame (&bench_ref);
+
+        ttime0 = get_time_ms ();
+        int num = posenet_build_root_queue (dec, score_thresh);
+        ttime1 = get_time_ms ();
+        bench_lap_add (BENCH_LAP_TOTAL, ttime1 - ttime0);
+        bench_commit_frame (&bench_opt);
+
+        num_roots += num;
+        if (num != (int)queue.size ())
+            num_mismatch ++;
+
+        part_score_t root;
+        std::list<part_score_t>::iterator itr = queue.begin();
+        for (; itr != queue.end() && posenet_pop_root (dec, &root); itr ++)
+        {
+            if (root.score != itr->score || root.idx_x  != itr->idx_x ||
+                root.idx_y != itr->idx_y || root.key_id != itr->key_id)
+            {
+                num_mismatch ++;
+                break;
+            }
+        }
+
+        /* whole multi-pose decode */
+        ttime0 = get_time_ms ();
+        posenet_decode_multiple_poses (dec, &pose_result);
+        ttime1 = get_time_ms ();
+        bench_lap_add (BENCH_LAP_TOTAL, ttime1 - ttime0);
+        bench_commit_frame (&bench_dec);
+
+        num_poses += pose_result.num;
+    }
+
+    fprintf (stdout, "%8d %10.1f %8.1f %12.4f %12.4f %12.4f%s\n",
+             num_persons,
+             (double)num_roots / num_frames,
+             (double)num_poses / num_frames,
+             bench_get_percentile (&bench_ref, BENCH_LAP_TOTAL, 50.0),
+             bench_get_percentile (&bench_opt, BENCH_LAP_TOTAL, 50.0),
+             bench_get_percentile (&bench_dec, BENCH_LAP_TOTAL, 50.0),
+             num_mismatch ? "  MISMATCH" : "");
+
+    bench_destroy (&bench_ref);
+    bench_destroy (&bench_opt);
+    bench_destroy (&bench_dec);
+
+    return (num_mismatch > 0) ? -1 : 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int img_size   = 513;
+    int hmp_size   = 33;
+    int num_frames = 100;
+    int max_poses  = MAX_POSE_NUM;
+    int seed       = 1;
+    int c;
+
+    const char *optstring = "i:m:n:p:s:";
+    while ((c = getopt (argc, argv, optstring)) != -1)
+    {
+        switch (c)
+        {
+        case 'i':
+            img_size = atoi (optarg);
+            break;
+        case 'm':
+            hmp_size = atoi (optarg);
+            break;
+        case 'n':
+            num_frames = atoi (optarg);
+            break;
+        case 'p':
+            max_poses = atoi (optarg);
+            break;
+        case 's':
+            seed = atoi (optarg);
+            break;
+        default:
+            print_usage (argv[0]);
+            return -1;
+        }
+    }
+
+    if (num_frames <= 0 || img_size <= 0 || hmp_size < 2)
+    {
+        print_usage (argv[0]);
+        return -1;
+    }
+
+    posenet_decoder_t dec;
+    if (posenet_init_decoder (&dec, img_size, img_size, hmp_size, hmp_size, EDGE_NUM, max_poses) < 0)
+    {
+        fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
+    int num = hmp_size * hmp_size;
+    tensors_t t;
+    t.heatmap = new float[num * kPoseKeyNum];
+    t.offsets = new float[num * kPoseKeyNum * 2];
+    t.fw_disp = new float[num * EDGE_NUM * 2];
+    t.bw_disp = new float[num * EDGE_NUM * 2];
+
+    bench_lap_enable (1);
+    srand (seed);
+
+    fprintf (stdout, "input %dx%d, heatmap %dx%d, max poses %d, %d frames (p50 in ms)\n",
+             img_size, img_size, hmp_size, hmp_size, dec.max_poses, num_frames);
+    fprintf (stdout, "%8s %10s %8s %12s %12s %12s\n",
+             "persons", "roots", "poses", "list queue", "heap queue", "decode");
+
+    int ret = 0;
+    int persons[] = {1, 2, 4, 8, 16, 32, 64};
+    for (unsigned int i = 0; i < sizeof (persons) / sizeof (persons[0]); i ++)
+        ret |= run_bench (&dec, &t, num_frames, persons[i]);
+
+    delete[] t.heatmap;
+    delete[] t.offsets;
+    delete[] t.fw_disp;
+    delete[] t.bw_disp;
+    posenet_destroy_decoder (&dec);
+
+    return ret;
+}
@@ -0,0 +1,275 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <GLES2/gl2.h>
+#include "util_tflite.h"
+#include "util_preprocess.h"
+#include "util_pixconv.h"
+#include "util_stream.h"
+
+/*
+ *  headless multi-stream inference server.
+ *
+ *  every worker thread owns its interpreter of the model, and serves the
+ *  frames of all the streams. the model is run as an image classifier:
+ *  input[0] is the RGB image, output[0] is the score of each class.
+ */
+
+typedef struct _worker_ctx_t
+{
+    tflite_interpreter_t interpreter;
+    tflite_tensor_t      tensor_input;
+    tflite_tensor_t      tensor_output;
+    preproc_t            preproc;
+} worker_ctx_t;
+
+typedef struct _classify_result_t
+{
+    int     class_id;
+    float   score;
+} classify_result_t;
+
+static const char *s_model_path = NULL;
+
+
+static double
+get_time_ms ()
+{
+    struct timespec tv;
+    clock_gettime (CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec * 1000.0 + tv.tv_nsec / 1000000.0);
+}
+
+
+/* -------------------------------------------------- *
+ *  worker (called on the worker threads)
+ * -------------------------------------------------- */
+static int
+worker_init (int worker_id, void *usr, void **wctx)
+{
+    worker_ctx_t *ctx = new worker_ctx_t;
+    tflite_createopt_t opt;
+
+    /* the threads of the interpreters are shared by the thread budget */
+    tflite_get_default_createopt (&opt);
+    if (tflite_create_interpreter_ex_from_file (&ctx->interpreter, s_model_path, &opt) != 0)
+    {
+        fprintf (stderr, "ERR: %s(%d): can't load %s\n", __FILE__, __LINE__, s_model_path);
+        delete ctx;
+        return -1;
+    }
+
+    std::unique_ptr<tflite::Interpreter> &interpreter = ctx->interpreter.interpreter;
+    tflite_get_tensor_by_name (&ctx->interpreter, 0, interpreter->input_tensor (0)->name,  &ctx->tensor_input);
+    tflite_get_tensor_by_name (&ctx->interpreter, 1, interpreter->output_tensor (0)->name, &ctx->tensor_output);
+
+    int w = ctx->tensor_input.dims[2];
+    int h = ctx->tensor_input.dims[1];
+    if (ctx->tensor_input.type == kTfLiteUInt8)
+        init_preprocess (&ctx->preproc, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_UINT8, 0.0f, 1.0f);
+    else
+        init_preprocess (&ctx->preproc, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 127.5f, 127.5f);
+
+    fprintf (stderr, "worker[%d]: input(%dx%d)\n", worker_id, w, h);
+
+    *wctx = ctx;
+    return 0;
+}
+
+static int
+worker_infer (void *wctx, const stream_frame_t *frame, void *result)
+{
+    worker_ctx_t      *ctx = (worker_ctx_t *)wctx;
+    classify_result_t *res = (classify_result_t *)result;
+
+    preprocess_buffer (&ctx->preproc, frame->rgba, frame->w, frame->h, NULL);
+    preprocess_get_tensor (&ctx->preproc, ctx->tensor_input.ptr);
+
+    if (tflite_invoke (&ctx->interpreter) != 0)
+        return -1;
+
+    tflite_tensor_t *out = &ctx->tensor_output;
+    int num_class = out->dims[1];
+
+    res->class_id = -1;
+    res->score    = 0;
+    for (int i = 0; i < num_class; i ++)
+    {
+        float score;
+        if (out->type == kTfLiteUInt8)
+            score = (((uint8_t *)out->ptr)[i] - out->quant_zerop) * out->quant_scale;
+        else
+            score = ((float *)out->ptr)[i];
+
+        if (res->class_id < 0 || score > res->score)
+        {
+            res->class_id = i;
+            res->score    = score;
+        }
+    }
+
+    return 0;
+}
+
+
+/* -------------------------------------------------- *
+ *  main
+ * -------------------------------------------------- */
+static int
+add_file_stream (stream_server_t *srv, const char *arg)
+{
+    char fname[256], fmt[16] = "yuyv";
+    int  w, h;
+
+    /* file:WxH[:yuyv|rgba] */
+    if (sscanf (arg, "%255[^:]:%dx%d:%15s", fname, &w, &h, fmt) < 3)
+        return -1;
+
+    int src_fmt = (strcmp (fmt, "rgba") == 0) ? PIXCONV_SRC_RGBA8 : PIXCONV_SRC_YUYV;
+    return stream_server_add_file (srv, fname, w, h, src_fmt);
+}
+
+static void
+print_usage (const char *argv0)
+{
+    fprintf (stderr, "usage: %s -m model.tflite [inputs] [options]\n", argv0);
+    fprintf (stderr, "inputs (up to %d):\n", STREAM_MAX_STREAMS);
+    fprintf (stderr, "  -c devid       : V4L2 camera /dev/video<devid> (YUYV)\n");
+    fprintf (stderr, "  -f file:WxH[:yuyv|rgba] : raw frames, looped at 30fps\n");
+#if defined (USE_INPUT_VIDEO_DECODE)
+    fprintf (stderr, "  -v video_file  : decoded video (only one)\n");
+#endif
+    fprintf (stderr, "options:\n");
+    fprintf (stderr, "  -w num    : number of workers (interpreters) (default 2)\n");
+    fprintf (stderr, "  -D rr|lat : dispatch, round robin or latency aware (default rr)\n");
+    fprintf (stderr, "  -t sec    : run time (default 10)\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+    stream_server_t srv;
+    const char *inputs[STREAM_MAX_STREAMS];
+    char input_type[STREAM_MAX_STREAMS];
+    int num_inputs  = 0;
+    int num_workers = 2;
+    int dispatch    = STREAM_DISPATCH_ROUND_ROBIN;
+    int run_sec     = 10;
+    int c;
+
+    const char *optstring = "m:c:f:v:w:D:t:";
+    while ((c = getopt (argc, argv, optstring)) != -1)
+    {
+        switch (c)
+        {
+        case 'm':
+            s_model_path = optarg;
+            break;
+        case 'c':
+        case 'f':
+        case 'v':
+            if (num_inputs >= STREAM_MAX_STREAMS)
+                break;
+            input_type[num_inputs] = c;
+            inputs    [num_inputs] = optarg;
+            num_inputs ++;
+            break;
+        case 'w':
+            num_workers = atoi (optarg);
+            break;
+        case 'D':
+            dispatch = (strcmp (optarg, "lat") == 0) ? STREAM_DISPATCH_LATENCY : STREAM_DISPATCH_ROUND_ROBIN;
+            break;
+        case 't':
+            run_sec = atoi (optarg);
+            break;
+        default:
+            print_usage (argv[0]);
+            return -1;
+        }
+    }
+
+    if (s_model_path == NULL || num_inputs == 0)
+    {
+        print_usage (argv[0]);
+        return -1;
+    }
+
+    /* the workers run their interpreters concurrently */
+    tflite_init_thread_budget (0, TFLITE_BUDGET_CONCURRENT);
+
+    if (stream_server_init (&srv, num_workers, dispatch, sizeof (classify_result_t),
+                            worker_init, worker_infer, NULL) != 0)
+        return -1;
+
+    for (int i = 0; i < num_inputs; i ++)
+    {
+        int ret;
+        switch (input_type[i])
+        {
+        case 'c': ret = stream_server_add_v4l2  (&srv, atoi (inputs[i])); break;
+        case 'f': ret = add_file_stream         (&srv, inputs[i]);        break;
+        default:  ret = stream_server_add_video (&srv, inputs[i]);        break;
+        }
+        if (ret < 0)
+        {
+            fprintf (stderr, "ERR: %s(%d): can't open %s\n", __FILE__, __LINE__, inputs[i]);
+            return -1;
+        }
+    }
+
+    if (stream_server_start (&srv) != 0)
+    {
+        fprintf (stderr, "ERR: %s(%d): can't start the workers\n", __FILE__, __LINE__);
+        stream_server_stop (&srv);
+        return -1;
+    }
+
+    classify_result_t last[STREAM_MAX_STREAMS] = {};
+    double t_start  = get_time_ms ();
+    double t_report = t_start;
+    for (;;)
+    {
+        /* take all the results, keeping the latest one of each stream */
+        for (int i = 0; i < srv.num_streams; i ++)
+        {
+            stream_result_info_t info;
+            classify_result_t    res;
+
+            while (stream_server_poll_result (&srv, i, &info, &res, 0) == 0)
+            {
+                if (info.ret == 0)
+                    last[i] = res;
+            }
+        }
+
+        double now = get_time_ms ();
+        if (now - t_report >= 1000.0)
+        {
+            for (int i = 0; i < srv.num_streams; i ++)
+            {
+                stream_stats_t st;
+                stream_server_get_stats (&srv, i, &st);
+                fprintf (stderr, "[%d] %-16s cap:%6lu inf:%6lu skip:%6lu drop:%4lu  infer:%7.2f[ms] latency:%7.2f[ms]  class:%4d (%.2f)\n",
+                         i, srv.streams[i].name,
+                         (unsigned long)st.num_captured, (unsigned long)st.num_inferred,
+                         (unsigned long)st.num_skipped,  (unsigned long)st.num_dropped,
+                         st.avg_infer_ms, st.avg_latency_ms, last[i].class_id, last[i].score);
+            }
+            t_report = now;
+        }
+
+        if (now - t_start >= run_sec * 1000.0)
+            break;
+        usleep (5 * 1000);
+    }
+
+    stream_server_stop (&srv);
+    return 0;
+}
@@ -0,0 +1,66 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <GLES2/gl2.h>
+#include "util_preprocess.h"
+#include "util_bench.h"
+#include "tflite_blazepose.h"
+#include "bench_pipeline.h"
+
+static preproc_t              s_preproc_detect;
+static preproc_t              s_preproc_landmark;
+static blazepose_config_t     s_config;
+static pose_detect_result_t   s_detect_ret;
+static pose_landmark_result_t s_landmark_ret[MAX_POSE_NUM];
+
+static int
+init_blazepose ()
+{
+    int w, h;
+
+    init_tflite_blazepose (0, &s_config);
+
+    get_pose_detect_input_buf (&w, &h);
+    init_preprocess (&s_preproc_detect, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    get_pose_landmark_input_buf (&w, &h);
+    init_preprocess (&s_preproc_landmark, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    return 0;
+}
+
+static int
+run_blazepose (unsigned char *rgba, int img_w, int img_h)
+{
+    int w, h;
+    float *buf_fp32 = (float *)get_pose_detect_input_buf (&w, &h);
+
+    bench_lap_start (BENCH_LAP_PREPROCESS);
+    preprocess_buffer (&s_preproc_detect, rgba, img_w, img_h, NULL);
+    preprocess_get_tensor (&s_preproc_detect, buf_fp32);
+    bench_lap_stop (BENCH_LAP_PREPROCESS);
+
+    invoke_pose_detect (&s_detect_ret, &s_config);
+
+    buf_fp32 = (float *)get_pose_landmark_input_buf (&w, &h);
+    for (int pose_id = 0; pose_id < s_detect_ret.num; pose_id ++)
+    {
+        float *roi = (float *)s_detect_ret.poses[pose_id].roi_coord;
+
+        bench_lap_start (BENCH_LAP_PREPROCESS);
+        preprocess_buffer (&s_preproc_landmark, rgba, img_w, img_h, roi);
+        preprocess_get_tensor (&s_preproc_landmark, buf_fp32);
+        bench_lap_stop (BENCH_LAP_PREPROCESS);
+
+        invoke_pose_landmark (&s_landmark_ret[pose_id]);
+    }
+
+    return s_detect_ret.num;
+}
+
+bench_pipeline_t bench_pipeline_blazepose =
+{
+    "blazepose", "gl2blazepose", init_blazepose, run_blazepose
+};
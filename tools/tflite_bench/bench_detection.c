@@ -0,0 +1,50 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <GLES2/gl2.h>
+#include "util_preprocess.h"
+#include "util_bench.h"
+#include "tflite_detect.h"
+#include "bench_pipeline.h"
+
+static preproc_t       s_preproc;
+static detect_result_t s_detect_ret;
+
+static int
+init_detection ()
+{
+    int w, h;
+
+    init_tflite_detection (0);
+
+    get_detect_input_buf (&w, &h);
+    if (get_detect_input_type ())
+        init_preprocess (&s_preproc, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_UINT8, 0.0f, 1.0f);
+    else
+        init_preprocess (&s_preproc, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    return 0;
+}
+
+static int
+run_detection (unsigned char *rgba, int img_w, int img_h)
+{
+    int w, h;
+    void *buf = get_detect_input_buf (&w, &h);
+
+    bench_lap_start (BENCH_LAP_PREPROCESS);
+    preprocess_buffer (&s_preproc, rgba, img_w, img_h, NULL);
+    preprocess_get_tensor (&s_preproc, buf);
+    bench_lap_stop (BENCH_LAP_PREPROCESS);
+
+    invoke_detect (&s_detect_ret);
+
+    return s_detect_ret.num;
+}
+
+bench_pipeline_t bench_pipeline_detection =
+{
+    "detection", "gl2detection", init_detection, run_detection
+};
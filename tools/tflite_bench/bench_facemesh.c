@@ -0,0 +1,74 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <GLES2/gl2.h>
+#include "util_preprocess.h"
+#include "util_bench.h"
+#include "tflite_facemesh.h"
+#include "bench_pipeline.h"
+
+static preproc_t              s_preproc_detect;
+static preproc_t              s_preproc_landmark;
+static face_detect_result_t   s_detect_ret;
+static face_landmark_result_t s_mesh_ret[MAX_FACE_NUM];
+
+static int
+init_facemesh ()
+{
+    int w, h;
+
+    init_tflite_facemesh (0);
+
+    get_face_detect_input_buf (&w, &h);
+    init_preprocess (&s_preproc_detect, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    get_facemesh_landmark_input_buf (&w, &h);
+    init_preprocess (&s_preproc_landmark, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    return 0;
+}
+
+static int
+run_facemesh (unsigned char *rgba, int img_w, int img_h)
+{
+    int w, h;
+    float *buf_fp32 = (float *)get_face_detect_input_buf (&w, &h);
+
+    bench_lap_start (BENCH_LAP_PREPROCESS);
+    preprocess_buffer (&s_preproc_detect, rgba, img_w, img_h, NULL);
+    preprocess_get_tensor (&s_preproc_detect, buf_fp32);
+    bench_lap_stop (BENCH_LAP_PREPROCESS);
+
+    invoke_face_detect (&s_detect_ret);
+
+    /* all the faces in one batch, same as gl2facemesh */
+    int num_faces = s_detect_ret.num;
+    int num_batch = (num_faces > 0) ? set_facemesh_landmark_batch (num_faces) : 1;
+    buf_fp32 = (float *)get_facemesh_landmark_input_buf (&w, &h);
+
+    for (int face_id = 0; face_id < num_faces; face_id += num_batch)
+    {
+        int batch = (num_faces - face_id < num_batch) ? num_faces - face_id : num_batch;
+
+        bench_lap_start (BENCH_LAP_PREPROCESS);
+        for (int i = 0; i < batch; i ++)
+        {
+            float *roi = (float *)s_detect_ret.faces[face_id + i].face_pos;
+
+            preprocess_buffer (&s_preproc_landmark, rgba, img_w, img_h, roi);
+            preprocess_get_tensor (&s_preproc_landmark, buf_fp32 + i * (w * h * 3));
+        }
+        bench_lap_stop (BENCH_LAP_PREPROCESS);
+
+        invoke_facemesh_landmark_batch (&s_mesh_ret[face_id], batch);
+    }
+
+    return num_faces;
+}
+
+bench_pipeline_t bench_pipeline_facemesh =
+{
+    "facemesh", "gl2facemesh", init_facemesh, run_facemesh
+};
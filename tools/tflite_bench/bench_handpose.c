@@ -0,0 +1,74 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <GLES2/gl2.h>
+#include "util_preprocess.h"
+#include "util_bench.h"
+#include "tflite_handpose.h"
+#include "bench_pipeline.h"
+
+static preproc_t               s_preproc_detect;
+static preproc_t               s_preproc_landmark;
+static palm_detection_result_t s_palm_ret;
+static hand_landmark_result_t  s_hand_ret[MAX_PALM_NUM];
+
+static int
+init_handpose ()
+{
+    int w, h;
+
+    init_tflite_hand_landmark (0);
+
+    get_palm_detection_input_buf (&w, &h);
+    init_preprocess (&s_preproc_detect, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    get_hand_landmark_input_buf (&w, &h);
+    init_preprocess (&s_preproc_landmark, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 128.0f, 128.0f);
+
+    return 0;
+}
+
+static int
+run_handpose (unsigned char *rgba, int img_w, int img_h)
+{
+    int w, h;
+    float *buf_fp32 = (float *)get_palm_detection_input_buf (&w, &h);
+
+    bench_lap_start (BENCH_LAP_PREPROCESS);
+    preprocess_buffer (&s_preproc_detect, rgba, img_w, img_h, NULL);
+    preprocess_get_tensor (&s_preproc_detect, buf_fp32);
+    bench_lap_stop (BENCH_LAP_PREPROCESS);
+
+    invoke_palm_detection (&s_palm_ret, 0);
+
+    /* all the hands in one batch, same as gl2handpose */
+    int num_hands = s_palm_ret.num;
+    int num_batch = (num_hands > 0) ? set_hand_landmark_batch (num_hands) : 1;
+    buf_fp32 = (float *)get_hand_landmark_input_buf (&w, &h);
+
+    for (int hand_id = 0; hand_id < num_hands; hand_id += num_batch)
+    {
+        int batch = (num_hands - hand_id < num_batch) ? num_hands - hand_id : num_batch;
+
+        bench_lap_start (BENCH_LAP_PREPROCESS);
+        for (int i = 0; i < batch; i ++)
+        {
+            float *roi = (float *)s_palm_ret.palms[hand_id + i].hand_pos;
+
+            preprocess_buffer (&s_preproc_landmark, rgba, img_w, img_h, roi);
+            preprocess_get_tensor (&s_preproc_landmark, buf_fp32 + i * (w * h * 3));
+        }
+        bench_lap_stop (BENCH_LAP_PREPROCESS);
+
+        invoke_hand_landmark_batch (&s_hand_ret[hand_id], batch);
+    }
+
+    return num_hands;
+}
+
+bench_pipeline_t bench_pipeline_handpose =
+{
+    "handpose", "gl2handpose", init_handpose, run_handpose
+};
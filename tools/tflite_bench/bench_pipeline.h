@@ -0,0 +1,37 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#ifndef _BENCH_PIPELINE_H_
+#define _BENCH_PIPELINE_H_
+
+/*
+ *  a model pipeline of one gl2* app, driven without GL:
+ *  the input image (RGBA8, top row first) is cropped and normalized by the
+ *  CPU backend of util_preprocess, and fed to the app's invoke functions.
+ */
+typedef struct _bench_pipeline_t
+{
+    const char *name;
+    const char *app_dir;        /* the model paths are relative to this directory */
+
+    int (*init) ();
+    int (*run)  (unsigned char *rgba, int w, int h);    /* returns the number of detected objects */
+} bench_pipeline_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern bench_pipeline_t bench_pipeline_facemesh;
+extern bench_pipeline_t bench_pipeline_handpose;
+extern bench_pipeline_t bench_pipeline_blazepose;
+extern bench_pipeline_t bench_pipeline_detection;
+extern bench_pipeline_t bench_pipeline_posenet;
+extern bench_pipeline_t bench_pipeline_segmentation;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BENCH_PIPELINE_H_ */
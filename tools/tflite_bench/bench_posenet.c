@@ -0,0 +1,47 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <GLES2/gl2.h>
+#include "util_preprocess.h"
+#include "util_bench.h"
+#include "tflite_posenet.h"
+#include "bench_pipeline.h"
+
+static preproc_t        s_preproc;
+static posenet_result_t s_pose_ret;
+
+static int
+init_posenet ()
+{
+    int w, h;
+
+    init_tflite_posenet (0, NULL);
+
+    get_posenet_input_buf (&w, &h);
+    init_preprocess (&s_preproc, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 0.0f, 255.0f);
+
+    return 0;
+}
+
+static int
+run_posenet (unsigned char *rgba, int img_w, int img_h)
+{
+    int w, h;
+    float *buf_fp32 = (float *)get_posenet_input_buf (&w, &h);
+
+    bench_lap_start (BENCH_LAP_PREPROCESS);
+    preprocess_buffer (&s_preproc, rgba, img_w, img_h, NULL);
+    preprocess_get_tensor (&s_preproc, buf_fp32);
+    bench_lap_stop (BENCH_LAP_PREPROCESS);
+
+    invoke_posenet (&s_pose_ret);
+
+    return s_pose_ret.num;
+}
+
+bench_pipeline_t bench_pipeline_posenet =
+{
+    "posenet", "gl2posenet", init_posenet, run_posenet
+};
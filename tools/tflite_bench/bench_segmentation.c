@@ -0,0 +1,73 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <GLES2/gl2.h>
+#include "util_preprocess.h"
+#include "util_bench.h"
+#include "util_segmap.h"
+#include "tflite_deeplab.h"
+#include "bench_pipeline.h"
+
+static preproc_t        s_preproc;
+static deeplab_result_t s_deeplab_ret;
+static unsigned char    *s_class_map;
+
+static int
+init_segmentation ()
+{
+    int w, h;
+
+    init_tflite_deeplab ();
+
+    get_deeplab_input_buf (&w, &h);
+    if (get_deeplab_input_type ())
+        init_preprocess (&s_preproc, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_UINT8, 0.0f, 1.0f);
+    else
+        init_preprocess (&s_preproc, PREPROC_BACKEND_CPU, w, h, PREPROC_TYPE_FP32, 0.0f, 255.0f);
+
+    return 0;
+}
+
+static int
+run_segmentation (unsigned char *rgba, int img_w, int img_h)
+{
+    int w, h;
+    void *buf = get_deeplab_input_buf (&w, &h);
+
+    bench_lap_start (BENCH_LAP_PREPROCESS);
+    preprocess_buffer (&s_preproc, rgba, img_w, img_h, NULL);
+    preprocess_get_tensor (&s_preproc, buf);
+    bench_lap_stop (BENCH_LAP_PREPROCESS);
+
+    invoke_deeplab (&s_deeplab_ret);
+
+    /* the most confident class of each pixel, as gl2segmentation renders it */
+    float *segmap = s_deeplab_ret.segmentmap;
+    int segmap_w  = s_deeplab_ret.segmentmap_dims[0];
+    int segmap_h  = s_deeplab_ret.segmentmap_dims[1];
+    int segmap_c  = s_deeplab_ret.segmentmap_dims[2];
+    int class_found[256] = {0};
+    int num_class = 0;
+
+    if (s_class_map == NULL)
+        s_class_map = (unsigned char *)malloc (segmap_w * segmap_h);
+
+    segmap_argmax (segmap, segmap_w * segmap_h, segmap_c, segmap_c, s_class_map);
+
+    for (int i = 0; i < segmap_w * segmap_h; i ++)
+    {
+        int class_id = s_class_map[i];
+        if (class_id > 0 && class_found[class_id] ++ == 0)
+            num_class ++;
+    }
+
+    return num_class;       /* number of the classes other than background */
+}
+
+bench_pipeline_t bench_pipeline_segmentation =
+{
+    "segmentation", "gl2segmentation", init_segmentation, run_segmentation
+};
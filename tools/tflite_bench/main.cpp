@@ -0,0 +1,335 @@
+/* ------------------------------------------------ *
+ * The MIT License (MIT)
+ * Copyright (c) 2020 terryky1220@gmail.com
+ * ------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <stb/stb_image.h>
+#include "util_tflite.h"
+#include "util_bench.h"
+#include "util_pixconv.h"
+#include "bench_pipeline.h"
+#if defined (USE_GL_DELEGATE) || defined (USE_GPU_DELEGATEV2)
+#include "util_egl.h"
+#endif
+#if defined (USE_INPUT_VIDEO_DECODE)
+#include "util_video_decode.h"
+#endif
+
+#define MAX_INPUT_IMAGES    256
+
+static bench_pipeline_t *s_pipelines[] =
+{
+    &bench_pipeline_facemesh,
+    &bench_pipeline_handpose,
+    &bench_pipeline_blazepose,
+    &bench_pipeline_detection,
+    &bench_pipeline_posenet,
+    &bench_pipeline_segmentation,
+};
+#define NUM_PIPELINES   (int)(sizeof (s_pipelines) / sizeof (s_pipelines[0]))
+
+typedef struct _input_image_t
+{
+    unsigned char *rgba;
+    int           w, h;
+} input_image_t;
+
+static input_image_t s_images[MAX_INPUT_IMAGES];
+static int           s_num_images = 0;
+static int           s_use_video  = 0;
+
+
+static double
+get_time_ms ()
+{
+    struct timespec tv;
+    clock_gettime (CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec * 1000.0 + tv.tv_nsec / 1000000.0);
+}
+
+
+/* -------------------------------------------------- *
+ *  input images (decoded into memory in advance)
+ * -------------------------------------------------- */
+static int
+load_image (const char *fname)
+{
+    input_image_t *img = &s_images[s_num_images];
+    int ch;
+
+    if (s_num_images >= MAX_INPUT_IMAGES)
+        return -1;
+
+    img->rgba = stbi_load (fname, &img->w, &img->h, &ch, 4);
+    if (img->rgba == NULL)
+        return -1;
+
+    s_num_images ++;
+    return 0;
+}
+
+static int
+compare_name (const void *a, const void *b)
+{
+    return strcmp (*(char * const *)a, *(char * const *)b);
+}
+
+static int
+load_input_images (const char *path)
+{
+    DIR *dir = opendir (path);
+    if (dir == NULL)
+        return load_image (path);       /* single image file */
+
+    /* load the files in the name order, so that the runs are reproducible */
+    char *names[MAX_INPUT_IMAGES];
+    int num_names = 0;
+    struct dirent *ent;
+    while ((ent = readdir (dir)) != NULL && num_names < MAX_INPUT_IMAGES)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        names[num_names ++] = strdup (ent->d_name);
+    }
+    closedir (dir);
+
+    qsort (names, num_names, sizeof (char *), compare_name);
+
+    for (int i = 0; i < num_names; i ++)
+    {
+        char fname[1024];
+        snprintf (fname, sizeof (fname), "%s/%s", path, names[i]);
+
+        if (load_image (fname) < 0)
+            fprintf (stderr, "skip %s (not an image)\n", fname);
+        free (names[i]);
+    }
+
+    return (s_num_images > 0) ? 0 : -1;
+}
+
+static input_image_t *
+get_input_image (int frame_idx)
+{
+#if defined (USE_INPUT_VIDEO_DECODE)
+    if (s_use_video)
+    {
+        /* the latest frame decoded (the decoder runs at the video frame rate) */
+        static input_image_t vimg;
+        void *buf = NULL;
+
+        while (get_video_buffer (&buf), buf == NULL)
+            usleep (1000);
+
+        get_video_dimension (&vimg.w, &vimg.h);
+        vimg.rgba = (unsigned char *)buf;
+        return &vimg;
+    }
+#endif
+    return &s_images[frame_idx % s_num_images];
+}
+
+
+/* -------------------------------------------------- *
+ *  report
+ * -------------------------------------------------- */
+static void
+write_json_string (FILE *fp, const char *str)
+{
+    fputc ('"', fp);
+    for (; *str; str ++)
+    {
+        if (*str == '"' || *str == '\\')
+            fputc ('\\', fp);
+        if ((unsigned char)*str >= 0x20)
+            fputc (*str, fp);
+    }
+    fputc ('"', fp);
+}
+
+static void
+write_report (FILE *fp, bench_pipeline_t *pipeline, const char *input_name,
+              bench_t *bench, int num_warmup, double elapsed_ms, long num_objs)
+{
+    int num_frames = bench->num_samples;
+
+    fprintf (fp, "{\n");
+    fprintf (fp, "  \"pipeline\": \"%s\",\n", pipeline->name);
+    fprintf (fp, "  \"input\": ");  write_json_string (fp, input_name);  fprintf (fp, ",\n");
+    fprintf (fp, "  \"num_inputs\": %d,\n", s_use_video ? 1 : s_num_images);
+    fprintf (fp, "  \"frames\": %d,\n", num_frames);
+    fprintf (fp, "  \"warmup\": %d,\n", num_warmup);
+    fprintf (fp, "  \"simd\": \"%s\",\n", pixconv_get_simd_str ());
+    fprintf (fp, "  \"throughput_fps\": %.2f,\n", (elapsed_ms > 0) ? num_frames * 1000.0 / elapsed_ms : 0);
+    fprintf (fp, "  \"objects_per_frame\": %.2f,\n", (num_frames > 0) ? (double)num_objs / num_frames : 0);
+    fprintf (fp, "  \"peak_rss_kb\": %ld,\n", bench_get_peak_rss_kb ());
+    bench_write_stages_json (bench, fp, "  ");
+    fprintf (fp, "\n}\n");
+}
+
+
+/* -------------------------------------------------- *
+ *  main
+ * -------------------------------------------------- */
+static void
+print_usage (const char *argv0)
+{
+    fprintf (stderr, "usage: %s -m pipeline -i (image file | image dir) [options]\n", argv0);
+#if defined (USE_INPUT_VIDEO_DECODE)
+    fprintf (stderr, "       %s -m pipeline -v video_file [options]\n", argv0);
+#endif
+    fprintf (stderr, "  -n num    : number of measured frames (default 100)\n");
+    fprintf (stderr, "  -w num    : number of warm-up frames  (default 10)\n");
+    fprintf (stderr, "  -d dir    : model directory (default ../../<app dir>)\n");
+    fprintf (stderr, "  -o file   : write the JSON report to file (default stdout)\n");
+    fprintf (stderr, "pipelines:");
+    for (int i = 0; i < NUM_PIPELINES; i ++)
+        fprintf (stderr, " %s", s_pipelines[i]->name);
+    fprintf (stderr, "\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+    bench_pipeline_t *pipeline = NULL;
+    const char *input_name = NULL;
+    const char *model_dir  = NULL;
+    const char *out_name   = NULL;
+    int num_frames = 100;
+    int num_warmup = 10;
+    char default_dir[256];
+    int c;
+
+    const char *optstring = "m:i:v:n:w:d:o:";
+    while ((c = getopt (argc, argv, optstring)) != -1)
+    {
+        switch (c)
+        {
+        case 'm':
+            for (int i = 0; i < NUM_PIPELINES; i ++)
+            {
+                if (strcmp (optarg, s_pipelines[i]->name) == 0)
+                    pipeline = s_pipelines[i];
+            }
+            break;
+        case 'i':
+            input_name = optarg;
+            break;
+#if defined (USE_INPUT_VIDEO_DECODE)
+        case 'v':
+            input_name = optarg;
+            s_use_video = 1;
+            break;
+#endif
+        case 'n':
+            num_frames = atoi (optarg);
+            break;
+        case 'w':
+            num_warmup = atoi (optarg);
+            break;
+        case 'd':
+            model_dir = optarg;
+            break;
+        case 'o':
+            out_name = optarg;
+            break;
+        default:
+            print_usage (argv[0]);
+            return -1;
+        }
+    }
+
+    if (pipeline == NULL || input_name == NULL || num_frames <= 0)
+    {
+        print_usage (argv[0]);
+        return -1;
+    }
+
+    /* the inputs and the output are relative to the current directory */
+    FILE *fp_out = stdout;
+    if (out_name && (fp_out = fopen (out_name, "w")) == NULL)
+    {
+        fprintf (stderr, "ERR: %s(%d): can't open %s\n", __FILE__, __LINE__, out_name);
+        return -1;
+    }
+
+#if defined (USE_INPUT_VIDEO_DECODE)
+    if (s_use_video)
+    {
+        if (init_video_decode () != 0 || open_video_file (input_name) != 0)
+        {
+            fprintf (stderr, "ERR: %s(%d): can't open %s\n", __FILE__, __LINE__, input_name);
+            return -1;
+        }
+        start_video_decode ();
+    }
+    else
+#endif
+    if (load_input_images (input_name) < 0)
+    {
+        fprintf (stderr, "ERR: %s(%d): no image in %s\n", __FILE__, __LINE__, input_name);
+        return -1;
+    }
+
+    /* the model paths of the apps are relative to their directories */
+    if (model_dir == NULL)
+    {
+        snprintf (default_dir, sizeof (default_dir), "../../%s", pipeline->app_dir);
+        model_dir = default_dir;
+    }
+    if (chdir (model_dir) != 0)
+    {
+        fprintf (stderr, "ERR: %s(%d): can't chdir to %s\n", __FILE__, __LINE__, model_dir);
+        return -1;
+    }
+
+#if defined (USE_GL_DELEGATE) || defined (USE_GPU_DELEGATEV2)
+    /* the GPU delegates need a current GL context. nothing is rendered. */
+    egl_init_with_pbuffer_surface (2, 0, 0, 0, 16, 16);
+#endif
+
+    pipeline->init ();
+
+    bench_t bench;
+    if (bench_init (&bench, num_frames) < 0)
+        return -1;
+
+    bench_lap_enable (1);
+
+    for (int i = 0; i < num_warmup; i ++)
+    {
+        input_image_t *img = get_input_image (i);
+        pipeline->run (img->rgba, img->w, img->h);
+    }
+
+    long num_objs = 0;
+    double t_start = get_time_ms ();
+    for (int i = 0; i < num_frames; i ++)
+    {
+        input_image_t *img = get_input_image (i);
+
+        bench_lap_reset ();
+        double invoke_ms = tflite_get_invoke_time_ms ();
+        double t0 = get_time_ms ();
+
+        num_objs += pipeline->run (img->rgba, img->w, img->h);
+
+        bench_lap_add (BENCH_LAP_TOTAL,  get_time_ms () - t0);
+        bench_lap_add (BENCH_LAP_INVOKE, tflite_get_invoke_time_ms () - invoke_ms);
+        bench_commit_frame (&bench);
+    }
+    double elapsed_ms = get_time_ms () - t_start;
+
+    write_report (fp_out, pipeline, input_name, &bench, num_warmup, elapsed_ms, num_objs);
+
+    if (fp_out != stdout)
+        fclose (fp_out);
+    bench_destroy (&bench);
+
+    return 0;
+}
@@ -4,6 +4,7 @@
  * ------------------------------------------------ */
 #include "util_trt.h"
 #include "trt_age_gender.h"
+#include "util_nms.h"
 #include <unistd.h>
 
 /* 
@@ -21,6 +22,8 @@ static trt_tensor_t         s_detect_tensor_input;
 static trt_tensor_t         s_detect_tensor_hm;
 static trt_tensor_t         s_detect_tensor_box;
 static trt_tensor_t         s_detect_tensor_landmark;
+
+static nms_boxes_t          s_face_boxes;
 static std::vector<void *>  s_detect_gpu_buffers;
 
 static IExecutionContext   *s_trt_context;
@@ -104,6 +107,10 @@ init_trt_age_gender (face_detect_config_t *config)
         s_detect_gpu_buffers[s_detect_tensor_landmark.bind_idx] = s_detect_tensor_landmark.gpu_mem;
 
         s_detect_trt_context = engine->createExecutionContext();
+
+        /* a candidate box for each cell of the heatmap */
+        int num_cells = s_detect_tensor_hm.dims.d[1] * s_detect_tensor_hm.dims.d[2];
+        nms_init_boxes (&s_face_boxes, num_cells, kFaceKeyNum);
     }
 
     /* ---------------------------------- *
@@ -185,142 +192,50 @@ _exp (float v)
 
 
 static int
-decode_bounds (std::list<face_t> &face_list, float score_thresh)
+decode_bounds (nms_boxes_t *boxes, float score_thresh)
 {
-    face_t face_item;
-    float  *scores_ptr = (float *)s_detect_tensor_hm.cpu_mem;
+    float *scores_ptr = (float *)s_detect_tensor_hm.cpu_mem;
     int score_w = s_detect_tensor_hm.dims.d[2];
     int score_h = s_detect_tensor_hm.dims.d[1];
 
-    for (int y = 0; y < score_h; y ++)
-    {
-        for (int x = 0; x < score_w; x ++)
-        {
-            int idx = y * score_w + x;
-            float score = scores_ptr[idx];
-
-            if (score < score_thresh)
-                continue;
-
-            float *p = get_bbox_ptr (idx);
-            float bx = p[0];
-            float by = p[1];
-            float bw = p[2];
-            float bh = p[3];
-
-            fvec2 topleft, btmright;
-            topleft.x  = (x - bx) / (float)score_w;
-            topleft.y  = (y - by) / (float)score_h;
-            btmright.x = (x + bw) / (float)score_w;
-            btmright.y = (y + bh) / (float)score_h;
-
-            face_item.score    = score;
-            face_item.topleft  = topleft;
-            face_item.btmright = btmright;
-
-            /* landmark positions (5 keys) */
-            float *lm = get_landmark_ptr (idx);
-            for (int j = 0; j < kFaceKeyNum; j ++)
-            {
-                float lx = lm[j    ] * 4;
-                float ly = lm[j + 5] * 4;
-                lx = (_exp (lx) + x) / (float)score_w;
-                ly = (_exp (ly) + y) / (float)score_h;
-
-                face_item.keys[j].x = lx;
-                face_item.keys[j].y = ly;
-            }
-
-            face_list.push_back (face_item);
-        }
-    }
-    return 0;
-}
-
-
-/* -------------------------------------------------- *
- *  Apply NonMaxSuppression:
- *      https://github.com/tensorflow/tfjs/blob/master/tfjs-core/src/ops/image_ops.ts
- * -------------------------------------------------- */
-static float
-calc_intersection_over_union (face_t &face0, face_t &face1)
-{
-    float sx0 = face0.topleft.x;
-    float sy0 = face0.topleft.y;
-    float ex0 = face0.btmright.x;
-    float ey0 = face0.btmright.y;
-    float sx1 = face1.topleft.x;
-    float sy1 = face1.topleft.y;
-    float ex1 = face1.btmright.x;
-    float ey1 = face1.btmright.y;
-    
-    float xmin0 = std::min (sx0, ex0);
-    float ymin0 = std::min (sy0, ey0);
-    float xmax0 = std::max (sx0, ex0);
-    float ymax0 = std::max (sy0, ey0);
-    float xmin1 = std::min (sx1, ex1);
-    float ymin1 = std::min (sy1, ey1);
-    float xmax1 = std::max (sx1, ex1);
-    float ymax1 = std::max (sy1, ey1);
-    
-    float area0 = (ymax0 - ymin0) * (xmax0 - xmin0);
-    float area1 = (ymax1 - ymin1) * (xmax1 - xmin1);
-    if (area0 <= 0 || area1 <= 0)
-        return 0.0f;
-
-    float intersect_xmin = std::max (xmin0, xmin1);
-    float intersect_ymin = std::max (ymin0, ymin1);
-    float intersect_xmax = std::min (xmax0, xmax1);
-    float intersect_ymax = std::min (ymax0, ymax1);
-
-    float intersect_area = std::max (intersect_ymax - intersect_ymin, 0.0f) *
-                           std::max (intersect_xmax - intersect_xmin, 0.0f);
-    
-    return intersect_area / (area0 + area1 - intersect_area);
-}
-
-static bool
-compare (face_t &v1, face_t &v2)
-{
-    if (v1.score > v2.score)
-        return true;
-    else
-        return false;
-}
-
-static int
-non_max_suppression (std::list<face_t> &face_list, std::list<face_t> &face_sel_list, float iou_thresh)
-{
-    face_list.sort (compare);
+    int num = nms_filter_scores (scores_ptr, score_w * score_h, score_thresh,
+                                 boxes->index, boxes->max_num);
 
-    for (auto itr = face_list.begin(); itr != face_list.end(); itr ++)
+    for (int i = 0; i < num; i ++)
     {
-        face_t face_candidate = *itr;
-
-        int ignore_candidate = false;
-        for (auto itr_sel = face_sel_list.rbegin(); itr_sel != face_sel_list.rend(); itr_sel ++)
+        int idx = boxes->index[i];
+        int x   = idx % score_w;
+        int y   = idx / score_w;
+
+        float *p = get_bbox_ptr (idx);
+        float bx = p[0];
+        float by = p[1];
+        float bw = p[2];
+        float bh = p[3];
+
+        boxes->score[i] = scores_ptr[idx];
+        boxes->x0[i]    = (x - bx) / (float)score_w;
+        boxes->y0[i]    = (y - by) / (float)score_h;
+        boxes->x1[i]    = (x + bw) / (float)score_w;
+        boxes->y1[i]    = (y + bh) / (float)score_h;
+
+        /* landmark positions (5 keys) */
+        float *lm   = get_landmark_ptr (idx);
+        float *keys = nms_get_keys (boxes, i);
+        for (int j = 0; j < kFaceKeyNum; j ++)
         {
-            face_t face_sel = *itr_sel;
-
-            float iou = calc_intersection_over_union (face_candidate, face_sel);
-            if (iou >= iou_thresh)
-            {
-                ignore_candidate = true;
-                break;
-            }
-        }
-
-        if (!ignore_candidate)
-        {
-            face_sel_list.push_back(face_candidate);
-            if (face_sel_list.size() >= MAX_FACE_NUM)
-                break;
+            float lx = lm[j    ] * 4;
+            float ly = lm[j + 5] * 4;
+            keys[2 * j + 0] = (_exp (lx) + x) / (float)score_w;
+            keys[2 * j + 1] = (_exp (ly) + y) / (float)score_h;
         }
     }
 
+    boxes->num = num;
     return 0;
 }
 
+
 /* -------------------------------------------------- *
  *  Compute ROI region
  * -------------------------------------------------- */
@@ -411,23 +326,32 @@ compute_face_rect (face_t &face)
 
 
 static void
-pack_face_result (face_detect_result_t *facedet_result, std::list<face_t> &face_list)
+pack_face_result (face_detect_result_t *facedet_result, nms_boxes_t *boxes, int *sel, int num_sel)
 {
     int num_faces = 0;
-    for (auto itr = face_list.begin(); itr != face_list.end(); itr ++)
+    for (int i = 0; i < num_sel && num_faces < MAX_FACE_NUM; i ++)
     {
-        face_t face = *itr;
+        face_t *face = &facedet_result->faces[num_faces];
+        int    idx   = sel[i];
+        float  *keys = nms_get_keys (boxes, idx);
 
-        compute_rotation (face);
-        compute_face_rect (face);
+        face->score      = boxes->score[idx];
+        face->topleft.x  = boxes->x0[idx];
+        face->topleft.y  = boxes->y0[idx];
+        face->btmright.x = boxes->x1[idx];
+        face->btmright.y = boxes->y1[idx];
 
-        memcpy (&facedet_result->faces[num_faces], &face, sizeof (face));
-        num_faces ++;
-        facedet_result->num = num_faces;
+        for (int j = 0; j < kFaceKeyNum; j ++)
+        {
+            face->keys[j].x = keys[2 * j + 0];
+            face->keys[j].y = keys[2 * j + 1];
+        }
 
-        if (num_faces >= MAX_FACE_NUM)
-            break;
+        compute_rotation (*face);
+        compute_face_rect (*face);
+        num_faces ++;
     }
+    facedet_result->num = num_faces;
 }
 
 
@@ -452,19 +376,15 @@ invoke_face_detect (face_detect_result_t *facedet_result, face_detect_config_t *
 
     /* decode boundary box and landmark keypoints */
     float score_thresh = config->score_thresh;
-    std::list<face_t> face_list;
 
-    decode_bounds (face_list, score_thresh);
+    decode_bounds (&s_face_boxes, score_thresh);
 
-#if 1 /* USE NMS */
     float iou_thresh = config->iou_thresh;
-    std::list<face_t> face_nms_list;
+    int   sel[MAX_FACE_NUM];
+    int   num_sel;
 
-    non_max_suppression (face_list, face_nms_list, iou_thresh);
-    pack_face_result (facedet_result, face_nms_list);
-#else
-    pack_face_result (facedet_result, face_list);
-#endif
+    num_sel = nms_hard (&s_face_boxes, iou_thresh, sel, MAX_FACE_NUM);
+    pack_face_result (facedet_result, &s_face_boxes, sel, num_sel);
 
     return 0;
 }
@@ -12,6 +12,7 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
 #include "trt_detection.h"
 #include "util_camera_capture.h"
 #include "util_video_decode.h"
@@ -24,7 +25,7 @@
 void
 feed_detect_image (texture_2d_t *srctex, int win_w, int win_h)
 {
-    int x, y, w, h;
+    int w, h;
     float *buf_fp32 = (float *)get_detect_input_buf (&w, &h);
     unsigned char *buf_ui8 = NULL;
     static unsigned char *pui8 = NULL;
@@ -42,28 +43,10 @@ feed_detect_image (texture_2d_t *srctex, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [-1, 1] */
     float mean = 128.0f;
     float std  = 128.0f;
-    for (y = 0; y < h; y ++)
-    {
-        for (x = 0; x < w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-#if 1
-			/* CHW */
-            int plane_size = w * h;
-            buf_fp32[(w * y + x) + plane_size * 0] = (float)(r - mean) / std;
-            buf_fp32[(w * y + x) + plane_size * 1] = (float)(g - mean) / std;
-            buf_fp32[(w * y + x) + plane_size * 2] = (float)(b - mean) / std;
-#else
-			/* HWC */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-#endif
-        }
-    }
+    pixconv_param_t prm;
+    pixconv_init_param (&prm, PIXCONV_SRC_RGBA8, PIXCONV_DST_FP32, mean, std);
+    prm.dst_layout = PIXCONV_LAYOUT_NCHW;
+    convert_pixels (&prm, buf_ui8, w, h, buf_fp32);
 
     return;
 }
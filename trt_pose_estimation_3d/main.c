@@ -13,6 +13,7 @@
 #include "util_pmeter.h"
 #include "util_texture.h"
 #include "util_render2d.h"
+#include "util_pixconv.h"
 #include "util_matrix.h"
 #include "trt_pose3d.h"
 #include "util_camera_capture.h"
@@ -86,19 +87,7 @@ feed_pose3d_image(texture_2d_t *srctex, int win_w, int win_h)
     /* convert UI8 [0, 255] ==> FP32 [0, 1] */
     float mean =   0.0f;
     float std  = 255.0f;
-    for (int y = 0; y < dst_h; y ++)
-    {
-        for (int x = 0; x < dst_w; x ++)
-        {
-            int r = *buf_ui8 ++;
-            int g = *buf_ui8 ++;
-            int b = *buf_ui8 ++;
-            buf_ui8 ++;          /* skip alpha */
-            *buf_fp32 ++ = (float)(r - mean) / std;
-            *buf_fp32 ++ = (float)(g - mean) / std;
-            *buf_fp32 ++ = (float)(b - mean) / std;
-        }
-    }
+    pixconv_rgba8_to_fp32 (buf_ui8, dst_w * dst_h, buf_fp32, mean, std);
 
     s_srctex_region.width  = dst_w;     /* full rect width  with margin */
     s_srctex_region.height = dst_h;     /* full rect height with margin */
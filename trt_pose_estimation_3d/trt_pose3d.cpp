@@ -4,6 +4,7 @@
  * ------------------------------------------------ */
 #include "util_trt.h"
 #include "trt_pose3d.h"
+#include "util_heatmap.h"
 #include <unistd.h>
 #include <float.h>
 
@@ -24,6 +25,8 @@ static int     s_img_h = 0;
 static int     s_hmp_w = 0;
 static int     s_hmp_h = 0;
 
+static heatmap_filter_t s_hmp_filter;
+
 /* -------------------------------------------------- *
  *  create cuda engine
  * -------------------------------------------------- */
@@ -102,6 +105,10 @@ init_trt_pose3d (pose3d_config_t *config)
     s_hmp_h = s_tensor_heatmap.dims.d[1];
     fprintf (stderr, "heatmap size: (%d, %d)\n", s_hmp_w, s_hmp_h);
 
+    /* only the argmax of each key: no max filter window */
+    if (heatmap_init_filter (&s_hmp_filter, s_hmp_w, s_hmp_h, 0) < 0)
+        return -1;
+
     return 0;
 }
 
@@ -117,14 +124,6 @@ get_pose3d_input_buf (int *w, int *h)
 /* -------------------------------------------------- *
  * Invoke TensorRT
  * -------------------------------------------------- */
-static float
-get_heatmap_score (int idx_y, int idx_x, int key_id)
-{
-    int idx = (idx_y * s_hmp_w * kPoseKeyNum) + (idx_x * kPoseKeyNum) + key_id;
-    float *heatmap_ptr = (float *)s_tensor_heatmap.cpu_mem;
-    return heatmap_ptr[idx];
-}
-
 static void
 get_offset_vector (float *ofst_x, float *ofst_y, float *ofst_z, int idx_y, int idx_x, int pose_id_)
 {
@@ -174,38 +173,37 @@ static void
 decode_single_pose (posenet_result_t *pose_result)
 {
     int   max_block_idx[kPoseKeyNum][2] = {0};
+    float max_block_pos[kPoseKeyNum][2] = {0};
     float max_block_cnf[kPoseKeyNum]    = {0};
+    float *heatmap_ptr = (float *)s_tensor_heatmap.cpu_mem;
 
     /* find the highest heatmap block for each key */
     for (int i = 0; i < kPoseKeyNum; i ++)
     {
-        float max_confidence = -FLT_MAX;
-        for (int y = 0; y < s_hmp_h; y ++)
-        {
-            for (int x = 0; x < s_hmp_w; x ++)
-            {
-                float confidence = get_heatmap_score (y, x, i);
-                if (confidence > max_confidence)
-                {
-                    max_confidence = confidence;
-                    max_block_cnf[i] = confidence;
-                    max_block_idx[i][0] = x;
-                    max_block_idx[i][1] = y;
-                }
-            }
-        }
+        heatmap_peak_t peak;
+        heatmap_load_channel (&s_hmp_filter, heatmap_ptr, kPoseKeyNum, i);
+        heatmap_find_max (&s_hmp_filter, &peak);
+
+        max_block_cnf[i]    = peak.score;
+        max_block_idx[i][0] = peak.x;
+        max_block_idx[i][1] = peak.y;
+
+        /* sub-pixel position of the peak for the 2D keypoint */
+        heatmap_refine_peak (&s_hmp_filter, &peak, &max_block_pos[i][0], &max_block_pos[i][1]);
     }
 
 #if 0
     for (int i = 0; i < kPoseKeyNum; i ++)
     {
+        heatmap_load_channel (&s_hmp_filter, heatmap_ptr, kPoseKeyNum, i);
+
         fprintf (stderr, "---------[%d] --------\n", i);
         for (int y = 0; y < s_hmp_h; y ++)
         {
             fprintf (stderr, "[%d] ", y);
             for (int x = 0; x < s_hmp_w; x ++)
             {
-                float confidence = get_heatmap_score (y, x, i);
+                float confidence = s_hmp_filter.plane[y * s_hmp_w + x];
                 fprintf (stderr, "%6.3f ", confidence);
 
                 if (x == max_block_idx[i][0] && y == max_block_idx[i][1])
@@ -227,6 +225,10 @@ decode_single_pose (posenet_result_t *pose_result)
         fvec3 pos3d;
         get_index_to_pos (idx_x, idx_y, i, &pos2d, &pos3d);
 
+        /* 2D: the sub-pixel peak, 3D: the offsets of the peak block */
+        pos2d.x = max_block_pos[i][0] / (float)(s_hmp_w - 1);
+        pos2d.y = max_block_pos[i][1] / (float)(s_hmp_h - 1);
+
         pose_result->pose[0].key[i].x     = pos2d.x;
         pose_result->pose[0].key[i].y     = pos2d.y;
         pose_result->pose[0].key[i].score = max_block_cnf[i];
@@ -4,8 +4,10 @@
  * ------------------------------------------------ */
 #include "util_trt.h"
 #include "trt_posenet.h"
+#include "util_heatmap.h"
 #include <unistd.h>
 #include <float.h>
+#include <algorithm>
 
 #define UFF_MODEL_PATH      "./models/posenet_mobilenet_v1_100_257x257_multi_kpt_stripped.uff"
 #define PLAN_MODEL_PATH     "./models/posenet_mobilenet_v1_100_257x257_multi_kpt_stripped.plan"
@@ -24,6 +26,11 @@ static int     s_hmp_w = 0;
 static int     s_hmp_h = 0;
 static int     s_edge_num = 0;
 
+/* the part candidates are the local max in (2 * LOCAL_MAX_RAD + 1)^2 window */
+#define LOCAL_MAX_RAD   1
+static heatmap_filter_t s_hmp_filter;
+static heatmap_peak_t   *s_hmp_peaks;
+
 typedef struct part_score_t {
     float score;
     int   idx_x;
@@ -31,6 +38,11 @@ typedef struct part_score_t {
     int   key_id;
 } part_score_t;
 
+/* heap of the root candidates */
+static part_score_t     *s_parts;
+static int              s_num_parts;
+static int              s_max_poses = MAX_POSE_NUM;
+
 typedef struct keypoint_t {
     float pos_x;
     float pos_y;
@@ -158,6 +170,16 @@ init_trt_posenet ()
     s_hmp_h = s_tensor_heatmap.dims.d[0];
     fprintf (stderr, "heatmap size: (%d, %d)\n", s_hmp_w, s_hmp_h);
 
+    if (heatmap_init_filter (&s_hmp_filter, s_hmp_w, s_hmp_h, LOCAL_MAX_RAD) < 0)
+        return -1;
+    s_hmp_peaks = (heatmap_peak_t *)malloc (s_hmp_w * s_hmp_h * sizeof (heatmap_peak_t));
+    s_parts     = (part_score_t   *)malloc (s_hmp_w * s_hmp_h * kPoseKeyNum * sizeof (part_score_t));
+    if (s_hmp_peaks == NULL || s_parts == NULL)
+    {
+        fprintf (stderr, "ERR: %s(%d)\n", __FILE__, __LINE__);
+        return -1;
+    }
+
     /* displacement forward vector dimention */
     s_edge_num = s_tensor_fw_disp.dims.d[2] / 2;
 
@@ -172,6 +194,13 @@ get_posenet_input_buf (int *w, int *h)
     return s_tensor_input.cpu_mem;
 }
 
+/* the number of the persons to decode, 1 - MAX_POSE_NUM */
+void
+set_posenet_max_poses (int max_poses)
+{
+    s_max_poses = std::min (std::max (max_poses, 1), MAX_POSE_NUM);
+}
+
 static float
 get_heatmap_score (int idx_y, int idx_x, int key_id)
 {
@@ -202,80 +231,64 @@ get_offset_vector (float *ofst_x, float *ofst_y, int idx_y, int idx_x, int pose_
     *ofst_y = offsets_ptr[idx1];
 }
 
-/* enqueue an item in descending order. */
-static void
-enqueue_score (std::list<part_score_t> &queue, int x, int y, int key, float score)
-{
-    std::list<part_score_t>::iterator itr;
-    for (itr = queue.begin(); itr != queue.end(); itr++)
-    {
-        if (itr->score < score)
-            break;
-    }
-
-    part_score_t item;
-    item.score = score;
-    item.idx_x = x;
-    item.idx_y = y;
-    item.key_id= key;
-    queue.insert(itr, item);
-}
+/* -------------------------------------------------- *
+ *  root candidates
+ *
+ *   all the candidates go into a binary heap at once (O(N)), and only the
+ *   roots actually visited are popped (O(log N) each).
+ * -------------------------------------------------- */
 
 /*
- * If the score is the highest in local window, return true.
- *
- *    xs    xe
- *   +--+--+--+
- *   |  |  |  | ys
- *   +--+--+--+
- *   |  |##|  |         ##: (idx_x, idx_y)
- *   +--+--+--+
- *   |  |  |  | ye
- *   +--+--+--+
+ *  (a) comes later than (b): the lower score first, and the equal scores
+ *  in the raster order of (y, x, key).
  */
 static bool
-score_is_max_in_local_window (int key, float score, int idx_y, int idx_x, int max_rad)
+part_comes_later (const part_score_t &a, const part_score_t &b)
 {
-    int xs = std::max (idx_x - max_rad,     0);
-    int ys = std::max (idx_y - max_rad,     0);
-    int xe = std::min (idx_x + max_rad + 1, s_hmp_w);
-    int ye = std::min (idx_y + max_rad + 1, s_hmp_h);
+    if (a.score != b.score) return a.score < b.score;
+    if (a.idx_y != b.idx_y) return a.idx_y > b.idx_y;
+    if (a.idx_x != b.idx_x) return a.idx_x > b.idx_x;
+    return a.key_id > b.key_id;
+}
+
+static void
+build_root_queue (float thresh)
+{
+    float *heatmap_ptr = (float *)s_tensor_heatmap.cpu_mem;
+    int num_parts = 0;
 
-    for (int y = ys; y < ye; y ++)
+    for (int key = 0; key < kPoseKeyNum; key ++)
     {
-        for (int x = xs; x < xe; x ++)
+        heatmap_load_channel (&s_hmp_filter, heatmap_ptr, kPoseKeyNum, key);
+        heatmap_max_filter (&s_hmp_filter);
+
+        /* the scores above the thresh, and no higher score near the pixel */
+        int num_peaks = heatmap_find_peaks (&s_hmp_filter, thresh, s_hmp_peaks, s_hmp_w * s_hmp_h);
+        for (int i = 0; i < num_peaks; i ++)
         {
-            /* if a higher score is found, return false */
-            if (get_heatmap_score (y, x, key) > score)
-                return false;
+            part_score_t *item = &s_parts[num_parts ++];
+            item->score = s_hmp_peaks[i].score;
+            item->idx_x = s_hmp_peaks[i].x;
+            item->idx_y = s_hmp_peaks[i].y;
+            item->key_id= key;
         }
     }
-    return true;
+
+    std::make_heap (s_parts, s_parts + num_parts, part_comes_later);
+    s_num_parts = num_parts;
 }
 
-static void
-build_score_queue (std::list<part_score_t> &queue, float thresh, int max_rad)
+static int
+pop_root (part_score_t *root)
 {
-    for (int y = 0; y < s_hmp_h; y ++)
-    {
-        for (int x = 0; x < s_hmp_w; x ++)
-        {
-            for (int key = 0; key < kPoseKeyNum; key ++)
-            {
-                float score = get_heatmap_score (y, x, key);
-
-                /* if this score is lower than thresh, skip this pixel. */
-                if (score < thresh)
-                    continue;
+    if (s_num_parts <= 0)
+        return 0;
 
-                /* if there is a higher score near this pixel, skip this pixel. */
-                if (!score_is_max_in_local_window (key, score, y, x, max_rad))
-                    continue;
+    *root = s_parts[0];
+    std::pop_heap (s_parts, s_parts + s_num_parts, part_comes_later);
+    s_num_parts --;
 
-                enqueue_score (queue, x, y, key, score);
-            }
-        }
-    }
+    return 1;
 }
 
 /*
@@ -461,34 +474,26 @@ regist_detected_pose (posenet_result_t *pose_result, keypoint_t *keys, float sco
 static void
 decode_multiple_poses (posenet_result_t *pose_result)
 {
-    std::list<part_score_t> queue;
-
     float score_thresh  = 0.5f;
-    int   local_max_rad = 1;
-    build_score_queue (queue, score_thresh, local_max_rad);
+    build_root_queue (score_thresh);
 
     memset (pose_result, 0, sizeof (posenet_result_t));
-    while (pose_result->num < MAX_POSE_NUM && !queue.empty())
-    {
-        part_score_t &root = queue.front();
 
+    part_score_t root;
+    while (pose_result->num < s_max_poses && pop_root (&root))
+    {
         float pos_x, pos_y;
         get_index_to_pos (root.idx_x, root.idx_y, root.key_id, &pos_x, &pos_y);
 
         float nms_rad = 20.0f;
         if (within_nms_of_corresponding_point (pose_result, pos_x, pos_y, root.key_id, nms_rad))
-        {
-            queue.pop_front();
             continue;
-        }
 
         keypoint_t key_points[kPoseKeyNum] = {0};
         decode_pose (root, key_points);
 
         float score = get_instance_score (pose_result, key_points, nms_rad);
         regist_detected_pose (pose_result, key_points, score);
-
-        queue.pop_front();
     }
 }
 
@@ -499,23 +504,16 @@ decode_single_pose (posenet_result_t *pose_result)
     float max_block_cnf[kPoseKeyNum]    = {0};
 
     /* find the highest heatmap block for each key */
+    float *heatmap_ptr = (float *)s_tensor_heatmap.cpu_mem;
     for (int i = 0; i < kPoseKeyNum; i ++)
     {
-        float max_confidence = -FLT_MAX;
-        for (int y = 0; y < s_hmp_h; y ++)
-        {
-            for (int x = 0; x < s_hmp_w; x ++)
-            {
-                float confidence = get_heatmap_score (y, x, i);
-                if (confidence > max_confidence)
-                {
-                    max_confidence = confidence;
-                    max_block_cnf[i] = confidence;
-                    max_block_idx[i][0] = x;
-                    max_block_idx[i][1] = y;
-                }
-            }
-        }
+        heatmap_peak_t peak;
+        heatmap_load_channel (&s_hmp_filter, heatmap_ptr, kPoseKeyNum, i);
+        heatmap_find_max (&s_hmp_filter, &peak);
+
+        max_block_cnf[i]    = peak.score;
+        max_block_idx[i][0] = peak.x;
+        max_block_idx[i][1] = peak.y;
     }
 
 #if 0
@@ -60,6 +60,7 @@ int init_trt_posenet ();
 void  *get_posenet_input_buf (int *w, int *h);
 
 int invoke_posenet (posenet_result_t *pose_result);
+void set_posenet_max_poses (int max_poses);
     
 #ifdef __cplusplus
 }